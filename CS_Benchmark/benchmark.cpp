@@ -0,0 +1,587 @@
+// ChecksumBenchmark: micro-benchmarks of the hot paths and end-to-end create /
+// validate runs over a deterministic synthetic tree. Results go out as JSON so
+// runs of different versions on the same machine can be compared.
+#include "binary_manifest.h"
+#include "checksum.h"
+#include "crc.h"
+#include "exclude_matcher.h"
+#include "hash.h"
+#include "manifest.h"
+#include "manifest_diff.h"
+#include "manifest_parser.h"
+#include "merkle.h"
+#include "tree_generator.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int benchmarkSchemaVersion = 1;
+
+// Buffer hashed by the hash micro-benchmarks
+constexpr size_t hashBufferSize = 64 << 20;
+
+struct BenchmarkOptions {
+    std::string scale = "small";
+    std::filesystem::path workDirectory = std::filesystem::temp_directory_path() / "checksum_benchmark";
+    std::filesystem::path outputPath;       // Empty: JSON on stdout
+    std::string filter;
+    int repetitions = 5;
+    unsigned int threadCount = 0;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    std::vector<double> seconds;
+    uint64_t bytes = 0;         // Processed per repetition; 0 when throughput does not apply
+    uint64_t items = 0;         // Files, entries or paths per repetition
+    std::string error;
+};
+
+// Swallows the library's console output while a benchmark runs
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+class QuietOutput {
+public:
+    QuietOutput() : saved(std::cout.rdbuf(&sink)) {}
+    ~QuietOutput() { std::cout.rdbuf(saved); }
+
+private:
+    NullBuffer sink;
+    std::streambuf* saved;
+};
+
+bool isSelected(const BenchmarkOptions& options, std::string_view name) {
+    return options.filter.empty() || name.find(options.filter) != std::string_view::npos;
+}
+
+// Benchmarks that need the synthetic tree
+const char* const treeBenchmarks[] = { "create/full/crc32", "create/full/xxh3-64", "create/full/blake3",
+    "create/incremental", "validate/tree-identical" };
+
+class BenchmarkRunner {
+public:
+    explicit BenchmarkRunner(const BenchmarkOptions& options) : options(options) {}
+
+    // body returns false (with error set) on failure. One untimed warm-up run
+    // precedes the timed ones, so file benchmarks measure a warm page cache.
+    void run(const std::string& name, uint64_t bytes, uint64_t items, const std::function<bool(std::string& error)>& body) {
+        if (!isSelected(options, name)) {
+            return;
+        }
+        std::cerr << "Running " << name << "..." << std::endl;
+
+        BenchmarkResult result;
+        result.name = name;
+        result.bytes = bytes;
+        result.items = items;
+        for (int i = 0; i <= options.repetitions && result.error.empty(); i++) {
+            auto start = std::chrono::steady_clock::now();
+            bool succeeded = false;
+            {
+                QuietOutput quiet;
+                succeeded = body(result.error);
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (!succeeded && result.error.empty()) {
+                result.error = "failed";
+            }
+            if (i > 0) {
+                result.seconds.push_back(elapsed.count());
+            }
+        }
+        if (!result.error.empty()) {
+            std::cerr << "  failed: " << result.error << std::endl;
+        }
+        results.push_back(std::move(result));
+    }
+
+    const std::vector<BenchmarkResult>& all() const { return results; }
+
+private:
+    const BenchmarkOptions& options;
+    std::vector<BenchmarkResult> results;
+};
+
+std::string jsonString(std::string_view text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            std::ostringstream escape;
+            escape << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+            quoted += escape.str();
+        }
+        else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+const char* platformName() {
+#if defined(_WIN32)
+    return "windows";
+#elif defined(__linux__)
+    return "linux";
+#elif defined(__APPLE__)
+    return "macos";
+#else
+    return "unknown";
+#endif
+}
+
+std::string compilerName() {
+    std::ostringstream name;
+#if defined(_MSC_VER)
+    name << "msvc " << _MSC_FULL_VER;
+#elif defined(__clang__)
+    name << "clang " << __clang_major__ << "." << __clang_minor__ << "." << __clang_patchlevel__;
+#elif defined(__GNUC__)
+    name << "gcc " << __GNUC__ << "." << __GNUC_MINOR__ << "." << __GNUC_PATCHLEVEL__;
+#else
+    name << "unknown";
+#endif
+    return name.str();
+}
+
+std::string utcTimestamp() {
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    return text;
+}
+
+void writeJson(std::ostream& out, const BenchmarkOptions& options, const TreeProfile& profile, const TreeStats& treeStats,
+    const std::vector<BenchmarkResult>& results) {
+    out << std::setprecision(9);
+    out << "{\n";
+    out << "  \"schema\": " << benchmarkSchemaVersion << ",\n";
+    out << "  \"timestamp\": " << jsonString(utcTimestamp()) << ",\n";
+    out << "  \"scale\": " << jsonString(options.scale) << ",\n";
+    out << "  \"repetitions\": " << options.repetitions << ",\n";
+    out << "  \"system\": {\n";
+    out << "    \"platform\": " << jsonString(platformName()) << ",\n";
+    out << "    \"compiler\": " << jsonString(compilerName()) << ",\n";
+    out << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "    \"hashing_threads\": " << options.threadCount << ",\n";
+    out << "    \"crc32_kernel\": " << jsonString(getCrc32KernelName()) << ",\n";
+    out << "    \"crc32c_kernel\": " << jsonString(getCrc32cKernelName()) << "\n";
+    out << "  },\n";
+    out << "  \"tree\": {\n";
+    out << "    \"profile\": " << jsonString(describeTreeProfile(profile)) << ",\n";
+    out << "    \"files\": " << treeStats.fileCount << ",\n";
+    out << "    \"directories\": " << treeStats.directoryCount << ",\n";
+    out << "    \"bytes\": " << treeStats.byteCount << "\n";
+    out << "  },\n";
+    out << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n";
+        out << "      \"name\": " << jsonString(result.name) << ",\n";
+        if (!result.error.empty() || result.seconds.empty()) {
+            out << "      \"error\": " << jsonString(result.error.empty() ? "not run" : result.error) << "\n";
+            out << "    }";
+            continue;
+        }
+
+        std::vector<double> sorted = result.seconds;
+        std::sort(sorted.begin(), sorted.end());
+        double median = sorted.size() % 2 == 1 ? sorted[sorted.size() / 2] :
+            (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2.0;
+        double mean = 0.0;
+        for (double seconds : sorted) {
+            mean += seconds / static_cast<double>(sorted.size());
+        }
+
+        out << "      \"seconds_min\": " << sorted.front() << ",\n";
+        out << "      \"seconds_median\": " << median << ",\n";
+        out << "      \"seconds_mean\": " << mean << ",\n";
+        out << "      \"seconds_max\": " << sorted.back() << ",\n";
+        out << "      \"bytes\": " << result.bytes << ",\n";
+        out << "      \"items\": " << result.items;
+        // Rates use the median run
+        if (result.bytes > 0 && median > 0.0) {
+            out << ",\n      \"megabytes_per_second\": " << static_cast<double>(result.bytes) / median / 1e6;
+        }
+        if (result.items > 0 && median > 0.0) {
+            out << ",\n      \"items_per_second\": " << static_cast<double>(result.items) / median;
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Entry count of the synthetic manifests per scale
+size_t manifestEntryCount(const std::string& scale) {
+    if (scale == "large") {
+        return 4000000;
+    }
+    return scale == "medium" ? 1000000 : 200000;
+}
+
+// Write a sorted, relative v4 manifest with directory digests: 1000 files per
+// module in 10 subdirectories. With changed set, the digests of every file in
+// one module out of 100 differ, so changes are clustered as in real trees.
+bool writeSyntheticManifest(const std::filesystem::path& manifestPath, size_t entryCount, bool changed,
+    std::vector<std::string>* paths, std::string& error) {
+    std::ofstream file(manifestPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        error = "unable to create " + manifestPath.string();
+        return false;
+    }
+
+    ManifestHeader header;
+    header.version = plainManifestVersion;
+    header.algorithm = HashAlgorithm::Xxh3_64;
+    header.hasStat = true;
+    header.sorted = true;
+    header.hasTree = true;
+    header.relative = true;
+    std::string text = formatManifestHeader(header) + "\n";
+
+    DirectoryDigestBuilder directories("", [&](std::string_view directory, const HashValue& digest) {
+        text += formatManifestDirectory(directory, digest);
+        text += '\n';
+    });
+
+    ContentGenerator random(7);
+    char path[64];
+    for (size_t i = 0; i < entryCount; i++) {
+        size_t module = i / 1000;
+        std::snprintf(path, sizeof(path), "mod%05zu/sub%02zu/file%07zu.dat", module, (i / 100) % 10, i);
+        HashValue hash = hashFromUint(random.next(), 8);
+        if (changed && module % 100 == 7) {
+            hash.bytes[0] ^= 0xFF;
+        }
+
+        FileStat stat;
+        stat.valid = true;
+        stat.size = random.next() % 65536;
+        stat.mtimeNs = 1700000000000000000ll + static_cast<int64_t>(i);
+        stat.inode = 1000 + i;
+        directories.addFile(path, hash);
+        appendManifestEntry(text, path, hash, stat);
+        if (paths != nullptr) {
+            paths->emplace_back(path);
+        }
+
+        if (text.size() >= (1 << 20)) {
+            file.write(text.data(), static_cast<std::streamsize>(text.size()));
+            text.clear();
+        }
+    }
+    directories.finish();
+    file.write(text.data(), static_cast<std::streamsize>(text.size()));
+    if (!file) {
+        error = "unable to write " + manifestPath.string();
+        return false;
+    }
+    return true;
+}
+
+void runHashBenchmarks(BenchmarkRunner& runner) {
+    std::vector<uint8_t> buffer(hashBufferSize);
+    ContentGenerator(3).fill(buffer.data(), buffer.size());
+
+    // The portable slicing-by-16 CRC shows what the selected kernel gains
+    runner.run("hash/crc32-portable", buffer.size(), 0, [&](std::string&) {
+        volatile uint32_t crc = Crc32::compute(buffer.data(), buffer.size());
+        (void)crc;
+        return true;
+    });
+
+    const HashAlgorithm algorithms[] = { HashAlgorithm::Crc32, HashAlgorithm::Crc32c, HashAlgorithm::Crc64,
+        HashAlgorithm::Xxh3_64, HashAlgorithm::Xxh3_128, HashAlgorithm::Blake3 };
+    for (HashAlgorithm algorithm : algorithms) {
+        runner.run(std::string("hash/") + hashAlgorithmName(algorithm), buffer.size(), 0, [&](std::string&) {
+            std::unique_ptr<Hasher> hasher = createHasher(algorithm);
+            hasher->update(buffer.data(), buffer.size());
+            volatile uint8_t first = hasher->finalize().bytes[0];
+            (void)first;
+            return true;
+        });
+    }
+}
+
+bool runManifestBenchmarks(BenchmarkRunner& runner, const BenchmarkOptions& options, std::string& error) {
+    size_t entryCount = manifestEntryCount(options.scale);
+    std::filesystem::path basePath = options.workDirectory / "base.txt";
+    std::filesystem::path changedPath = options.workDirectory / "changed.txt";
+    std::filesystem::path binaryPath = options.workDirectory / "base.bin";
+    std::vector<std::string> paths;
+    paths.reserve(entryCount);
+
+    std::cerr << "Writing synthetic manifests (" << entryCount << " entries)..." << std::endl;
+    if (!writeSyntheticManifest(basePath, entryCount, false, &paths, error) ||
+        !writeSyntheticManifest(changedPath, entryCount, true, nullptr, error) ||
+        !convertManifest(basePath, binaryPath, error)) {
+        return false;
+    }
+    uint64_t manifestBytes = std::filesystem::file_size(basePath);
+
+    // Parsing
+    runner.run("manifest/parse-text", manifestBytes, entryCount, [&](std::string& runError) {
+        ParsedManifest manifest;
+        return manifest.load(basePath, options.threadCount, runError) && manifest.entries().size() == entryCount;
+    });
+    runner.run("manifest/parse-binary", std::filesystem::file_size(binaryPath), entryCount, [&](std::string& runError) {
+        ParsedManifest manifest;
+        return manifest.load(binaryPath, options.threadCount, runError) && manifest.entries().size() == entryCount;
+    });
+
+    // Diffs over the same loaded pair
+    ParsedManifest baseManifest;
+    ParsedManifest changedManifest;
+    if (!baseManifest.load(basePath, options.threadCount, error) || !changedManifest.load(changedPath, options.threadCount, error)) {
+        return false;
+    }
+    size_t expectedChanges = 0;
+    for (size_t module = 7; module * 1000 < entryCount; module += 100) {
+        expectedChanges += (std::min)(entryCount - module * 1000, size_t(1000));
+    }
+    auto checkChanges = [expectedChanges](const std::vector<ManifestChange>& changes, std::string& runError) {
+        if (changes.size() != expectedChanges) {
+            runError = "expected " + std::to_string(expectedChanges) + " changes, found " + std::to_string(changes.size());
+            return false;
+        }
+        return true;
+    };
+
+    runner.run("diff/merge", 0, entryCount, [&](std::string& runError) {
+        std::vector<ManifestChange> changes;
+        mergeSortedManifests(baseManifest.entries(), changedManifest.entries(), changes);
+        return checkChanges(changes, runError);
+    });
+    runner.run("diff/hash-join", 0, entryCount, [&](std::string& runError) {
+        std::vector<ManifestChange> changes;
+        hashJoinManifests(baseManifest.entries(), changedManifest.entries(), changes);
+        return checkChanges(changes, runError);
+    });
+    runner.run("diff/tree", 0, entryCount, [&](std::string& runError) {
+        std::vector<ManifestChange> changes;
+        diffManifestTrees(baseManifest.entries(), baseManifest.directories(), changedManifest.entries(),
+            changedManifest.directories(), baseManifest.rootDirectory(), changes);
+        return checkChanges(changes, runError);
+    });
+
+    // Exclude matching over the manifest's paths
+    uint64_t pathBytes = 0;
+    for (const auto& path : paths) {
+        pathBytes += path.size();
+    }
+    auto runExcludeBenchmark = [&](const std::string& name, const std::vector<std::string>& patterns) {
+        ExcludeMatcher matcher;
+        for (const auto& pattern : patterns) {
+            matcher.addPattern(pattern);
+        }
+        matcher.compile();
+        runner.run(name, pathBytes, paths.size(), [&](std::string&) {
+            size_t excluded = 0;
+            for (const auto& path : paths) {
+                excluded += matcher.excludes(path, 0, false);
+            }
+            volatile size_t sink = excluded;
+            (void)sink;
+            return true;
+        });
+    };
+    runExcludeBenchmark("exclude/literal", { ".git", "node_modules", "file0000123", "sub07/file", ".tmp", "cache",
+        "build", "dist", "target", "vendor", "__pycache__", ".DS_Store", "Thumbs.db", "coverage", ".idea", ".vs" });
+    runExcludeBenchmark("exclude/glob", { "*.tmp", "*.log", "**/cache/**", "/mod00001/", "mod*/sub0[3-5]/*.dat",
+        "!mod*/sub04/file*1.dat", "**/*.o", "*.pyc", "build/", "**/node_modules/", "file??????7.dat", "*.swp",
+        "/dist/**", "**/.git/", "*.bak", "*~" });
+
+    // End-to-end validation of the two manifest files
+    runner.run("validate/manifests", manifestBytes * 2, entryCount, [&](std::string&) {
+        clearManifestCache();
+        return !validateChecksumFile(basePath.string(), changedPath.string());
+    });
+    runner.run("validate/manifests-cached", manifestBytes * 2, entryCount, [&](std::string&) {
+        return !validateChecksumFile(basePath.string(), changedPath.string());
+    });
+    clearManifestCache();
+    return true;
+}
+
+void runTreeBenchmarks(BenchmarkRunner& runner, const BenchmarkOptions& options, const std::filesystem::path& treeRoot,
+    const TreeStats& treeStats) {
+    std::string root = treeRoot.string();
+    std::filesystem::path checksumPath = treeRoot / "checksum.txt";
+
+    const HashAlgorithm algorithms[] = { HashAlgorithm::Crc32, HashAlgorithm::Xxh3_64, HashAlgorithm::Blake3 };
+    for (HashAlgorithm algorithm : algorithms) {
+        runner.run(std::string("create/full/") + hashAlgorithmName(algorithm), treeStats.byteCount, treeStats.fileCount,
+            [&](std::string& runError) {
+                ChecksumOptions createOptions;
+                createOptions.algorithm = algorithm;
+                createOptions.threadCount = options.threadCount;
+                if (createChecksumFile(root, {}, createOptions) != 200) {
+                    runError = "create failed";
+                    return false;
+                }
+                return true;
+            });
+    }
+
+    // Only stat calls once every entry is reusable
+    runner.run("create/incremental", 0, treeStats.fileCount, [&](std::string& runError) {
+        ChecksumOptions createOptions;
+        createOptions.algorithm = HashAlgorithm::Blake3;
+        createOptions.threadCount = options.threadCount;
+        createOptions.incremental = true;
+        if (createChecksumFile(root, {}, createOptions) != 200) {
+            runError = "create failed";
+            return false;
+        }
+        return true;
+    });
+
+    // Identical trees are decided by the root digests alone
+    std::filesystem::path copyPath = options.workDirectory / "tree_checksum.txt";
+    std::error_code copyError;
+    if (!std::filesystem::exists(checksumPath)) {
+        QuietOutput quiet;
+        ChecksumOptions createOptions;
+        createOptions.threadCount = options.threadCount;
+        createChecksumFile(root, {}, createOptions);
+    }
+    std::filesystem::copy_file(checksumPath, copyPath, std::filesystem::copy_options::overwrite_existing, copyError);
+    runner.run("validate/tree-identical", 0, treeStats.fileCount, [&](std::string& runError) {
+        if (copyError) {
+            runError = copyError.message();
+            return false;
+        }
+        clearManifestCache();
+        return validateChecksumFile(checksumPath.string(), copyPath.string());
+    });
+    std::filesystem::remove(checksumPath, copyError);
+    clearManifestCache();
+}
+
+void displayUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [--scale small|medium|large] [--work <dir>] [--output <file.json>]"
+        << " [--filter <text>] [--repetitions <n>] [--threads <n>]" << std::endl;
+    std::cerr << "  --scale: size of the synthetic tree and manifests (default small)." << std::endl;
+    std::cerr << "  --work: folder for the generated tree and manifests, reused while the scale is unchanged." << std::endl;
+    std::cerr << "  --output: write the JSON results to a file instead of stdout." << std::endl;
+    std::cerr << "  --filter: only run benchmarks whose name contains this text (e.g. hash/, diff/, create/)." << std::endl;
+    std::cerr << "  --repetitions: timed runs per benchmark after one warm-up run (default 5)." << std::endl;
+    std::cerr << "  --threads: hashing and parsing threads (default one per CPU thread)." << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        try {
+            if (arg == "--scale" && i + 1 < argc) {
+                options.scale = argv[++i];
+            }
+            else if (arg == "--work" && i + 1 < argc) {
+                options.workDirectory = argv[++i];
+            }
+            else if (arg == "--output" && i + 1 < argc) {
+                options.outputPath = argv[++i];
+            }
+            else if (arg == "--filter" && i + 1 < argc) {
+                options.filter = argv[++i];
+            }
+            else if (arg == "--repetitions" && i + 1 < argc) {
+                options.repetitions = (std::max)(1, std::stoi(argv[++i]));
+            }
+            else if (arg == "--threads" && i + 1 < argc) {
+                options.threadCount = static_cast<unsigned int>(std::stoul(argv[++i]));
+            }
+            else {
+                displayUsage(argv[0]);
+                return arg == "--help" || arg == "help" ? 0 : 1;
+            }
+        }
+        catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    TreeProfile profile;
+    if (!treeProfileForScale(options.scale, profile)) {
+        std::cerr << "Unknown scale: " << options.scale << std::endl;
+        return 1;
+    }
+
+    std::string error;
+    std::error_code directoryError;
+    std::filesystem::create_directories(options.workDirectory, directoryError);
+    if (directoryError) {
+        std::cerr << "Unable to create " << options.workDirectory << ": " << directoryError.message() << std::endl;
+        return 1;
+    }
+
+    BenchmarkRunner runner(options);
+    runHashBenchmarks(runner);
+    if (!runManifestBenchmarks(runner, options, error)) {
+        std::cerr << "Unable to prepare manifests: " << error << std::endl;
+        return 1;
+    }
+
+    // The tree is only generated when a tree benchmark is selected
+    std::filesystem::path treeRoot = options.workDirectory / ("tree_" + options.scale);
+    TreeStats treeStats;
+    if (std::any_of(std::begin(treeBenchmarks), std::end(treeBenchmarks),
+        [&](const char* name) { return isSelected(options, name); })) {
+        bool generated = false;
+        std::cerr << "Preparing synthetic tree (" << describeTreeProfile(profile) << ")..." << std::endl;
+        if (!prepareTree(treeRoot, profile, treeStats, generated, error)) {
+            std::cerr << "Unable to generate the tree: " << error << std::endl;
+            return 1;
+        }
+        std::cerr << (generated ? "Generated " : "Reusing ") << treeStats.fileCount << " files, "
+            << treeStats.byteCount << " bytes" << std::endl;
+        runTreeBenchmarks(runner, options, treeRoot, treeStats);
+    }
+
+    if (options.outputPath.empty()) {
+        writeJson(std::cout, options, profile, treeStats, runner.all());
+    }
+    else {
+        std::ofstream output(options.outputPath);
+        writeJson(output, options, profile, treeStats, runner.all());
+        if (!output) {
+            std::cerr << "Unable to write " << options.outputPath << std::endl;
+            return 1;
+        }
+        std::cerr << "Results written to " << options.outputPath << std::endl;
+    }
+
+    for (const auto& result : runner.all()) {
+        if (!result.error.empty()) {
+            return 1;
+        }
+    }
+    return 0;
+}
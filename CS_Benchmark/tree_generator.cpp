@@ -0,0 +1,211 @@
+#include "tree_generator.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+constexpr size_t writeBufferSize = 1 << 20;
+
+// Zero-padded so directory listings sort the same as creation order
+std::string numberedName(const char* prefix, size_t number, int width) {
+    std::ostringstream name;
+    name << prefix << std::setw(width) << std::setfill('0') << number;
+    return name.str();
+}
+
+bool writeFile(const std::filesystem::path& filePath, const char* data, size_t length, std::string& error) {
+    std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+    file.write(data, static_cast<std::streamsize>(length));
+    if (!file) {
+        error = "unable to write " + filePath.string();
+        return false;
+    }
+    return true;
+}
+
+// Count what a create of root would see; checksum files are left out
+void countTree(const std::filesystem::path& root, TreeStats& stats) {
+    stats = TreeStats{};
+    stats.directoryCount = 1;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+        if (entry.is_directory()) {
+            stats.directoryCount++;
+        }
+        else if (entry.is_regular_file()) {
+            std::string name = entry.path().filename().string();
+            if (name.rfind("checksum.", 0) == 0) {
+                continue;
+            }
+            stats.fileCount++;
+            stats.byteCount += entry.file_size();
+        }
+    }
+}
+
+} // namespace
+
+void ContentGenerator::fill(void* data, size_t length) {
+    uint8_t* out = static_cast<uint8_t*>(data);
+    while (length >= sizeof(uint64_t)) {
+        uint64_t value = next();
+        std::memcpy(out, &value, sizeof(value));
+        out += sizeof(value);
+        length -= sizeof(value);
+    }
+    if (length > 0) {
+        uint64_t value = next();
+        std::memcpy(out, &value, length);
+    }
+}
+
+bool treeProfileForScale(std::string_view scale, TreeProfile& profile) {
+    profile = TreeProfile{};
+    if (scale == "small") {
+        profile.tinyFiles = 5000;
+        profile.hugeFileSize = 64ull << 20;
+        profile.nestingDepth = 32;
+        profile.sparseFileSize = 256ull << 20;
+        profile.sparseStride = 16ull << 20;
+        return true;
+    }
+    if (scale == "medium") {
+        return true;
+    }
+    if (scale == "large") {
+        profile.tinyFiles = 200000;
+        profile.hugeFiles = 4;
+        profile.hugeFileSize = 1ull << 30;
+        profile.nestingDepth = 128;
+        profile.sparseFiles = 4;
+        profile.sparseFileSize = 4ull << 30;
+        return true;
+    }
+    return false;
+}
+
+std::string describeTreeProfile(const TreeProfile& profile) {
+    std::ostringstream text;
+    text << "seed=" << profile.seed
+        << " tiny=" << profile.tinyFiles << "x" << profile.tinyFilesPerDirectory
+        << " huge=" << profile.hugeFiles << "x" << profile.hugeFileSize
+        << " depth=" << profile.nestingDepth
+        << " sparse=" << profile.sparseFiles << "x" << profile.sparseFileSize << "/" << profile.sparseExtentSize << "/" << profile.sparseStride;
+    return text.str();
+}
+
+bool generateTree(const std::filesystem::path& root, const TreeProfile& profile, TreeStats& stats, std::string& error) {
+    try {
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root);
+
+        ContentGenerator random(profile.seed);
+        std::vector<char> buffer(writeBufferSize);
+
+        // Many tiny files, spread over directories of tinyFilesPerDirectory
+        size_t perDirectory = (std::max)(profile.tinyFilesPerDirectory, size_t(1));
+        std::filesystem::path directory;
+        for (size_t i = 0; i < profile.tinyFiles; i++) {
+            if (i % perDirectory == 0) {
+                directory = root / "tiny" / numberedName("d", i / perDirectory, 5);
+                std::filesystem::create_directories(directory);
+            }
+            size_t size = static_cast<size_t>(random.next() % 4097);
+            random.fill(buffer.data(), size);
+            if (!writeFile(directory / (numberedName("f", i, 7) + ".bin"), buffer.data(), size, error)) {
+                return false;
+            }
+        }
+
+        // A few huge files, written a buffer at a time
+        std::filesystem::create_directories(root / "huge");
+        for (size_t i = 0; i < profile.hugeFiles; i++) {
+            std::filesystem::path filePath = root / "huge" / (numberedName("huge", i, 2) + ".bin");
+            std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+            for (uint64_t written = 0; written < profile.hugeFileSize && file; ) {
+                size_t length = static_cast<size_t>((std::min)(profile.hugeFileSize - written, uint64_t(buffer.size())));
+                random.fill(buffer.data(), length);
+                file.write(buffer.data(), static_cast<std::streamsize>(length));
+                written += length;
+            }
+            if (!file) {
+                error = "unable to write " + filePath.string();
+                return false;
+            }
+        }
+
+        // Deep nesting: one chain of directories with a small file on each level
+        directory = root / "deep";
+        for (size_t level = 0; level < profile.nestingDepth; level++) {
+            directory /= numberedName("level", level, 3);
+            std::filesystem::create_directories(directory);
+            size_t size = 64 + static_cast<size_t>(random.next() % 961);
+            random.fill(buffer.data(), size);
+            if (!writeFile(directory / "file.txt", buffer.data(), size, error)) {
+                return false;
+            }
+        }
+
+        // Sparse files: extended with holes, then one extent written every stride
+        std::filesystem::create_directories(root / "sparse");
+        size_t extentLength = static_cast<size_t>((std::min)(profile.sparseExtentSize, uint64_t(buffer.size())));
+        for (size_t i = 0; i < profile.sparseFiles; i++) {
+            std::filesystem::path filePath = root / "sparse" / (numberedName("sparse", i, 2) + ".bin");
+            std::ofstream(filePath, std::ios::binary | std::ios::trunc).close();
+            std::filesystem::resize_file(filePath, profile.sparseFileSize);
+
+            std::fstream file(filePath, std::ios::binary | std::ios::in | std::ios::out);
+            for (uint64_t offset = 0; offset < profile.sparseFileSize && file; offset += (std::max)(profile.sparseStride, uint64_t(1))) {
+                size_t length = static_cast<size_t>((std::min)(profile.sparseFileSize - offset, uint64_t(extentLength)));
+                random.fill(buffer.data(), length);
+                file.seekp(static_cast<std::streamoff>(offset));
+                file.write(buffer.data(), static_cast<std::streamsize>(length));
+            }
+            if (!file) {
+                error = "unable to write " + filePath.string();
+                return false;
+            }
+        }
+
+        countTree(root, stats);
+        return true;
+    }
+    catch (const std::exception& e) {
+        error = e.what();
+        return false;
+    }
+}
+
+bool prepareTree(const std::filesystem::path& root, const TreeProfile& profile, TreeStats& stats, bool& generated,
+    std::string& error) {
+    std::filesystem::path markerPath = root.parent_path() / (root.filename().string() + ".profile");
+    std::string description = describeTreeProfile(profile);
+
+    generated = false;
+    std::ifstream marker(markerPath);
+    std::string recorded;
+    if (marker && std::getline(marker, recorded) && recorded == description && std::filesystem::is_directory(root)) {
+        try {
+            countTree(root, stats);
+            return true;
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+            return false;
+        }
+    }
+    marker.close();
+
+    // Drop the marker first, so an interrupted generation is not reused
+    std::error_code ignored;
+    std::filesystem::remove(markerPath, ignored);
+    if (!generateTree(root, profile, stats, error)) {
+        return false;
+    }
+    std::ofstream(markerPath) << description << "\n";
+    generated = true;
+    return true;
+}
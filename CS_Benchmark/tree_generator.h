@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+// Shape of a synthetic tree. The same profile always produces the same paths
+// and contents, so results from different versions and machines compare.
+struct TreeProfile {
+    uint64_t seed = 1;
+    size_t tinyFiles = 20000;               // 0..4 KB each, tinyFilesPerDirectory per directory
+    size_t tinyFilesPerDirectory = 64;
+    size_t hugeFiles = 2;
+    uint64_t hugeFileSize = 256ull << 20;
+    size_t nestingDepth = 64;               // One directory chain with a small file on every level
+    size_t sparseFiles = 2;
+    uint64_t sparseFileSize = 1ull << 30;   // Holes, with one sparseExtentSize extent every sparseStride bytes
+    uint64_t sparseExtentSize = 64ull << 10;
+    uint64_t sparseStride = 64ull << 20;
+};
+
+// "small" (a quick run), "medium" or "large"; false for any other name
+bool treeProfileForScale(std::string_view scale, TreeProfile& profile);
+
+// One line naming every profile field, stored next to a generated tree
+std::string describeTreeProfile(const TreeProfile& profile);
+
+struct TreeStats {
+    size_t fileCount = 0;
+    size_t directoryCount = 0;
+    uint64_t byteCount = 0;     // Logical size, holes included
+};
+
+// Deterministic content source (SplitMix64)
+class ContentGenerator {
+public:
+    explicit ContentGenerator(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    void fill(void* data, size_t length);
+
+private:
+    uint64_t state;
+};
+
+// Write the tree under root, replacing anything there. Sparse files are
+// created by extending them with holes, which stay unallocated on file systems
+// that support it.
+bool generateTree(const std::filesystem::path& root, const TreeProfile& profile, TreeStats& stats, std::string& error);
+
+// Generate the tree unless root already holds one for the same profile
+// (recorded in root's sibling "<root name>.profile"); stats are recounted either way
+bool prepareTree(const std::filesystem::path& root, const TreeProfile& profile, TreeStats& stats, bool& generated,
+    std::string& error);
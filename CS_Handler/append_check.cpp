@@ -0,0 +1,67 @@
+#include "pch.h"
+#include "append_check.h"
+#include "file_hasher.h"
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+// Fingerprint of the end blocks of the file's first size bytes
+bool fingerprintBlocks(const std::filesystem::path& filePath, uint64_t size, ReadStrategy strategy, uint64_t& value) {
+    std::unique_ptr<Hasher> hasher = createHasher(HashAlgorithm::Xxh3_64);
+    uint64_t headLength = (std::min)(size, appendCheckBlockSize);
+    if (headLength > 0 && !hashFileRange(filePath, 0, headLength, *hasher, strategy)) {
+        return false;
+    }
+
+    // The last block never overlaps the first, so short files are read once
+    uint64_t tailStart = (std::max)(headLength, size - (std::min)(size, appendCheckBlockSize));
+    if (tailStart < size && !hashFileRange(filePath, tailStart, size - tailStart, *hasher, strategy)) {
+        return false;
+    }
+    value = hashToUint(hasher->finalize());
+    return true;
+}
+
+} // namespace
+
+AppendCheck readAppendCheck(const std::filesystem::path& filePath, const FileStat& stat, ReadStrategy strategy) {
+    AppendCheck check;
+    if (!stat.valid || !fingerprintBlocks(filePath, stat.size, strategy, check.value)) {
+        return AppendCheck{};
+    }
+
+    // Hashing reads to the end of the file, wherever that was at the time
+    FileStat current;
+    if (!readFileStat(filePath, current) || current.size != stat.size) {
+        return AppendCheck{};
+    }
+    check.valid = true;
+    return check;
+}
+
+bool extendFileHash(const std::filesystem::path& filePath, HashAlgorithm algorithm, const HashValue& previousHash,
+    uint64_t previousSize, const AppendCheck& previousCheck, uint64_t newSize, HashValue& hash, AppendCheck& check,
+    ReadStrategy strategy) {
+    if (!supportsHashExtension(algorithm) || !previousCheck.valid || newSize <= previousSize) {
+        return false;
+    }
+
+    uint64_t value = 0;
+    if (!fingerprintBlocks(filePath, previousSize, strategy, value) || value != previousCheck.value) {
+        return false;
+    }
+
+    // Only the appended bytes are read
+    uint64_t appendedLength = newSize - previousSize;
+    std::unique_ptr<Hasher> hasher = createHasher(algorithm);
+    if (!hashFileRange(filePath, previousSize, appendedLength, *hasher, strategy)) {
+        return false;
+    }
+    if (!fingerprintBlocks(filePath, newSize, strategy, check.value)) {
+        return false;
+    }
+    hash = extendHash(algorithm, previousHash, hasher->finalize(), appendedLength);
+    check.valid = true;
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "file_reader.h"
+#include "file_stat.h"
+#include "hash.h"
+#include <cstdint>
+#include <filesystem>
+
+// Bytes fingerprinted at each end of a file by the append check
+constexpr uint64_t appendCheckBlockSize = 4096;
+
+// XXH3-64 of the first and the last appendCheckBlockSize bytes of a file at
+// the size recorded with it (the whole file when it is shorter than two
+// blocks). Stored with entries of append=1 manifests.
+//
+// When a file has grown, both blocks still matching at the old size is taken
+// to mean the old contents were only appended to: the old CRC is then extended
+// with the new bytes instead of reading the file again. The blocks in between
+// are not read, so a rewrite inside the old contents that also grows the file
+// goes unnoticed until the next full hash.
+struct AppendCheck {
+    bool valid = false;
+    uint64_t value = 0;
+
+    bool operator==(const AppendCheck& other) const = default;
+};
+
+// Fingerprint of a file just hashed at stat.size bytes. Invalid when the file
+// cannot be read or its size changed since stat, since the digest may then
+// cover a different length, e.g. of a log that grew while it was hashed.
+AppendCheck readAppendCheck(const std::filesystem::path& filePath, const FileStat& stat,
+    ReadStrategy strategy = ReadStrategy::Auto);
+
+// Digest of a file that grew from previousSize to newSize bytes: previousHash
+// extended with the hash of the bytes in between, plus the check at newSize.
+// Exactly newSize bytes are covered, so bytes appended meanwhile are left for
+// the next run. Returns false when the algorithm cannot be extended,
+// previousCheck no longer matches (the old contents were rewritten) or a read
+// fails; the file then needs a full hash.
+bool extendFileHash(const std::filesystem::path& filePath, HashAlgorithm algorithm, const HashValue& previousHash,
+    uint64_t previousSize, const AppendCheck& previousCheck, uint64_t newSize, HashValue& hash, AppendCheck& check,
+    ReadStrategy strategy = ReadStrategy::Auto);
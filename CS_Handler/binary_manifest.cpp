@@ -0,0 +1,329 @@
+#include "pch.h"
+#include "binary_manifest.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+namespace {
+
+constexpr bool littleEndianHost = std::endian::native == std::endian::little;
+
+// Directory part of a path, including its trailing separator
+size_t directoryLength(std::string_view path) {
+    size_t separator = path.find_last_of("/\\");
+    return separator == std::string_view::npos ? 0 : separator + 1;
+}
+
+// Byte-wise comparison of (aHead + aTail) with (bHead + bTail) without joining them
+int compareJoined(std::string_view aHead, std::string_view aTail, std::string_view bHead, std::string_view bTail) {
+    while (true) {
+        if (aHead.empty()) {
+            aHead = aTail;
+            aTail = {};
+        }
+        if (bHead.empty()) {
+            bHead = bTail;
+            bTail = {};
+        }
+        if (aHead.empty() || bHead.empty()) {
+            return aHead.empty() ? (bHead.empty() ? 0 : -1) : 1;
+        }
+
+        size_t length = (std::min)(aHead.size(), bHead.size());
+        int result = aHead.substr(0, length).compare(bHead.substr(0, length));
+        if (result != 0) {
+            return result;
+        }
+        aHead.remove_prefix(length);
+        bHead.remove_prefix(length);
+    }
+}
+
+bool inRange(uint64_t offset, uint64_t length, uint64_t limit) {
+    return offset <= limit && length <= limit - offset;
+}
+
+// Pool of unique strings; identical directories and names are stored once
+class StringPool {
+public:
+    void add(std::string_view text, uint64_t& offset, uint32_t& length) {
+        auto [it, inserted] = offsets.try_emplace(std::string(text), data.size());
+        if (inserted) {
+            data.append(text);
+        }
+        offset = it->second;
+        length = static_cast<uint32_t>(text.size());
+    }
+
+    const std::string& bytes() const { return data; }
+
+private:
+    std::unordered_map<std::string, uint64_t> offsets;
+    std::string data;
+};
+
+} // namespace
+
+bool BinaryManifest::open(const std::filesystem::path& manifestPath, std::string& error) {
+    records = nullptr;
+    recordCount = 0;
+    strings = nullptr;
+
+    if (!littleEndianHost) {
+        error = "binary manifests are not supported on big-endian hosts";
+        return false;
+    }
+    if (!file.open(manifestPath)) {
+        error = "unable to map file";
+        return false;
+    }
+
+    BinaryManifestHeader fileHeader;
+    if (file.size() < sizeof(fileHeader)) {
+        error = "file too small for a binary manifest";
+        return false;
+    }
+    std::memcpy(&fileHeader, file.data(), sizeof(fileHeader));
+
+    if (std::memcmp(fileHeader.magic, binaryManifestMagic, sizeof(binaryManifestMagic)) != 0) {
+        error = "not a binary manifest";
+        return false;
+    }
+    if (fileHeader.version > binaryManifestVersion) {
+        error = "binary manifest v" + std::to_string(fileHeader.version) + " is newer than this build";
+        return false;
+    }
+    if (fileHeader.headerSize < sizeof(BinaryManifestHeader) || fileHeader.recordSize != sizeof(BinaryManifestRecord)) {
+        error = "unsupported header or record size";
+        return false;
+    }
+
+    std::string algorithmName(fileHeader.algorithm, strnlen(fileHeader.algorithm, sizeof(fileHeader.algorithm)));
+    if (!parseHashAlgorithm(algorithmName, manifestHeader.algorithm)) {
+        error = "unknown hash algorithm '" + algorithmName + "'";
+        return false;
+    }
+    manifestHeader.version = plainManifestVersion;
+    manifestHeader.hasStat = (fileHeader.flags & binaryManifestHasStat) != 0;
+    manifestHeader.relative = (fileHeader.flags & binaryManifestRelative) != 0;
+    manifestHeader.sorted = true;
+
+    // Records are read in place, so they must be aligned and inside the file
+    const uint64_t fileSize = file.size();
+    if (fileHeader.recordsOffset % alignof(BinaryManifestRecord) != 0 ||
+        fileHeader.recordCount > fileSize / sizeof(BinaryManifestRecord) ||
+        !inRange(fileHeader.recordsOffset, fileHeader.recordCount * sizeof(BinaryManifestRecord), fileSize) ||
+        !inRange(fileHeader.stringsOffset, fileHeader.stringsSize, fileSize)) {
+        error = "record or string table out of bounds";
+        return false;
+    }
+
+    records = reinterpret_cast<const BinaryManifestRecord*>(file.data() + fileHeader.recordsOffset);
+    recordCount = static_cast<size_t>(fileHeader.recordCount);
+    strings = reinterpret_cast<const char*>(file.data() + fileHeader.stringsOffset);
+
+    for (size_t i = 0; i < recordCount; i++) {
+        const BinaryManifestRecord& entry = records[i];
+        if (!inRange(entry.directoryOffset, entry.directoryLength, fileHeader.stringsSize) ||
+            !inRange(entry.nameOffset, entry.nameLength, fileHeader.stringsSize)) {
+            error = "string reference out of bounds in record " + std::to_string(i);
+            records = nullptr;
+            recordCount = 0;
+            return false;
+        }
+        if (i > 0 && comparePath(records[i - 1], *this, entry) >= 0) {
+            error = "records are not sorted by path (record " + std::to_string(i) + ")";
+            records = nullptr;
+            recordCount = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view BinaryManifest::directory(const BinaryManifestRecord& record) const {
+    return std::string_view(strings + record.directoryOffset, record.directoryLength);
+}
+
+std::string_view BinaryManifest::name(const BinaryManifestRecord& record) const {
+    return std::string_view(strings + record.nameOffset, record.nameLength);
+}
+
+std::string BinaryManifest::path(const BinaryManifestRecord& record) const {
+    std::string result(directory(record));
+    result += name(record);
+    return result;
+}
+
+HashValue BinaryManifest::hash(const BinaryManifestRecord& record) const {
+    HashValue value;
+    value.size = static_cast<uint8_t>(hashSize(manifestHeader.algorithm));
+    std::memcpy(value.bytes.data(), record.hash, value.size);
+    return value;
+}
+
+FileStat BinaryManifest::stat(const BinaryManifestRecord& record) const {
+    FileStat value;
+    if (manifestHeader.hasStat && record.statValid != 0) {
+        value.valid = true;
+        value.size = record.size;
+        value.mtimeNs = record.mtimeNs;
+        value.inode = record.inode;
+    }
+    return value;
+}
+
+int BinaryManifest::comparePath(const BinaryManifestRecord& record, const BinaryManifest& other, const BinaryManifestRecord& otherRecord) const {
+    return compareJoined(directory(record), name(record), other.directory(otherRecord), other.name(otherRecord));
+}
+
+int BinaryManifest::comparePath(const BinaryManifestRecord& record, std::string_view path) const {
+    return compareJoined(directory(record), name(record), path, {});
+}
+
+const BinaryManifestRecord* BinaryManifest::find(std::string_view path) const {
+    size_t low = 0;
+    size_t high = recordCount;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int result = comparePath(records[middle], path);
+        if (result == 0) {
+            return &records[middle];
+        }
+        if (result < 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return nullptr;
+}
+
+bool isBinaryManifest(const std::filesystem::path& manifestPath) {
+    std::ifstream file(manifestPath, std::ios::binary);
+    char magic[sizeof(binaryManifestMagic)];
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, binaryManifestMagic, sizeof(magic)) == 0;
+}
+
+bool writeBinaryManifest(const std::filesystem::path& manifestPath, const ManifestHeader& header,
+    std::vector<ManifestEntry> entries, std::string& error) {
+    if (!littleEndianHost) {
+        error = "binary manifests are not supported on big-endian hosts";
+        return false;
+    }
+
+    // Sort by path; a stable sort keeps duplicates in input order, so the last one wins
+    std::stable_sort(entries.begin(), entries.end(), [](const ManifestEntry& a, const ManifestEntry& b) {
+        return a.path < b.path;
+    });
+    std::vector<BinaryManifestRecord> records;
+    records.reserve(entries.size());
+    StringPool pool;
+
+    const size_t digestSize = hashSize(header.algorithm);
+    for (size_t i = 0; i < entries.size(); i++) {
+        const ManifestEntry& entry = entries[i];
+        if (i + 1 < entries.size() && entries[i + 1].path == entry.path) {
+            continue;
+        }
+        if (entry.hash.size != digestSize) {
+            error = "digest size does not match the algorithm for " + entry.path;
+            return false;
+        }
+
+        BinaryManifestRecord record{};
+        std::string_view path = entry.path;
+        size_t split = directoryLength(path);
+        pool.add(path.substr(0, split), record.directoryOffset, record.directoryLength);
+        pool.add(path.substr(split), record.nameOffset, record.nameLength);
+        std::memcpy(record.hash, entry.hash.bytes.data(), digestSize);
+        if (entry.stat.valid) {
+            record.size = entry.stat.size;
+            record.mtimeNs = entry.stat.mtimeNs;
+            record.inode = entry.stat.inode;
+            record.statValid = 1;
+        }
+        records.push_back(record);
+    }
+
+    BinaryManifestHeader fileHeader{};
+    std::memcpy(fileHeader.magic, binaryManifestMagic, sizeof(binaryManifestMagic));
+    fileHeader.version = binaryManifestVersion;
+    fileHeader.headerSize = sizeof(BinaryManifestHeader);
+    fileHeader.recordSize = sizeof(BinaryManifestRecord);
+    fileHeader.flags = (header.hasStat ? binaryManifestHasStat : 0) | (header.relative ? binaryManifestRelative : 0);
+    std::string_view algorithmName = hashAlgorithmName(header.algorithm);
+    std::memcpy(fileHeader.algorithm, algorithmName.data(), (std::min)(algorithmName.size(), sizeof(fileHeader.algorithm)));
+    fileHeader.recordCount = records.size();
+    fileHeader.recordsOffset = sizeof(BinaryManifestHeader);
+    fileHeader.stringsOffset = fileHeader.recordsOffset + records.size() * sizeof(BinaryManifestRecord);
+    fileHeader.stringsSize = pool.bytes().size();
+
+    std::ofstream file(manifestPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        error = "unable to create file";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    file.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(BinaryManifestRecord)));
+    file.write(pool.bytes().data(), static_cast<std::streamsize>(pool.bytes().size()));
+    file.close();
+    if (file.fail()) {
+        error = "write failed";
+        return false;
+    }
+    return true;
+}
+
+bool convertManifest(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath, std::string& error) {
+    if (isBinaryManifest(inputPath)) {
+        BinaryManifest manifest;
+        if (!manifest.open(inputPath, error)) {
+            return false;
+        }
+
+        std::ofstream file(outputPath, std::ios::trunc);
+        if (!file.is_open()) {
+            error = "unable to create " + outputPath.string();
+            return false;
+        }
+
+        ManifestHeader header = manifest.header();
+        file << formatManifestHeader(header) << '\n';
+        std::string line;
+        for (size_t i = 0; i < manifest.size(); i++) {
+            const BinaryManifestRecord& record = manifest.record(i);
+            line.assign(manifest.directory(record));
+            line += manifest.name(record);
+            line += ' ';
+            line += formatManifestHash(manifest.hash(record));
+            if (header.hasStat) {
+                line += ' ';
+                line += formatManifestStat(manifest.stat(record));
+            }
+            line += '\n';
+            file << line;
+        }
+        file.close();
+        if (file.fail()) {
+            error = "write failed for " + outputPath.string();
+            return false;
+        }
+        return true;
+    }
+
+    ManifestHeader header;
+    std::vector<ManifestEntry> entries;
+    bool read = readManifestEntries(inputPath, header,
+        [&](std::string_view path, const HashValue& hash, const FileStat& stat, const AppendCheck&) {
+            entries.push_back({ std::string(path), hash, stat });
+        });
+    if (!read) {
+        error = "unable to read " + inputPath.string();
+        return false;
+    }
+    return writeBinaryManifest(outputPath, header, std::move(entries), error);
+}
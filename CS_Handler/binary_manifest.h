@@ -0,0 +1,93 @@
+#pragma once
+
+#include "manifest.h"
+#include "mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary manifest (checksum.bin): the same entries as checksum.txt in a layout
+// that is memory mapped and used in place, without parsing.
+//
+//   BinaryManifestHeader
+//   BinaryManifestRecord[recordCount]   sorted byte-wise by full path
+//   string pool                         deduplicated directory and file names
+//
+// All integers are little-endian. A record's path is its directory string
+// (ending in a separator, or empty) followed by its name string.
+constexpr char binaryManifestMagic[8] = { 'C', 'S', 'H', 'M', 'A', 'N', 'B', '\0' };
+constexpr uint32_t binaryManifestVersion = 1;
+constexpr uint32_t binaryManifestHasStat = 1;
+constexpr uint32_t binaryManifestRelative = 2;
+
+struct BinaryManifestHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    uint32_t flags;             // binaryManifestHasStat | binaryManifestRelative
+    char algorithm[16];         // Manifest algorithm name, NUL padded
+    uint64_t recordCount;
+    uint64_t recordsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+struct BinaryManifestRecord {
+    uint64_t directoryOffset;   // Into the string pool
+    uint64_t nameOffset;
+    uint32_t directoryLength;
+    uint32_t nameLength;
+    uint64_t size;
+    int64_t mtimeNs;
+    uint64_t inode;
+    uint8_t hash[32];           // hashSize(algorithm) bytes used, rest zero
+    uint32_t statValid;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(BinaryManifestHeader) == 72, "binary manifest header layout");
+static_assert(sizeof(BinaryManifestRecord) == 88, "binary manifest record layout");
+
+class BinaryManifest {
+public:
+    // Maps the file and checks the header, record bounds and sort order
+    bool open(const std::filesystem::path& manifestPath, std::string& error);
+
+    const ManifestHeader& header() const { return manifestHeader; }
+    size_t size() const { return recordCount; }
+    const BinaryManifestRecord& record(size_t index) const { return records[index]; }
+
+    std::string_view directory(const BinaryManifestRecord& record) const;
+    std::string_view name(const BinaryManifestRecord& record) const;
+    std::string path(const BinaryManifestRecord& record) const;
+    HashValue hash(const BinaryManifestRecord& record) const;
+    FileStat stat(const BinaryManifestRecord& record) const;
+
+    // Byte-wise comparison of a record's path with another record's or a string
+    int comparePath(const BinaryManifestRecord& record, const BinaryManifest& other, const BinaryManifestRecord& otherRecord) const;
+    int comparePath(const BinaryManifestRecord& record, std::string_view path) const;
+
+    // Binary search by full path; nullptr if absent
+    const BinaryManifestRecord* find(std::string_view path) const;
+
+private:
+    MappedFile file;
+    ManifestHeader manifestHeader;
+    const BinaryManifestRecord* records = nullptr;
+    size_t recordCount = 0;
+    const char* strings = nullptr;
+};
+
+// True when the file starts with the binary manifest magic
+bool isBinaryManifest(const std::filesystem::path& manifestPath);
+
+// Write entries (any order; for duplicate paths the last one wins)
+bool writeBinaryManifest(const std::filesystem::path& manifestPath, const ManifestHeader& header,
+    std::vector<ManifestEntry> entries, std::string& error);
+
+// Convert between text and binary manifests; the direction follows the input format
+bool convertManifest(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath, std::string& error);
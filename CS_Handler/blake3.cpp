@@ -0,0 +1,408 @@
+#include "pch.h"
+#include "blake3.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define CS_BLAKE3_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t kIV[8] = {
+    0x6A09E667u, 0xBB67AE85u, 0x3C6EF372u, 0xA54FF53Au,
+    0x510E527Fu, 0x9B05688Cu, 0x1F83D9ABu, 0x5BE0CD19u
+};
+
+enum Blake3Flags : uint8_t {
+    ChunkStart = 1 << 0,
+    ChunkEnd = 1 << 1,
+    Parent = 1 << 2,
+    Root = 1 << 3
+};
+
+constexpr uint8_t kMessagePermutation[16] = { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 };
+
+// Message word order for each of the seven rounds (the permutation applied
+// repeatedly), so rounds can index the block directly instead of shuffling it.
+constexpr std::array<std::array<uint8_t, 16>, 7> makeSchedule() {
+    std::array<std::array<uint8_t, 16>, 7> schedule{};
+    for (uint8_t i = 0; i < 16; i++) {
+        schedule[0][i] = i;
+    }
+    for (size_t r = 1; r < 7; r++) {
+        for (size_t i = 0; i < 16; i++) {
+            schedule[r][i] = schedule[r - 1][kMessagePermutation[i]];
+        }
+    }
+    return schedule;
+}
+
+constexpr auto kSchedule = makeSchedule();
+
+inline uint32_t load32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+        (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void store32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+inline uint32_t rotr32(uint32_t v, int n) {
+    return (v >> n) | (v << (32 - n));
+}
+
+inline void g(uint32_t* s, int a, int b, int c, int d, uint32_t x, uint32_t y) {
+    s[a] = s[a] + s[b] + x;
+    s[d] = rotr32(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + y;
+    s[d] = rotr32(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 7);
+}
+
+// Compress one block and write the new 8-word chaining value into cv
+void compress(uint32_t cv[8], const uint8_t block[blake3BlockLength], uint8_t blockLength, uint64_t counter, uint8_t flags) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = load32(block + i * 4);
+    }
+
+    uint32_t s[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        kIV[0], kIV[1], kIV[2], kIV[3],
+        static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+        blockLength, flags
+    };
+
+    for (const auto& r : kSchedule) {
+        g(s, 0, 4, 8, 12, m[r[0]], m[r[1]]);
+        g(s, 1, 5, 9, 13, m[r[2]], m[r[3]]);
+        g(s, 2, 6, 10, 14, m[r[4]], m[r[5]]);
+        g(s, 3, 7, 11, 15, m[r[6]], m[r[7]]);
+        g(s, 0, 5, 10, 15, m[r[8]], m[r[9]]);
+        g(s, 1, 6, 11, 12, m[r[10]], m[r[11]]);
+        g(s, 2, 7, 8, 13, m[r[12]], m[r[13]]);
+        g(s, 3, 4, 9, 14, m[r[14]], m[r[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        cv[i] = s[i] ^ s[i + 8];
+    }
+}
+
+// Inputs to the last compression of a node, kept until we know whether the
+// node is the root
+struct Output {
+    uint32_t cv[8];
+    uint8_t block[blake3BlockLength];
+    uint8_t blockLength;
+    uint64_t counter;
+    uint8_t flags;
+
+    void chainingValue(uint32_t out[8]) const {
+        std::copy(cv, cv + 8, out);
+        compress(out, block, blockLength, counter, flags);
+    }
+};
+
+Output parentOutput(const uint32_t left[8], const uint32_t right[8]) {
+    Output output;
+    std::copy(kIV, kIV + 8, output.cv);
+    for (int i = 0; i < 8; i++) {
+        store32(output.block + i * 4, left[i]);
+        store32(output.block + 32 + i * 4, right[i]);
+    }
+    output.blockLength = blake3BlockLength;
+    output.counter = 0;
+    output.flags = Parent;
+    return output;
+}
+
+Output chunkOutput(const uint32_t cv[8], const uint8_t block[blake3BlockLength], uint8_t blockLength,
+    uint64_t counter, uint8_t blocksCompressed) {
+    Output output;
+    std::copy(cv, cv + 8, output.cv);
+    std::memcpy(output.block, block, blake3BlockLength);
+    output.blockLength = blockLength;
+    output.counter = counter;
+    output.flags = static_cast<uint8_t>((blocksCompressed == 0 ? ChunkStart : 0) | ChunkEnd);
+    return output;
+}
+
+#ifdef CS_BLAKE3_SSE2
+
+inline __m128i rotrVec(__m128i v, int n) {
+    return _mm_or_si128(_mm_srli_epi32(v, n), _mm_slli_epi32(v, 32 - n));
+}
+
+inline void gVec(__m128i* v, int a, int b, int c, int d, __m128i x, __m128i y) {
+    v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), x);
+    v[d] = rotrVec(_mm_xor_si128(v[d], v[a]), 16);
+    v[c] = _mm_add_epi32(v[c], v[d]);
+    v[b] = rotrVec(_mm_xor_si128(v[b], v[c]), 12);
+    v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), y);
+    v[d] = rotrVec(_mm_xor_si128(v[d], v[a]), 8);
+    v[c] = _mm_add_epi32(v[c], v[d]);
+    v[b] = rotrVec(_mm_xor_si128(v[b], v[c]), 7);
+}
+
+inline void transpose4(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3) {
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    __m128i t1 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t2 = _mm_unpacklo_epi32(r2, r3);
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+    r0 = _mm_unpacklo_epi64(t0, t2);
+    r1 = _mm_unpackhi_epi64(t0, t2);
+    r2 = _mm_unpacklo_epi64(t1, t3);
+    r3 = _mm_unpackhi_epi64(t1, t3);
+}
+
+// Hash four consecutive whole chunks in parallel, one per SIMD lane, and write
+// their (non-root) chaining values to cvs
+void hashFourChunks(const uint8_t* input, uint64_t counter, uint32_t cvs[4][8]) {
+    __m128i h[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm_set1_epi32(static_cast<int>(kIV[i]));
+    }
+
+    const __m128i counterLow = _mm_setr_epi32(
+        static_cast<int>(counter), static_cast<int>(counter + 1),
+        static_cast<int>(counter + 2), static_cast<int>(counter + 3));
+    const __m128i counterHigh = _mm_setr_epi32(
+        static_cast<int>(counter >> 32), static_cast<int>((counter + 1) >> 32),
+        static_cast<int>((counter + 2) >> 32), static_cast<int>((counter + 3) >> 32));
+
+    const size_t blocksPerChunk = blake3ChunkLength / blake3BlockLength;
+    for (size_t b = 0; b < blocksPerChunk; b++) {
+        // Load the block from each chunk and transpose so m[i] holds word i of all four
+        __m128i m[16];
+        for (int group = 0; group < 4; group++) {
+            const uint8_t* base = input + b * blake3BlockLength + group * 16;
+            __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base));
+            __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + blake3ChunkLength));
+            __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + 2 * blake3ChunkLength));
+            __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + 3 * blake3ChunkLength));
+            transpose4(r0, r1, r2, r3);
+            m[group * 4 + 0] = r0;
+            m[group * 4 + 1] = r1;
+            m[group * 4 + 2] = r2;
+            m[group * 4 + 3] = r3;
+        }
+
+        uint8_t flags = 0;
+        if (b == 0) {
+            flags |= ChunkStart;
+        }
+        if (b == blocksPerChunk - 1) {
+            flags |= ChunkEnd;
+        }
+
+        __m128i v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            _mm_set1_epi32(static_cast<int>(kIV[0])), _mm_set1_epi32(static_cast<int>(kIV[1])),
+            _mm_set1_epi32(static_cast<int>(kIV[2])), _mm_set1_epi32(static_cast<int>(kIV[3])),
+            counterLow, counterHigh,
+            _mm_set1_epi32(static_cast<int>(blake3BlockLength)), _mm_set1_epi32(flags)
+        };
+
+        for (const auto& r : kSchedule) {
+            gVec(v, 0, 4, 8, 12, m[r[0]], m[r[1]]);
+            gVec(v, 1, 5, 9, 13, m[r[2]], m[r[3]]);
+            gVec(v, 2, 6, 10, 14, m[r[4]], m[r[5]]);
+            gVec(v, 3, 7, 11, 15, m[r[6]], m[r[7]]);
+            gVec(v, 0, 5, 10, 15, m[r[8]], m[r[9]]);
+            gVec(v, 1, 6, 11, 12, m[r[10]], m[r[11]]);
+            gVec(v, 2, 7, 8, 13, m[r[12]], m[r[13]]);
+            gVec(v, 3, 4, 9, 14, m[r[14]], m[r[15]]);
+        }
+
+        for (int i = 0; i < 8; i++) {
+            h[i] = _mm_xor_si128(v[i], v[i + 8]);
+        }
+    }
+
+    // Transpose back to one chaining value per chunk
+    alignas(16) uint32_t lanes[8][4];
+    for (int i = 0; i < 8; i++) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes[i]), h[i]);
+    }
+    for (int chunk = 0; chunk < 4; chunk++) {
+        for (int i = 0; i < 8; i++) {
+            cvs[chunk][i] = lanes[i][chunk];
+        }
+    }
+}
+
+#endif // CS_BLAKE3_SSE2
+
+void storeWords(uint8_t* out, const uint32_t words[8]) {
+    for (int i = 0; i < 8; i++) {
+        store32(out + i * 4, words[i]);
+    }
+}
+
+void loadWords(uint32_t words[8], const uint8_t* in) {
+    for (int i = 0; i < 8; i++) {
+        words[i] = load32(in + i * 4);
+    }
+}
+
+void rootBytes(const Output& output, uint8_t out[blake3OutLength]) {
+    uint32_t root[8];
+    std::copy(output.cv, output.cv + 8, root);
+    compress(root, output.block, output.blockLength, 0, static_cast<uint8_t>(output.flags | Root));
+    storeWords(out, root);
+}
+
+// Merge subtree chaining values [first, first + count) the way BLAKE3 builds
+// its tree: the left side takes the largest power of two below count
+Output mergeSubtrees(const uint8_t (*cvs)[blake3OutLength], size_t first, size_t count) {
+    size_t leftCount = 1;
+    while (leftCount * 2 < count) {
+        leftCount *= 2;
+    }
+
+    uint32_t left[8];
+    uint32_t right[8];
+    if (leftCount == 1) {
+        loadWords(left, cvs[first]);
+    }
+    else {
+        mergeSubtrees(cvs, first, leftCount).chainingValue(left);
+    }
+    if (count - leftCount == 1) {
+        loadWords(right, cvs[first + leftCount]);
+    }
+    else {
+        mergeSubtrees(cvs, first + leftCount, count - leftCount).chainingValue(right);
+    }
+    return parentOutput(left, right);
+}
+
+} // namespace
+
+void Blake3Hasher::ChunkState::reset(uint64_t counter) {
+    std::copy(kIV, kIV + 8, cv);
+    chunkCounter = counter;
+    std::memset(block, 0, sizeof(block));
+    blockLength = 0;
+    blocksCompressed = 0;
+}
+
+size_t Blake3Hasher::ChunkState::length() const {
+    return blake3BlockLength * blocksCompressed + blockLength;
+}
+
+void Blake3Hasher::ChunkState::update(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        // Only compress a full block once more input arrives; the last block
+        // of the chunk needs the CHUNK_END flag
+        if (blockLength == blake3BlockLength) {
+            compress(cv, block, blake3BlockLength, chunkCounter, blocksCompressed == 0 ? ChunkStart : 0);
+            blocksCompressed++;
+            std::memset(block, 0, sizeof(block));
+            blockLength = 0;
+        }
+
+        size_t take = (std::min)(blake3BlockLength - blockLength, length);
+        std::memcpy(block + blockLength, data, take);
+        blockLength = static_cast<uint8_t>(blockLength + take);
+        data += take;
+        length -= take;
+    }
+}
+
+Blake3Hasher::Blake3Hasher(uint64_t firstChunk)
+    : cvStackLength(0) {
+    chunk.reset(firstChunk);
+}
+
+void Blake3Hasher::addChunkChainingValue(const uint32_t cv[8], uint64_t totalChunks) {
+    // Each trailing zero bit in the chunk count completes a subtree; merge it
+    uint32_t merged[8];
+    std::copy(cv, cv + 8, merged);
+    while ((totalChunks & 1) == 0) {
+        cvStackLength--;
+        parentOutput(cvStack[cvStackLength], merged).chainingValue(merged);
+        totalChunks >>= 1;
+    }
+    std::copy(merged, merged + 8, cvStack[cvStackLength]);
+    cvStackLength++;
+}
+
+void Blake3Hasher::update(const void* data, size_t length) {
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+
+    while (length > 0) {
+        // The current chunk is complete and more input follows, so it is not the root
+        if (chunk.length() == blake3ChunkLength) {
+            uint32_t cv[8];
+            chunkOutput(chunk.cv, chunk.block, chunk.blockLength, chunk.chunkCounter, chunk.blocksCompressed).chainingValue(cv);
+            uint64_t totalChunks = chunk.chunkCounter + 1;
+            addChunkChainingValue(cv, totalChunks);
+            chunk.reset(totalChunks);
+        }
+
+#ifdef CS_BLAKE3_SSE2
+        // Whole chunks four at a time; keep at least one byte back so the
+        // final chunk is always finished by finalize()
+        if (chunk.length() == 0) {
+            while (length > 4 * blake3ChunkLength) {
+                uint32_t cvs[4][8];
+                hashFourChunks(input, chunk.chunkCounter, cvs);
+                for (int i = 0; i < 4; i++) {
+                    addChunkChainingValue(cvs[i], chunk.chunkCounter + i + 1);
+                }
+                chunk.reset(chunk.chunkCounter + 4);
+                input += 4 * blake3ChunkLength;
+                length -= 4 * blake3ChunkLength;
+            }
+        }
+#endif
+
+        size_t take = (std::min)(blake3ChunkLength - chunk.length(), length);
+        chunk.update(input, take);
+        input += take;
+        length -= take;
+    }
+}
+
+void Blake3Hasher::finalize(uint8_t out[blake3OutLength]) const {
+    Output output = chunkOutput(chunk.cv, chunk.block, chunk.blockLength, chunk.chunkCounter, chunk.blocksCompressed);
+
+    // Fold the pending subtrees from the right; the last parent is the root
+    for (size_t remaining = cvStackLength; remaining > 0; remaining--) {
+        uint32_t right[8];
+        output.chainingValue(right);
+        output = parentOutput(cvStack[remaining - 1], right);
+    }
+
+    rootBytes(output, out);
+}
+
+void Blake3Hasher::finalizeSubtree(uint8_t cv[blake3OutLength]) const {
+    // Same fold as finalize(), but the top node is an ordinary chaining value
+    Output output = chunkOutput(chunk.cv, chunk.block, chunk.blockLength, chunk.chunkCounter, chunk.blocksCompressed);
+    for (size_t remaining = cvStackLength; remaining > 0; remaining--) {
+        uint32_t right[8];
+        output.chainingValue(right);
+        output = parentOutput(cvStack[remaining - 1], right);
+    }
+
+    uint32_t words[8];
+    output.chainingValue(words);
+    storeWords(cv, words);
+}
+
+void blake3RootFromSubtrees(const uint8_t (*cvs)[blake3OutLength], size_t count, uint8_t out[blake3OutLength]) {
+    rootBytes(mergeSubtrees(cvs, 0, count), out);
+}
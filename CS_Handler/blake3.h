@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// BLAKE3 (unkeyed hash mode, 32-byte output).
+//
+// Whole 1 KiB chunks are compressed four at a time with SSE2 when the build
+// targets x86; other targets use the portable compression function. Both paths
+// produce identical output.
+//
+// Large inputs can be hashed as independent subtrees: split the input into
+// pieces whose size is a power-of-two number of chunks, hash piece i with a
+// hasher starting at chunk i * piece chunks, take finalizeSubtree() of each,
+// and merge them with blake3RootFromSubtrees().
+constexpr size_t blake3OutLength = 32;
+constexpr size_t blake3BlockLength = 64;
+constexpr size_t blake3ChunkLength = 1024;
+
+class Blake3Hasher {
+public:
+    // firstChunk is the chunk index where this input starts (non-zero only
+    // for subtrees of a larger input)
+    explicit Blake3Hasher(uint64_t firstChunk = 0);
+
+    void update(const void* data, size_t length);
+    void finalize(uint8_t out[blake3OutLength]) const;
+
+    // Non-root chaining value of the input seen so far, as a subtree
+    void finalizeSubtree(uint8_t cv[blake3OutLength]) const;
+
+private:
+    struct ChunkState {
+        uint32_t cv[8];
+        uint64_t chunkCounter;
+        uint8_t block[blake3BlockLength];
+        uint8_t blockLength;
+        uint8_t blocksCompressed;
+
+        void reset(uint64_t counter);
+        size_t length() const;
+        void update(const uint8_t* data, size_t length);
+    };
+
+    void addChunkChainingValue(const uint32_t cv[8], uint64_t totalChunks);
+
+    ChunkState chunk;
+    // One entry per tree level; 54 levels cover 2^64 bytes of input
+    uint32_t cvStack[54][8];
+    uint8_t cvStackLength;
+};
+
+// Root hash of an input hashed as `count` (at least two) consecutive subtrees of
+// equal power-of-two chunk size, where only the last may be shorter
+void blake3RootFromSubtrees(const uint8_t (*cvs)[blake3OutLength], size_t count, uint8_t out[blake3OutLength]);
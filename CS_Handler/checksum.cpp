@@ -1,55 +1,171 @@
 #include "pch.h"
 #include "checksum.h"
+#include "append_check.h"
+#include "binary_manifest.h"
+#include "crc_kernels.h"
+#include "duplicate_finder.h"
+#include "exclude_matcher.h"
+#include "external_diff.h"
+#include "file_hasher.h"
+#include "file_walker.h"
+#include "manifest.h"
+#include "manifest_cache.h"
+#include "manifest_diff.h"
+#include "manifest_parser.h"
+#include "manifest_writer.h"
+#include "merkle.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "sharded_manifest.h"
+#include "snapshot_store.h"
+#include "thread_pool.h"
+#include "tree_verifier.h"
+#include "tree_watcher.h"
+#include "uring_reader.h"
 #include <iostream>
 #include <fstream>
-#include <map>
+#include <functional>
 #include <iomanip>
+#include <mutex>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 extern int createChecksumFile(const std::string& path, const std::vector<std::string>& excludePatterns);
 extern bool validateChecksumFile(const std::string& currPath, const std::string& newPath);
 extern std::vector<FileChangeInfo> getChecksumFileChanges(const std::string& currPath, const std::string& newPath, bool printResults);
 
 
-// Internal C++ Function implementation
-int calculateFileChecksum(const std::filesystem::path& filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file) {
-        std::cout << "\n\033[1;33mWarning: Unable to open file for checksum: " << filePath << "\033[0m" << std::endl;
-        return -1;
-    }
+// Files queued per hashing thread between the directory walk and the writer
+constexpr size_t pipelineDepthPerThread = 64;
 
-    // CRC32 algorithm implementation
-    constexpr size_t bufferSize = 8192;  // 8KB Buffer
-    char buffer[bufferSize];
-    uint32_t crc = 0xFFFFFFFF;
+static unsigned int resolveThreadCount(unsigned int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+}
 
-    // Generate CRC32 lookup table once
-    static uint32_t crcTable[256];
-    static bool tableInitialized = false;
+// Digest, stat tuple and append check of a file from the previous manifest
+struct CachedEntry {
+    HashValue checksum;
+    FileStat stat;
+    AppendCheck check;
+};
+
+// Load the previous manifest's entries for an incremental create. Entries
+// modified at or after the time the manifest itself was written could have
+// changed again within the same timestamp tick, so they are left out and
+// always rehashed. Entries are keyed by path relative to the root; absolute
+// paths from older manifests are rebased by stripping rootPrefix.
+static void loadStatCache(const std::filesystem::path& manifestPath, const std::string& rootPrefix,
+    HashAlgorithm algorithm, std::unordered_map<std::string, CachedEntry>& cache, std::ostream& out) {
+    FileStat manifestStat;
+    if (!readFileStat(manifestPath, manifestStat)) {
+        out << "No previous checksum file, hashing every file" << std::endl;
+        return;
+    }
 
-    if (!tableInitialized) {
-        for (uint32_t i = 0; i < 256; i++) {
-            uint32_t c = i;
-            for (int j = 0; j < 8; j++) {
-                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+    PhaseTimer parseTimer(MetricPhase::Parse);
+    ManifestHeader header;
+    bool read = readManifestEntries(manifestPath, header,
+        [&](std::string_view filePath, const HashValue& checksum, const FileStat& stat, const AppendCheck& check) {
+            if (!header.hasStat || header.algorithm != algorithm || !stat.valid || stat.mtimeNs >= manifestStat.mtimeNs) {
+                return;
             }
-            crcTable[i] = c;
-        }
-        tableInitialized = true;
+            if (!header.relative) {
+                if (filePath.substr(0, rootPrefix.size()) != rootPrefix) {
+                    return;
+                }
+                filePath.remove_prefix(rootPrefix.size());
+            }
+            cache.emplace(std::string(filePath), CachedEntry{ checksum, stat, check });
+        });
+
+    if (!read) {
+        cache.clear();
+        out << "\033[1;33mWarning: Previous checksum file cannot be read, hashing every file\033[0m" << std::endl;
     }
+    else if (!header.hasStat) {
+        out << "Previous checksum file has no file stat data, hashing every file" << std::endl;
+    }
+    else if (header.algorithm != algorithm) {
+        out << "Previous checksum file uses " << hashAlgorithmName(header.algorithm) << ", hashing every file" << std::endl;
+    }
+}
 
-    while (file.read(buffer, bufferSize)) {
-        for (size_t i = 0; i < static_cast<size_t>(file.gcount()); ++i) {
-            crc = crcTable[(crc ^ buffer[i]) & 0xFF] ^ (crc >> 8);
-        }
+// Internal C++ Function implementation
+bool calculateFileHash(const std::filesystem::path& filePath, HashAlgorithm algorithm, HashValue& hash) {
+    if (!hashFileContents(filePath, algorithm, hash)) {
+        std::cout << "\n\033[1;33mWarning: Unable to open file for checksum: " << filePath << "\033[0m" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int calculateFileChecksum(const std::filesystem::path& filePath) {
+    // CRC32 using the kernel selected for this CPU (PCLMULQDQ, ARMv8 CRC or slicing-by-16)
+    HashValue hash;
+    if (!calculateFileHash(filePath, HashAlgorithm::Crc32, hash)) {
+        return -1;
     }
+    return static_cast<int>(static_cast<uint32_t>(hashToUint(hash)));
+}
+
+// Busy time of each pool worker as a share of the wall time
+static std::vector<double> threadUtilization(const RunStats& stats) {
+    std::vector<double> utilization;
+    for (double busySeconds : stats.threadBusySeconds) {
+        utilization.push_back(stats.wallSeconds > 0.0 ? (std::min)(busySeconds / stats.wallSeconds, 1.0) : 0.0);
+    }
+    return utilization;
+}
 
-    // Process remaining bytes
-    for (size_t i = 0; i < static_cast<size_t>(file.gcount()); ++i) {
-        crc = crcTable[(crc ^ buffer[i]) & 0xFF] ^ (crc >> 8);
+static double megabytesPerSecond(const RunStats& stats) {
+    return stats.wallSeconds > 0.0 ? static_cast<double>(stats.bytesRead) / stats.wallSeconds / 1e6 : 0.0;
+}
+
+std::string formatRunStatsJson(const RunStats& stats) {
+    std::ostringstream json;
+    json << std::setprecision(9);
+    json << "{\n";
+    json << "  \"operation\": \"" << stats.operation << "\",\n";
+    json << "  \"wall_seconds\": " << stats.wallSeconds << ",\n";
+    json << "  \"files\": { \"enumerated\": " << stats.filesEnumerated << ", \"hashed\": " << stats.filesHashed
+        << ", \"reused\": " << stats.filesReused << ", \"extended\": " << stats.filesExtended
+        << ", \"linked\": " << stats.filesLinked << " },\n";
+    json << "  \"bytes\": { \"enumerated\": " << stats.bytesEnumerated << ", \"read\": " << stats.bytesRead
+        << ", \"spilled\": " << stats.bytesSpilled << " },\n";
+    json << "  \"megabytes_per_second\": " << megabytesPerSecond(stats) << ",\n";
+    json << "  \"manifest\": { \"entries_parsed\": " << stats.entriesParsed << ", \"changes_found\": " << stats.changesFound << " },\n";
+    json << "  \"errors\": { \"walk\": " << stats.walkErrors << ", \"read\": " << stats.readErrors
+        << ", \"write\": " << stats.writeErrors << ", \"parse\": " << stats.parseErrors << " },\n";
+    json << "  \"phase_seconds\": { \"walk\": " << stats.walkSeconds << ", \"open\": " << stats.openSeconds
+        << ", \"read\": " << stats.readSeconds << ", \"hash\": " << stats.hashSeconds << ", \"write\": " << stats.writeSeconds
+        << ", \"parse\": " << stats.parseSeconds << ", \"diff\": " << stats.diffSeconds << " },\n";
+    json << "  \"threads\": [";
+    std::vector<double> utilization = threadUtilization(stats);
+    for (size_t i = 0; i < utilization.size(); i++) {
+        json << (i == 0 ? "\n" : ",\n") << "    { \"busy_seconds\": " << stats.threadBusySeconds[i]
+            << ", \"utilization\": " << utilization[i] << " }";
     }
+    json << (utilization.empty() ? "]\n" : "\n  ]\n");
+    json << "}\n";
+    return json.str();
+}
+
+const char* getCrc32KernelName() {
+    return crcKernelName(crc32Kernel());
+}
 
-    return ~crc; // Final XOR value
+const char* getCrc32cKernelName() {
+    return crcKernelName(crc32cKernel());
 }
 
 // C-compatible exported function implementation
@@ -57,383 +173,2260 @@ extern "C" {
     int CalculateChecksum(const char* filePath) {
         return calculateFileChecksum(std::filesystem::path(filePath));
     }
+
+    const char* GetCrc32Kernel() {
+        return getCrc32KernelName();
+    }
+
+    const char* GetCrc32cKernel() {
+        return getCrc32cKernelName();
+    }
+}
+
+
+// Command-line patterns plus the patterns of excludeFile (if any), compiled
+static bool buildExcludeMatcher(const std::vector<std::string>& excludePatterns, const std::string& excludeFile,
+    ExcludeMatcher& excludeMatcher, std::ostream& out) {
+    for (const auto& pattern : excludePatterns) {
+        excludeMatcher.addPattern(pattern);
+    }
+    if (!excludeFile.empty()) {
+        std::string error;
+        if (!excludeMatcher.loadIgnoreFile(excludeFile, error)) {
+            out << "\n\033[1;31mError: Unable to read exclude file: " << error << "\033[0m" << std::endl;
+            return false;
+        }
+    }
+    excludeMatcher.compile();
+    return true;
 }
 
+// Directories a walk could not list, one warning each as create prints them
+static void printWalkFailures(const std::vector<WalkFailure>& failures, std::ostream& out) {
+    for (const WalkFailure& failure : failures) {
+        out << "\n\033[1;33mWarning: Unable to read directory: " << failure.path << " (" << failure.message << ")\033[0m" << std::endl;
+    }
+}
 
 int createChecksumFile(const std::string& path, const std::vector<std::string>& excludePatterns) {
+    return createChecksumFile(path, excludePatterns, ChecksumOptions{});
+}
+
+// The part of a tree one create covers and the manifest it writes: the whole
+// tree into checksum.txt, or one shard of a sharded manifest
+struct CreateScope {
+    std::string root;                       // Directory walked; entry paths are relative to it
+    std::filesystem::path manifestPath;
+    size_t excludeStart = 0;                // Where exclude patterns start matching; 0 = after root
+    bool filesOnly = false;                 // Leave out subdirectories
+    HashValue rootDigest;                   // Set by a successful create
+    uint64_t entryCount = 0;
+};
+
+// Create with output going to out (a null stream when quiet); counters go to stats
+static int runCreate(CreateScope& scope, const std::vector<std::string>& excludePatterns, const ChecksumOptions& options,
+    std::ostream& out, RunStats& stats) {
+    const std::string& path = scope.root;
+
     // Validate that the path exists
     if (!std::filesystem::exists(path)) {
-        std::cout << "\n\033[1;31mError: Path does not exist: " << path << "\033[0m" << std::endl;
+        out << "\n\033[1;31mError: Path does not exist: " << path << "\033[0m" << std::endl;
         return -1;
     }
 
     // Create a Checksum File in Path
-    std::filesystem::path checksumPath = std::filesystem::path(path) / "checksum.txt";
-    std::ofstream checksumFile;
+    const std::filesystem::path& checksumPath = scope.manifestPath;
+
+    // Compile exclude patterns once; matching directories are never entered
+    ExcludeMatcher excludeMatcher;
+    if (!buildExcludeMatcher(excludePatterns, options.excludeFile, excludeMatcher, out)) {
+        return -1;
+    }
+    const std::string rootPrefix = directoryPrefix(path);
+    const size_t relativeStart = rootPrefix.size();
+    const size_t excludeStart = scope.excludeStart > 0 ? scope.excludeStart : relativeStart;
+
+    // Only CRC digests can be extended with appended bytes
+    bool appendAware = options.appendAware && supportsHashExtension(options.algorithm);
+    if (options.appendAware && !appendAware) {
+        out << "\033[1;33mWarning: " << hashAlgorithmName(options.algorithm)
+            << " digests cannot be extended, grown files are hashed in full\033[0m" << std::endl;
+    }
+
+    // Incremental mode reuses digests of files whose size, mtime and inode are
+    // unchanged, append-aware mode also extends those of files that only grew;
+    // the previous manifest has to be read before it is replaced
+    std::unordered_map<std::string, CachedEntry> statCache;
+    if (options.incremental || appendAware) {
+        loadStatCache(checksumPath, rootPrefix, options.algorithm, statCache, out);
+    }
+
+    // Entries go to a temporary file that replaces checksum.txt once complete
+    ManifestWriter checksumFile;
     try {
-        checksumFile.open(checksumPath);
-        if (!checksumFile.is_open()) {
-            std::cout << "\n\033[1;31mError: Unable to create checksum file\033[0m" << std::endl;
+        std::string error;
+        if (!checksumFile.open(checksumPath, error)) {
+            out << "\n\033[1;31mError: Unable to create checksum file: " << error << "\033[0m" << std::endl;
             return -1;
         }
     }
     catch (const std::exception& e) {
-        std::cout << "\n\033[1;31mException while creating checksum file: " << e.what() << "\033[0m" << std::endl;
+        out << "\n\033[1;31mException while creating checksum file: " << e.what() << "\033[0m" << std::endl;
         return -1;
     }
+    const std::filesystem::path tempFileName = checksumFile.temporaryPath().filename();
+
+    // Record the format version and hash algorithm on the first line. Only
+    // append checks need a v6 reader and front-coded paths a v5 one.
+    ManifestHeader header;
+    header.version = appendAware ? manifestVersion : options.frontCoding ? frontCodedManifestVersion : plainManifestVersion;
+    header.algorithm = options.algorithm;
+    header.hasStat = true;
+    header.sorted = true;
+    header.hasTree = true;
+    header.relative = true;
+    header.frontCoded = options.frontCoding;
+    header.appendCheck = appendAware;
+    checksumFile.write(formatManifestHeader(header));
+    checksumFile.write("\n");
 
     int fileCount = 0;
     int errorCount = 0;
+    int reusedCount = 0;
+    int sampledCount = 0;
+    int silentChangeCount = 0;
+    int appendedCount = 0;
+    int linkedCount = 0;
+
+    // Files with equal digests are collected for the duplicate report as they are written
+    std::unique_ptr<DuplicateReport> duplicates = options.duplicateReport.empty() ? nullptr : std::make_unique<DuplicateReport>();
 
     // Loop Through Each Folder and File in Path, Calculate Checksum & Write to File
-    std::cout << "\nCalculating checksums for files in " << path << "...\n";
+    unsigned int threadCount = resolveThreadCount(options.threadCount);
+    out << "\nCalculating " << hashAlgorithmName(options.algorithm) << " checksums for files in " << path
+        << " using " << threadCount << " thread" << (threadCount == 1 ? "" : "s") << "...\n";
+
+    // Three stages: one thread enumerates files in sorted order, a work-stealing
+    // pool hashes them (large files as several pieces), and this thread writes
+    // entries back in enumeration order. At most `window` files are in flight
+    // between the enumerator and the writer.
+    struct HashResult {
+        std::filesystem::path filePath;
+        HashValue checksum;
+        FileStat stat;
+        AppendCheck check;
+        bool hashed = false;
+        bool reused = false;            // Taken from the stat cache without reading the file
+        bool appended = false;          // Previous digest extended with the appended bytes only
+        bool sampled = false;           // Stat unchanged but rehashed by paranoid sampling
+        bool linked = false;            // Digest taken from another hard link to the same file
+        HashValue cachedChecksum;       // Previous digest of a sampled file
+        std::string walkError;
+    };
+
+    // Hard links met by the walk, keyed by (device, inode): the first path is
+    // hashed and later ones wait for its result instead of reading the file again
+    struct LinkedPath {
+        uint64_t sequence;
+        std::filesystem::path filePath;
+        FileStat stat;
+    };
+    struct LinkGroup {
+        bool done = false;
+        bool hashed = false;
+        HashValue checksum;
+        AppendCheck check;
+        std::vector<LinkedPath> waiting;
+    };
+    std::mutex linkMutex;
+    std::unordered_map<FileIdentity, LinkGroup, FileIdentityHash> linkGroups;
+    auto linkedResult = [](const LinkedPath& linked, const LinkGroup& group) {
+        HashResult result;
+        result.filePath = linked.filePath;
+        result.checksum = group.checksum;
+        result.stat = linked.stat;
+        result.check = group.check;
+        result.hashed = group.hashed;
+        result.linked = true;
+        return result;
+    };
+
+    WorkStealingPool pool(threadCount);
+    size_t window = static_cast<size_t>(threadCount) * pipelineDepthPerThread;
+
+    // Small files go through io_uring when requested and available
+    std::unique_ptr<UringFileReader> uring;
+    if (options.readStrategy == ReadStrategy::Uring) {
+        uring = UringFileReader::create(pool, options.ioQueueDepth, options.ioBufferCount);
+        if (uring) {
+            // Keep the ring full even with few hashing threads
+            unsigned int queueDepth = options.ioQueueDepth > 0 ? options.ioQueueDepth : defaultUringQueueDepth;
+            window = (std::max)(window, static_cast<size_t>(queueDepth) * 2);
+        }
+        else {
+            out << "\033[1;33mWarning: io_uring is not available, using the threaded reader\033[0m" << std::endl;
+        }
+    }
 
-    for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
-        if (entry.is_regular_file()) {
-            std::filesystem::path filePath = entry.path();
+    ReorderBuffer<HashResult> results(window);
+
+    RunMetrics* metrics = currentMetrics();
+    std::thread enumerator([&] {
+        MetricsScope walkerScope(metrics);
+        uint64_t sequence = 0;
+        std::mt19937_64 random(std::random_device{}());
+        std::uniform_real_distribution<double> sampleDistribution(0.0, 1.0);
+        try {
+            walkSortedFiles(path,
+                [&](const std::filesystem::directory_entry& entry) {
+                    const std::filesystem::path& filePath = entry.path();
+
+                    // Skip the checksum file itself and the one being written
+                    if (isChecksumOutputFile(filePath.filename()) || filePath.filename() == tempFileName) {
+                        return;
+                    }
 
-            // Skip the checksum file itself
-            if (filePath.filename() == "checksum.txt") {
-                continue;
-            }
+                    // Skip files matching exclude patterns
+                    std::string pathText = filePath.string();
+                    if (!excludeMatcher.empty() && excludeMatcher.excludes(pathText, excludeStart, false)) {
+                        return;
+                    }
 
-            // Skip files matching exclude patterns
-            bool shouldExclude = false;
-            for (const auto& pattern : excludePatterns) {
-                if (filePath.string().find(pattern) != std::string::npos) {
-                    shouldExclude = true;
-                    break;
-                }
-            }
+                    // Stat before hashing, so a change during hashing shows up next run
+                    FileStat stat;
+                    {
+                        PhaseTimer statTimer(MetricPhase::Walk);
+                        readFileStat(filePath, stat);
+                    }
 
-            if (shouldExclude) {
-                continue;
-            }
+                    results.acquire(sequence);
+                    uint64_t fileSequence = sequence++;
+
+                    const CachedEntry* cached = nullptr;
+                    const CachedEntry* grown = nullptr;
+                    if (!statCache.empty()) {
+                        auto it = statCache.find(pathText.substr((std::min)(relativeStart, pathText.size())));
+                        if (it != statCache.end() && it->second.stat == stat) {
+                            cached = &it->second;
+                        }
+                        // Same file, only longer: its previous digest may just need extending
+                        else if (it != statCache.end() && appendAware && it->second.check.valid && stat.valid &&
+                            stat.inode == it->second.stat.inode && stat.size > it->second.stat.size) {
+                            grown = &it->second;
+                        }
+                    }
 
-            int checksum = calculateFileChecksum(filePath);
-            if (checksum != -1) {
-                try {
-                    checksumFile << filePath.string() << " " << checksum << std::endl;
-                    if (checksumFile.fail()) {
-                        std::cout << "\n\033[1;33mWarning: Failed to write checksum for: " << filePath.string() << "\033[0m" << std::endl;
-                        errorCount++;
+                    bool sampled = cached != nullptr && options.paranoidSample > 0.0 &&
+                        sampleDistribution(random) < options.paranoidSample;
+                    if (cached != nullptr && !sampled) {
+                        HashResult result;
+                        result.filePath = filePath;
+                        result.checksum = cached->checksum;
+                        result.stat = stat;
+                        result.check = cached->check;
+                        result.hashed = true;
+                        result.reused = true;
+                        results.put(fileSequence, std::move(result));
+                        return;
                     }
-                    else {
-                        fileCount++;
-                        // Show progress every 10 files
-                        if (fileCount % 10 == 0) {
-                            std::cout << "." << std::flush;
+
+                    // Only the first of several hard links to a file is read
+                    bool linkLeader = false;
+                    if (grown == nullptr && !sampled && stat.valid && stat.linkCount > 1) {
+                        std::lock_guard<std::mutex> lock(linkMutex);
+                        auto [it, inserted] = linkGroups.try_emplace(fileIdentity(stat));
+                        if (!inserted) {
+                            LinkedPath linked{ fileSequence, filePath, stat };
+                            if (it->second.done) {
+                                results.put(fileSequence, linkedResult(linked, it->second));
+                            }
+                            else {
+                                it->second.waiting.push_back(std::move(linked));
+                            }
+                            return;
                         }
+                        linkLeader = true;
                     }
-                }
-                catch (const std::exception& e) {
-                    std::cout << "\n\033[1;33mException while writing checksum: " << e.what() << "\033[0m" << std::endl;
-                    errorCount++;
-                }
+
+                    HashValue cachedChecksum = sampled ? cached->checksum : HashValue{};
+                    auto onHashed = [&results, &options, &linkMutex, &linkGroups, linkedResult, appendAware, fileSequence, filePath, stat,
+                        sampled, cachedChecksum, linkLeader](bool hashed, const HashValue& checksum) {
+                        HashResult result;
+                        result.filePath = filePath;
+                        result.checksum = checksum;
+                        result.stat = stat;
+                        result.hashed = hashed;
+                        result.sampled = sampled;
+                        result.cachedChecksum = cachedChecksum;
+                        if (hashed && appendAware) {
+                            result.check = readAppendCheck(filePath, stat, options.readStrategy);
+                        }
+                        if (linkLeader) {
+                            std::lock_guard<std::mutex> lock(linkMutex);
+                            LinkGroup& group = linkGroups[fileIdentity(stat)];
+                            group.done = true;
+                            group.hashed = hashed;
+                            group.checksum = checksum;
+                            group.check = result.check;
+                            for (const LinkedPath& linked : group.waiting) {
+                                results.put(linked.sequence, linkedResult(linked, group));
+                            }
+                            group.waiting.clear();
+                        }
+                        results.put(fileSequence, std::move(result));
+                    };
+
+                    // Hash only the appended bytes; a rewritten file falls back to a full hash
+                    if (grown != nullptr) {
+                        pool.submit([&pool, &results, &options, fileSequence, filePath, stat, previous = *grown,
+                            onHashed = std::move(onHashed)]() mutable {
+                            HashResult result;
+                            try {
+                                result.appended = extendFileHash(filePath, options.algorithm, previous.checksum, previous.stat.size,
+                                    previous.check, stat.size, result.checksum, result.check, options.readStrategy);
+                            }
+                            catch (const std::exception&) {
+                                result.appended = false;
+                            }
+                            if (!result.appended) {
+                                scheduleFileHash(pool, filePath, stat.size, options.algorithm, options.readStrategy, std::move(onHashed));
+                                return;
+                            }
+                            result.filePath = filePath;
+                            result.stat = stat;
+                            result.hashed = true;
+                            results.put(fileSequence, std::move(result));
+                        });
+                        return;
+                    }
+
+                    // Size only decides how the file is read and split; 0 if unknown
+                    uint64_t fileSize = stat.valid ? stat.size : 0;
+                    if (uring && fileSize < uringMaxFileSize) {
+                        uring->submit(filePath, fileSize, options.algorithm, std::move(onHashed));
+                    }
+                    else {
+                        scheduleFileHash(pool, filePath, fileSize, options.algorithm, options.readStrategy, std::move(onHashed));
+                    }
+                },
+                [&](const std::filesystem::path& failedPath, const std::error_code& error) {
+                    HashResult result;
+                    result.filePath = failedPath;
+                    result.walkError = error.message();
+                    results.acquire(sequence);
+                    results.put(sequence++, std::move(result));
+                },
+                [&](const std::filesystem::path& directory) {
+                    if (scope.filesOnly || isChecksumOutputDirectory(directory.filename())) {
+                        return false;
+                    }
+                    return excludeMatcher.empty() || !excludeMatcher.excludes(directory.string(), excludeStart, true);
+                });
+        }
+        catch (const std::exception& e) {
+            HashResult result;
+            result.filePath = path;
+            result.walkError = e.what();
+            results.put(sequence++, std::move(result));
+        }
+        results.finish(sequence);
+    });
+
+    // Each directory's digest line follows its last entry; the root's is the last line
+    DirectoryDigestBuilder directoryDigests("", [&](std::string_view directory, const HashValue& digest) {
+        checksumFile.write(formatManifestDirectory(directory, digest));
+        checksumFile.write("\n");
+    });
+
+    // Paths are stored relative to the root, optionally front-coded against the previous entry
+    std::string line;
+    std::string previousPath;
+
+    HashResult result;
+    while (results.next(result)) {
+        const std::filesystem::path& filePath = result.filePath;
+
+        if (!result.walkError.empty()) {
+            out << "\n\033[1;33mWarning: Unable to read directory: " << filePath << " (" << result.walkError << ")\033[0m" << std::endl;
+            errorCount++;
+            stats.walkErrors++;
+            continue;
+        }
+
+        stats.filesEnumerated++;
+        stats.bytesEnumerated += result.stat.valid ? result.stat.size : 0;
+        if (!result.hashed) {
+            out << "\n\033[1;33mWarning: Unable to open file for checksum: " << filePath << "\033[0m" << std::endl;
+            errorCount++;
+            stats.readErrors++;
+            continue;
+        }
+
+        if (result.reused) {
+            reusedCount++;
+        }
+        if (result.appended) {
+            appendedCount++;
+        }
+        if (result.linked) {
+            linkedCount++;
+        }
+        if (result.sampled) {
+            sampledCount++;
+            if (result.checksum != result.cachedChecksum) {
+                out << "\n\033[1;33mWarning: Contents changed without a size, mtime or inode change: " << filePath << "\033[0m" << std::endl;
+                silentChangeCount++;
             }
-            else {
+        }
+
+        try {
+            std::string pathText = filePath.string();
+            std::string_view relativePath = std::string_view(pathText).substr((std::min)(relativeStart, pathText.size()));
+            directoryDigests.addFile(relativePath, result.checksum);
+
+            line.clear();
+            appendManifestEntry(line, options.frontCoding ? formatFrontCodedPath(relativePath, previousPath) : std::string(relativePath),
+                result.checksum, result.stat, appendAware ? &result.check : nullptr);
+            checksumFile.write(line);
+            if (options.frontCoding) {
+                previousPath.assign(relativePath);
+            }
+            if (duplicates) {
+                duplicates->add(relativePath, result.stat, result.checksum);
+            }
+
+            if (checksumFile.failed()) {
+                out << "\n\033[1;33mWarning: Failed to write checksum for: " << pathText << "\033[0m" << std::endl;
                 errorCount++;
+                stats.writeErrors++;
+            }
+            else {
+                fileCount++;
+                // Show progress every 10 files
+                if (!options.quiet && fileCount % 10 == 0) {
+                    out << "." << std::flush;
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            out << "\n\033[1;33mException while writing checksum: " << e.what() << "\033[0m" << std::endl;
+            errorCount++;
+            stats.writeErrors++;
+        }
+    }
+
+    enumerator.join();
+    if (uring) {
+        uring->finish();
+    }
+    pool.shutdown();
+
+    stats.filesReused = static_cast<uint64_t>(reusedCount);
+    stats.filesExtended = static_cast<uint64_t>(appendedCount);
+    stats.filesLinked = static_cast<uint64_t>(linkedCount);
+    stats.filesHashed = static_cast<uint64_t>(fileCount - reusedCount - appendedCount - linkedCount);
+
+    HashValue rootDigest = directoryDigests.finish();
+    scope.rootDigest = rootDigest;
+    scope.entryCount = static_cast<uint64_t>(fileCount);
+    // A cached mapping of the previous manifest would keep Windows from replacing it
+    evictCachedManifest(checksumPath);
+    std::string writeError;
+    if (!checksumFile.commit(writeError)) {
+        out << "\n\033[1;31mError: Unable to write checksum file: " << writeError << "\033[0m" << std::endl;
+        return -1;
+    }
+
+    // Print Success
+    out << "\n\033[1;32mChecksum File Created: " << checksumPath << "\033[0m" << std::endl;
+    out << "\033[1;32mProcessed " << fileCount << " files";
+    if (errorCount > 0) {
+        out << " (" << errorCount << " files could not be read)";
+    }
+    out << "\033[0m" << std::endl;
+    out << "Root digest: " << formatManifestHash(rootDigest) << std::endl;
+    if (options.incremental || appendAware) {
+        out << "Reused " << reusedCount << " unchanged entries, hashed " << (fileCount - reusedCount - appendedCount - linkedCount) << " files";
+        if (sampledCount > 0) {
+            out << " (" << sampledCount << " unchanged files rehashed as a sample, "
+                << silentChangeCount << " differed)";
+        }
+        out << std::endl;
+    }
+    if (appendAware) {
+        out << "Extended " << appendedCount << " grown files by hashing only their appended bytes" << std::endl;
+    }
+    if (linkedCount > 0) {
+        out << "Hashed " << linkedCount << " hard links once with the files they link to" << std::endl;
+    }
+
+    // The report comes from the digests just written; nothing is read again
+    if (duplicates) {
+        duplicates->finish();
+        std::string reportError;
+        if (!duplicates->write(options.duplicateReport, options.algorithm, reportError)) {
+            out << "\033[1;33mWarning: Unable to write duplicate report: " << reportError << "\033[0m" << std::endl;
+            stats.writeErrors++;
+        }
+        else {
+            out << "Duplicate report: " << duplicates->groupCount() << " groups, " << duplicates->duplicateCount()
+                << " redundant copies (" << duplicates->wastedBytes() << " bytes) in " << options.duplicateReport << std::endl;
+            if (hashSize(options.algorithm) <= 4) {
+                out << "\033[1;33mWarning: " << hashAlgorithmName(options.algorithm)
+                    << " digests can collide in large trees; use xxh3-128 or blake3 for a reliable duplicate report\033[0m" << std::endl;
+            }
+        }
+    }
+
+    // Return Success
+    return 200;
+}
+
+// Shard holding a path given to a targeted update: its top-level directory,
+// or the root shard for a file at the top of the tree
+static std::string shardOfPath(const std::string& updatePath, const std::string& root) {
+    std::string relative = updatePath;
+    const std::string rootPrefix = directoryPrefix(root);
+    if (relative.substr(0, rootPrefix.size()) == rootPrefix) {
+        relative.erase(0, rootPrefix.size());
+    }
+    size_t separator = relative.find_first_of("/\\");
+    std::string top = relative.substr(0, separator);
+    if (separator == std::string::npos && !std::filesystem::is_directory(std::filesystem::path(root) / top)) {
+        return std::string(rootShardName);
+    }
+    return top;
+}
+
+// Sharded create: one manifest per top-level directory plus one for the files
+// beside them, built on separate threads, then checksum.idx. With shardUpdates
+// only the shards holding those paths are rebuilt and the rest are kept.
+static int runShardedCreate(const std::string& path, const std::vector<std::string>& excludePatterns, const ChecksumOptions& options,
+    std::ostream& out, RunStats& stats) {
+    if (!std::filesystem::is_directory(path)) {
+        out << "\n\033[1;31mError: Directory does not exist: " << path << "\033[0m" << std::endl;
+        return -1;
+    }
+    ExcludeMatcher excludeMatcher;
+    if (!buildExcludeMatcher(excludePatterns, options.excludeFile, excludeMatcher, out)) {
+        return -1;
+    }
+    if (!options.duplicateReport.empty()) {
+        out << "\033[1;33mWarning: The duplicate report is not written for sharded checksum files\033[0m" << std::endl;
+    }
+
+    const std::filesystem::path root(path);
+    const std::filesystem::path indexPath = root / shardIndexFileName;
+    const std::filesystem::path shardDirectory = root / shardDirectoryName;
+    const size_t relativeStart = directoryPrefix(path).size();
+
+    // Top-level directories become shards; the files beside them form the root shard
+    std::vector<std::string> subtrees{ std::string(rootShardName) };
+    std::error_code listError;
+    for (const auto& entry : std::filesystem::directory_iterator(root, listError)) {
+        std::error_code typeError;
+        if (!entry.is_directory(typeError) || entry.is_symlink(typeError) || entry.path().filename() == shardDirectoryName) {
+            continue;
+        }
+        if (!excludeMatcher.empty() && excludeMatcher.excludes(entry.path().string(), relativeStart, true)) {
+            continue;
+        }
+        subtrees.push_back(entry.path().filename().string());
+    }
+    if (listError) {
+        out << "\n\033[1;31mError: Unable to list " << path << ": " << listError.message() << "\033[0m" << std::endl;
+        return -1;
+    }
+    std::sort(subtrees.begin(), subtrees.end());
+
+    // A targeted update keeps every shard of the previous index it does not touch
+    ShardIndex previous;
+    std::string previousError;
+    bool hasPrevious = readShardIndex(indexPath, previous, previousError) && previous.algorithm == options.algorithm;
+    ShardIndex index;
+    index.algorithm = options.algorithm;
+    std::vector<std::string> rebuild = subtrees;
+    if (!options.shardUpdates.empty() && !hasPrevious) {
+        out << "\033[1;33mWarning: No checksum index with " << hashAlgorithmName(options.algorithm)
+            << " digests to update, creating every shard\033[0m" << std::endl;
+    }
+    else if (!options.shardUpdates.empty()) {
+        std::vector<std::string> affected;
+        for (const auto& updatePath : options.shardUpdates) {
+            affected.push_back(shardOfPath(updatePath, path));
+        }
+        auto isAffected = [&](const std::string& subtree) {
+            return std::find(affected.begin(), affected.end(), subtree) != affected.end();
+        };
+        rebuild.clear();
+        for (const auto& subtree : subtrees) {
+            if (isAffected(subtree)) {
+                rebuild.push_back(subtree);
+            }
+        }
+        for (auto& shard : previous.shards) {
+            if (!isAffected(shard.subtree)) {
+                index.shards.push_back(std::move(shard));
+            }
+        }
+    }
+
+    // Largest shards first, by their previous size, so one big subtree does not finish last
+    if (hasPrevious) {
+        auto previousSize = [&](const std::string& subtree) {
+            auto it = std::find_if(previous.shards.begin(), previous.shards.end(),
+                [&](const ShardInfo& shard) { return shard.subtree == subtree; });
+            return it != previous.shards.end() ? it->entryCount : 0;
+        };
+        std::stable_sort(rebuild.begin(), rebuild.end(),
+            [&](const std::string& a, const std::string& b) { return previousSize(a) > previousSize(b); });
+    }
+
+    std::error_code directoryError;
+    std::filesystem::create_directories(shardDirectory, directoryError);
+    if (directoryError) {
+        out << "\n\033[1;31mError: Unable to create " << shardDirectory << ": " << directoryError.message() << "\033[0m" << std::endl;
+        return -1;
+    }
+
+    unsigned int threadCount = resolveThreadCount(options.threadCount);
+    unsigned int shardThreads = (std::max)(1u, (std::min)(threadCount, static_cast<unsigned int>(rebuild.size())));
+    out << "\nCalculating " << hashAlgorithmName(options.algorithm) << " checksums for " << rebuild.size() << " of "
+        << subtrees.size() << " shards in " << path << " using " << threadCount << " thread" << (threadCount == 1 ? "" : "s") << "..." << std::endl;
+
+    // Each shard is an ordinary create of its subtree; its output is kept and
+    // only shown when something went wrong
+    ChecksumOptions shardOptions = options;
+    shardOptions.threadCount = (std::max)(1u, threadCount / shardThreads);
+    shardOptions.quiet = true;
+    shardOptions.stats = nullptr;
+    shardOptions.duplicateReport.clear();
+    shardOptions.sharded = false;
+    shardOptions.shardUpdates.clear();
+
+    struct ShardBuild {
+        CreateScope scope;
+        RunStats stats;
+        std::ostringstream log;
+        int result = 0;
+    };
+    std::vector<ShardBuild> builds(rebuild.size());
+    std::atomic<size_t> nextShard{ 0 };
+    RunMetrics* metrics = currentMetrics();
+    auto buildShards = [&] {
+        MetricsScope scope(metrics);
+        for (size_t i = nextShard++; i < builds.size(); i = nextShard++) {
+            ShardBuild& build = builds[i];
+            bool rootShard = rebuild[i] == rootShardName;
+            build.scope.root = rootShard ? path : (root / rebuild[i]).string();
+            build.scope.manifestPath = shardDirectory / shardFileName(rebuild[i]);
+            build.scope.excludeStart = relativeStart;
+            build.scope.filesOnly = rootShard;
+            build.result = runCreate(build.scope, excludePatterns, shardOptions, build.log, build.stats);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < shardThreads; i++) {
+        workers.emplace_back(buildShards);
+    }
+    buildShards();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    int failedShards = 0;
+    uint64_t fileCount = 0;
+    for (size_t i = 0; i < builds.size(); i++) {
+        ShardBuild& build = builds[i];
+        stats.filesEnumerated += build.stats.filesEnumerated;
+        stats.bytesEnumerated += build.stats.bytesEnumerated;
+        stats.filesHashed += build.stats.filesHashed;
+        stats.filesReused += build.stats.filesReused;
+        stats.filesExtended += build.stats.filesExtended;
+        stats.filesLinked += build.stats.filesLinked;
+        stats.walkErrors += build.stats.walkErrors;
+        stats.readErrors += build.stats.readErrors;
+        stats.writeErrors += build.stats.writeErrors;
+
+        if (build.result != 200 || build.stats.walkErrors + build.stats.readErrors + build.stats.writeErrors > 0) {
+            out << "\n\033[1;36mShard " << rebuild[i] << ":\033[0m" << build.log.str();
+        }
+        if (build.result != 200) {
+            failedShards++;
+            continue;
+        }
+
+        // Subtrees without files have no shard, as they have no directory digest
+        if (build.scope.entryCount == 0) {
+            std::error_code removeError;
+            std::filesystem::remove(build.scope.manifestPath, removeError);
+            continue;
+        }
+        fileCount += build.scope.entryCount;
+        index.shards.push_back({ rebuild[i], shardFileName(rebuild[i]), build.scope.entryCount, build.scope.rootDigest });
+    }
+    if (failedShards > 0) {
+        out << "\n\033[1;31mError: " << failedShards << " shards could not be written; " << indexPath << " was left unchanged\033[0m" << std::endl;
+        return -1;
+    }
+
+    // The index is replaced last, once every shard it lists is on disk
+    std::string indexError;
+    if (!computeShardedRootDigest(shardDirectory, index, indexError) || !writeShardIndex(indexPath, index, indexError)) {
+        out << "\n\033[1;31mError: Unable to write checksum index: " << indexError << "\033[0m" << std::endl;
+        stats.writeErrors++;
+        return -1;
+    }
+
+    // Drop shards of subtrees that are gone
+    std::vector<std::filesystem::path> staleShards;
+    for (const auto& entry : std::filesystem::directory_iterator(shardDirectory, listError)) {
+        std::string name = entry.path().filename().string();
+        bool listed = std::any_of(index.shards.begin(), index.shards.end(), [&](const ShardInfo& shard) { return shard.fileName == name; });
+        if (!listed && entry.path().extension() == ".txt") {
+            staleShards.push_back(entry.path());
+        }
+    }
+    for (const auto& stalePath : staleShards) {
+        std::error_code removeError;
+        std::filesystem::remove(stalePath, removeError);
+    }
+
+    out << "\n\033[1;32mSharded Checksum File Created: " << indexPath << "\033[0m" << std::endl;
+    out << "\033[1;32mProcessed " << fileCount << " files in " << rebuild.size() << " rebuilt shards";
+    if (stats.readErrors > 0) {
+        out << " (" << stats.readErrors << " files could not be read)";
+    }
+    out << "\033[0m" << std::endl;
+    out << "Shards: " << index.shards.size() << " (" << index.shards.size() - (std::min)(index.shards.size(), rebuild.size())
+        << " kept unchanged)" << std::endl;
+    out << "Root digest: " << formatManifestHash(index.rootDigest) << std::endl;
+    return 200;
+}
+
+static int runAddSnapshot(const std::string& storePath, const std::string& manifestPath, const HistoryOptions& options,
+    std::ostream& out, RunStats& stats);
+
+// Create (sharded or not) and record the result in the history store, with
+// output going to out; counters go to stats
+static int runCreateCommand(const std::string& path, const std::vector<std::string>& excludePatterns, const ChecksumOptions& options,
+    std::ostream& out, RunStats& stats) {
+    int result = 0;
+    if (options.sharded || !options.shardUpdates.empty()) {
+        result = runShardedCreate(path, excludePatterns, options, out, stats);
+    }
+    else {
+        CreateScope scope;
+        scope.root = path;
+        scope.manifestPath = std::filesystem::path(path) / "checksum.txt";
+        result = runCreate(scope, excludePatterns, options, out, stats);
+    }
+
+    // The new checksum file also becomes the history store's latest snapshot
+    if (result == 200 && !options.historyStore.empty()) {
+        bool sharded = options.sharded || !options.shardUpdates.empty();
+        std::string manifestPath = (std::filesystem::path(path) / (sharded ? shardIndexFileName : "checksum.txt")).string();
+        RunStats historyStats;
+        if (runAddSnapshot(options.historyStore, manifestPath, HistoryOptions{}, out, historyStats) < 0) {
+            out << "\033[1;33mWarning: The checksum file was not recorded in " << options.historyStore << "\033[0m" << std::endl;
+            stats.writeErrors++;
+        }
+    }
+    return result;
+}
+
+int createChecksumFile(const std::string& path, const std::vector<std::string>& excludePatterns, const ChecksumOptions& options) {
+    // Phases are only timed when the caller asked for stats
+    std::unique_ptr<RunMetrics> metrics = options.stats != nullptr ? std::make_unique<RunMetrics>() : nullptr;
+    MetricsScope scope(metrics.get());
+    std::ostream out(options.quiet ? nullptr : std::cout.rdbuf());
+
+    RunStats stats;
+    stats.operation = "create";
+    int result = runCreateCommand(path, excludePatterns, options, out, stats);
+    if (metrics) {
+        metrics->collect(stats);
+        *options.stats = std::move(stats);
+    }
+    return result;
+}
+
+// Set from signal handlers, so only lock-free atomics are touched
+static std::atomic<bool> watchStopRequested{ false };
+static std::atomic<bool> watchReportRequested{ false };
+
+// Watch with output going to out (a null stream when quiet); counters of the
+// catch-up create and of every batch go to stats
+static int runWatch(const std::string& path, const std::vector<std::string>& excludePatterns, const ChecksumOptions& options,
+    const WatchOptions& watchOptions, std::ostream& out, RunStats& stats) {
+    ExcludeMatcher excludeMatcher;
+    if (!buildExcludeMatcher(excludePatterns, options.excludeFile, excludeMatcher, out)) {
+        return -1;
+    }
+
+    // Start from an up-to-date manifest; files unchanged since the last one keep their digests
+    watchStopRequested.store(false);
+    ChecksumOptions createOptions = options;
+    createOptions.incremental = true;
+    createOptions.sharded = false;      // The watcher keeps a single checksum.txt
+    createOptions.shardUpdates.clear();
+    int result = runCreateCommand(path, excludePatterns, createOptions, out, stats);
+    if (result != 200) {
+        return result;
+    }
+
+    try {
+        TreeWatcher watcher(path, excludeMatcher, options, watchOptions, out, stats);
+        std::string error;
+        if (!watcher.start(std::filesystem::path(path) / "checksum.txt", error)) {
+            out << "\n\033[1;31mError: Unable to start watching: " << error << "\033[0m" << std::endl;
+            return -1;
+        }
+        watcher.run(watchStopRequested, watchReportRequested);
+    }
+    catch (const std::exception& e) {
+        out << "\n\033[1;31mException while watching " << path << ": " << e.what() << "\033[0m" << std::endl;
+        return -1;
+    }
+    return 200;
+}
+
+int watchChecksumFile(const std::string& path, const std::vector<std::string>& excludePatterns,
+    const ChecksumOptions& options, const WatchOptions& watchOptions) {
+    std::unique_ptr<RunMetrics> metrics = options.stats != nullptr ? std::make_unique<RunMetrics>() : nullptr;
+    MetricsScope scope(metrics.get());
+    std::ostream out(options.quiet ? nullptr : std::cout.rdbuf());
+
+    RunStats stats;
+    stats.operation = "watch";
+    int result = runWatch(path, excludePatterns, options, watchOptions, out, stats);
+    if (metrics) {
+        metrics->collect(stats);
+        *options.stats = std::move(stats);
+    }
+    return result;
+}
+
+void stopWatching() {
+    watchStopRequested.store(true);
+}
+
+void requestWatchReport() {
+    watchReportRequested.store(true);
+}
+
+// Report the lines of a checksum file that could not be used; returns their count
+static int reportLineErrors(const ParsedManifest& manifest, const char* label, std::ostream& out) {
+    for (const auto& lineError : manifest.errors()) {
+        if (lineError.badHash) {
+            out << "\n\033[1;31mError parsing checksum in " << label << " file (line " << lineError.line
+                << "): " << lineError.text << "\033[0m" << std::endl;
+        }
+        else {
+            out << "\n\033[1;33mWarning: Malformed line in " << label << " checksum file (line "
+                << lineError.line << "): " << lineError.text << "\033[0m" << std::endl;
+        }
+    }
+    return static_cast<int>(manifest.errors().size());
+}
+
+// Entries of a manifest without relative=1 with its root (see
+// absoluteManifestPrefix) stripped from the paths under it
+static std::vector<ManifestDiffEntry> rebaseAbsoluteEntries(const ParsedManifest& manifest, const std::filesystem::path& manifestPath) {
+    const std::string rootPrefix = manifest.hasRootDirectory() ? directoryPrefix(std::string(manifest.rootDirectory())) :
+        absoluteManifestPrefix(manifestPath);
+    std::vector<ManifestDiffEntry> entries = manifest.entries();
+    for (ManifestDiffEntry& entry : entries) {
+        if (entry.path.substr(0, rootPrefix.size()) == rootPrefix) {
+            entry.path.remove_prefix(rootPrefix.size());
+        }
+    }
+    return entries;
+}
+
+// Diff two loaded manifests with the cheapest method both support, handing each
+// change to onChange in path order. Sorted manifests are streamed as they are
+// merged; unsorted ones are collected and sorted first. When only one of them
+// is relative, the other's absolute paths are rebased onto its root first.
+// Returns false (with error set) when they cannot be compared. With log set,
+// warnings and the number of entries skipped by the tree diff are printed to it.
+static bool diffLoadedManifests(const ParsedManifest& currManifest, const std::filesystem::path& currPath,
+    const ParsedManifest& newManifest, const std::filesystem::path& newPath, std::ostream* log,
+    const ManifestChangeSink& onChange, std::string& error) {
+    PhaseTimer diffTimer(MetricPhase::Diff);
+    const ManifestHeader& currHeader = currManifest.header();
+    const ManifestHeader& newHeader = newManifest.header();
+
+    // Digests from different algorithms can never match, so refuse to compare them
+    if (currHeader.algorithm != newHeader.algorithm) {
+        error = std::string("Checksum files use different algorithms (current: ") + hashAlgorithmName(currHeader.algorithm) +
+            ", new: " + hashAlgorithmName(newHeader.algorithm) + "). Recreate one of them with the same algorithm.";
+        return false;
+    }
+
+    // Manifests written before relative=1 hold absolute paths
+    std::vector<ManifestDiffEntry> rebasedFiles;
+    bool rebased = currHeader.relative != newHeader.relative;
+    if (rebased) {
+        rebasedFiles = currHeader.relative ? rebaseAbsoluteEntries(newManifest, newPath) : rebaseAbsoluteEntries(currManifest, currPath);
+    }
+    const std::vector<ManifestDiffEntry>& currFiles = rebased && !currHeader.relative ? rebasedFiles : currManifest.entries();
+    const std::vector<ManifestDiffEntry>& newFiles = rebased && !newHeader.relative ? rebasedFiles : newManifest.entries();
+
+    // Manifests written by create are sorted; the flag is checked rather than trusted
+    auto byPath = [](const ManifestDiffEntry& a, const ManifestDiffEntry& b) { return a.path < b.path; };
+    bool currSorted = rebased && !currHeader.relative ? std::is_sorted(currFiles.begin(), currFiles.end(), byPath) : currManifest.isSorted();
+    bool newSorted = rebased && !newHeader.relative ? std::is_sorted(newFiles.begin(), newFiles.end(), byPath) : newManifest.isSorted();
+    if (log != nullptr && currHeader.sorted && !currManifest.isSorted()) {
+        *log << "\033[1;33mWarning: Current checksum file is marked sorted but is not\033[0m" << std::endl;
+    }
+    if (log != nullptr && newHeader.sorted && !newManifest.isSorted()) {
+        *log << "\033[1;33mWarning: New checksum file is marked sorted but is not\033[0m" << std::endl;
+    }
+
+    // With Merkle digests on both sides only differing subtrees are visited
+    if (!rebased && currSorted && newSorted && currHeader.hasTree && newHeader.hasTree &&
+        currManifest.hasRootDirectory() && newManifest.hasRootDirectory() &&
+        currManifest.rootDirectory() == newManifest.rootDirectory()) {
+        size_t skippedCount = diffManifestTrees(currFiles, currManifest.directories(), newFiles, newManifest.directories(),
+            currManifest.rootDirectory(), onChange);
+        if (log != nullptr) {
+            *log << "Unchanged subtrees skipped: " << skippedCount << " of " << currFiles.size() << " entries" << std::endl;
+        }
+    }
+    else if (currSorted && newSorted) {
+        mergeSortedManifests(currFiles, newFiles, onChange);
+    }
+    else {
+        std::vector<ManifestChange> changes;
+        hashJoinManifests(currFiles, newFiles, changes);
+        for (const ManifestChange& change : changes) {
+            if (!onChange(change)) {
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// Sink that appends to a change list
+static ManifestChangeSink collectChanges(std::vector<ManifestChange>& changes) {
+    return [&changes](const ManifestChange& change) {
+        changes.push_back(change);
+        return true;
+    };
+}
+
+// Previous and new state of the files behind Changed entries, read with their
+// stat and append check columns; entries not found keep an invalid stat
+static void readChangedEntries(const std::filesystem::path& manifestPath,
+    const std::unordered_map<std::string_view, size_t>& changedIndex, std::vector<CachedEntry>& entries) {
+    ManifestHeader header;
+    readManifestEntries(manifestPath, header,
+        [&](std::string_view filePath, const HashValue& checksum, const FileStat& stat, const AppendCheck& check) {
+            auto it = changedIndex.find(filePath);
+            if (it != changedIndex.end()) {
+                entries[it->second] = CachedEntry{ checksum, stat, check };
             }
+        });
+}
+
+// Turn Changed entries into Appended ones where the file only grew: the file
+// under root (for relative paths) must still hold the current entry's bytes
+// (by its append check), and extending the current digest with the bytes up
+// to the new entry's size must give the new digest. Needs an append=1 current
+// manifest and a text new manifest with stat columns. Returns the count;
+// unreadable counts grown files that are missing, shorter than the new entry
+// or could not be read, which stay Changed.
+static size_t markAppendedChanges(const std::filesystem::path& currChecksumPath, const std::filesystem::path& newChecksumPath,
+    const ParsedManifest& newManifest, const std::filesystem::path& root, std::vector<ManifestChange>& changes, size_t& unreadable) {
+    unreadable = 0;
+    std::unordered_map<std::string_view, size_t> changedIndex;
+    for (size_t i = 0; i < changes.size(); i++) {
+        if (changes[i].kind == ChangeKind::Changed) {
+            changedIndex.emplace(changes[i].path, i);
+        }
+    }
+    if (changedIndex.empty()) {
+        return 0;
+    }
+
+    std::vector<CachedEntry> currEntries(changes.size());
+    std::vector<CachedEntry> newEntries(changes.size());
+    readChangedEntries(currChecksumPath, changedIndex, currEntries);
+    readChangedEntries(newChecksumPath, changedIndex, newEntries);
+
+    HashAlgorithm algorithm = newManifest.header().algorithm;
+    bool relative = newManifest.header().relative;
+
+    // Only the appended bytes of each candidate are read, on the hashing pool
+    enum : char { NotAppended, Appended, Unreadable };
+    std::vector<char> outcomes(changes.size(), NotAppended);
+    WorkStealingPool pool(resolveThreadCount(0));
+    for (const auto& [path, index] : changedIndex) {
+        const CachedEntry& currEntry = currEntries[index];
+        const CachedEntry& newEntry = newEntries[index];
+        if (!currEntry.stat.valid || !currEntry.check.valid || !newEntry.stat.valid || newEntry.stat.size <= currEntry.stat.size) {
+            continue;
         }
+        std::filesystem::path filePath = relative ? root / std::filesystem::path(path) : std::filesystem::path(path);
+        pool.submit([&, filePath, index] {
+            const CachedEntry& previous = currEntries[index];
+            FileStat stat;
+            if (!readFileStat(filePath, stat) || !stat.valid || stat.size < newEntries[index].stat.size) {
+                outcomes[index] = Unreadable;
+                return;
+            }
+            HashValue checksum;
+            AppendCheck check;
+            try {
+                bool extended = extendFileHash(filePath, algorithm, previous.checksum, previous.stat.size, previous.check,
+                    newEntries[index].stat.size, checksum, check);
+                outcomes[index] = extended && checksum == newEntries[index].checksum ? Appended : NotAppended;
+            }
+            catch (const std::exception&) {
+                outcomes[index] = Unreadable;
+            }
+        });
     }
+    pool.shutdown();
 
-    checksumFile.close();
+    size_t appendedCount = 0;
+    for (size_t i = 0; i < changes.size(); i++) {
+        if (outcomes[i] == Appended) {
+            changes[i].kind = ChangeKind::Appended;
+            appendedCount++;
+        }
+        unreadable += outcomes[i] == Unreadable;
+    }
+    return appendedCount;
+}
+
+// Number of changes of each kind
+struct ChangeCounts {
+    int added = 0;
+    int deleted = 0;
+    int changed = 0;
+    int appended = 0;
+
+    void add(ChangeKind kind) {
+        added += kind == ChangeKind::Added;
+        deleted += kind == ChangeKind::Deleted;
+        changed += kind == ChangeKind::Changed;
+        appended += kind == ChangeKind::Appended;
+    }
+    size_t total() const { return static_cast<size_t>(added) + deleted + changed + appended; }
+};
+
+// Closing lines of a change report: the counts and the change percentage of
+// totalFiles, the larger side's file count
+static void printChangeSummary(const ChangeCounts& counts, bool showAppended, size_t totalFiles, std::ostream& out) {
+    out << "-------------------------" << std::endl;
+    out << "Summary: " << counts.added << " added, " << counts.deleted << " deleted, " << counts.changed << " changed";
+    if (showAppended) {
+        out << ", " << counts.appended << " appended";
+    }
+    out << std::endl;
+
+    // Calculate change ratio for context
+    double changeRatio = static_cast<double>(counts.total()) / (totalFiles > 0 ? totalFiles : 1) * 100.0;
+
+    out << "Change percentage: " << std::fixed << std::setprecision(2)
+        << changeRatio << "% of files affected" << std::endl;
+    out.flush();
+}
+
+// Print a non-empty change list: every path (grouped by kind past 20 changes)
+// or, without listChanges, only the summary. totalFiles is the larger side's
+// file count, for the change percentage.
+static void printChangeList(const std::vector<ManifestChange>& changedFiles, bool listChanges, bool showAppended,
+    size_t totalFiles, std::ostream& out) {
+    out << "\n\033[1;33mChanges Detected:\033[0m" << std::endl;
+    out << "-------------------------" << std::endl;
+
+    ChangeCounts counts;
+    for (const auto& change : changedFiles) {
+        counts.add(change.kind);
+    }
+
+    // Use categorized output for better readability when there are many changes
+    if (listChanges && changedFiles.size() > 20) {
+        // Group changes by type for easier reading
+        std::vector<std::string_view> addedFiles;
+        std::vector<std::string_view> deletedFiles;
+        std::vector<std::string_view> modifiedFiles;
+        std::vector<std::string_view> appendedFiles;
+
+        for (const auto& change : changedFiles) {
+            if (change.kind == ChangeKind::Added) {
+                addedFiles.push_back(change.path);
+            }
+            else if (change.kind == ChangeKind::Deleted) {
+                deletedFiles.push_back(change.path);
+            }
+            else if (change.kind == ChangeKind::Appended) {
+                appendedFiles.push_back(change.path);
+            }
+            else {
+                modifiedFiles.push_back(change.path);
+            }
+        }
+
+        // Show added files
+        if (!addedFiles.empty()) {
+            out << "\n\033[1;32mAdded Files (" << counts.added << "):\033[0m" << std::endl;
+            for (const auto& file : addedFiles) {
+                out << "  " << file << std::endl;
+            }
+        }
+
+        // Show deleted files
+        if (!deletedFiles.empty()) {
+            out << "\n\033[1;31mDeleted Files (" << counts.deleted << "):\033[0m" << std::endl;
+            for (const auto& file : deletedFiles) {
+                out << "  " << file << std::endl;
+            }
+        }
+
+        // Show modified files
+        if (!modifiedFiles.empty()) {
+            out << "\n\033[1;33mModified Files (" << counts.changed << "):\033[0m" << std::endl;
+            for (const auto& file : modifiedFiles) {
+                out << "  " << file << std::endl;
+            }
+        }
+
+        // Show files that only grew
+        if (!appendedFiles.empty()) {
+            out << "\n\033[1;36mAppended Files (" << counts.appended << "):\033[0m" << std::endl;
+            for (const auto& file : appendedFiles) {
+                out << "  " << file << std::endl;
+            }
+        }
+    }
+    else if (listChanges) {
+        // For fewer changes, use the original line-by-line output
+        for (const auto& change : changedFiles) {
+            if (change.kind == ChangeKind::Added) {
+                out << "\033[1;32m[ADDED]\033[0m " << change.path << std::endl;
+            }
+            else if (change.kind == ChangeKind::Deleted) {
+                out << "\033[1;31m[DELETED]\033[0m " << change.path << std::endl;
+            }
+            else if (change.kind == ChangeKind::Appended) {
+                out << "\033[1;36m[APPENDED]\033[0m " << change.path << std::endl;
+            }
+            else {
+                out << "\033[1;33m[CHANGED]\033[0m " << change.path << std::endl;
+            }
+        }
+    }
+
+    printChangeSummary(counts, showAppended, totalFiles, out);
+}
+
+// Receives every change in path order while both manifests are still loaded
+using ChangeListVisitor = std::function<void(const std::vector<ManifestChange>& changes)>;
+
+// Compare two sharded checksum files. Shards with equal digests are skipped
+// unread; the others are loaded and diffed a pair at a time, one pair per
+// thread, so only those pairs are ever in memory.
+static int runShardedCompare(const std::filesystem::path& currIndexPath, const std::filesystem::path& newIndexPath,
+    const ValidateOptions& options, bool listChanges, const ChangeListVisitor& onChanges, std::ostream& out, RunStats& stats) {
+    ShardIndex currIndex;
+    ShardIndex newIndex;
+    std::string indexError;
+    if (!readShardIndex(currIndexPath, currIndex, indexError)) {
+        out << "\n\033[1;31mError: Unable to read current checksum index " << currIndexPath << ": " << indexError << "\033[0m" << std::endl;
+        return -1;
+    }
+    if (!readShardIndex(newIndexPath, newIndex, indexError)) {
+        out << "\n\033[1;31mError: Unable to read new checksum index " << newIndexPath << ": " << indexError << "\033[0m" << std::endl;
+        return -1;
+    }
+    if (currIndex.algorithm != newIndex.algorithm) {
+        out << "\n\033[1;31mError: Checksum files use different algorithms (current: " << hashAlgorithmName(currIndex.algorithm)
+            << ", new: " << hashAlgorithmName(newIndex.algorithm) << "). Recreate one of them with the same algorithm.\033[0m" << std::endl;
+        return -1;
+    }
+    if (options.appendAware) {
+        out << "\033[1;33mWarning: Appends are not told apart in sharded checksum files; grown files are reported as changed\033[0m" << std::endl;
+    }
+
+    if (currIndex.rootDigest == newIndex.rootDigest) {
+        out << "\nRoot digests match: " << formatManifestHash(currIndex.rootDigest) << std::endl;
+        out << "\n\033[1;32mChecksum Files Match - No Changes Detected\033[0m" << std::endl;
+        onChanges({});
+        return 0;
+    }
+
+    // Pair the shards by subtree; a shard on one side only is all added or all deleted
+    auto bySubtree = [](const ShardInfo& a, const ShardInfo& b) { return a.subtree < b.subtree; };
+    std::sort(currIndex.shards.begin(), currIndex.shards.end(), bySubtree);
+    std::sort(newIndex.shards.begin(), newIndex.shards.end(), bySubtree);
+
+    struct ShardPair {
+        const ShardInfo* curr = nullptr;
+        const ShardInfo* next = nullptr;
+        std::vector<std::pair<std::string, ChangeKind>> changes;
+        uint64_t entriesParsed = 0;
+        uint64_t parseErrors = 0;
+        std::string error;
+    };
+    std::vector<ShardPair> pairs;
+    uint64_t currEntryCount = 0;
+    uint64_t newEntryCount = 0;
+    size_t c = 0;
+    size_t n = 0;
+    while (c < currIndex.shards.size() || n < newIndex.shards.size()) {
+        ShardPair pair;
+        if (n == newIndex.shards.size() || (c < currIndex.shards.size() && currIndex.shards[c].subtree < newIndex.shards[n].subtree)) {
+            pair.curr = &currIndex.shards[c++];
+        }
+        else if (c == currIndex.shards.size() || newIndex.shards[n].subtree < currIndex.shards[c].subtree) {
+            pair.next = &newIndex.shards[n++];
+        }
+        else {
+            pair.curr = &currIndex.shards[c++];
+            pair.next = &newIndex.shards[n++];
+        }
+        currEntryCount += pair.curr != nullptr ? pair.curr->entryCount : 0;
+        newEntryCount += pair.next != nullptr ? pair.next->entryCount : 0;
+        if (pair.curr == nullptr || pair.next == nullptr || !(pair.curr->digest == pair.next->digest)) {
+            pairs.push_back(std::move(pair));
+        }
+    }
+
+    out << "\n\033[1;36mFile Statistics:\033[0m" << std::endl;
+    out << "Current file: " << currEntryCount << " entries in " << currIndex.shards.size() << " shards" << std::endl;
+    out << "New file: " << newEntryCount << " entries in " << newIndex.shards.size() << " shards" << std::endl;
+    out << "\nComparing " << pairs.size() << " differing shards..." << std::endl;
+
+    const std::filesystem::path currShards = currIndexPath.parent_path() / shardDirectoryName;
+    const std::filesystem::path newShards = newIndexPath.parent_path() / shardDirectoryName;
+    unsigned int workerCount = (std::max)(1u, (std::min)((std::max)(1u, std::thread::hardware_concurrency()), static_cast<unsigned int>(pairs.size())));
+    unsigned int parseThreads = (std::max)(1u, std::thread::hardware_concurrency() / workerCount);
+    std::atomic<size_t> nextPair{ 0 };
+    RunMetrics* metrics = currentMetrics();
+    auto comparePairs = [&] {
+        MetricsScope scope(metrics);
+        for (size_t i = nextPair++; i < pairs.size(); i = nextPair++) {
+            ShardPair& pair = pairs[i];
+            const ShardInfo& shard = pair.curr != nullptr ? *pair.curr : *pair.next;
+            const std::string prefix = shardPathPrefix(shard.subtree);
+
+            // Shards are read once per comparison, so they bypass the manifest cache
+            ParsedManifest currShard;
+            ParsedManifest newShard;
+            if (pair.curr != nullptr && !currShard.load(currShards / pair.curr->fileName, parseThreads, pair.error)) {
+                pair.error = "shard " + shard.subtree + " of the current checksum file: " + pair.error;
+                continue;
+            }
+            if (pair.next != nullptr && !newShard.load(newShards / pair.next->fileName, parseThreads, pair.error)) {
+                pair.error = "shard " + shard.subtree + " of the new checksum file: " + pair.error;
+                continue;
+            }
+            pair.entriesParsed = currShard.entries().size() + newShard.entries().size();
+            pair.parseErrors = currShard.errors().size() + newShard.errors().size();
+
+            std::vector<ManifestChange> changes;
+            if (pair.curr != nullptr && pair.next != nullptr) {
+                if (!diffLoadedManifests(currShard, currShards / pair.curr->fileName, newShard, newShards / pair.next->fileName, nullptr, collectChanges(changes), pair.error)) {
+                    continue;
+                }
+            }
+            else {
+                const ParsedManifest& present = pair.curr != nullptr ? currShard : newShard;
+                ChangeKind kind = pair.curr != nullptr ? ChangeKind::Deleted : ChangeKind::Added;
+                for (const ManifestDiffEntry& entry : present.entries()) {
+                    changes.push_back({ entry.path, kind });
+                }
+            }
+            for (const ManifestChange& change : changes) {
+                pair.changes.emplace_back(prefix + std::string(change.path), change.kind);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < workerCount; i++) {
+        workers.emplace_back(comparePairs);
+    }
+    comparePairs();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // Gather the changes of every pair back into one path-ordered list
+    std::vector<std::pair<std::string, ChangeKind>> changedPaths;
+    for (ShardPair& pair : pairs) {
+        if (!pair.error.empty()) {
+            out << "\n\033[1;31mError: " << pair.error << "\033[0m" << std::endl;
+            return -1;
+        }
+        stats.entriesParsed += pair.entriesParsed;
+        stats.parseErrors += pair.parseErrors;
+        std::move(pair.changes.begin(), pair.changes.end(), std::back_inserter(changedPaths));
+    }
+    if (stats.parseErrors > 0) {
+        out << "Errors: " << stats.parseErrors << " lines had parsing issues" << std::endl;
+    }
+    {
+        PhaseTimer diffTimer(MetricPhase::Diff);
+        std::sort(changedPaths.begin(), changedPaths.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+    }
+    std::vector<ManifestChange> changedFiles;
+    changedFiles.reserve(changedPaths.size());
+    for (const auto& [changedPath, kind] : changedPaths) {
+        changedFiles.push_back({ changedPath, kind });
+    }
+
+    stats.changesFound = changedFiles.size();
+    if (changedFiles.empty()) {
+        out << "\n\033[1;32mChecksum Files Match - No Changes Detected\033[0m" << std::endl;
+    }
+    else {
+        printChangeList(changedFiles, listChanges, false, (std::max)(currEntryCount, newEntryCount), out);
+    }
+    onChanges(changedFiles);
+    return changedFiles.empty() ? 0 : 1;
+}
+
+// Compare two manifests too large for the memory budget by external sort:
+// entries stream from disk and only runs that fit the budget are held
+static int runExternalCompare(const std::filesystem::path& currChecksumPath, const std::filesystem::path& newChecksumPath,
+    const ValidateOptions& options, bool listChanges, const ChangeListVisitor& onChanges, std::ostream& out, RunStats& stats) {
+    if (options.appendAware) {
+        out << "\033[1;33mWarning: Appends are not told apart in a memory-bounded comparison; grown files are reported as changed\033[0m" << std::endl;
+    }
+    out << "\nComparing within a " << (std::max)(options.memoryBudget, minimumMemoryBudget) / (1 << 20)
+        << " MB memory budget..." << std::endl;
+
+    ExternalManifestDiff externalDiff(options.memoryBudget, options.tempDirectory);
+    std::vector<std::pair<std::string, ChangeKind>> changedPaths;
+    std::string error;
+    if (!externalDiff.run(currChecksumPath, newChecksumPath, changedPaths, error)) {
+        out << "\n\033[1;31mError: " << error << "\033[0m" << std::endl;
+        return -1;
+    }
+    stats.entriesParsed = externalDiff.currentEntries() + externalDiff.newEntries();
+    stats.parseErrors = externalDiff.skippedLines();
+    stats.bytesSpilled = externalDiff.bytesSpilled();
+
+    out << "\n\033[1;36mFile Statistics:\033[0m" << std::endl;
+    out << "Current file: " << externalDiff.currentEntries() << " valid entries" << std::endl;
+    out << "New file: " << externalDiff.newEntries() << " valid entries" << std::endl;
+    if (externalDiff.skippedLines() > 0) {
+        out << "Errors: " << externalDiff.skippedLines() << " lines had parsing issues" << std::endl;
+    }
+    if (externalDiff.unsortedFallback()) {
+        out << "\033[1;33mWarning: A checksum file is marked sorted but is not; it was sorted through temporary files\033[0m" << std::endl;
+    }
+    out << "Sorted runs: " << externalDiff.runsWritten() << " (" << externalDiff.bytesSpilled() << " bytes spilled, "
+        << externalDiff.mergePasses() << " extra merge passes)" << std::endl;
+
+    std::vector<ManifestChange> changedFiles;
+    changedFiles.reserve(changedPaths.size());
+    for (const auto& [changedPath, kind] : changedPaths) {
+        changedFiles.push_back({ changedPath, kind });
+    }
+    stats.changesFound = changedFiles.size();
+    if (changedFiles.empty()) {
+        out << "\n\033[1;32mChecksum Files Match - No Changes Detected\033[0m" << std::endl;
+    }
+    else {
+        printChangeList(changedFiles, listChanges, false, (std::max)(externalDiff.currentEntries(), externalDiff.newEntries()), out);
+    }
+    onChanges(changedFiles);
+    return changedFiles.empty() ? 0 : 1;
+}
+
+// Compare with output going to out (a null stream when quiet); counters go to stats.
+// With onChange set and listChanges off, changes between two loaded manifests
+// go to it as the diff finds them and onChanges is not called; only their
+// counts are kept. Append checks, sharded and external comparisons need the
+// whole list and still report through onChanges.
+static int runCompare(const std::string& currPath, const std::string& newPath, const ValidateOptions& options,
+    bool listChanges, const ChangeListVisitor& onChanges, const ManifestChangeSink* onChange, std::ostream& out, RunStats& stats) {
+    try {
+        out << "\nValidating Files..." << std::endl;
+
+        // Validate Both Paths Exist; a folder stands for its checksum.txt (or checksum.bin, or checksum.idx)
+        std::filesystem::path currChecksumPath;
+        std::filesystem::path newChecksumPath;
+        std::string pathError;
+        if (!resolveManifestPath(currPath, currChecksumPath, pathError)) {
+            out << "\n\033[1;31mError: " << pathError << "\033[0m" << std::endl;
+            return -1;
+        }
+        if (!resolveManifestPath(newPath, newChecksumPath, pathError)) {
+            out << "\n\033[1;31mError: " << pathError << "\033[0m" << std::endl;
+            return -1;
+        }
+
+        // Sharded checksum files are compared shard by shard
+        bool currSharded = isShardIndex(currChecksumPath);
+        bool newSharded = isShardIndex(newChecksumPath);
+        if (currSharded != newSharded) {
+            out << "\n\033[1;31mError: A sharded checksum file can only be compared with another sharded one\033[0m" << std::endl;
+            return -1;
+        }
+        if (currSharded) {
+            return runShardedCompare(currChecksumPath, newChecksumPath, options, listChanges, onChanges, out, stats);
+        }
+
+        // Equal Merkle roots mean identical trees; nothing else has to be read
+        std::string currRoot;
+        std::string newRoot;
+        HashValue currRootDigest;
+        HashValue newRootDigest;
+        if (readManifestRoot(currChecksumPath, currRoot, currRootDigest) && readManifestRoot(newChecksumPath, newRoot, newRootDigest) &&
+            currRoot == newRoot && currRootDigest == newRootDigest) {
+            out << "\nRoot digests match: " << formatManifestHash(currRootDigest) << std::endl;
+            out << "\n\033[1;32mChecksum Files Match - No Changes Detected\033[0m" << std::endl;
+            onChanges({});
+            return 0;
+        }
+
+        // Loaded manifests take about twice their file size; beyond the budget they are sorted externally
+        if (options.memoryBudget > 0) {
+            std::error_code currSizeError;
+            std::error_code newSizeError;
+            uint64_t currBytes = std::filesystem::file_size(currChecksumPath, currSizeError);
+            uint64_t newBytes = std::filesystem::file_size(newChecksumPath, newSizeError);
+            if (currSizeError || newSizeError || 2 * (currBytes + newBytes) > options.memoryBudget) {
+                return runExternalCompare(currChecksumPath, newChecksumPath, options, listChanges, onChanges, out, stats);
+            }
+        }
+
+        // Read Checksum Files
+        out << "\nReading and comparing checksum files..." << std::endl;
+
+        // Map and parse both checksum files at the same time, each split across half
+        // the threads; manifests unchanged since an earlier comparison come from the cache
+        unsigned int parseThreads = (std::max)(1u, std::thread::hardware_concurrency() / 2);
+        std::shared_ptr<const ParsedManifest> currLoaded;
+        std::shared_ptr<const ParsedManifest> newLoaded;
+        std::string currError;
+        std::string newError;
+        RunMetrics* metrics = currentMetrics();
+        std::thread currLoader([&] {
+            MetricsScope scope(metrics);
+            currLoaded = loadCachedManifest(currChecksumPath, parseThreads, currError);
+        });
+        newLoaded = loadCachedManifest(newChecksumPath, parseThreads, newError);
+        currLoader.join();
+
+        if (!currLoaded) {
+            out << "\n\033[1;31mError: Unable to read current checksum file " << currChecksumPath << ": " << currError << "\033[0m" << std::endl;
+            return -1;
+        }
+        if (!newLoaded) {
+            out << "\n\033[1;31mError: Unable to read new checksum file " << newChecksumPath << ": " << newError << "\033[0m" << std::endl;
+            return -1;
+        }
+
+        const ParsedManifest& currManifest = *currLoaded;
+        const ParsedManifest& newManifest = *newLoaded;
+        const std::vector<ManifestDiffEntry>& currFiles = currManifest.entries();
+        const std::vector<ManifestDiffEntry>& newFiles = newManifest.entries();
+        int errorLineCount = reportLineErrors(currManifest, "current", out) + reportLineErrors(newManifest, "new", out);
+        stats.entriesParsed = currFiles.size() + newFiles.size();
+        stats.parseErrors = static_cast<uint64_t>(errorLineCount);
+
+        // File statistics
+        out << "\n\033[1;36mFile Statistics:\033[0m" << std::endl;
+        out << "Current file: " << currFiles.size() << " valid entries" << std::endl;
+        out << "New file: " << newFiles.size() << " valid entries" << std::endl;
+        if (errorLineCount > 0) {
+            out << "Errors: " << errorLineCount << " lines had parsing issues" << std::endl;
+        }
+
+        // Compare files and identify changes
+        out << "\nComparing checksums..." << std::endl;
+        std::string diffError;
+        if (onChange != nullptr && !listChanges && !options.appendAware) {
+            // Changes go straight to the caller; once it stops taking them they are only counted
+            ChangeCounts counts;
+            bool forwarding = true;
+            if (!diffLoadedManifests(currManifest, currChecksumPath, newManifest, newChecksumPath, &out, [&](const ManifestChange& change) {
+                counts.add(change.kind);
+                forwarding = forwarding && (*onChange)(change);
+                return true;
+            }, diffError)) {
+                out << "\n\033[1;31mError: " << diffError << "\033[0m" << std::endl;
+                return -1;
+            }
+
+            stats.changesFound = counts.total();
+            if (counts.total() == 0) {
+                out << "\n\033[1;32mChecksum Files Match - No Changes Detected\033[0m" << std::endl;
+                return 0;
+            }
+            out << "\n\033[1;33mChanges Detected:\033[0m" << std::endl;
+            out << "-------------------------" << std::endl;
+            printChangeSummary(counts, false, (std::max)(currFiles.size(), newFiles.size()), out);
+            return 1;
+        }
+
+        std::vector<ManifestChange> changedFiles;
+        if (!diffLoadedManifests(currManifest, currChecksumPath, newManifest, newChecksumPath, &out, collectChanges(changedFiles), diffError)) {
+            out << "\n\033[1;31mError: " << diffError << "\033[0m" << std::endl;
+            return -1;
+        }
+
+        // Grown files are checked against the disk, reading only their new bytes
+        if (options.appendAware) {
+            if (currManifest.isBinary() || newManifest.isBinary() || !currManifest.header().appendCheck ||
+                !newManifest.header().hasStat || !supportsHashExtension(newManifest.header().algorithm)) {
+                out << "\033[1;33mWarning: Appends can only be told apart with a current checksum file created with "
+                    << "--append-aware and a text new checksum file; grown files are reported as changed\033[0m" << std::endl;
+            }
+            else {
+                // Relative paths resolve against the tree the new manifest describes
+                std::filesystem::path treeRoot = options.treeDirectory.empty() ? newChecksumPath.parent_path() :
+                    std::filesystem::path(options.treeDirectory);
+                out << "Checking grown files under " << treeRoot << " for appends..." << std::endl;
+                PhaseTimer diffTimer(MetricPhase::Diff);
+                size_t unreadable = 0;
+                markAppendedChanges(currChecksumPath, newChecksumPath, newManifest, treeRoot, changedFiles, unreadable);
+                stats.readErrors += unreadable;
+                if (unreadable > 0) {
+                    out << "\033[1;33mWarning: " << unreadable << " grown files could not be read under " << treeRoot
+                        << " and are reported as changed\033[0m" << std::endl;
+                }
+            }
+        }
+
+        // Print summary
+        stats.changesFound = changedFiles.size();
+        if (changedFiles.empty()) {
+            out << "\n\033[1;32mChecksum Files Match - No Changes Detected\033[0m" << std::endl;
+        }
+        else {
+            printChangeList(changedFiles, listChanges, options.appendAware,
+                (std::max)(currFiles.size(), newFiles.size()), out);
+        }
+
+        onChanges(changedFiles);
+        return changedFiles.empty() ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        out << "\n\033[1;31mUnexpected error during checksum validation: " << e.what() << "\033[0m" << std::endl;
+        return -1;
+    }
+}
+
+// Returns 1 when the manifests differ, 0 when they match and -1 when they cannot
+// be compared. With listChanges false only the summary is printed.
+static int compareChecksumFiles(const std::string& currPath, const std::string& newPath, const ValidateOptions& options,
+    bool listChanges, const ChangeListVisitor& onChanges, const ManifestChangeSink* onChange = nullptr) {
+    std::unique_ptr<RunMetrics> metrics = options.stats != nullptr ? std::make_unique<RunMetrics>() : nullptr;
+    MetricsScope scope(metrics.get());
+    std::ostream out(options.quiet ? nullptr : std::cout.rdbuf());
+
+    RunStats stats;
+    stats.operation = "compare";
+    int result = runCompare(currPath, newPath, options, listChanges, onChanges, onChange, out, stats);
+    if (metrics) {
+        metrics->collect(stats);
+        *options.stats = std::move(stats);
+    }
+    return result;
+}
+
+
+bool convertChecksumFile(const std::string& inputPath, const std::string& outputPath) {
+    try {
+        bool toText = isBinaryManifest(inputPath);
+        std::cout << "\nConverting " << (toText ? "binary" : "text") << " checksum file to "
+            << (toText ? "text" : "binary") << "..." << std::endl;
+
+        std::string error;
+        evictCachedManifest(outputPath);
+        if (!convertManifest(inputPath, outputPath, error)) {
+            std::cout << "\n\033[1;31mError: Unable to convert " << inputPath << ": " << error << "\033[0m" << std::endl;
+            return false;
+        }
+
+        std::cout << "\n\033[1;32mChecksum file written: " << outputPath << "\033[0m" << std::endl;
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cout << "\n\033[1;31mUnexpected error during checksum conversion: " << e.what() << "\033[0m" << std::endl;
+        return false;
+    }
+}
+
+
+// Overload Implementations
+bool validateChecksumFile(const std::string& currPath, const std::string& newPath, const ValidateOptions& options,
+    std::vector<FileChangeInfo>& changedFiles) {
+    changedFiles.clear();
+    int result = compareChecksumFiles(currPath, newPath, options, true, [&](const std::vector<ManifestChange>& changes) {
+        changedFiles.reserve(changes.size());
+        for (const auto& change : changes) {
+            changedFiles.push_back({ std::string(change.path), changeKindName(change.kind) });
+        }
+    });
+    return result == 0;
+}
+
+bool validateChecksumFile(const std::string& currPath, const std::string& newPath) {
+    return validateChecksumFile(currPath, newPath, ValidateOptions{});
+}
+
+bool validateChecksumFile(const std::string& currPath, const std::string& newPath, const ValidateOptions& options) {
+    return compareChecksumFiles(currPath, newPath, options, true, [](const std::vector<ManifestChange>&) {}) == 0;
+}
+
+
+std::vector<FileChangeInfo> getChecksumFileChanges(const std::string& currPath, const std::string& newPath, bool printResults) {
+    return getChecksumFileChanges(currPath, newPath, ValidateOptions{});
+}
+
+std::vector<FileChangeInfo> getChecksumFileChanges(const std::string& currPath, const std::string& newPath,
+    const ValidateOptions& options) {
+    std::vector<FileChangeInfo> changes;
+    validateChecksumFile(currPath, newPath, options, changes);
+    return changes;
+}
+
+
+// Verify with output going to out (a null stream when quiet); counters go to stats.
+// With loaded set its entries are used and manifestPath is the file it came from.
+static int runVerify(const std::string& directory, const std::string& manifestPath, const ParsedManifest* loaded,
+    const std::vector<std::string>& excludePatterns, const VerifyOptions& options, const ChangeListVisitor& onChanges,
+    std::ostream& out, RunStats& stats) {
+    try {
+        out << "\nVerifying Files..." << std::endl;
+
+        if (!std::filesystem::is_directory(directory)) {
+            out << "\n\033[1;31mError: Directory does not exist: " << directory << "\033[0m" << std::endl;
+            return -1;
+        }
+        std::filesystem::path checksumPath = manifestPath;
+        std::string pathError;
+        if (loaded == nullptr && !resolveManifestPath(manifestPath, checksumPath, pathError)) {
+            out << "\n\033[1;31mError: " << pathError << "\033[0m" << std::endl;
+            return -1;
+        }
+
+        ExcludeMatcher excludeMatcher;
+        if (!buildExcludeMatcher(excludePatterns, options.excludeFile, excludeMatcher, out)) {
+            return -1;
+        }
+
+        TreeVerifier verifier(directory, excludeMatcher, options);
+        std::string loadError;
+        bool manifestRead = loaded != nullptr ? verifier.loadManifest(*loaded, checksumPath, loadError) :
+            verifier.loadManifest(checksumPath, loadError);
+        if (!manifestRead) {
+            out << "\n\033[1;31mError: Unable to read checksum file " << checksumPath << ": " << loadError << "\033[0m" << std::endl;
+            return -1;
+        }
+
+        // Sizes first: added, deleted and resized files need no reads
+        std::vector<ManifestChange> changedFiles;
+        verifier.precheck(changedFiles);
+        out << "\n\033[1;36mFile Statistics:\033[0m" << std::endl;
+        out << "Checksum file: " << verifier.entryCount() << " entries (" << hashAlgorithmName(verifier.algorithm()) << ")" << std::endl;
+        out << "Directory: " << verifier.fileCount() << " files" << std::endl;
+        printWalkFailures(verifier.walkErrorList(), out);
+
+        bool complete = true;
+        if (options.failFast && !changedFiles.empty()) {
+            complete = verifier.candidateCount() == 0;
+        }
+        else if (verifier.candidateCount() > 0) {
+            out << "\nHashing " << verifier.candidateCount() << " files..." << std::endl;
+            complete = verifier.hashCandidates(changedFiles);
+        }
+        std::sort(changedFiles.begin(), changedFiles.end(),
+            [](const ManifestChange& a, const ManifestChange& b) { return a.path < b.path; });
+
+        stats.filesEnumerated = verifier.fileCount();
+        stats.bytesEnumerated = verifier.bytesEnumerated();
+        stats.filesHashed = verifier.hashedCount();
+        stats.entriesParsed = verifier.entryCount();
+        stats.changesFound = changedFiles.size();
+        stats.walkErrors = verifier.walkErrorCount();
+        stats.readErrors = verifier.readErrorCount();
+
+        if (verifier.readErrorCount() > 0) {
+            out << "\033[1;33mWarning: " << verifier.readErrorCount() << " files could not be read and are reported as changed\033[0m" << std::endl;
+        }
+        if (changedFiles.empty()) {
+            out << "\n\033[1;32mDirectory Matches Checksum File - No Changes Detected\033[0m" << std::endl;
+        }
+        else {
+            if (!complete) {
+                out << "\n\033[1;33mStopped at the first difference; other files were not checked\033[0m" << std::endl;
+            }
+            printChangeList(changedFiles, true, false, (std::max)(verifier.entryCount(), verifier.fileCount()), out);
+        }
+
+        onChanges(changedFiles);
+        return changedFiles.empty() ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        out << "\n\033[1;31mUnexpected error during checksum verification: " << e.what() << "\033[0m" << std::endl;
+        return -1;
+    }
+}
+
+// Visitor copying changes into FileChangeInfo records
+static ChangeListVisitor changeInfoVisitor(std::vector<FileChangeInfo>& changes) {
+    return [&changes](const std::vector<ManifestChange>& changedFiles) {
+        changes.reserve(changedFiles.size());
+        for (const auto& change : changedFiles) {
+            changes.push_back({ std::string(change.path), changeKindName(change.kind) });
+        }
+    };
+}
+
+// Returns 1 when the directory differs from the manifest, 0 when it matches and
+// -1 when the manifest cannot be read
+static int verifyTree(const std::string& directory, const std::string& manifestPath, const ParsedManifest* loaded,
+    const std::vector<std::string>& excludePatterns, const VerifyOptions& options, const ChangeListVisitor& onChanges) {
+    std::unique_ptr<RunMetrics> metrics = options.stats != nullptr ? std::make_unique<RunMetrics>() : nullptr;
+    MetricsScope scope(metrics.get());
+    std::ostream out(options.quiet ? nullptr : std::cout.rdbuf());
+
+    RunStats stats;
+    stats.operation = "verify";
+    int result = runVerify(directory, manifestPath, loaded, excludePatterns, options, onChanges, out, stats);
+    if (metrics) {
+        metrics->collect(stats);
+        *options.stats = std::move(stats);
+    }
+    return result;
+}
+
+int verifyChecksumFile(const std::string& directory, const std::string& manifestPath,
+    const std::vector<std::string>& excludePatterns, const VerifyOptions& options, std::vector<FileChangeInfo>& changes) {
+    changes.clear();
+    return verifyTree(directory, manifestPath, nullptr, excludePatterns, options, changeInfoVisitor(changes));
+}
+
+bool verifyChecksumFile(const std::string& directory, const std::string& manifestPath) {
+    return verifyTree(directory, manifestPath, nullptr, {}, VerifyOptions{}, [](const std::vector<ManifestChange>&) {}) == 0;
+}
+
+// Find duplicates with output going to out (a null stream when quiet); counters go to stats
+static int runDuplicates(const std::string& path, const std::vector<std::string>& excludePatterns, const DuplicateOptions& options,
+    std::ostream& out, RunStats& stats) {
+    try {
+        if (!std::filesystem::is_directory(path)) {
+            out << "\n\033[1;31mError: Directory does not exist: " << path << "\033[0m" << std::endl;
+            return -1;
+        }
+
+        ExcludeMatcher excludeMatcher;
+        if (!buildExcludeMatcher(excludePatterns, options.excludeFile, excludeMatcher, out)) {
+            return -1;
+        }
+
+        out << "\nFinding duplicate files in " << path << "..." << std::endl;
+        DuplicateFinder finder(path, excludeMatcher, options);
+        finder.scan();
+        printWalkFailures(finder.walkErrorList(), out);
+        DuplicateReport report;
+        finder.hashCandidates(report);
+        report.finish();
+
+        stats.filesEnumerated = finder.fileCount();
+        stats.bytesEnumerated = finder.bytesEnumerated();
+        stats.filesHashed = finder.fullHashedCount();
+        stats.filesLinked = finder.linkCount();
+        stats.walkErrors = finder.walkErrorCount();
+        stats.readErrors = finder.readErrorCount();
+
+        out << "\n\033[1;36mFile Statistics:\033[0m" << std::endl;
+        out << "Files: " << finder.fileCount() << " (" << finder.linkCount() << " further hard links)" << std::endl;
+        out << "Read in full: " << finder.fullHashedCount() << ", first " << duplicatePrefixSize << " bytes only: "
+            << finder.prefixHashedCount() << std::endl;
+        if (finder.readErrorCount() > 0 || finder.walkErrorCount() > 0) {
+            out << "\033[1;33mWarning: " << finder.readErrorCount() << " files and " << finder.walkErrorCount()
+                << " directories could not be read\033[0m" << std::endl;
+        }
+
+        if (!options.reportPath.empty()) {
+            std::string reportError;
+            if (!report.write(options.reportPath, options.algorithm, reportError)) {
+                out << "\n\033[1;31mError: Unable to write duplicate report: " << reportError << "\033[0m" << std::endl;
+                stats.writeErrors++;
+                return -1;
+            }
+        }
+        else {
+            report.print(out);
+        }
+
+        if (report.groupCount() == 0) {
+            out << "\n\033[1;32mNo Duplicate Files Found\033[0m" << std::endl;
+            return 0;
+        }
+        out << "\n\033[1;33m" << report.groupCount() << " groups of identical files, " << report.duplicateCount()
+            << " redundant copies (" << report.wastedBytes() << " bytes)\033[0m" << std::endl;
+        if (!options.reportPath.empty()) {
+            out << "Report written: " << options.reportPath << std::endl;
+        }
+        return 1;
+    }
+    catch (const std::exception& e) {
+        out << "\n\033[1;31mUnexpected error while finding duplicates: " << e.what() << "\033[0m" << std::endl;
+        return -1;
+    }
+}
+
+int findDuplicateFiles(const std::string& path, const std::vector<std::string>& excludePatterns, const DuplicateOptions& options) {
+    std::unique_ptr<RunMetrics> metrics = options.stats != nullptr ? std::make_unique<RunMetrics>() : nullptr;
+    MetricsScope scope(metrics.get());
+    std::ostream out(options.quiet ? nullptr : std::cout.rdbuf());
+
+    RunStats stats;
+    stats.operation = "duplicates";
+    int result = runDuplicates(path, excludePatterns, options, out, stats);
+    if (metrics) {
+        metrics->collect(stats);
+        *options.stats = std::move(stats);
+    }
+    return result;
+}
+
+// Entries of a checksum file, or of every shard of a checksum index, with
+// paths relative to the tree they describe
+static bool readSnapshotEntries(const std::filesystem::path& manifestPath, std::vector<SnapshotEntry>& entries,
+    HashAlgorithm& algorithm, std::ostream& out, RunStats& stats, std::string& error) {
+    auto readManifest = [&](const std::filesystem::path& path, const std::string& pathPrefix) {
+        ParsedManifest manifest;
+        if (!manifest.load(path, 0, error)) {
+            error = path.string() + ": " + error;
+            return false;
+        }
+        stats.parseErrors += reportLineErrors(manifest, "snapshot", out);
+        stats.entriesParsed += manifest.entries().size();
+        algorithm = manifest.header().algorithm;
+
+        // Absolute paths of older manifests are made relative to the manifest's folder
+        const std::string rootPrefix = directoryPrefix(path.parent_path().string());
+        bool relative = manifest.header().relative;
+        for (const ManifestDiffEntry& entry : manifest.entries()) {
+            std::string_view entryPath = entry.path;
+            if (!relative && entryPath.substr(0, rootPrefix.size()) == rootPrefix) {
+                entryPath.remove_prefix(rootPrefix.size());
+            }
+            entries.push_back({ pathPrefix + std::string(entryPath), entry.hash });
+        }
+        return true;
+    };
+
+    if (!isShardIndex(manifestPath)) {
+        return readManifest(manifestPath, std::string());
+    }
+    ShardIndex index;
+    if (!readShardIndex(manifestPath, index, error)) {
+        return false;
+    }
+    for (const ShardInfo& shard : index.shards) {
+        if (!readManifest(manifestPath.parent_path() / shardDirectoryName / shard.fileName, shardPathPrefix(shard.subtree))) {
+            return false;
+        }
+    }
+    algorithm = index.algorithm;
+    return true;
+}
+
+static int runAddSnapshot(const std::string& storePath, const std::string& manifestPath, const HistoryOptions& options,
+    std::ostream& out, RunStats& stats) {
+    try {
+        std::filesystem::path checksumPath;
+        std::string error;
+        if (!resolveManifestPath(manifestPath, checksumPath, error)) {
+            out << "\n\033[1;31mError: " << error << "\033[0m" << std::endl;
+            return -1;
+        }
+
+        std::vector<SnapshotEntry> entries;
+        HashAlgorithm algorithm = HashAlgorithm::Crc32;
+        if (!readSnapshotEntries(checksumPath, entries, algorithm, out, stats, error)) {
+            out << "\n\033[1;31mError: Unable to read checksum file " << error << "\033[0m" << std::endl;
+            return -1;
+        }
+
+        SnapshotStore store(storePath);
+        Snapshot snapshot;
+        if (!store.add(entries, algorithm, options.label, snapshot, error)) {
+            out << "\n\033[1;31mError: Unable to record snapshot: " << error << "\033[0m" << std::endl;
+            stats.writeErrors++;
+            return -1;
+        }
+
+        out << "\n\033[1;32mSnapshot " << snapshot.id << " recorded in " << storePath << "\033[0m" << std::endl;
+        out << "Entries: " << snapshot.entryCount << " in " << snapshot.chunks.size() << " chunks" << std::endl;
+        out << "New chunks: " << store.chunksWritten() << " (" << store.bytesWritten() << " bytes); the rest were already stored" << std::endl;
+        return 0;
+    }
+    catch (const std::exception& e) {
+        out << "\n\033[1;31mUnexpected error while recording snapshot: " << e.what() << "\033[0m" << std::endl;
+        return -1;
+    }
+}
 
-    // Print Success
-    std::cout << "\n\033[1;32mChecksum File Created: " << checksumPath << "\033[0m" << std::endl;
-    std::cout << "\033[1;32mProcessed " << fileCount << " files";
-    if (errorCount > 0) {
-        std::cout << " (" << errorCount << " files could not be read)";
+static int runListSnapshots(const std::string& storePath, std::ostream& out) {
+    SnapshotStore store(storePath);
+    std::vector<Snapshot> snapshots;
+    std::string error;
+    if (!store.list(snapshots, error)) {
+        out << "\n\033[1;31mError: " << error << "\033[0m" << std::endl;
+        return -1;
+    }
+    if (snapshots.empty()) {
+        out << "\nNo snapshots in " << storePath << std::endl;
+        return 0;
     }
-    std::cout << "\033[0m" << std::endl;
 
-    // Return Success
-    return 200;
+    out << "\n\033[1;36mSnapshots in " << storePath << ":\033[0m" << std::endl;
+    for (const Snapshot& snapshot : snapshots) {
+        out << std::setw(6) << snapshot.id << "  " << snapshot.created << "  " << std::setw(8) << hashAlgorithmName(snapshot.algorithm)
+            << "  " << std::setw(10) << snapshot.entryCount << " entries";
+        if (!snapshot.label.empty()) {
+            out << "  " << snapshot.label;
+        }
+        out << std::endl;
+    }
+    return 0;
 }
 
-bool validateChecksumFile(const std::string& currPath, const std::string& newPath, std::vector<FileChangeInfo>& changedFiles) {
+static int runDiffSnapshots(const std::string& storePath, const std::string& from, const std::string& to, const HistoryOptions& options,
+    std::vector<FileChangeInfo>& changes, std::ostream& out, RunStats& stats) {
     try {
-        std::cout << "\nValidating Files..." << std::endl;
-
-        // Validate Both Paths Exist
-        if (!std::filesystem::exists(currPath)) {
-            std::cout << "\n\033[1;31mError: Current Path does not exist: " << currPath << "\033[0m" << std::endl;
-            return false;
+        SnapshotStore store(storePath);
+        Snapshot fromSnapshot;
+        Snapshot toSnapshot;
+        std::string error;
+        if (!store.find(from, fromSnapshot, error) || !store.find(to, toSnapshot, error)) {
+            out << "\n\033[1;31mError: " << error << "\033[0m" << std::endl;
+            return -1;
         }
 
-        if (!std::filesystem::exists(newPath)) {
-            std::cout << "\n\033[1;31mError: New Path does not exist: " << newPath << "\033[0m" << std::endl;
-            return false;
+        out << "\nComparing snapshot " << fromSnapshot.id << " (" << fromSnapshot.created << ") with snapshot "
+            << toSnapshot.id << " (" << toSnapshot.created << ")..." << std::endl;
+        std::vector<SnapshotChange> snapshotChanges;
+        if (!store.diff(fromSnapshot, toSnapshot, snapshotChanges, error)) {
+            out << "\n\033[1;31mError: " << error << "\033[0m" << std::endl;
+            return -1;
         }
-
-        // Check if paths are folders and look for checksum.txt
-        std::filesystem::path currChecksumPath = currPath;
-        std::filesystem::path newChecksumPath = newPath;
-
-        if (std::filesystem::is_directory(currPath)) {
-            currChecksumPath = std::filesystem::path(currPath) / "checksum.txt";
-            if (!std::filesystem::exists(currChecksumPath)) {
-                std::cout << "\n\033[1;31mError: checksum.txt not found in current folder: " << currPath << "\033[0m" << std::endl;
-                return false;
-            }
+        stats.entriesParsed = store.entriesRead();
+        stats.changesFound = snapshotChanges.size();
+        out << "Shared chunks skipped: " << store.chunksSkipped() << ", chunks read: " << store.chunksRead() << std::endl;
+
+        std::vector<ManifestChange> changedFiles;
+        changedFiles.reserve(snapshotChanges.size());
+        changes.clear();
+        for (const SnapshotChange& change : snapshotChanges) {
+            changedFiles.push_back({ change.path, change.kind });
+            changes.push_back({ change.path, changeKindName(change.kind) });
         }
-
-        if (std::filesystem::is_directory(newPath)) {
-            newChecksumPath = std::filesystem::path(newPath) / "checksum.txt";
-            if (!std::filesystem::exists(newChecksumPath)) {
-                std::cout << "\n\033[1;31mError: checksum.txt not found in new folder: " << newPath << "\033[0m" << std::endl;
-                return false;
-            }
+        if (changedFiles.empty()) {
+            out << "\n\033[1;32mSnapshots Match - No Changes Detected\033[0m" << std::endl;
+            return 0;
         }
+        printChangeList(changedFiles, options.listChanges, false, (std::max)(fromSnapshot.entryCount, toSnapshot.entryCount), out);
+        return 1;
+    }
+    catch (const std::exception& e) {
+        out << "\n\033[1;31mUnexpected error while comparing snapshots: " << e.what() << "\033[0m" << std::endl;
+        return -1;
+    }
+}
 
-        // Read Checksum Files with progress indication
-        std::cout << "\nReading and comparing checksum files..." << std::endl;
-
-        // Open and validate checksum files
-        std::ifstream currChecksumFile(currChecksumPath);
-        std::ifstream newChecksumFile(newChecksumPath);
-
-        if (!currChecksumFile.is_open()) {
-            std::cout << "\n\033[1;31mError: Unable to open current checksum file: " << currChecksumPath << "\033[0m" << std::endl;
-            return false;
+static int runFileHistory(const std::string& storePath, const std::string& filePath, std::ostream& out, RunStats& stats) {
+    try {
+        SnapshotStore store(storePath);
+        std::vector<FileHistoryEvent> events;
+        std::string error;
+        if (!store.fileHistory(filePath, events, error)) {
+            out << "\n\033[1;31mError: " << error << "\033[0m" << std::endl;
+            return -1;
         }
+        stats.entriesParsed = store.entriesRead();
+        stats.changesFound = events.size();
 
-        if (!newChecksumFile.is_open()) {
-            std::cout << "\n\033[1;31mError: Unable to open new checksum file: " << newChecksumPath << "\033[0m" << std::endl;
-            currChecksumFile.close();
-            return false;
+        if (events.empty()) {
+            out << "\n" << filePath << " is in no snapshot of " << storePath << std::endl;
+            return 0;
         }
-
-        // Create maps to store file checksums
-        std::map<std::string, int> currFiles;
-        std::map<std::string, int> newFiles;
-        int parsedLineCount = 0;
-        int validLineCount = 0;
-        int errorLineCount = 0;
-
-        // Read current checksum file
-        std::string line;
-        while (std::getline(currChecksumFile, line)) {
-            parsedLineCount++;
-
-            // Show progress indicator for large files
-            if (parsedLineCount % 100 == 0) {
-                std::cout << "." << std::flush;
-            }
-
-            size_t spacePos = line.find_last_of(' ');
-            if (spacePos != std::string::npos) {
-                std::string filePath = line.substr(0, spacePos);
-                try {
-                    int checksum = std::stoi(line.substr(spacePos + 1));
-                    currFiles[filePath] = checksum;
-                    validLineCount++;
-                }
-                catch (const std::exception& e) {
-                    std::cout << "\n\033[1;31mError parsing checksum in current file (line " << parsedLineCount
-                        << "): " << filePath << " (" << e.what() << ")\033[0m" << std::endl;
-                    errorLineCount++;
-                }
+        out << "\n\033[1;36mHistory of " << filePath << ":\033[0m" << std::endl;
+        for (const FileHistoryEvent& event : events) {
+            out << std::setw(6) << event.snapshotId << "  " << event.created << "  ";
+            if (event.kind == ChangeKind::Added) {
+                out << "\033[1;32m[" << changeKindName(event.kind) << "]\033[0m";
             }
-            else if (!line.empty()) { // Ignore empty lines
-                std::cout << "\n\033[1;33mWarning: Malformed line in current checksum file (line "
-                    << parsedLineCount << "): " << line << "\033[0m" << std::endl;
-                errorLineCount++;
+            else if (event.kind == ChangeKind::Deleted) {
+                out << "\033[1;31m[" << changeKindName(event.kind) << "]\033[0m";
             }
-        }
-
-        // Reset counters for the new file
-        parsedLineCount = 0;
-        int validNewLineCount = 0;
-
-        // Read new checksum file
-        while (std::getline(newChecksumFile, line)) {
-            parsedLineCount++;
-
-            // Show progress indicator for large files
-            if (parsedLineCount % 100 == 0) {
-                std::cout << "+" << std::flush;
+            else {
+                out << "\033[1;33m[" << changeKindName(event.kind) << "]\033[0m";
             }
-
-            size_t spacePos = line.find_last_of(' ');
-            if (spacePos != std::string::npos) {
-                std::string filePath = line.substr(0, spacePos);
-                try {
-                    int checksum = std::stoi(line.substr(spacePos + 1));
-                    newFiles[filePath] = checksum;
-                    validNewLineCount++;
-                }
-                catch (const std::exception& e) {
-                    std::cout << "\n\033[1;31mError parsing checksum in new file (line " << parsedLineCount
-                        << "): " << filePath << " (" << e.what() << ")\033[0m" << std::endl;
-                    errorLineCount++;
-                }
+            if (event.kind != ChangeKind::Deleted) {
+                out << " " << hashToHex(event.hash);
             }
-            else if (!line.empty()) { // Ignore empty lines
-                std::cout << "\n\033[1;33mWarning: Malformed line in new checksum file (line "
-                    << parsedLineCount << "): " << line << "\033[0m" << std::endl;
-                errorLineCount++;
+            if (!event.label.empty()) {
+                out << "  " << event.label;
             }
+            out << std::endl;
         }
+        out << "Chunks read: " << store.chunksRead() << ", unchanged chunks skipped: " << store.chunksSkipped() << std::endl;
+        return static_cast<int>(events.size());
+    }
+    catch (const std::exception& e) {
+        out << "\n\033[1;31mUnexpected error while reading history: " << e.what() << "\033[0m" << std::endl;
+        return -1;
+    }
+}
 
-        // File statistics
-        std::cout << "\n\033[1;36mFile Statistics:\033[0m" << std::endl;
-        std::cout << "Current file: " << validLineCount << " valid entries" << std::endl;
-        std::cout << "New file: " << validNewLineCount << " valid entries" << std::endl;
-        if (errorLineCount > 0) {
-            std::cout << "Errors: " << errorLineCount << " lines had parsing issues" << std::endl;
-        }
-
-        // Close Checksum Files
-        currChecksumFile.close();
-        newChecksumFile.close();
-
-        // Compare files and identify changes
-        changedFiles.clear();
-        std::cout << "\nComparing checksums..." << std::endl;
-
-        // Find added and changed files
-        for (const auto& [filePath, checksum] : newFiles) {
-            auto it = currFiles.find(filePath);
+// Metrics, output and stats handling shared by the history commands
+template <typename Body>
+static int runHistoryCommand(const char* operation, const HistoryOptions& options, const Body& body) {
+    std::unique_ptr<RunMetrics> metrics = options.stats != nullptr ? std::make_unique<RunMetrics>() : nullptr;
+    MetricsScope scope(metrics.get());
+    std::ostream out(options.quiet ? nullptr : std::cout.rdbuf());
+
+    RunStats stats;
+    stats.operation = operation;
+    int result = body(out, stats);
+    if (metrics) {
+        metrics->collect(stats);
+        *options.stats = std::move(stats);
+    }
+    return result;
+}
 
-            if (it == currFiles.end()) {
-                // File was added
-                changedFiles.push_back({ filePath, "ADDED" });
-            }
-            else if (it->second != checksum) {
-                // File was changed (different checksum)
-                changedFiles.push_back({ filePath, "CHANGED" });
-            }
-        }
+int addSnapshot(const std::string& storePath, const std::string& manifestPath, const HistoryOptions& options) {
+    return runHistoryCommand("snapshot", options, [&](std::ostream& out, RunStats& stats) {
+        return runAddSnapshot(storePath, manifestPath, options, out, stats);
+    });
+}
 
-        // Find deleted files
-        for (const auto& [filePath, checksum] : currFiles) {
-            if (newFiles.find(filePath) == newFiles.end()) {
-                // File was deleted
-                changedFiles.push_back({ filePath, "DELETED" });
-            }
-        }
+int listSnapshots(const std::string& storePath, const HistoryOptions& options) {
+    return runHistoryCommand("snapshots", options, [&](std::ostream& out, RunStats&) {
+        return runListSnapshots(storePath, out);
+    });
+}
 
-        // Print summary
-        if (changedFiles.empty()) {
-            std::cout << "\n\033[1;32mChecksum Files Match - No Changes Detected\033[0m" << std::endl;
-        }
-        else {
-            std::cout << "\n\033[1;33mChanges Detected:\033[0m" << std::endl;
-            std::cout << "-------------------------" << std::endl;
-
-            int addedCount = 0, deletedCount = 0, changedCount = 0;
-
-            // Use categorized output for better readability when there are many changes
-            if (changedFiles.size() > 20) {
-                // Group changes by type for easier reading
-                std::vector<std::string> addedFiles;
-                std::vector<std::string> deletedFiles;
-                std::vector<std::string> modifiedFiles;
-
-                for (const auto& change : changedFiles) {
-                    if (change.changeType == "ADDED") {
-                        addedFiles.push_back(change.filePath);
-                        addedCount++;
-                    }
-                    else if (change.changeType == "DELETED") {
-                        deletedFiles.push_back(change.filePath);
-                        deletedCount++;
-                    }
-                    else if (change.changeType == "CHANGED") {
-                        modifiedFiles.push_back(change.filePath);
-                        changedCount++;
-                    }
-                }
+int diffSnapshots(const std::string& storePath, const std::string& from, const std::string& to, const HistoryOptions& options,
+    std::vector<FileChangeInfo>& changes) {
+    return runHistoryCommand("snapshot-diff", options, [&](std::ostream& out, RunStats& stats) {
+        return runDiffSnapshots(storePath, from, to, options, changes, out, stats);
+    });
+}
 
-                // Show added files
-                if (!addedFiles.empty()) {
-                    std::cout << "\n\033[1;32mAdded Files (" << addedCount << "):\033[0m" << std::endl;
-                    for (const auto& file : addedFiles) {
-                        std::cout << "  " << file << std::endl;
-                    }
-                }
+int showFileHistory(const std::string& storePath, const std::string& filePath, const HistoryOptions& options) {
+    return runHistoryCommand("file-history", options, [&](std::ostream& out, RunStats& stats) {
+        return runFileHistory(storePath, filePath, out, stats);
+    });
+}
 
-                // Show deleted files
-                if (!deletedFiles.empty()) {
-                    std::cout << "\n\033[1;31mDeleted Files (" << deletedCount << "):\033[0m" << std::endl;
-                    for (const auto& file : deletedFiles) {
-                        std::cout << "  " << file << std::endl;
-                    }
-                }
+bool Manifest::load(const std::string& path, std::string& error) {
+    data.reset();
+    std::filesystem::path manifestPath;
+    if (!resolveManifestPath(path, manifestPath, error)) {
+        return false;
+    }
+    if (isShardIndex(manifestPath)) {
+        error = "a sharded checksum file cannot be loaded; compare it by path";
+        return false;
+    }
+    data = loadCachedManifest(manifestPath, 0, error);
+    sourcePath = manifestPath.string();
+    return data != nullptr;
+}
 
-                // Show modified files
-                if (!modifiedFiles.empty()) {
-                    std::cout << "\n\033[1;33mModified Files (" << changedCount << "):\033[0m" << std::endl;
-                    for (const auto& file : modifiedFiles) {
-                        std::cout << "  " << file << std::endl;
-                    }
-                }
-            }
-            else {
-                // For fewer changes, use the original line-by-line output
-                for (const auto& change : changedFiles) {
-                    if (change.changeType == "ADDED") {
-                        std::cout << "\033[1;32m[ADDED]\033[0m " << change.filePath << std::endl;
-                        addedCount++;
-                    }
-                    else if (change.changeType == "DELETED") {
-                        std::cout << "\033[1;31m[DELETED]\033[0m " << change.filePath << std::endl;
-                        deletedCount++;
-                    }
-                    else if (change.changeType == "CHANGED") {
-                        std::cout << "\033[1;33m[CHANGED]\033[0m " << change.filePath << std::endl;
-                        changedCount++;
-                    }
-                }
-            }
+size_t Manifest::size() const {
+    return data ? data->entries().size() : 0;
+}
 
-            std::cout << "-------------------------" << std::endl;
-            std::cout << "Summary: " << addedCount << " added, " << deletedCount << " deleted, " << changedCount << " changed" << std::endl;
+HashAlgorithm Manifest::algorithm() const {
+    return data ? data->header().algorithm : HashAlgorithm::Crc32;
+}
 
-            // Calculate change ratio for context
-            double changeRatio = static_cast<double>(changedFiles.size()) /
-                ((std::max)(currFiles.size(), newFiles.size()) > 0 ?
-                    (std::max)(currFiles.size(), newFiles.size()) : 1) * 100.0;
+bool Manifest::diff(const Manifest& other, std::vector<FileChangeInfo>& changes, std::string& error) const {
+    changes.clear();
+    if (!data || !other.data) {
+        error = "manifest not loaded";
+        return false;
+    }
 
-            std::cout << "Change percentage: " << std::fixed << std::setprecision(2)
-                << changeRatio << "% of files affected" << std::endl;
-            std::cout.flush();
-        }
+    return diffLoadedManifests(*data, sourcePath, *other.data, other.sourcePath, nullptr, [&](const ManifestChange& change) {
+        changes.push_back({ std::string(change.path), changeKindName(change.kind) });
+        return true;
+    }, error);
+}
 
-        // Return true if there are no changes, false if there are changes
-        return changedFiles.empty();
+int Manifest::verify(const std::string& directory, const std::vector<std::string>& excludePatterns, const VerifyOptions& options,
+    std::vector<FileChangeInfo>& changes) const {
+    changes.clear();
+    if (!data) {
+        return -1;
     }
-    catch (const std::exception& e) {
-        std::cout << "\n\033[1;31mUnexpected error during checksum validation: " << e.what() << "\033[0m" << std::endl;
+    return verifyTree(directory, sourcePath, data.get(), excludePatterns, options, changeInfoVisitor(changes));
+}
+
+bool Manifest::diff(const std::string& otherPath, std::vector<FileChangeInfo>& changes, std::string& error) const {
+    Manifest other;
+    if (!other.load(otherPath, error)) {
+        changes.clear();
         return false;
     }
+    return diff(other, changes, error);
 }
 
+void clearManifestCache() {
+    clearCachedManifests();
+}
 
-// Overload Implementations
-bool validateChecksumFile(const std::string& currPath, const std::string& newPath) {
-    std::vector<FileChangeInfo> changedFiles;
-    return validateChecksumFile(currPath, newPath, changedFiles);
+// Exported C-compatible function implementations
+#ifdef CS_HANDLER_EXPORTS
+int CreateChecksumFile(const char* path) {
+    return createChecksumFile(std::string(path), {});
 }
 
+// True when the caller's ChecksumCreateOptions is large enough to contain field
+#define CS_OPTION_PRESENT(options, field) \
+    ((options)->structSize >= offsetof(ChecksumCreateOptions, field) + sizeof((options)->field))
 
-std::vector<FileChangeInfo> getChecksumFileChanges(const std::string& currPath, const std::string& newPath, bool printResults) {
-    std::vector<FileChangeInfo> changes;
-    validateChecksumFile(currPath, newPath, changes);
-    return changes;
+// Copy stats into a caller's ChecksumRunStats, up to the structSize it was compiled with
+static void copyRunStats(const RunStats& stats, ChecksumRunStats* statsOut) {
+    if (statsOut == nullptr || statsOut->structSize < sizeof(unsigned int)) {
+        return;
+    }
+
+    ChecksumRunStats full{};
+    full.structSize = statsOut->structSize;
+    full.threadCount = static_cast<unsigned int>(stats.threadBusySeconds.size());
+    full.wallSeconds = stats.wallSeconds;
+    full.filesEnumerated = stats.filesEnumerated;
+    full.bytesEnumerated = stats.bytesEnumerated;
+    full.filesHashed = stats.filesHashed;
+    full.filesReused = stats.filesReused;
+    full.filesExtended = stats.filesExtended;
+    full.bytesRead = stats.bytesRead;
+    full.entriesParsed = stats.entriesParsed;
+    full.changesFound = stats.changesFound;
+    full.walkErrors = stats.walkErrors;
+    full.readErrors = stats.readErrors;
+    full.writeErrors = stats.writeErrors;
+    full.parseErrors = stats.parseErrors;
+    full.walkSeconds = stats.walkSeconds;
+    full.openSeconds = stats.openSeconds;
+    full.readSeconds = stats.readSeconds;
+    full.hashSeconds = stats.hashSeconds;
+    full.writeSeconds = stats.writeSeconds;
+    full.parseSeconds = stats.parseSeconds;
+    full.diffSeconds = stats.diffSeconds;
+    full.megabytesPerSecond = megabytesPerSecond(stats);
+    full.filesLinked = stats.filesLinked;
+    full.bytesSpilled = stats.bytesSpilled;
+
+    std::vector<double> utilization = threadUtilization(stats);
+    if (!utilization.empty()) {
+        full.threadUtilizationMin = *std::min_element(utilization.begin(), utilization.end());
+        full.threadUtilizationMax = *std::max_element(utilization.begin(), utilization.end());
+        for (double share : utilization) {
+            full.threadUtilizationMean += share / static_cast<double>(utilization.size());
+        }
+    }
+    std::memcpy(statsOut, &full, (std::min)(static_cast<size_t>(statsOut->structSize), sizeof(full)));
 }
 
-// Exported C-compatible function implementations
-#ifdef CHECKSUMHANDLER_EXPORTS
-int CreateChecksumFile(const char* path) {
-    return createChecksumFile(std::string(path), {});
+int CreateChecksumFileEx(const char* path, const ChecksumCreateOptions* options) {
+    if (path == nullptr) {
+        return -1;
+    }
+
+    ChecksumOptions createOptions;
+    RunStats stats;
+    ChecksumRunStats* statsOut = nullptr;
+    std::vector<std::string> excludePatterns;
+    if (options != nullptr) {
+        if (CS_OPTION_PRESENT(options, algorithm) && options->algorithm != nullptr && options->algorithm[0] != '\0' &&
+            !parseHashAlgorithm(options->algorithm, createOptions.algorithm)) {
+            std::cout << "\n\033[1;31mError: Unknown hash algorithm: " << options->algorithm << "\033[0m" << std::endl;
+            return -1;
+        }
+        if (CS_OPTION_PRESENT(options, threadCount) && options->threadCount > 0) {
+            createOptions.threadCount = static_cast<unsigned int>(options->threadCount);
+        }
+        if (CS_OPTION_PRESENT(options, readStrategy) && options->readStrategy != nullptr && options->readStrategy[0] != '\0' &&
+            !parseReadStrategy(options->readStrategy, createOptions.readStrategy)) {
+            std::cout << "\n\033[1;31mError: Unknown read strategy: " << options->readStrategy << "\033[0m" << std::endl;
+            return -1;
+        }
+        if (CS_OPTION_PRESENT(options, ioQueueDepth) && options->ioQueueDepth > 0) {
+            createOptions.ioQueueDepth = static_cast<unsigned int>(options->ioQueueDepth);
+        }
+        if (CS_OPTION_PRESENT(options, ioBufferCount) && options->ioBufferCount > 0) {
+            createOptions.ioBufferCount = static_cast<unsigned int>(options->ioBufferCount);
+        }
+        if (CS_OPTION_PRESENT(options, incremental)) {
+            createOptions.incremental = options->incremental != 0;
+        }
+        if (CS_OPTION_PRESENT(options, paranoidSample)) {
+            createOptions.paranoidSample = (std::min)((std::max)(options->paranoidSample, 0.0), 1.0);
+        }
+        if (CS_OPTION_PRESENT(options, excludeFile) && options->excludeFile != nullptr) {
+            createOptions.excludeFile = options->excludeFile;
+        }
+        if (CS_OPTION_PRESENT(options, frontCoding)) {
+            createOptions.frontCoding = options->frontCoding != 0;
+        }
+        if (CS_OPTION_PRESENT(options, appendAware)) {
+            createOptions.appendAware = options->appendAware != 0;
+        }
+        if (CS_OPTION_PRESENT(options, quiet)) {
+            createOptions.quiet = options->quiet != 0;
+        }
+        if (CS_OPTION_PRESENT(options, stats) && options->stats != nullptr) {
+            statsOut = options->stats;
+            createOptions.stats = &stats;
+        }
+        if (CS_OPTION_PRESENT(options, duplicateReport) && options->duplicateReport != nullptr) {
+            createOptions.duplicateReport = options->duplicateReport;
+        }
+        if (CS_OPTION_PRESENT(options, sharded)) {
+            createOptions.sharded = options->sharded != 0;
+        }
+        if (CS_OPTION_PRESENT(options, shardUpdateCount) && options->shardUpdates != nullptr) {
+            for (int i = 0; i < options->shardUpdateCount; i++) {
+                if (options->shardUpdates[i] != nullptr) {
+                    createOptions.shardUpdates.push_back(options->shardUpdates[i]);
+                }
+            }
+        }
+        if (CS_OPTION_PRESENT(options, excludePatternCount) && options->excludePatterns != nullptr) {
+            for (int i = 0; i < options->excludePatternCount; i++) {
+                if (options->excludePatterns[i] != nullptr) {
+                    excludePatterns.push_back(options->excludePatterns[i]);
+                }
+            }
+        }
+    }
+
+    int result = createChecksumFile(std::string(path), excludePatterns, createOptions);
+    copyRunStats(stats, statsOut);
+    return result;
 }
 
 bool ValidateChecksumFile(const char* currPath, const char* newPath) {
     return validateChecksumFile(std::string(currPath), std::string(newPath));
 }
 
+bool ConvertChecksumFile(const char* inputPath, const char* outputPath) {
+    return convertChecksumFile(std::string(inputPath), std::string(outputPath));
+}
+
 int GetChangedFiles(const char* currPath, const char* newPath, char*** filePathsOut, char*** changeTypesOut, int* count) {
     // Validate input parameters
     if (filePathsOut == nullptr || changeTypesOut == nullptr || count == nullptr) {
@@ -446,9 +2439,8 @@ int GetChangedFiles(const char* currPath, const char* newPath, char*** filePaths
     *count = 0;
 
     try {
-        // Get changed files - FIXED VERSION
-        std::vector<FileChangeInfo> changedFiles;
-        getChecksumFileChanges(std::string(currPath), std::string(newPath), changedFiles, false);
+        // Get changed files
+        std::vector<FileChangeInfo> changedFiles = getChecksumFileChanges(std::string(currPath), std::string(newPath), false);
 
         // Set the count
         *count = static_cast<int>(changedFiles.size());
@@ -491,7 +2483,7 @@ int GetChangedFiles(const char* currPath, const char* newPath, char*** filePaths
                 *count = 0;
                 return -2; // Memory allocation failure
             }
-            strcpy_s((*filePathsOut)[i], pathLen, info.filePath.c_str());
+            std::memcpy((*filePathsOut)[i], info.filePath.c_str(), pathLen);
 
             // Allocate and copy change type
             size_t typeLen = info.changeType.length() + 1;
@@ -504,7 +2496,7 @@ int GetChangedFiles(const char* currPath, const char* newPath, char*** filePaths
                 *count = 0;
                 return -2; // Memory allocation failure
             }
-            strcpy_s((*changeTypesOut)[i], typeLen, info.changeType.c_str());
+            std::memcpy((*changeTypesOut)[i], info.changeType.c_str(), typeLen);
         }
 
         return 1; // Success
@@ -540,4 +2532,288 @@ void FreeChangedFiles(char** filePaths, char** changeTypes, int count) {
         free(changeTypes);
     }
 }
-#endif
\ No newline at end of file
+
+// Copy changes into one block: header, record array, then the NUL-terminated paths.
+// Returns nullptr when the allocation fails.
+static ChecksumChangeSet* buildChangeSet(const std::vector<ManifestChange>& changes) {
+    // Size everything first so the header, records and paths fit one allocation
+    size_t pathsSize = 0;
+    for (const auto& change : changes) {
+        pathsSize += change.path.size() + 1;
+    }
+    size_t recordsOffset = sizeof(ChecksumChangeSet);
+    size_t pathsOffset = recordsOffset + changes.size() * sizeof(ChecksumChangeRecord);
+
+    char* block = static_cast<char*>(malloc(pathsOffset + pathsSize));
+    if (block == nullptr) {
+        return nullptr;
+    }
+
+    ChecksumChangeSet* changeSet = reinterpret_cast<ChecksumChangeSet*>(block);
+    ChecksumChangeRecord* records = reinterpret_cast<ChecksumChangeRecord*>(block + recordsOffset);
+    char* paths = block + pathsOffset;
+    *changeSet = ChecksumChangeSet{};
+    changeSet->structSize = sizeof(ChecksumChangeSet);
+    changeSet->recordSize = sizeof(ChecksumChangeRecord);
+    changeSet->count = changes.size();
+    changeSet->records = records;
+    changeSet->paths = paths;
+    changeSet->pathsSize = pathsSize;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < changes.size(); i++) {
+        const ManifestChange& change = changes[i];
+        records[i].changeType = static_cast<uint32_t>(change.kind);
+        records[i].pathLength = static_cast<uint32_t>(change.path.size());
+        records[i].pathOffset = offset;
+        std::memcpy(paths + offset, change.path.data(), change.path.size());
+        paths[offset + change.path.size()] = '\0';
+        offset += change.path.size() + 1;
+
+        changeSet->addedCount += change.kind == ChangeKind::Added;
+        changeSet->deletedCount += change.kind == ChangeKind::Deleted;
+        changeSet->changedCount += change.kind == ChangeKind::Changed;
+        changeSet->appendedCount += change.kind == ChangeKind::Appended;
+    }
+    return changeSet;
+}
+
+// Sink handing each change to a ChecksumChangeCallback until it asks to stop
+static ManifestChangeSink callbackSink(ChecksumChangeCallback callback, void* context) {
+    return [callback, context](const ManifestChange& change) {
+        return callback(context, static_cast<int>(change.kind), change.path.data(), static_cast<uint32_t>(change.path.size())) == 0;
+    };
+}
+
+// Hand collected changes to a ChecksumChangeCallback until it asks to stop
+static void streamChanges(const std::vector<ManifestChange>& changes, const ManifestChangeSink& onChange) {
+    for (const auto& change : changes) {
+        if (!onChange(change)) {
+            break;
+        }
+    }
+}
+
+// ValidateOptions for the ChecksumCompareFlags of the C entry points
+static ValidateOptions compareFlagOptions(unsigned int flags) {
+    ValidateOptions options;
+    options.appendAware = (flags & ChecksumCompareAppendAware) != 0;
+    options.quiet = (flags & ChecksumCompareQuiet) != 0;
+    return options;
+}
+
+int ValidateChecksumFileEx(const char* currPath, const char* newPath, unsigned int flags, ChecksumRunStats* stats) {
+    if (currPath == nullptr || newPath == nullptr) {
+        return -1; // Invalid parameters
+    }
+
+    try {
+        RunStats runStats;
+        ValidateOptions options = compareFlagOptions(flags);
+        options.stats = stats != nullptr ? &runStats : nullptr;
+        int result = compareChecksumFiles(std::string(currPath), std::string(newPath), options, true,
+            [](const std::vector<ManifestChange>&) {});
+        copyRunStats(runStats, stats);
+        return result < 0 ? -4 : result;
+    }
+    catch (const std::exception&) {
+        return -3; // Exception occurred
+    }
+}
+
+// Verify for the C entry points, from a manifest path or a loaded manifest
+static int verifyForCaller(const char* directory, const std::string& manifestPath, const ParsedManifest* loaded,
+    unsigned int flags, ChecksumChangeCallback callback, void* context, ChecksumRunStats* stats) {
+    try {
+        RunStats runStats;
+        VerifyOptions options;
+        options.failFast = (flags & ChecksumCompareFailFast) != 0;
+        options.quiet = (flags & ChecksumCompareQuiet) != 0;
+        options.stats = stats != nullptr ? &runStats : nullptr;
+        int result = verifyTree(std::string(directory), manifestPath, loaded, {}, options,
+            [&](const std::vector<ManifestChange>& changes) {
+                if (callback != nullptr) {
+                    streamChanges(changes, callbackSink(callback, context));
+                }
+            });
+        copyRunStats(runStats, stats);
+        return result < 0 ? -4 : result;
+    }
+    catch (const std::exception&) {
+        return -3; // Exception occurred
+    }
+}
+
+int VerifyChecksumFile(const char* directory, const char* manifestPath, unsigned int flags,
+    ChecksumChangeCallback callback, void* context, ChecksumRunStats* stats) {
+    if (directory == nullptr || manifestPath == nullptr) {
+        return -1; // Invalid parameters
+    }
+    return verifyForCaller(directory, std::string(manifestPath), nullptr, flags, callback, context, stats);
+}
+
+int GetChangeSet(const char* currPath, const char* newPath, ChecksumChangeSet** changeSetOut) {
+    return GetChangeSetEx(currPath, newPath, 0, changeSetOut);
+}
+
+int GetChangeSetEx(const char* currPath, const char* newPath, unsigned int flags, ChecksumChangeSet** changeSetOut) {
+    if (currPath == nullptr || newPath == nullptr || changeSetOut == nullptr) {
+        return -1; // Invalid parameters
+    }
+    *changeSetOut = nullptr;
+
+    try {
+        bool allocated = true;
+        int result = compareChecksumFiles(std::string(currPath), std::string(newPath), compareFlagOptions(flags), false,
+            [&](const std::vector<ManifestChange>& changes) {
+                *changeSetOut = buildChangeSet(changes);
+                allocated = *changeSetOut != nullptr;
+            });
+
+        if (!allocated) {
+            return -2; // Memory allocation failure
+        }
+        if (result < 0) {
+            return -4; // Checksum files could not be compared
+        }
+        return result;
+    }
+    catch (const std::exception&) {
+        FreeChangeSet(*changeSetOut);
+        *changeSetOut = nullptr;
+        return -3; // Exception occurred
+    }
+}
+
+void FreeChangeSet(ChecksumChangeSet* changeSet) {
+    free(changeSet);
+}
+
+struct ChecksumManifest {
+    Manifest manifest;
+};
+
+// Diff two handles for the C entry points; -1 for a missing handle, -4 when they
+// cannot be compared, otherwise 1 when onChange received a change
+static int diffManifestHandles(const ChecksumManifest* currManifest, const ChecksumManifest* newManifest,
+    const ManifestChangeSink& onChange) {
+    if (currManifest == nullptr || newManifest == nullptr) {
+        return -1; // Invalid parameters
+    }
+    std::string error;
+    bool changed = false;
+    if (!diffLoadedManifests(*currManifest->manifest.parsed(), currManifest->manifest.path(),
+        *newManifest->manifest.parsed(), newManifest->manifest.path(), nullptr,
+        [&](const ManifestChange& change) {
+            changed = true;
+            return onChange(change);
+        }, error)) {
+        std::cout << "\n\033[1;31mError: " << error << "\033[0m" << std::endl;
+        return -4;
+    }
+    return changed ? 1 : 0;
+}
+
+int ForEachChangedFile(const char* currPath, const char* newPath, ChecksumChangeCallback callback, void* context) {
+    return ForEachChangedFileEx(currPath, newPath, 0, callback, context);
+}
+
+int ForEachChangedFileEx(const char* currPath, const char* newPath, unsigned int flags, ChecksumChangeCallback callback,
+    void* context) {
+    if (currPath == nullptr || newPath == nullptr || callback == nullptr) {
+        return -1; // Invalid parameters
+    }
+
+    try {
+        // Paths are handed out straight from the loaded manifests as the diff finds them
+        ManifestChangeSink onChange = callbackSink(callback, context);
+        int result = compareChecksumFiles(std::string(currPath), std::string(newPath), compareFlagOptions(flags), false,
+            [&](const std::vector<ManifestChange>& changes) {
+                streamChanges(changes, onChange);
+            }, &onChange);
+        return result < 0 ? -4 : result;
+    }
+    catch (const std::exception&) {
+        return -3; // Exception occurred
+    }
+}
+
+ChecksumManifest* LoadManifest(const char* path) {
+    if (path == nullptr) {
+        return nullptr;
+    }
+
+    try {
+        ChecksumManifest* handle = new ChecksumManifest();
+        std::string error;
+        if (!handle->manifest.load(std::string(path), error)) {
+            std::cout << "\n\033[1;31mError: Unable to load checksum file " << path << ": " << error << "\033[0m" << std::endl;
+            delete handle;
+            return nullptr;
+        }
+        return handle;
+    }
+    catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+void FreeManifest(ChecksumManifest* manifest) {
+    delete manifest;
+}
+
+uint64_t GetManifestEntryCount(const ChecksumManifest* manifest) {
+    return manifest != nullptr ? manifest->manifest.size() : 0;
+}
+
+int GetManifestChangeSet(const ChecksumManifest* currManifest, const ChecksumManifest* newManifest, ChecksumChangeSet** changeSetOut) {
+    if (changeSetOut == nullptr) {
+        return -1; // Invalid parameters
+    }
+    *changeSetOut = nullptr;
+
+    try {
+        std::vector<ManifestChange> changes;
+        int result = diffManifestHandles(currManifest, newManifest, collectChanges(changes));
+        if (result < 0) {
+            return result;
+        }
+        *changeSetOut = buildChangeSet(changes);
+        if (*changeSetOut == nullptr) {
+            return -2; // Memory allocation failure
+        }
+        return result;
+    }
+    catch (const std::exception&) {
+        FreeChangeSet(*changeSetOut);
+        *changeSetOut = nullptr;
+        return -3; // Exception occurred
+    }
+}
+
+int ForEachManifestChange(const ChecksumManifest* currManifest, const ChecksumManifest* newManifest,
+    ChecksumChangeCallback callback, void* context) {
+    if (callback == nullptr) {
+        return -1; // Invalid parameters
+    }
+
+    try {
+        return diffManifestHandles(currManifest, newManifest, callbackSink(callback, context));
+    }
+    catch (const std::exception&) {
+        return -3; // Exception occurred
+    }
+}
+
+int VerifyManifest(const ChecksumManifest* manifest, const char* directory, unsigned int flags,
+    ChecksumChangeCallback callback, void* context, ChecksumRunStats* stats) {
+    if (manifest == nullptr || directory == nullptr) {
+        return -1; // Invalid parameters
+    }
+    return verifyForCaller(directory, manifest->manifest.path(), manifest->manifest.parsed(), flags, callback, context, stats);
+}
+
+void ClearManifestCache() {
+    clearManifestCache();
+}
+#endif
@@ -1,14 +1,13 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <filesystem>
+#include <memory>
 #include <vector>
-
-#ifdef CS_HANDLER_EXPORTS
-#define CS_HANDLER_API __declspec(dllexport)
-#else
-#define CS_HANDLER_API __declspec(dllimport)
-#endif
+#include "cs_handler_api.h"
+#include "file_reader.h"
+#include "hash.h"
 
 // Define a struct to hold file change information
 struct FileChangeInfo {
@@ -16,23 +15,343 @@ struct FileChangeInfo {
     std::string changeType;
 };
 
+// Counters and timings of one create or compare, filled in when a caller
+// passes ChecksumOptions::stats or ValidateOptions::stats
+struct RunStats {
+    std::string operation;          // "create", "watch", "compare", "verify", "duplicates", "snapshot", "snapshot-diff", ...
+    double wallSeconds = 0.0;
+    uint64_t filesEnumerated = 0;   // Files found by the walk
+    uint64_t bytesEnumerated = 0;   // Their sizes at stat time
+    uint64_t filesHashed = 0;       // Read in full
+    uint64_t filesReused = 0;       // Digest taken from the previous manifest
+    uint64_t filesExtended = 0;     // Digest extended with the appended bytes
+    uint64_t filesLinked = 0;       // Hard links that took the digest of another path to the same file
+    uint64_t bytesRead = 0;         // Read from files for hashing and append checks
+    uint64_t bytesSpilled = 0;      // Written to temporary sort runs when a compare exceeds its memory budget
+    uint64_t entriesParsed = 0;     // Entries of both compared manifests
+    uint64_t changesFound = 0;
+    uint64_t walkErrors = 0;        // Directories that could not be listed
+    uint64_t readErrors = 0;        // Files that could not be hashed
+    uint64_t writeErrors = 0;
+    uint64_t parseErrors = 0;       // Malformed manifest lines
+    // Seconds per phase, summed over threads (see MetricPhase)
+    double walkSeconds = 0.0;
+    double openSeconds = 0.0;
+    double readSeconds = 0.0;
+    double hashSeconds = 0.0;
+    double writeSeconds = 0.0;
+    double parseSeconds = 0.0;
+    double diffSeconds = 0.0;
+    std::vector<double> threadBusySeconds;  // Time each pool worker spent running tasks
+};
+
+// Options for creating a checksum file
+struct ChecksumOptions {
+    HashAlgorithm algorithm = HashAlgorithm::Crc32;
+    unsigned int threadCount = 0;   // Hashing threads; 0 = one per hardware thread
+    ReadStrategy readStrategy = ReadStrategy::Auto;
+    unsigned int ioQueueDepth = 0;  // io_uring entries (uring strategy); 0 = default
+    unsigned int ioBufferCount = 0; // Pooled read buffers = files in flight; 0 = queue depth
+    bool incremental = false;       // Reuse digests whose size/mtime/inode match the previous manifest
+    double paranoidSample = 0.0;    // Fraction (0..1) of reusable entries rehashed anyway
+    std::string excludeFile;        // Gitignore-style pattern file; empty = none
+    bool frontCoding = false;       // Store paths as shared-prefix length + suffix (format v5)
+    bool appendAware = false;       // Extend the CRCs of files that only grew from the previous manifest (format v6)
+    bool quiet = false;             // No console output at all
+    RunStats* stats = nullptr;      // Receives the run's metrics; timing is only enabled when set
+    std::string duplicateReport;    // Also write the files with equal digests here; empty = none
+    bool sharded = false;           // Write checksum.idx plus one manifest per top-level directory
+    std::vector<std::string> shardUpdates;  // Rebuild only the shards holding these paths (implies sharded)
+    std::string historyStore;       // Also record the new checksum file as a snapshot in this store; empty = none
+};
+
+// Options for comparing checksum files
+struct ValidateOptions {
+    bool appendAware = false;       // Read grown files under treeDirectory to tell appends from rewrites
+    std::string treeDirectory;      // Folder the new manifest describes; empty = the folder holding it
+    uint64_t memoryBudget = 0;      // Bytes; larger comparisons sort through temporary files instead; 0 = no limit
+    std::string tempDirectory;      // Where those files go; empty = the system temporary directory
+    bool quiet = false;             // No console output at all
+    RunStats* stats = nullptr;      // Receives the comparison's metrics
+};
+
+// Options for checking a directory against a checksum file
+struct VerifyOptions {
+    unsigned int threadCount = 0;   // Hashing threads; 0 = one per hardware thread
+    ReadStrategy readStrategy = ReadStrategy::Auto;
+    bool failFast = false;          // Stop at the first difference instead of listing them all
+    std::string excludeFile;        // Gitignore-style pattern file; empty = none
+    bool quiet = false;             // No console output at all
+    RunStats* stats = nullptr;      // Receives the run's metrics
+};
+
+// Options for finding duplicate files
+struct DuplicateOptions {
+    HashAlgorithm algorithm = HashAlgorithm::Xxh3_128;  // Digest that confirms a duplicate
+    unsigned int threadCount = 0;   // Hashing threads; 0 = one per hardware thread
+    ReadStrategy readStrategy = ReadStrategy::Auto;
+    std::string excludeFile;        // Gitignore-style pattern file; empty = none
+    std::string reportPath;         // Write the report here instead of printing the groups
+    bool quiet = false;             // No console output at all
+    RunStats* stats = nullptr;      // Receives the run's metrics
+};
+
+// Options for the snapshot history commands
+struct HistoryOptions {
+    std::string label;              // Name of an added snapshot, usable in place of its id; empty = none
+    bool listChanges = true;        // Diff: list every changed path, not only the summary
+    bool quiet = false;             // No console output at all
+    RunStats* stats = nullptr;      // Receives the run's metrics
+};
+
+// Options for watch mode
+struct WatchOptions {
+    unsigned int settleMs = 200;        // Quiet time that ends a burst of file system events
+    unsigned int persistSeconds = 30;   // checksum.txt is rewritten this often while out of date
+    unsigned int pollSeconds = 10;      // Resync interval where file system events are unavailable
+};
+
 // Calculate checksum for a file
 CS_HANDLER_API int calculateFileChecksum(const std::filesystem::path& filePath);
 
-// Create a checksum file
+// Calculate a file digest with the given algorithm; returns false if the file cannot be read
+CS_HANDLER_API bool calculateFileHash(const std::filesystem::path& filePath, HashAlgorithm algorithm, HashValue& hash);
+
+// Stats as one JSON object, with MB/s and per-thread utilization derived
+CS_HANDLER_API std::string formatRunStatsJson(const RunStats& stats);
+
+// Name of the CRC-32 / CRC-32C kernel selected for this CPU at startup
+CS_HANDLER_API const char* getCrc32KernelName();
+CS_HANDLER_API const char* getCrc32cKernelName();
+
+// Create a checksum file. An exclude pattern without glob characters skips every
+// path containing it; one with *, ? or [ is a gitignore-style pattern.
 CS_HANDLER_API int createChecksumFile(const std::string& path, const std::vector<std::string>& excludePatterns = {});
+CS_HANDLER_API int createChecksumFile(const std::string& path, const std::vector<std::string>& excludePatterns, const ChecksumOptions& options);
+
+// Create (or incrementally refresh) the checksum file, then keep it current from
+// file system events until stopWatching is called. Returns 200 like create.
+// options.stats receives the catch-up create's counters plus every batch's.
+CS_HANDLER_API int watchChecksumFile(const std::string& path, const std::vector<std::string>& excludePatterns,
+    const ChecksumOptions& options, const WatchOptions& watchOptions);
+
+// Safe to call from a signal handler: end a running watch, or have it print
+// the files that drifted since it started
+CS_HANDLER_API void stopWatching();
+CS_HANDLER_API void requestWatchReport();
 
 // Validate checksum files
 CS_HANDLER_API bool validateChecksumFile(const std::string& currPath, const std::string& newPath);
+CS_HANDLER_API bool validateChecksumFile(const std::string& currPath, const std::string& newPath, const ValidateOptions& options);
+
+// Check the files under directory against a checksum file (or a folder holding
+// one) without writing a new manifest. Returns 0 when they match, 1 when they
+// differ (changes lists the differences, only the first ones with failFast) and
+// -1 when the manifest cannot be read.
+CS_HANDLER_API int verifyChecksumFile(const std::string& directory, const std::string& manifestPath,
+    const std::vector<std::string>& excludePatterns, const VerifyOptions& options, std::vector<FileChangeInfo>& changes);
+CS_HANDLER_API bool verifyChecksumFile(const std::string& directory, const std::string& manifestPath);
+
+// Find files with identical contents under path, reading only files that share
+// a size with another file and, past the first block, only those whose first
+// blocks match too. Returns 1 when duplicates were found, 0 when there are none
+// and -1 on error.
+CS_HANDLER_API int findDuplicateFiles(const std::string& path, const std::vector<std::string>& excludePatterns,
+    const DuplicateOptions& options);
+
+// Snapshot history: a store directory keeps any number of checksum files as
+// chunks of entries shared between snapshots, so each snapshot only adds the
+// chunks that changed. Snapshots are named by id (1, 2, ...) or label.
+// addSnapshot records a checksum file (or a folder holding one) as the next
+// snapshot and returns 0, or -1 on error.
+CS_HANDLER_API int addSnapshot(const std::string& storePath, const std::string& manifestPath, const HistoryOptions& options);
+CS_HANDLER_API int listSnapshots(const std::string& storePath, const HistoryOptions& options);
+
+// Changes between two snapshots; chunks they share are not read. Returns 1 when
+// they differ, 0 when they match and -1 on error.
+CS_HANDLER_API int diffSnapshots(const std::string& storePath, const std::string& from, const std::string& to,
+    const HistoryOptions& options, std::vector<FileChangeInfo>& changes);
+
+// Print the snapshots in which filePath (relative to the tree) was added, changed
+// or deleted. Returns their number, or -1 on error.
+CS_HANDLER_API int showFileHistory(const std::string& storePath, const std::string& filePath, const HistoryOptions& options);
+
+// Convert a checksum file between the text (checksum.txt) and binary (checksum.bin)
+// formats; the direction follows the format of inputPath
+CS_HANDLER_API bool convertChecksumFile(const std::string& inputPath, const std::string& outputPath);
 
 // Function to retrieve changes with return value
 CS_HANDLER_API std::vector<FileChangeInfo> getChecksumFileChanges(const std::string& currPath, const std::string& newPath, bool printResults = false);
+CS_HANDLER_API std::vector<FileChangeInfo> getChecksumFileChanges(const std::string& currPath, const std::string& newPath,
+    const ValidateOptions& options);
+
+class ParsedManifest;
+
+// A checksum file loaded once and compared any number of times. Copies share
+// the same immutable data. Loads go through a process-wide cache keyed by path
+// and file stat, so a manifest that is unchanged on disk is parsed only once,
+// including by validateChecksumFile and getChecksumFileChanges.
+class CS_HANDLER_API Manifest {
+public:
+    // path is a manifest file or a folder holding checksum.txt / checksum.bin;
+    // sharded checksum files cannot be loaded
+    bool load(const std::string& path, std::string& error);
+
+    bool isLoaded() const { return data != nullptr; }
+    size_t size() const;
+    HashAlgorithm algorithm() const;
+
+    // Changes from this manifest to other in path order; false (with error set)
+    // when the two cannot be compared
+    bool diff(const Manifest& other, std::vector<FileChangeInfo>& changes, std::string& error) const;
+
+    // Compare against a manifest file or folder, loaded through the cache
+    bool diff(const std::string& otherPath, std::vector<FileChangeInfo>& changes, std::string& error) const;
+
+    // Check the files under directory against this manifest, as verifyChecksumFile
+    // does, without reading the manifest again
+    int verify(const std::string& directory, const std::vector<std::string>& excludePatterns, const VerifyOptions& options,
+        std::vector<FileChangeInfo>& changes) const;
+
+    const ParsedManifest* parsed() const { return data.get(); }
+    const std::string& path() const { return sourcePath; }     // Manifest file it was loaded from
+
+private:
+    std::shared_ptr<const ParsedManifest> data;
+    std::string sourcePath;
+};
+
+// Drop every cached manifest; loaded Manifest objects keep their data
+CS_HANDLER_API void clearManifestCache();
 
 // Export functions with C linkage
 extern "C" {
+    // Metrics of CreateChecksumFileEx (ChecksumCreateOptions::stats), ValidateChecksumFileEx and VerifyChecksumFile.
+    // Set structSize to sizeof(ChecksumRunStats); fields beyond it are not written.
+    struct ChecksumRunStats {
+        unsigned int structSize;
+        unsigned int threadCount;               // Pool workers in the thread utilization figures
+        double wallSeconds;
+        uint64_t filesEnumerated;
+        uint64_t bytesEnumerated;
+        uint64_t filesHashed;
+        uint64_t filesReused;
+        uint64_t filesExtended;
+        uint64_t bytesRead;
+        uint64_t entriesParsed;
+        uint64_t changesFound;
+        uint64_t walkErrors;
+        uint64_t readErrors;
+        uint64_t writeErrors;
+        uint64_t parseErrors;
+        double walkSeconds;                     // Phase times, summed over threads
+        double openSeconds;
+        double readSeconds;
+        double hashSeconds;
+        double writeSeconds;
+        double parseSeconds;
+        double diffSeconds;
+        double megabytesPerSecond;              // bytesRead over the wall time
+        double threadUtilizationMin;            // Busy share of the wall time (0..1)
+        double threadUtilizationMean;
+        double threadUtilizationMax;
+        uint64_t filesLinked;                   // Hard links hashed once with the file they link to
+        uint64_t bytesSpilled;                  // Written to temporary sort runs by a memory-bounded compare
+    };
+
+    // Options for CreateChecksumFileEx. Set structSize to sizeof(ChecksumCreateOptions);
+    // fields beyond the size a caller was compiled with keep their defaults.
+    struct ChecksumCreateOptions {
+        unsigned int structSize;
+        const char* algorithm;                  // NULL or "" for crc32
+        int threadCount;                        // 0 = one per hardware thread
+        const char* const* excludePatterns;
+        int excludePatternCount;
+        const char* readStrategy;               // NULL or "" for auto; "mmap", "pread", "direct" or "uring"
+        int ioQueueDepth;                       // 0 = default (uring only)
+        int ioBufferCount;                      // 0 = queue depth (uring only)
+        int incremental;                        // Non-zero: reuse unchanged entries of the previous checksum.txt
+        double paranoidSample;                  // Fraction of reused entries rehashed anyway (0..1)
+        const char* excludeFile;                // NULL or path of a gitignore-style pattern file
+        int frontCoding;                        // Non-zero: front-code paths (format v5)
+        int appendAware;                        // Non-zero: extend the CRCs of files that only grew (format v6)
+        int quiet;                              // Non-zero: no console output
+        ChecksumRunStats* stats;                // NULL, or receives the run's metrics
+        const char* duplicateReport;            // NULL, or path of a report of files with equal digests
+        int sharded;                            // Non-zero: write checksum.idx and per-directory shards
+        const char* const* shardUpdates;        // Paths whose shards alone are rebuilt (implies sharded)
+        int shardUpdateCount;
+    };
+
+    // Change codes of ChecksumChangeRecord and ChecksumChangeCallback
+    enum ChecksumChangeType {
+        ChecksumChangeAdded = 1,
+        ChecksumChangeDeleted = 2,
+        ChecksumChangeChanged = 3,
+        ChecksumChangeAppended = 4              // Only with ChecksumCompareAppendAware
+    };
+
+    // Flags of GetChangeSetEx, ForEachChangedFileEx and VerifyChecksumFile
+    enum ChecksumCompareFlags {
+        ChecksumCompareAppendAware = 1,         // Report files that only grew as appended (reads their new bytes)
+        ChecksumCompareQuiet = 2,               // No console output
+        ChecksumCompareFailFast = 4             // VerifyChecksumFile and VerifyManifest only: stop at the first difference
+    };
+
+    struct ChecksumChangeRecord {
+        uint32_t changeType;                    // ChecksumChangeType
+        uint32_t pathLength;                    // Bytes, excluding the terminating NUL
+        uint64_t pathOffset;                    // Start of the path in ChecksumChangeSet::paths
+    };
+
+    // Result of GetChangeSet: this header, the record array and the path blob
+    // share one allocation, released with a single FreeChangeSet call. Records
+    // are in path order; every path in the blob is NUL terminated.
+    struct ChecksumChangeSet {
+        uint32_t structSize;                    // sizeof(ChecksumChangeSet) of the library
+        uint32_t recordSize;                    // sizeof(ChecksumChangeRecord) of the library
+        uint64_t count;
+        uint64_t addedCount;
+        uint64_t deletedCount;
+        uint64_t changedCount;
+        const ChecksumChangeRecord* records;
+        const char* paths;
+        uint64_t pathsSize;
+        uint64_t appendedCount;                 // Check structSize; always 0 without ChecksumCompareAppendAware
+    };
+
+    // Called once per change in path order. path is not NUL terminated and is
+    // only valid during the call; return non-zero to stop the iteration.
+    typedef int (*ChecksumChangeCallback)(void* context, int changeType, const char* path, uint32_t pathLength);
+
+    // Opaque handle to a loaded Manifest
+    struct ChecksumManifest;
+
     CS_HANDLER_API int CalculateChecksum(const char* filePath);
+    CS_HANDLER_API const char* GetCrc32Kernel();
+    CS_HANDLER_API const char* GetCrc32cKernel();
     CS_HANDLER_API int CreateChecksumFile(const char* path);
+    CS_HANDLER_API int CreateChecksumFileEx(const char* path, const ChecksumCreateOptions* options);
     CS_HANDLER_API bool ValidateChecksumFile(const char* currPath, const char* newPath);
+    CS_HANDLER_API int ValidateChecksumFileEx(const char* currPath, const char* newPath, unsigned int flags, ChecksumRunStats* stats);
+    CS_HANDLER_API int VerifyChecksumFile(const char* directory, const char* manifestPath, unsigned int flags,
+        ChecksumChangeCallback callback, void* context, ChecksumRunStats* stats);
+    CS_HANDLER_API bool ConvertChecksumFile(const char* inputPath, const char* outputPath);
     CS_HANDLER_API int GetChangedFiles(const char* currPath, const char* newPath, char*** filePathsOut, char*** changeTypesOut, int* count);
     CS_HANDLER_API void FreeChangedFiles(char** filePaths, char** changeTypes, int count);
+    CS_HANDLER_API int GetChangeSet(const char* currPath, const char* newPath, ChecksumChangeSet** changeSetOut);
+    CS_HANDLER_API int GetChangeSetEx(const char* currPath, const char* newPath, unsigned int flags, ChecksumChangeSet** changeSetOut);
+    CS_HANDLER_API void FreeChangeSet(ChecksumChangeSet* changeSet);
+    CS_HANDLER_API int ForEachChangedFile(const char* currPath, const char* newPath, ChecksumChangeCallback callback, void* context);
+    CS_HANDLER_API int ForEachChangedFileEx(const char* currPath, const char* newPath, unsigned int flags,
+        ChecksumChangeCallback callback, void* context);
+    CS_HANDLER_API ChecksumManifest* LoadManifest(const char* path);
+    CS_HANDLER_API void FreeManifest(ChecksumManifest* manifest);
+    CS_HANDLER_API uint64_t GetManifestEntryCount(const ChecksumManifest* manifest);
+    CS_HANDLER_API int GetManifestChangeSet(const ChecksumManifest* currManifest, const ChecksumManifest* newManifest, ChecksumChangeSet** changeSetOut);
+    CS_HANDLER_API int ForEachManifestChange(const ChecksumManifest* currManifest, const ChecksumManifest* newManifest,
+        ChecksumChangeCallback callback, void* context);
+    CS_HANDLER_API int VerifyManifest(const ChecksumManifest* manifest, const char* directory, unsigned int flags,
+        ChecksumChangeCallback callback, void* context, ChecksumRunStats* stats);
+    CS_HANDLER_API void ClearManifestCache();
 }
\ No newline at end of file
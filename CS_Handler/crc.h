@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Table-driven CRC engine for reflected polynomials (CRC-32, CRC-32C, CRC-64/XZ).
+// All lookup tables are generated at compile time, so there is no runtime
+// initialization and no shared mutable state between threads.
+//
+// The engine works on the raw CRC register: start from init(), feed data through
+// update() and call finalize() to apply the final XOR. Both init and final XOR
+// are all ones for every variant defined below.
+template <typename T, T Polynomial>
+struct CrcEngine {
+    using value_type = T;
+
+    static constexpr T polynomial = Polynomial;
+    static constexpr int width = static_cast<int>(sizeof(T) * 8);
+    static constexpr size_t maxSlices = 16;
+
+    using Table = std::array<T, 256>;
+    using SliceTables = std::array<Table, maxSlices>;
+
+    // tables[0] is the classic byte-at-a-time table. tables[k][b] is the CRC
+    // contribution of byte b followed by k zero bytes, which lets slicing-by-N
+    // fold N input bytes with N independent lookups.
+    static constexpr SliceTables makeTables() {
+        SliceTables tables{};
+        for (uint32_t i = 0; i < 256; i++) {
+            T c = static_cast<T>(i);
+            for (int j = 0; j < 8; j++) {
+                c = (c & 1) ? static_cast<T>(Polynomial ^ (c >> 1)) : static_cast<T>(c >> 1);
+            }
+            tables[0][i] = c;
+        }
+        for (size_t k = 1; k < maxSlices; k++) {
+            for (uint32_t i = 0; i < 256; i++) {
+                T prev = tables[k - 1][i];
+                tables[k][i] = static_cast<T>((prev >> 8) ^ tables[0][prev & 0xFF]);
+            }
+        }
+        return tables;
+    }
+
+    alignas(64) static constexpr SliceTables tables = makeTables();
+
+    static constexpr T init() { return static_cast<T>(~T(0)); }
+    static constexpr T finalize(T state) { return static_cast<T>(~state); }
+
+    // One table lookup per byte. Used for tails and on big-endian hosts.
+    static T updateBytewise(T state, const uint8_t* data, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            state = static_cast<T>(tables[0][(state ^ data[i]) & 0xFF] ^ (state >> 8));
+        }
+        return state;
+    }
+
+    // Slicing-by-N: fold N bytes per iteration. N must be 8 or 16.
+    template <size_t N>
+    static T updateSlicing(T state, const uint8_t* data, size_t length) {
+        static_assert(N == 8 || N == 16, "slicing-by-8 and slicing-by-16 are supported");
+
+        if constexpr (std::endian::native != std::endian::little) {
+            return updateBytewise(state, data, length);
+        }
+        else {
+            while (length >= N) {
+                uint64_t words[N / 8];
+                std::memcpy(words, data, N);
+
+                // The CRC register overlaps the first bytes of the block
+                words[0] ^= static_cast<uint64_t>(state);
+
+                T crc = 0;
+                for (size_t w = 0; w < N / 8; w++) {
+                    for (size_t b = 0; b < 8; b++) {
+                        crc ^= tables[N - 1 - (w * 8 + b)][(words[w] >> (b * 8)) & 0xFF];
+                    }
+                }
+                state = crc;
+                data += N;
+                length -= N;
+            }
+            return updateBytewise(state, data, length);
+        }
+    }
+
+    static T update(T state, const void* data, size_t length) {
+        return updateSlicing<16>(state, static_cast<const uint8_t*>(data), length);
+    }
+
+    static T compute(const void* data, size_t length) {
+        return finalize(update(init(), data, length));
+    }
+
+    // Multiply two polynomials modulo the CRC polynomial (reflected bit order,
+    // x^0 is the top bit)
+    static constexpr T multModP(T a, T b) {
+        T product = 0;
+        for (T m = static_cast<T>(T(1) << (width - 1)); m != 0; m >>= 1) {
+            if (a & m) {
+                product ^= b;
+                if ((a & (m - 1)) == 0) {
+                    break;
+                }
+            }
+            b = (b & 1) ? static_cast<T>((b >> 1) ^ Polynomial) : static_cast<T>(b >> 1);
+        }
+        return product;
+    }
+
+    // x2nTable[k] = x^(2^k) mod P, enough entries for any 64-bit byte length
+    static constexpr std::array<T, 72> makeX2nTable() {
+        std::array<T, 72> table{};
+        table[0] = static_cast<T>(T(1) << (width - 2)); // x^1
+        for (size_t k = 1; k < table.size(); k++) {
+            table[k] = multModP(table[k - 1], table[k - 1]);
+        }
+        return table;
+    }
+
+    static constexpr std::array<T, 72> x2nTable = makeX2nTable();
+
+    // x^(8 * length) mod P: the operator that appends length zero bytes
+    static constexpr T zeroBytesOperator(uint64_t length) {
+        T p = static_cast<T>(T(1) << (width - 1)); // x^0
+        for (size_t k = 3; length != 0; length >>= 1, k++) {
+            if (length & 1) {
+                p = multModP(x2nTable[k], p);
+            }
+        }
+        return p;
+    }
+
+    // Finished CRC of A followed by B, from the finished CRCs of A and B and
+    // the length of B (same result as zlib's crc32_combine)
+    static constexpr T combine(T crcA, T crcB, uint64_t lengthB) {
+        return static_cast<T>(multModP(zeroBytesOperator(lengthB), crcA) ^ crcB);
+    }
+};
+
+// CRC-32 (ISO-HDLC, zlib, PNG) - the checksum written to checksum.txt
+using Crc32 = CrcEngine<uint32_t, 0xEDB88320u>;
+
+// CRC-32C (Castagnoli, iSCSI, ext4)
+using Crc32c = CrcEngine<uint32_t, 0x82F63B78u>;
+
+// CRC-64/XZ (ECMA-182 polynomial, reflected)
+using Crc64 = CrcEngine<uint64_t, 0xC96C5795D7870F42ull>;
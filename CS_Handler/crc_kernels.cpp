@@ -0,0 +1,318 @@
+#include "pch.h"
+#include "crc_kernels.h"
+#include "crc.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define CS_CRC_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CS_CRC_ARM64 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <arm_acle.h>
+#endif
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+// GCC and Clang only emit SIMD instructions inside functions that opt in to the
+// target feature; MSVC allows intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define CS_TARGET(features) __attribute__((target(features)))
+#else
+#define CS_TARGET(features)
+#endif
+
+namespace {
+
+using CrcUpdateFn = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+uint32_t crc32Portable(uint32_t state, const uint8_t* data, size_t length) {
+    return Crc32::update(state, data, length);
+}
+
+uint32_t crc32cPortable(uint32_t state, const uint8_t* data, size_t length) {
+    return Crc32c::update(state, data, length);
+}
+
+#ifdef CS_CRC_X86
+
+struct X86Features {
+    bool sse41 = false;
+    bool sse42 = false;
+    bool pclmul = false;
+};
+
+X86Features detectX86Features() {
+    X86Features features;
+    unsigned int ecx = 0;
+#ifdef _MSC_VER
+    int regs[4] = {};
+    __cpuid(regs, 1);
+    ecx = static_cast<unsigned int>(regs[2]);
+#else
+    unsigned int eax = 0, ebx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return features;
+    }
+#endif
+    features.pclmul = (ecx & (1u << 1)) != 0;
+    features.sse41 = (ecx & (1u << 19)) != 0;
+    features.sse42 = (ecx & (1u << 20)) != 0;
+    return features;
+}
+
+// Fold constants for the reflected CRC-32 polynomial 0xEDB88320
+// (x^n mod P for the fold distances, plus the Barrett reduction pair).
+alignas(16) const uint64_t kFold4x128[2] = { 0x0154442bd4, 0x01c6e41596 };
+alignas(16) const uint64_t kFold1x128[2] = { 0x01751997d0, 0x00ccaa009e };
+alignas(16) const uint64_t kFold64[2] = { 0x0163cd6124, 0x0000000000 };
+alignas(16) const uint64_t kBarrett[2] = { 0x01db710641, 0x01f7011641 };
+
+// Carry-less multiply folding over 64-byte blocks. Requires length >= 64 and a
+// multiple of 16; returns the raw CRC register.
+CS_TARGET("pclmul,sse4.1")
+uint32_t crc32FoldPclmul(uint32_t state, const uint8_t* data, size_t length) {
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(state)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(kFold4x128));
+    data += 64;
+    length -= 64;
+
+    // Fold four 128-bit lanes in parallel
+    while (length >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        data += 64;
+        length -= 64;
+    }
+
+    // Fold the four lanes into one
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(kFold1x128));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Remaining 16-byte blocks
+    while (length >= 16) {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        data += 16;
+        length -= 16;
+    }
+
+    // Fold 128 bits down to 64
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(kFold64));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(kBarrett));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+uint32_t crc32Pclmul(uint32_t state, const uint8_t* data, size_t length) {
+    if (length >= 64) {
+        size_t folded = length & ~static_cast<size_t>(15);
+        state = crc32FoldPclmul(state, data, folded);
+        data += folded;
+        length -= folded;
+    }
+    return Crc32::update(state, data, length);
+}
+
+CS_TARGET("sse4.2")
+uint32_t crc32cSse42(uint32_t state, const uint8_t* data, size_t length) {
+#if defined(_M_X64) || defined(__x86_64__)
+    uint64_t crc = state;
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u64(crc, word);
+        data += 8;
+        length -= 8;
+    }
+    state = static_cast<uint32_t>(crc);
+#endif
+    while (length >= 4) {
+        uint32_t word;
+        std::memcpy(&word, data, sizeof(word));
+        state = _mm_crc32_u32(state, word);
+        data += 4;
+        length -= 4;
+    }
+    while (length > 0) {
+        state = _mm_crc32_u8(state, *data++);
+        length--;
+    }
+    return state;
+}
+
+#endif // CS_CRC_X86
+
+#ifdef CS_CRC_ARM64
+
+bool detectArmCrc() {
+#if defined(_WIN32)
+    return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE) != 0;
+#elif defined(__APPLE__)
+    return true; // Every Apple silicon core implements the CRC extension
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return false;
+#endif
+}
+
+CS_TARGET("+crc")
+uint32_t crc32Arm(uint32_t state, const uint8_t* data, size_t length) {
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        state = __crc32d(state, word);
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        state = __crc32b(state, *data++);
+        length--;
+    }
+    return state;
+}
+
+CS_TARGET("+crc")
+uint32_t crc32cArm(uint32_t state, const uint8_t* data, size_t length) {
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        state = __crc32cd(state, word);
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        state = __crc32cb(state, *data++);
+        length--;
+    }
+    return state;
+}
+
+#endif // CS_CRC_ARM64
+
+struct CrcDispatch {
+    CrcKernel crc32Kernel = CrcKernel::Portable;
+    CrcKernel crc32cKernel = CrcKernel::Portable;
+    CrcUpdateFn crc32 = crc32Portable;
+    CrcUpdateFn crc32c = crc32cPortable;
+};
+
+CrcDispatch selectKernels() {
+    CrcDispatch dispatch;
+#ifdef CS_CRC_X86
+    X86Features features = detectX86Features();
+    if (features.pclmul && features.sse41) {
+        dispatch.crc32Kernel = CrcKernel::Pclmul;
+        dispatch.crc32 = crc32Pclmul;
+    }
+    if (features.sse42) {
+        dispatch.crc32cKernel = CrcKernel::Sse42;
+        dispatch.crc32c = crc32cSse42;
+    }
+#endif
+#ifdef CS_CRC_ARM64
+    if (detectArmCrc()) {
+        dispatch.crc32Kernel = CrcKernel::ArmCrc;
+        dispatch.crc32 = crc32Arm;
+        dispatch.crc32cKernel = CrcKernel::ArmCrc;
+        dispatch.crc32c = crc32cArm;
+    }
+#endif
+    return dispatch;
+}
+
+const CrcDispatch& crcDispatch() {
+    static const CrcDispatch dispatch = selectKernels();
+    return dispatch;
+}
+
+// Resolve the kernels while the library loads rather than on the first hash
+const CrcDispatch& initialDispatch = crcDispatch();
+
+} // namespace
+
+CrcKernel crc32Kernel() {
+    return crcDispatch().crc32Kernel;
+}
+
+CrcKernel crc32cKernel() {
+    return crcDispatch().crc32cKernel;
+}
+
+const char* crcKernelName(CrcKernel kernel) {
+    switch (kernel) {
+    case CrcKernel::Pclmul:
+        return "pclmulqdq";
+    case CrcKernel::Sse42:
+        return "sse4.2";
+    case CrcKernel::ArmCrc:
+        return "armv8-crc";
+    case CrcKernel::Portable:
+    default:
+        return "slicing-by-16";
+    }
+}
+
+uint32_t crc32Update(uint32_t state, const void* data, size_t length) {
+    return crcDispatch().crc32(state, static_cast<const uint8_t*>(data), length);
+}
+
+uint32_t crc32cUpdate(uint32_t state, const void* data, size_t length) {
+    return crcDispatch().crc32c(state, static_cast<const uint8_t*>(data), length);
+}
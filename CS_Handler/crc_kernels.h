@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC kernels available on this build, selected once per process from CPUID
+// (x86) or the hardware capability bits (ARMv8).
+enum class CrcKernel {
+    Portable,   // Slicing-by-16 tables from crc.h
+    Pclmul,     // PCLMULQDQ carry-less multiply folding (CRC-32 only)
+    Sse42,      // SSE4.2 crc32 instruction (CRC-32C only)
+    ArmCrc      // ARMv8 crc32/crc32c instructions
+};
+
+// Kernels chosen for the current CPU
+CrcKernel crc32Kernel();
+CrcKernel crc32cKernel();
+
+// Human-readable kernel name ("pclmulqdq", "sse4.2", "armv8-crc", "slicing-by-16")
+const char* crcKernelName(CrcKernel kernel);
+
+// Update a raw CRC register (no init/final XOR) using the selected kernel.
+// Results are identical to Crc32::update and Crc32c::update.
+uint32_t crc32Update(uint32_t state, const void* data, size_t length);
+uint32_t crc32cUpdate(uint32_t state, const void* data, size_t length);
@@ -0,0 +1,16 @@
+#pragma once
+
+// Marks the public API of the CS_Handler library. Building the library defines
+// CS_HANDLER_EXPORTS; targets that compile its sources in directly (the
+// benchmark) define CS_HANDLER_STATIC.
+#if defined(CS_HANDLER_STATIC)
+#define CS_HANDLER_API
+#elif defined(_WIN32)
+#ifdef CS_HANDLER_EXPORTS
+#define CS_HANDLER_API __declspec(dllexport)
+#else
+#define CS_HANDLER_API __declspec(dllimport)
+#endif
+#else
+#define CS_HANDLER_API __attribute__((visibility("default")))
+#endif
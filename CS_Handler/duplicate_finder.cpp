@@ -0,0 +1,320 @@
+#include "pch.h"
+#include "duplicate_finder.h"
+#include "file_hasher.h"
+#include "file_reader.h"
+#include "file_walker.h"
+#include "manifest.h"
+#include "manifest_writer.h"
+#include "merkle.h"
+#include "metrics.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+// Counts outstanding pool tasks down to zero
+class TaskLatch {
+public:
+    explicit TaskLatch(size_t count)
+        : remaining(count) {
+    }
+
+    void countDown() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--remaining == 0) {
+            done.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return remaining == 0; });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining;
+};
+
+bool digestLess(const HashValue& a, const HashValue& b) {
+    return a.size != b.size ? a.size < b.size : a.bytes < b.bytes;
+}
+
+} // namespace
+
+void DuplicateReport::add(std::string_view path, const FileStat& stat, const HashValue& digest) {
+    if (!stat.valid || stat.size == 0) {
+        return;
+    }
+    items.push_back({ std::string(path), stat.size, fileIdentity(stat), digest });
+}
+
+void DuplicateReport::finish() {
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+        if (a.size != b.size) {
+            return a.size < b.size;
+        }
+        if (!(a.digest == b.digest)) {
+            return digestLess(a.digest, b.digest);
+        }
+        return a.path < b.path;
+    });
+
+    groups.clear();
+    duplicates = 0;
+    wasted = 0;
+    std::vector<FileIdentity> identities;
+    for (size_t first = 0; first < items.size();) {
+        size_t last = first + 1;
+        while (last < items.size() && items[last].size == items[first].size && items[last].digest == items[first].digest) {
+            last++;
+        }
+
+        // Hard links to one file are not copies of it
+        identities.clear();
+        for (size_t i = first; i < last; i++) {
+            identities.push_back(items[i].identity);
+        }
+        std::sort(identities.begin(), identities.end(), [](const FileIdentity& a, const FileIdentity& b) {
+            return a.device != b.device ? a.device < b.device : a.inode < b.inode;
+        });
+        size_t copies = std::unique(identities.begin(), identities.end()) - identities.begin();
+        if (copies > 1) {
+            groups.push_back({ first, last - first, copies });
+            duplicates += copies - 1;
+            wasted += (copies - 1) * items[first].size;
+        }
+        first = last;
+    }
+
+    std::stable_sort(groups.begin(), groups.end(), [this](const Group& a, const Group& b) {
+        return (a.copies - 1) * items[a.first].size > (b.copies - 1) * items[b.first].size;
+    });
+}
+
+std::string DuplicateReport::formatGroup(const Group& group) const {
+    const Item& first = items[group.first];
+    std::string text = "#g " + hashToHex(first.digest) + " size=" + std::to_string(first.size) +
+        " copies=" + std::to_string(group.copies) + "\n";
+    for (size_t i = group.first; i < group.first + group.count; i++) {
+        text += items[i].path;
+        text += '\n';
+    }
+    return text;
+}
+
+bool DuplicateReport::write(const std::filesystem::path& reportPath, HashAlgorithm algorithm, std::string& error) const {
+    ManifestWriter reportFile;
+    if (!reportFile.open(reportPath, error)) {
+        return false;
+    }
+
+    reportFile.write("# checksum_handler duplicates algorithm=" + std::string(hashAlgorithmName(algorithm)) +
+        " groups=" + std::to_string(groups.size()) + " duplicates=" + std::to_string(duplicates) +
+        " wasted=" + std::to_string(wasted) + "\n");
+    for (const Group& group : groups) {
+        reportFile.write(formatGroup(group));
+    }
+    return reportFile.commit(error);
+}
+
+void DuplicateReport::print(std::ostream& out) const {
+    for (const Group& group : groups) {
+        const Item& first = items[group.first];
+        out << "\n\033[1;33m" << group.copies << " copies of " << first.size << " bytes:\033[0m" << std::endl;
+        for (size_t i = group.first; i < group.first + group.count; i++) {
+            out << "  " << items[i].path << std::endl;
+        }
+    }
+}
+
+DuplicateFinder::DuplicateFinder(const std::filesystem::path& directory, const ExcludeMatcher& excludeMatcher,
+    const DuplicateOptions& options)
+    : root(directory), excludeMatcher(excludeMatcher), options(options) {
+}
+
+void DuplicateFinder::scan() {
+    const size_t relativeStart = directoryPrefix(root.string()).size();
+    std::unordered_map<FileIdentity, size_t, FileIdentityHash> linkedFiles;
+
+    walkSortedFiles(root,
+        [&](const std::filesystem::directory_entry& entry) {
+            const std::filesystem::path& filePath = entry.path();
+            if (isChecksumOutputFile(filePath.filename())) {
+                return;
+            }
+            std::string pathText = filePath.string();
+            if (!excludeMatcher.empty() && excludeMatcher.excludes(pathText, relativeStart, false)) {
+                return;
+            }
+
+            FileStat stat;
+            {
+                PhaseTimer statTimer(MetricPhase::Walk);
+                readFileStat(filePath, stat);
+            }
+            scannedFiles++;
+            if (!stat.valid) {
+                readErrors++;
+                return;
+            }
+            enumeratedBytes += stat.size;
+            if (stat.size == 0) {
+                return;
+            }
+
+            // Further links to a file already seen add a path, not a file
+            std::string relativePath = pathText.substr((std::min)(relativeStart, pathText.size()));
+            if (stat.linkCount > 1) {
+                auto [it, inserted] = linkedFiles.try_emplace(fileIdentity(stat), candidates.size());
+                if (!inserted) {
+                    candidates[it->second].paths.push_back(std::move(relativePath));
+                    linkedPaths++;
+                    return;
+                }
+            }
+            Candidate candidate;
+            candidate.stat = stat;
+            candidate.paths.push_back(std::move(relativePath));
+            candidates.push_back(std::move(candidate));
+        },
+        [&](const std::filesystem::path& failedPath, const std::error_code& error) {
+            walkFailures.push_back({ failedPath, error.message() });
+        },
+        [&](const std::filesystem::path& directory) {
+            if (isChecksumOutputDirectory(directory.filename())) {
+                return false;
+            }
+            return excludeMatcher.empty() || !excludeMatcher.excludes(directory.string(), relativeStart, true);
+        });
+
+    // A file whose size no other file has cannot have a duplicate
+    std::stable_sort(candidates.begin(), candidates.end(),
+        [](const Candidate& a, const Candidate& b) { return a.stat.size < b.stat.size; });
+    std::vector<Candidate> shared;
+    for (size_t first = 0; first < candidates.size();) {
+        size_t last = first + 1;
+        while (last < candidates.size() && candidates[last].stat.size == candidates[first].stat.size) {
+            last++;
+        }
+        if (last - first > 1) {
+            std::move(candidates.begin() + first, candidates.begin() + last, std::back_inserter(shared));
+        }
+        first = last;
+    }
+    candidates = std::move(shared);
+}
+
+void DuplicateFinder::hashCandidates(DuplicateReport& report) {
+    unsigned int threadCount = options.threadCount > 0 ? options.threadCount : (std::max)(1u, std::thread::hardware_concurrency());
+    WorkStealingPool pool(threadCount);
+
+    // First block of every candidate; files no larger than it are hashed in
+    // full by the same read
+    {
+        TaskLatch latch(candidates.size());
+        for (size_t i = 0; i < candidates.size(); i++) {
+            pool.submit([this, i, &latch] {
+                Candidate& candidate = candidates[i];
+                uint64_t length = (std::min)(candidate.stat.size, duplicatePrefixSize);
+                bool whole = candidate.stat.size <= duplicatePrefixSize;
+                try {
+                    std::unique_ptr<Hasher> prefixHasher = createHasher(HashAlgorithm::Xxh3_64);
+                    std::unique_ptr<Hasher> fullHasher = whole ? createHasher(options.algorithm) : nullptr;
+                    uint64_t bytesRead = 0;
+                    bool read = readFileRange(root / std::filesystem::path(candidate.paths.front()), 0, length, options.readStrategy,
+                        [&](const void* data, size_t size) {
+                            prefixHasher->update(data, size);
+                            if (fullHasher) {
+                                fullHasher->update(data, size);
+                            }
+                        }, bytesRead);
+                    candidate.readable = read && bytesRead == length;
+                    candidate.prefix = hashToUint(prefixHasher->finalize());
+                    if (fullHasher) {
+                        candidate.digest = fullHasher->finalize();
+                    }
+                }
+                catch (const std::exception&) {
+                    candidate.readable = false;
+                }
+                latch.countDown();
+            });
+        }
+        latch.wait();
+    }
+
+    // Only larger files whose size and first block both match another file's are read in full
+    std::vector<size_t> order;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (!candidates[i].readable) {
+            readErrors++;
+        }
+        else if (candidates[i].stat.size <= duplicatePrefixSize) {
+            fullHashed++;
+        }
+        else {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        const Candidate& first = candidates[a];
+        const Candidate& second = candidates[b];
+        return first.stat.size != second.stat.size ? first.stat.size < second.stat.size : first.prefix < second.prefix;
+    });
+
+    std::vector<size_t> fullReads;
+    for (size_t first = 0; first < order.size();) {
+        size_t last = first + 1;
+        while (last < order.size() && candidates[order[last]].stat.size == candidates[order[first]].stat.size &&
+            candidates[order[last]].prefix == candidates[order[first]].prefix) {
+            last++;
+        }
+        if (last - first > 1) {
+            fullReads.insert(fullReads.end(), order.begin() + first, order.begin() + last);
+        }
+        else {
+            prefixHashed++;
+            candidates[order[first]].readable = false;   // Unique; nothing to report
+        }
+        first = last;
+    }
+
+    {
+        TaskLatch latch(fullReads.size());
+        for (size_t index : fullReads) {
+            Candidate& candidate = candidates[index];
+            scheduleFileHash(pool, root / std::filesystem::path(candidate.paths.front()), candidate.stat.size,
+                options.algorithm, options.readStrategy, [this, &candidate, &latch](bool hashed, const HashValue& hash) {
+                    candidate.readable = hashed;
+                    candidate.digest = hash;
+                    latch.countDown();
+                });
+        }
+        latch.wait();
+    }
+    pool.shutdown();
+
+    for (size_t index : fullReads) {
+        if (candidates[index].readable) {
+            fullHashed++;
+        }
+        else {
+            readErrors++;
+        }
+    }
+
+    for (const Candidate& candidate : candidates) {
+        if (!candidate.readable) {
+            continue;
+        }
+        for (const std::string& path : candidate.paths) {
+            report.add(path, candidate.stat, candidate.digest);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "checksum.h"
+#include "exclude_matcher.h"
+#include "file_stat.h"
+#include "file_walker.h"
+#include "hash.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bytes hashed from the start of each same-size file before full reads
+constexpr uint64_t duplicatePrefixSize = 4096;
+
+// Files with identical contents, grouped by size and digest. Paths that are
+// hard links to the same file count as one copy; a group needs two distinct
+// files. Empty files are never reported.
+class DuplicateReport {
+public:
+    void add(std::string_view path, const FileStat& stat, const HashValue& digest);
+
+    // Group the added files; call once after the last add
+    void finish();
+
+    size_t groupCount() const { return groups.size(); }
+    uint64_t duplicateCount() const { return duplicates; }   // Copies beyond the first of each group
+    uint64_t wastedBytes() const { return wasted; }          // Their total size
+
+    // Text report: a header, then per group a "#g <digest> size=<n> copies=<n>"
+    // line followed by its paths, largest groups (by wasted bytes) first
+    bool write(const std::filesystem::path& reportPath, HashAlgorithm algorithm, std::string& error) const;
+    void print(std::ostream& out) const;
+
+private:
+    struct Item {
+        std::string path;
+        uint64_t size;
+        FileIdentity identity;
+        HashValue digest;
+    };
+
+    struct Group {
+        size_t first;           // Range of items
+        size_t count;
+        size_t copies;          // Distinct files among them
+    };
+
+    std::string formatGroup(const Group& group) const;
+
+    std::vector<Item> items;
+    std::vector<Group> groups;
+    uint64_t duplicates = 0;
+    uint64_t wasted = 0;
+};
+
+// Finds duplicate files without hashing every file in full. Files are stat'ed
+// and bucketed by size; hard links collapse into one file by (device, inode).
+// Only files sharing a size have their first duplicatePrefixSize bytes hashed,
+// and only those whose prefixes also match are read in full.
+class DuplicateFinder {
+public:
+    DuplicateFinder(const std::filesystem::path& directory, const ExcludeMatcher& excludeMatcher, const DuplicateOptions& options);
+
+    DuplicateFinder(const DuplicateFinder&) = delete;
+    DuplicateFinder& operator=(const DuplicateFinder&) = delete;
+
+    // Stat walk; files of a size no other file has are dropped here
+    void scan();
+
+    // Prefix pass, then full hashes of the remaining candidates, into report
+    void hashCandidates(DuplicateReport& report);
+
+    size_t fileCount() const { return scannedFiles; }
+    uint64_t bytesEnumerated() const { return enumeratedBytes; }
+    size_t linkCount() const { return linkedPaths; }
+    size_t prefixHashedCount() const { return prefixHashed; }
+    size_t fullHashedCount() const { return fullHashed; }
+    size_t readErrorCount() const { return readErrors; }
+    size_t walkErrorCount() const { return walkFailures.size(); }
+    const std::vector<WalkFailure>& walkErrorList() const { return walkFailures; }
+
+private:
+    // One distinct file (by identity) and every path that links to it
+    struct Candidate {
+        FileStat stat;
+        std::vector<std::string> paths;     // Relative to the directory
+        uint64_t prefix = 0;
+        HashValue digest;
+        bool readable = true;
+    };
+
+    std::filesystem::path root;
+    const ExcludeMatcher& excludeMatcher;
+    const DuplicateOptions& options;
+    std::vector<Candidate> candidates;
+    size_t scannedFiles = 0;
+    uint64_t enumeratedBytes = 0;
+    size_t linkedPaths = 0;
+    size_t prefixHashed = 0;
+    size_t fullHashed = 0;
+    size_t readErrors = 0;
+    std::vector<WalkFailure> walkFailures;
+};
@@ -0,0 +1,309 @@
+#include "pch.h"
+#include "exclude_matcher.h"
+#include <algorithm>
+#include <deque>
+#include <fstream>
+
+void ExcludeMatcher::addPattern(std::string_view pattern) {
+    if (pattern.find_first_of("*?[") != std::string_view::npos) {
+        addIgnoreLine(pattern);
+    }
+    else if (!pattern.empty()) {
+        literals.emplace_back(pattern);
+    }
+}
+
+void ExcludeMatcher::addIgnoreLine(std::string_view line) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+        line.remove_suffix(1);
+    }
+    // Trailing spaces are ignored unless escaped
+    while (!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+        line.remove_suffix(1);
+    }
+    if (line.empty() || line[0] == '#') {
+        return;
+    }
+
+    Glob glob{ false, false };
+    if (line[0] == '!') {
+        glob.negated = true;
+        line.remove_prefix(1);
+    }
+    else if (line[0] == '\\' && line.size() > 1 && (line[1] == '!' || line[1] == '#')) {
+        line.remove_prefix(1);
+    }
+    if (!line.empty() && line.back() == '/') {
+        glob.directoryOnly = true;
+        line.remove_suffix(1);
+    }
+    if (line.empty()) {
+        return;
+    }
+
+    // A pattern with a '/' is relative to the root; otherwise it matches at any depth
+    bool anchored = line.find('/') != std::string_view::npos;
+    if (line[0] == '/') {
+        line.remove_prefix(1);
+    }
+
+    globStarts.push_back(static_cast<uint32_t>(tokens.size()));
+    if (!anchored) {
+        tokens.push_back({ TokenKind::DirectoryStar, 0, 0 });
+    }
+
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '*') {
+            bool atSegmentStart = i == 0 || line[i - 1] == '/';
+            if (atSegmentStart && line.substr(i, 3) == "**/") {
+                tokens.push_back({ TokenKind::DirectoryStar, 0, 0 });
+                i += 2;
+                continue;
+            }
+            if (atSegmentStart && line.substr(i) == "**") {
+                tokens.push_back({ TokenKind::DeepStar, 0, 0 });
+                break;
+            }
+            // Any other run of stars is a single '*'
+            while (i + 1 < line.size() && line[i + 1] == '*') {
+                i++;
+            }
+            tokens.push_back({ TokenKind::Star, 0, 0 });
+        }
+        else if (c == '?') {
+            tokens.push_back({ TokenKind::AnyChar, 0, 0 });
+        }
+        else if (c == '[') {
+            size_t j = i + 1;
+            bool negate = j < line.size() && (line[j] == '!' || line[j] == '^');
+            if (negate) {
+                j++;
+            }
+            std::bitset<256> set;
+            bool first = true;
+            while (j < line.size() && (line[j] != ']' || first)) {
+                unsigned char low = static_cast<unsigned char>(line[j]);
+                if (low == '\\' && j + 1 < line.size()) {
+                    low = static_cast<unsigned char>(line[++j]);
+                }
+                if (j + 2 < line.size() && line[j + 1] == '-' && line[j + 2] != ']') {
+                    unsigned char high = static_cast<unsigned char>(line[j + 2]);
+                    for (unsigned int value = low; value <= high; value++) {
+                        set.set(value);
+                    }
+                    j += 3;
+                }
+                else {
+                    set.set(low);
+                    j++;
+                }
+                first = false;
+            }
+            if (j >= line.size()) {
+                // No closing bracket: a literal '['
+                tokens.push_back({ TokenKind::Char, '[', 0 });
+                continue;
+            }
+            if (negate) {
+                set.flip();
+            }
+            set.reset('/');
+            tokens.push_back({ TokenKind::Class, 0, static_cast<uint32_t>(classes.size()) });
+            classes.push_back(set);
+            i = j;
+        }
+        else {
+            if (c == '\\' && i + 1 < line.size()) {
+                c = line[++i];
+            }
+            tokens.push_back({ TokenKind::Char, c, 0 });
+        }
+    }
+
+    tokens.push_back({ TokenKind::Accept, 0, static_cast<uint32_t>(globs.size()) });
+    globs.push_back(glob);
+}
+
+bool ExcludeMatcher::loadIgnoreFile(const std::filesystem::path& filePath, std::string& error) {
+    std::ifstream file(filePath);
+    if (!file.is_open()) {
+        error = "unable to open " + filePath.string();
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        addIgnoreLine(line);
+    }
+    return true;
+}
+
+void ExcludeMatcher::compile() {
+    literalTransitions.assign(1, {});
+    literalAccepts.assign(1, false);
+    if (literals.empty()) {
+        return;
+    }
+
+    // Trie of the literals; 0 is the root, so 0 also means "no child" while building
+    for (const auto& literal : literals) {
+        uint32_t node = 0;
+        for (char c : literal) {
+            uint32_t& next = literalTransitions[node][static_cast<unsigned char>(c)];
+            if (next == 0) {
+                next = static_cast<uint32_t>(literalTransitions.size());
+                literalTransitions.push_back({});
+                literalAccepts.push_back(false);
+            }
+            node = literalTransitions[node][static_cast<unsigned char>(c)];
+        }
+        literalAccepts[node] = true;
+    }
+
+    // Breadth-first failure links, folded into a full transition table
+    std::vector<uint32_t> failure(literalTransitions.size(), 0);
+    std::deque<uint32_t> queue;
+    for (uint32_t child : literalTransitions[0]) {
+        if (child != 0) {
+            queue.push_back(child);
+        }
+    }
+    while (!queue.empty()) {
+        uint32_t node = queue.front();
+        queue.pop_front();
+        if (literalAccepts[failure[node]]) {
+            literalAccepts[node] = true;
+        }
+        for (size_t byte = 0; byte < 256; byte++) {
+            uint32_t child = literalTransitions[node][byte];
+            uint32_t fallback = literalTransitions[failure[node]][byte];
+            if (child != 0) {
+                failure[child] = fallback;
+                queue.push_back(child);
+            }
+            else {
+                literalTransitions[node][byte] = fallback;
+            }
+        }
+    }
+}
+
+bool ExcludeMatcher::excludes(std::string_view path, size_t relativeStart, bool isDirectory) const {
+    if (!literals.empty() && containsLiteral(path, isDirectory)) {
+        return true;
+    }
+    if (globs.empty()) {
+        return false;
+    }
+    int glob = lastMatchingGlob(path.substr((std::min)(relativeStart, path.size())), isDirectory);
+    return glob >= 0 && !globs[glob].negated;
+}
+
+bool ExcludeMatcher::containsLiteral(std::string_view path, bool isDirectory) const {
+    uint32_t node = 0;
+    for (char c : path) {
+        node = literalTransitions[node][static_cast<unsigned char>(c)];
+        if (literalAccepts[node]) {
+            return true;
+        }
+    }
+    // Every path below a directory continues with a separator
+    if (isDirectory) {
+        node = literalTransitions[node][static_cast<unsigned char>(std::filesystem::path::preferred_separator)];
+        return literalAccepts[node];
+    }
+    return false;
+}
+
+void ExcludeMatcher::addState(std::vector<uint32_t>& states, std::vector<uint32_t>& marks, uint32_t generation,
+    uint32_t state, bool followEmpty) const {
+    if (marks[state] != generation) {
+        marks[state] = generation;
+        states.push_back(state);
+    }
+
+    // Stars may match nothing; '**/' only when entered, since a run it has
+    // started must end in '/'
+    TokenKind kind = tokens[state].kind;
+    if (followEmpty && (kind == TokenKind::Star || kind == TokenKind::DirectoryStar || kind == TokenKind::DeepStar)) {
+        addState(states, marks, generation, state + 1, true);
+    }
+}
+
+int ExcludeMatcher::lastMatchingGlob(std::string_view relativePath, bool isDirectory) const {
+    // Per-thread state sets, reused across calls
+    thread_local std::vector<uint32_t> current;
+    thread_local std::vector<uint32_t> next;
+    thread_local std::vector<uint32_t> marks;
+    thread_local uint32_t generation = 0;
+
+    if (marks.size() < tokens.size() || generation > UINT32_MAX - relativePath.size() - 2) {
+        marks.assign((std::max)(marks.size(), tokens.size()), 0);
+        generation = 0;
+    }
+
+    current.clear();
+    generation++;
+    for (uint32_t start : globStarts) {
+        addState(current, marks, generation, start, true);
+    }
+
+    for (char c : relativePath) {
+#ifdef _WIN32
+        if (c == '\\') {
+            c = '/';
+        }
+#endif
+        next.clear();
+        generation++;
+        for (uint32_t state : current) {
+            const Token& token = tokens[state];
+            switch (token.kind) {
+            case TokenKind::Char:
+                if (c == token.byte) {
+                    addState(next, marks, generation, state + 1, true);
+                }
+                break;
+            case TokenKind::AnyChar:
+                if (c != '/') {
+                    addState(next, marks, generation, state + 1, true);
+                }
+                break;
+            case TokenKind::Class:
+                if (classes[token.value].test(static_cast<unsigned char>(c))) {
+                    addState(next, marks, generation, state + 1, true);
+                }
+                break;
+            case TokenKind::Star:
+                if (c != '/') {
+                    addState(next, marks, generation, state, true);
+                }
+                break;
+            case TokenKind::DirectoryStar:
+                addState(next, marks, generation, state, false);
+                if (c == '/') {
+                    addState(next, marks, generation, state + 1, true);
+                }
+                break;
+            case TokenKind::DeepStar:
+                addState(next, marks, generation, state, true);
+                break;
+            case TokenKind::Accept:
+                break;
+            }
+        }
+        current.swap(next);
+        if (current.empty()) {
+            return -1;
+        }
+    }
+
+    int match = -1;
+    for (uint32_t state : current) {
+        const Token& token = tokens[state];
+        if (token.kind == TokenKind::Accept && (isDirectory || !globs[token.value].directoryOnly)) {
+            match = (std::max)(match, static_cast<int>(token.value));
+        }
+    }
+    return match;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Decides which files and directories create leaves out.
+//
+// Two kinds of patterns are compiled once into two automata:
+//  - Literal patterns (command-line patterns without glob characters) exclude
+//    every path that contains them, as before. All literals share one
+//    Aho-Corasick automaton, so a path is scanned once whatever their number.
+//  - Gitignore-style patterns (pattern files, and command-line patterns with
+//    *, ? or [) are matched against the path below the root with '/' as the
+//    separator. A pattern without an inner '/' matches at any depth, a leading
+//    '/' anchors it to the root, a trailing '/' matches directories only, '**'
+//    spans directories, and a leading '!' re-includes what an earlier pattern
+//    excluded; the last matching pattern decides. All globs run as one NFA.
+//
+// An excluded directory is not entered at all, so nothing below it can be
+// re-included (as in git).
+class ExcludeMatcher {
+public:
+    // Command-line pattern: a literal, or a gitignore-style line if it has glob characters
+    void addPattern(std::string_view pattern);
+
+    // One gitignore-style line; blank lines and '#' comments are ignored
+    void addIgnoreLine(std::string_view line);
+
+    // Add every line of a gitignore-style file
+    bool loadIgnoreFile(const std::filesystem::path& filePath, std::string& error);
+
+    // Build the automata; call once after the last pattern is added
+    void compile();
+
+    bool empty() const { return literals.empty() && globs.empty(); }
+
+    // path is the full path as written to the manifest and relativeStart the
+    // offset of the part below the root. Safe to call from several threads.
+    bool excludes(std::string_view path, size_t relativeStart, bool isDirectory) const;
+
+private:
+    enum class TokenKind : uint8_t {
+        Char,           // One byte
+        AnyChar,        // '?': one byte except '/'
+        Class,          // [...] : one byte from a set, except '/'
+        Star,           // '*': any run without '/'
+        DirectoryStar,  // '**/': nothing, or any run ending in '/'
+        DeepStar,       // Trailing '/**': any run
+        Accept          // End of a pattern
+    };
+
+    struct Token {
+        TokenKind kind;
+        char byte;
+        uint32_t value;     // Class index, or the pattern index for Accept
+    };
+
+    struct Glob {
+        bool negated;
+        bool directoryOnly;
+    };
+
+    bool containsLiteral(std::string_view path, bool isDirectory) const;
+    int lastMatchingGlob(std::string_view relativePath, bool isDirectory) const;
+    void addState(std::vector<uint32_t>& states, std::vector<uint32_t>& marks, uint32_t generation,
+        uint32_t state, bool followEmpty) const;
+
+    // Aho-Corasick automaton over the literals: full transition table per node
+    std::vector<std::string> literals;
+    std::vector<std::array<uint32_t, 256>> literalTransitions;
+    std::vector<bool> literalAccepts;
+
+    // Glob NFA: patterns laid out one after another, each ending in Accept
+    std::vector<Glob> globs;
+    std::vector<Token> tokens;
+    std::vector<uint32_t> globStarts;
+    std::vector<std::bitset<256>> classes;
+};
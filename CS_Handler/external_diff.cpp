@@ -0,0 +1,471 @@
+#include "pch.h"
+#include "external_diff.h"
+#include "binary_manifest.h"
+#include "manifest.h"
+#include "metrics.h"
+#include <algorithm>
+#include <fstream>
+#include <queue>
+#include <random>
+
+namespace {
+
+// Bytes a run writer collects before each write
+constexpr size_t spillWriteBufferSize = 1 << 20;
+
+class EntryStream {
+public:
+    virtual ~EntryStream() = default;
+
+    // Next entry; false at the end or on a read error
+    virtual bool next(SpilledEntry& entry) = 0;
+};
+
+// Entries of a text or binary manifest in file order. With checkOrder set the
+// stream ends at the first entry that sorts before the previous one.
+class ManifestStream : public EntryStream {
+public:
+    bool open(const std::filesystem::path& manifestPath, bool checkOrder, std::string& error) {
+        orderChecked = checkOrder;
+        if (isBinaryManifest(manifestPath)) {
+            binary = true;
+            return binaryManifest.open(manifestPath, error);
+        }
+        if (!textManifest.open(manifestPath)) {
+            error = "unable to read " + manifestPath.string();
+            return false;
+        }
+        return true;
+    }
+
+    const ManifestHeader& header() const { return binary ? binaryManifest.header() : textManifest.header(); }
+
+    // Binary manifests are always sorted; text ones say so in their header
+    bool isMarkedSorted() const { return binary || textManifest.header().sorted; }
+
+    // Strip prefix from the paths that start with it, before the order check
+    void stripPathPrefix(std::string prefix) { pathPrefix = std::move(prefix); }
+
+    bool next(SpilledEntry& entry) override {
+        if (binary) {
+            if (position == binaryManifest.size()) {
+                return false;
+            }
+            const BinaryManifestRecord& record = binaryManifest.record(position++);
+            entry.path = binaryManifest.path(record);
+            entry.hash = binaryManifest.hash(record);
+        }
+        else {
+            std::string_view path;
+            FileStat stat;
+            AppendCheck check;
+            if (!textManifest.next(path, entry.hash, stat, check)) {
+                return false;
+            }
+            entry.path.assign(path);
+        }
+        if (!pathPrefix.empty() && entry.path.compare(0, pathPrefix.size(), pathPrefix) == 0) {
+            entry.path.erase(0, pathPrefix.size());
+        }
+
+        if (orderChecked) {
+            if (entries > 0 && entry.path < previousPath) {
+                disordered = true;
+                return false;
+            }
+            previousPath = entry.path;
+        }
+        entries++;
+        return true;
+    }
+
+    uint64_t entryCount() const { return entries; }
+    size_t skippedLines() const { return binary ? 0 : textManifest.skippedLines(); }
+    bool outOfOrder() const { return disordered; }
+
+private:
+    bool binary = false;
+    BinaryManifest binaryManifest;
+    ManifestReader textManifest;
+    size_t position = 0;
+    bool orderChecked = false;
+    std::string pathPrefix;
+    std::string previousPath;
+    uint64_t entries = 0;
+    bool disordered = false;
+};
+
+// Run files: per entry a 4-byte little-endian path length, the path, a
+// 1-byte digest size and the digest
+class RunWriter {
+public:
+    bool open(const std::filesystem::path& runPath) {
+        file.open(runPath, std::ios::binary | std::ios::trunc);
+        return file.is_open();
+    }
+
+    void write(const SpilledEntry& entry) {
+        uint32_t length = static_cast<uint32_t>(entry.path.size());
+        for (int shift = 0; shift < 32; shift += 8) {
+            buffer += static_cast<char>((length >> shift) & 0xFF);
+        }
+        buffer += entry.path;
+        buffer += static_cast<char>(entry.hash.size);
+        buffer.append(reinterpret_cast<const char*>(entry.hash.bytes.data()), entry.hash.size);
+        if (buffer.size() >= spillWriteBufferSize) {
+            flush();
+        }
+    }
+
+    // Bytes written; false if any write failed
+    bool close(uint64_t& bytesWritten) {
+        flush();
+        file.close();
+        bytesWritten = written;
+        return !file.fail();
+    }
+
+private:
+    void flush() {
+        PhaseTimer writeTimer(MetricPhase::Write);
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        written += buffer.size();
+        buffer.clear();
+    }
+
+    std::ofstream file;
+    std::string buffer;
+    uint64_t written = 0;
+};
+
+class RunReader : public EntryStream {
+public:
+    explicit RunReader(const std::filesystem::path& runPath)
+        : buffer(spillReadBufferSize) {
+        file.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        file.open(runPath, std::ios::binary);
+    }
+
+    bool next(SpilledEntry& entry) override {
+        unsigned char lengthBytes[4];
+        if (!file.read(reinterpret_cast<char*>(lengthBytes), sizeof(lengthBytes))) {
+            return false;
+        }
+        uint32_t length = lengthBytes[0] | (lengthBytes[1] << 8) | (lengthBytes[2] << 16) | (static_cast<uint32_t>(lengthBytes[3]) << 24);
+        entry.path.resize(length);
+        char hashSize = 0;
+        if (!file.read(entry.path.data(), length) || !file.get(hashSize) ||
+            static_cast<uint8_t>(hashSize) > entry.hash.bytes.size()) {
+            readFailed = true;
+            return false;
+        }
+        entry.hash = HashValue{};
+        entry.hash.size = static_cast<uint8_t>(hashSize);
+        if (!file.read(reinterpret_cast<char*>(entry.hash.bytes.data()), entry.hash.size)) {
+            readFailed = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool isOpen() const { return file.is_open(); }
+    bool failed() const { return readFailed; }
+
+private:
+    std::vector<char> buffer;   // Set before opening, so it must outlive the stream's use of it
+    std::ifstream file;
+    bool readFailed = false;
+};
+
+// K-way merge of sorted runs through a heap of their current entries
+class RunMerger : public EntryStream {
+public:
+    bool open(const std::vector<std::filesystem::path>& runs, std::string& error) {
+        for (const auto& runPath : runs) {
+            readers.push_back(std::make_unique<RunReader>(runPath));
+            if (!readers.back()->isOpen()) {
+                error = "unable to read " + runPath.string();
+                return false;
+            }
+        }
+        heads.resize(readers.size());
+        for (size_t i = 0; i < readers.size(); i++) {
+            advance(i);
+        }
+        return true;
+    }
+
+    bool next(SpilledEntry& entry) override {
+        if (heap.empty()) {
+            return false;
+        }
+        size_t index = heap.top();
+        heap.pop();
+        entry = std::move(heads[index]);
+        advance(index);
+        return true;
+    }
+
+    bool failed() const {
+        return std::any_of(readers.begin(), readers.end(), [](const auto& reader) { return reader->failed(); });
+    }
+
+private:
+    void advance(size_t index) {
+        if (readers[index]->next(heads[index])) {
+            heap.push(index);
+        }
+    }
+
+    // Smallest path on top; equal paths come out in run order
+    struct HeadGreater {
+        const std::vector<SpilledEntry>* heads;
+        bool operator()(size_t a, size_t b) const {
+            int order = (*heads)[a].path.compare((*heads)[b].path);
+            return order != 0 ? order > 0 : a > b;
+        }
+    };
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+    std::vector<SpilledEntry> heads;
+    std::priority_queue<size_t, std::vector<size_t>, HeadGreater> heap{ HeadGreater{ &heads } };
+};
+
+} // namespace
+
+ExternalManifestDiff::ExternalManifestDiff(uint64_t memoryBudget, const std::filesystem::path& tempDirectory)
+    : budget((std::max)(memoryBudget, minimumMemoryBudget)) {
+    std::random_device seed;
+    std::mt19937_64 random((static_cast<uint64_t>(seed()) << 32) ^ seed());
+    HashValue suffix = hashFromUint(random(), 8);
+    workDirectory = (tempDirectory.empty() ? std::filesystem::temp_directory_path() : tempDirectory) /
+        ("checksum_handler_sort_" + hashToHex(suffix));
+}
+
+ExternalManifestDiff::~ExternalManifestDiff() {
+    std::error_code ec;
+    std::filesystem::remove_all(workDirectory, ec);
+}
+
+std::filesystem::path ExternalManifestDiff::nextRunPath() {
+    return workDirectory / ("run" + std::to_string(runCounter++) + ".tmp");
+}
+
+bool ExternalManifestDiff::spillRuns(const std::filesystem::path& manifestPath, int side, const std::string& pathPrefix,
+    std::vector<std::filesystem::path>& runs, std::string& error) {
+    ManifestStream input;
+    if (!input.open(manifestPath, false, error)) {
+        return false;
+    }
+    input.stripPathPrefix(pathPrefix);
+
+    // Entries are collected until they (and the vector holding them) would outgrow the budget
+    std::vector<SpilledEntry> buffer;
+    uint64_t pathBytes = 0;
+    auto spill = [&] {
+        {
+            PhaseTimer sortTimer(MetricPhase::Diff);
+            std::sort(buffer.begin(), buffer.end(), [](const SpilledEntry& a, const SpilledEntry& b) { return a.path < b.path; });
+        }
+        runs.push_back(nextRunPath());
+        RunWriter writer;
+        uint64_t written = 0;
+        if (!writer.open(runs.back())) {
+            error = "unable to create " + runs.back().string();
+            return false;
+        }
+        for (const SpilledEntry& entry : buffer) {
+            writer.write(entry);
+        }
+        if (!writer.close(written)) {
+            error = "unable to write " + runs.back().string();
+            return false;
+        }
+        spilledRuns++;
+        spilledBytes += written;
+        buffer.clear();
+        pathBytes = 0;
+        return true;
+    };
+
+    PhaseTimer parseTimer(MetricPhase::Parse);
+    SpilledEntry entry;
+    while (input.next(entry)) {
+        // Spill before an entry that would take the buffer (grown if full) past the budget
+        size_t capacity = buffer.size() < buffer.capacity() ? buffer.capacity() : (std::max)(static_cast<size_t>(1), buffer.capacity() * 2);
+        if (!buffer.empty() && capacity * sizeof(SpilledEntry) + pathBytes + entry.path.size() > budget && !spill()) {
+            return false;
+        }
+        pathBytes += entry.path.size();
+        buffer.push_back(std::move(entry));
+    }
+    if (!buffer.empty() && !spill()) {
+        return false;
+    }
+    entryCounts[side] = input.entryCount();
+    lineErrors += input.skippedLines();
+    return true;
+}
+
+bool ExternalManifestDiff::mergeRuns(std::vector<std::filesystem::path>& runs, size_t fanIn, std::string& error) {
+    // Each pass merges groups of fanIn runs into one until few enough remain
+    while (runs.size() > fanIn) {
+        extraPasses++;
+        std::vector<std::filesystem::path> merged;
+        for (size_t first = 0; first < runs.size(); first += fanIn) {
+            std::vector<std::filesystem::path> group(runs.begin() + first, runs.begin() + (std::min)(first + fanIn, runs.size()));
+            if (group.size() == 1) {
+                merged.push_back(group.front());
+                continue;
+            }
+
+            RunMerger merger;
+            if (!merger.open(group, error)) {
+                return false;
+            }
+            merged.push_back(nextRunPath());
+            RunWriter writer;
+            if (!writer.open(merged.back())) {
+                error = "unable to create " + merged.back().string();
+                return false;
+            }
+            SpilledEntry entry;
+            while (merger.next(entry)) {
+                writer.write(entry);
+            }
+            uint64_t written = 0;
+            if (merger.failed() || !writer.close(written)) {
+                error = "unable to merge runs into " + merged.back().string();
+                return false;
+            }
+            spilledBytes += written;
+
+            std::error_code ec;
+            for (const auto& runPath : group) {
+                std::filesystem::remove(runPath, ec);
+            }
+        }
+        runs = std::move(merged);
+    }
+    return true;
+}
+
+bool ExternalManifestDiff::compare(const std::filesystem::path (&paths)[2], const bool (&forceSpill)[2], bool (&outOfOrder)[2],
+    std::vector<std::pair<std::string, ChangeKind>>& changes, std::string& error) {
+    // Manifests to spill are cut into runs first, one after the other, so each
+    // can use the whole budget
+    ManifestStream manifests[2];
+    bool direct[2];
+    std::vector<std::filesystem::path> runs[2];
+    HashAlgorithm algorithms[2];
+    for (int side = 0; side < 2; side++) {
+        if (!manifests[side].open(paths[side], true, error)) {
+            return false;
+        }
+        algorithms[side] = manifests[side].header().algorithm;
+    }
+    if (algorithms[0] != algorithms[1]) {
+        error = std::string("Checksum files use different algorithms (current: ") + hashAlgorithmName(algorithms[0]) +
+            ", new: " + hashAlgorithmName(algorithms[1]) + "). Recreate one of them with the same algorithm.";
+        return false;
+    }
+
+    // Absolute paths of a manifest older than relative=1 are rebased onto its
+    // root to compare with a relative one
+    std::string pathPrefixes[2];
+    if (manifests[0].header().relative != manifests[1].header().relative) {
+        int absoluteSide = manifests[0].header().relative ? 1 : 0;
+        pathPrefixes[absoluteSide] = absoluteManifestPrefix(paths[absoluteSide]);
+        manifests[absoluteSide].stripPathPrefix(pathPrefixes[absoluteSide]);
+    }
+
+    for (int side = 0; side < 2; side++) {
+        direct[side] = manifests[side].isMarkedSorted() && !forceSpill[side];
+        if (!direct[side] && !spillRuns(paths[side], side, pathPrefixes[side], runs[side], error)) {
+            return false;
+        }
+    }
+
+    // The final merge of both sides shares the budget's read buffers
+    size_t fanIn = (std::max)(static_cast<size_t>(2), static_cast<size_t>(budget / 2 / spillReadBufferSize));
+    RunMerger mergers[2];
+    EntryStream* streams[2];
+    for (int side = 0; side < 2; side++) {
+        if (direct[side]) {
+            streams[side] = &manifests[side];
+            continue;
+        }
+        if (!mergeRuns(runs[side], fanIn, error) || !mergers[side].open(runs[side], error)) {
+            return false;
+        }
+        streams[side] = &mergers[side];
+    }
+
+    // One linear merge of the two sorted streams
+    PhaseTimer diffTimer(MetricPhase::Diff);
+    changes.clear();
+    SpilledEntry entries[2];
+    bool present[2] = { streams[0]->next(entries[0]), streams[1]->next(entries[1]) };
+    while (present[0] || present[1]) {
+        int order = !present[0] ? 1 : !present[1] ? -1 : entries[0].path.compare(entries[1].path);
+        if (order < 0) {
+            changes.emplace_back(std::move(entries[0].path), ChangeKind::Deleted);
+            present[0] = streams[0]->next(entries[0]);
+        }
+        else if (order > 0) {
+            changes.emplace_back(std::move(entries[1].path), ChangeKind::Added);
+            present[1] = streams[1]->next(entries[1]);
+        }
+        else {
+            if (!(entries[0].hash == entries[1].hash)) {
+                changes.emplace_back(std::move(entries[1].path), ChangeKind::Changed);
+            }
+            present[0] = streams[0]->next(entries[0]);
+            present[1] = streams[1]->next(entries[1]);
+        }
+    }
+
+    for (int side = 0; side < 2; side++) {
+        if (direct[side]) {
+            outOfOrder[side] = manifests[side].outOfOrder();
+            entryCounts[side] = manifests[side].entryCount();
+            lineErrors += manifests[side].skippedLines();
+        }
+        else if (mergers[side].failed()) {
+            error = "unable to read back sorted runs";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ExternalManifestDiff::run(const std::filesystem::path& currPath, const std::filesystem::path& newPath,
+    std::vector<std::pair<std::string, ChangeKind>>& changes, std::string& error) {
+    std::error_code ec;
+    std::filesystem::create_directories(workDirectory, ec);
+    if (ec) {
+        error = "unable to create " + workDirectory.string() + ": " + ec.message();
+        return false;
+    }
+
+    // A manifest marked sorted is trusted until an entry proves otherwise; it is
+    // then compared again with its entries spilled and sorted
+    const std::filesystem::path paths[2] = { currPath, newPath };
+    bool forceSpill[2] = { false, false };
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool outOfOrder[2] = { false, false };
+        entryCounts[0] = entryCounts[1] = 0;
+        lineErrors = 0;
+        if (!compare(paths, forceSpill, outOfOrder, changes, error)) {
+            return false;
+        }
+        if (!outOfOrder[0] && !outOfOrder[1]) {
+            return true;
+        }
+        resorted = true;
+        forceSpill[0] = forceSpill[0] || outOfOrder[0];
+        forceSpill[1] = forceSpill[1] || outOfOrder[1];
+    }
+    error = "sorted entries could not be read back in order";
+    return false;
+}
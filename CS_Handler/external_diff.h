@@ -0,0 +1,78 @@
+#pragma once
+
+#include "hash.h"
+#include "manifest_diff.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Smallest memory budget honoured; smaller ones are raised to it
+constexpr uint64_t minimumMemoryBudget = 16ull << 20;
+
+// Read buffer of each run file open during a merge
+constexpr size_t spillReadBufferSize = 256 * 1024;
+
+// An entry as held in memory and in run files
+struct SpilledEntry {
+    std::string path;
+    HashValue hash;
+};
+
+// Compares two manifests of any size within a fixed memory budget.
+//
+// Each manifest is streamed from disk. One whose header says it is sorted (and
+// every binary manifest) is merged as it is read. Any other is cut into runs
+// that fill the budget, each sorted in memory and spilled to a temporary file,
+// and the runs are merged back k ways, with extra merge passes when there are
+// more runs than the budget's read buffers allow. The two sorted streams are
+// then diffed in one linear merge. A manifest marked sorted that turns out not
+// to be is spilled on a second attempt.
+//
+// Temporary files live in a directory of their own under tempDirectory and
+// are deleted with the object. Memory beyond the budget grows only with the
+// number of changes found.
+class ExternalManifestDiff {
+public:
+    ExternalManifestDiff(uint64_t memoryBudget, const std::filesystem::path& tempDirectory);
+    ~ExternalManifestDiff();
+
+    ExternalManifestDiff(const ExternalManifestDiff&) = delete;
+    ExternalManifestDiff& operator=(const ExternalManifestDiff&) = delete;
+
+    // Changes from currPath to newPath in path order. False (with error set)
+    // when a manifest cannot be read or the two use different algorithms. When
+    // only one is relative, the other's paths are rebased onto its root.
+    bool run(const std::filesystem::path& currPath, const std::filesystem::path& newPath,
+        std::vector<std::pair<std::string, ChangeKind>>& changes, std::string& error);
+
+    uint64_t currentEntries() const { return entryCounts[0]; }
+    uint64_t newEntries() const { return entryCounts[1]; }
+    uint64_t skippedLines() const { return lineErrors; }
+    size_t runsWritten() const { return spilledRuns; }
+    size_t mergePasses() const { return extraPasses; }      // Merges of runs into longer runs before the diff
+    uint64_t bytesSpilled() const { return spilledBytes; }  // Written to run files, merge passes included
+    bool unsortedFallback() const { return resorted; }      // A manifest marked sorted had to be spilled
+
+private:
+    // One attempt at the whole comparison; outOfOrder reports manifests taken
+    // as sorted that were not
+    bool compare(const std::filesystem::path (&paths)[2], const bool (&forceSpill)[2], bool (&outOfOrder)[2],
+        std::vector<std::pair<std::string, ChangeKind>>& changes, std::string& error);
+    bool spillRuns(const std::filesystem::path& manifestPath, int side, const std::string& pathPrefix,
+        std::vector<std::filesystem::path>& runs, std::string& error);
+    bool mergeRuns(std::vector<std::filesystem::path>& runs, size_t fanIn, std::string& error);
+    std::filesystem::path nextRunPath();
+
+    uint64_t budget;
+    std::filesystem::path workDirectory;
+    size_t runCounter = 0;
+    uint64_t entryCounts[2] = { 0, 0 };
+    uint64_t lineErrors = 0;
+    size_t spilledRuns = 0;
+    size_t extraPasses = 0;
+    uint64_t spilledBytes = 0;
+    bool resorted = false;
+};
@@ -0,0 +1,144 @@
+#include "pch.h"
+#include "file_hasher.h"
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Shared state of one file hashed as pieces. The piece task that finishes last
+// combines the results and reports the file.
+struct SplitHashJob {
+    std::filesystem::path filePath;
+    HashAlgorithm algorithm;
+    ReadStrategy strategy;
+    FileHashCallback onDone;
+    const std::atomic<bool>* cancelled = nullptr;
+    std::vector<HashValue> pieces;
+    uint64_t lastPieceLength = 0;
+    std::atomic<size_t> remaining{ 0 };
+    std::atomic<bool> failed{ false };
+};
+
+bool isCancelled(const std::atomic<bool>* cancelled) {
+    return cancelled != nullptr && cancelled->load();
+}
+
+void hashPiece(const std::shared_ptr<SplitHashJob>& job, size_t index) {
+    uint64_t offset = index * hashPieceSize;
+    bool last = index + 1 == job->pieces.size();
+
+    // Pieces of a cancelled file are not read; failed stops the one-pass fallback too
+    if (isCancelled(job->cancelled)) {
+        job->failed = true;
+    }
+    else {
+        try {
+            std::unique_ptr<Hasher> hasher = createPieceHasher(job->algorithm, offset);
+
+            // The last piece runs to the end of the file in case it grew since the walk
+            uint64_t length = last ? (std::numeric_limits<uint64_t>::max)() : hashPieceSize;
+            uint64_t consumed = 0;
+            bool read = readFileRange(job->filePath, offset, length, job->strategy,
+                [&](const void* data, size_t size) { hasher->update(data, size); }, consumed);
+            if (!read || (!last && consumed != hashPieceSize)) {
+                job->failed = true;
+            }
+            else {
+                if (last) {
+                    job->lastPieceLength = consumed;
+                }
+                job->pieces[index] = hasher->finalize();
+            }
+        }
+        catch (const std::exception&) {
+            job->failed = true;
+        }
+    }
+
+    if (--job->remaining != 0) {
+        return;
+    }
+
+    // A CRC piece combines at any length, but a BLAKE3 piece longer than
+    // hashPieceSize (a file that grew) is no longer a subtree of the right shape
+    bool combinable = !job->failed && job->lastPieceLength > 0 &&
+        (job->lastPieceLength <= hashPieceSize || supportsHashExtension(job->algorithm));
+
+    HashValue hash;
+    bool hashed = false;
+    if (combinable) {
+        hash = combineHashPieces(job->algorithm, job->pieces, job->lastPieceLength);
+        hashed = true;
+    }
+    else if (!isCancelled(job->cancelled)) {
+        // The file changed size while it was being split; hash it in one pass
+        try {
+            hashed = hashFileContents(job->filePath, job->algorithm, hash, job->strategy);
+        }
+        catch (const std::exception&) {
+            hashed = false;
+        }
+    }
+    job->onDone(hashed, hash);
+}
+
+} // namespace
+
+bool hashFileContents(const std::filesystem::path& filePath, HashAlgorithm algorithm, HashValue& hash,
+    ReadStrategy strategy) {
+    std::unique_ptr<Hasher> hasher = createHasher(algorithm);
+    uint64_t bytesRead = 0;
+    if (!readFileRange(filePath, 0, (std::numeric_limits<uint64_t>::max)(), strategy,
+        [&](const void* data, size_t length) { hasher->update(data, length); }, bytesRead)) {
+        return false;
+    }
+
+    hash = hasher->finalize();
+    return true;
+}
+
+bool hashFileRange(const std::filesystem::path& filePath, uint64_t offset, uint64_t length, Hasher& hasher,
+    ReadStrategy strategy) {
+    uint64_t bytesRead = 0;
+    bool read = readFileRange(filePath, offset, length, strategy,
+        [&](const void* data, size_t size) { hasher.update(data, size); }, bytesRead);
+    return read && bytesRead == length;
+}
+
+void scheduleFileHash(WorkStealingPool& pool, const std::filesystem::path& filePath, uint64_t fileSize,
+    HashAlgorithm algorithm, ReadStrategy strategy, FileHashCallback onDone, const std::atomic<bool>* cancelled) {
+    if (fileSize < splitHashThreshold || !supportsPieceHashing(algorithm)) {
+        pool.submit([filePath, algorithm, strategy, onDone = std::move(onDone), cancelled] {
+            HashValue hash;
+            bool hashed = false;
+            try {
+                hashed = !isCancelled(cancelled) && hashFileContents(filePath, algorithm, hash, strategy);
+            }
+            catch (const std::exception&) {
+                hashed = false;
+            }
+            onDone(hashed, hash);
+        });
+        return;
+    }
+
+    auto job = std::make_shared<SplitHashJob>();
+    job->filePath = filePath;
+    job->algorithm = algorithm;
+    job->strategy = strategy;
+    job->onDone = std::move(onDone);
+    job->cancelled = cancelled;
+    job->pieces.resize(static_cast<size_t>((fileSize + hashPieceSize - 1) / hashPieceSize));
+    job->remaining = job->pieces.size();
+
+    // One task fans the file out from inside the pool, so its pieces land on
+    // that worker's deque where idle workers can steal them
+    pool.submit([&pool, job] {
+        for (size_t i = 1; i < job->pieces.size(); i++) {
+            pool.submit([job, i] { hashPiece(job, i); });
+        }
+        hashPiece(job, 0);
+    });
+}
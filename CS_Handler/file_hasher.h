@@ -0,0 +1,31 @@
+#pragma once
+
+#include "file_reader.h"
+#include "hash.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+// Files at least this large are split into hashPieceSize pieces that are hashed
+// as separate pool tasks, when the algorithm supports piece hashing
+constexpr uint64_t splitHashThreshold = 4 * hashPieceSize;
+
+// Hash a file's contents without reporting errors; safe to call from worker threads
+bool hashFileContents(const std::filesystem::path& filePath, HashAlgorithm algorithm, HashValue& hash,
+    ReadStrategy strategy = ReadStrategy::Auto);
+
+// Feed `length` bytes starting at offset into hasher; a short read is a failure
+bool hashFileRange(const std::filesystem::path& filePath, uint64_t offset, uint64_t length, Hasher& hasher,
+    ReadStrategy strategy = ReadStrategy::Auto);
+
+using FileHashCallback = std::function<void(bool hashed, const HashValue& hash)>;
+
+// Hash a file on the pool and report the result through onDone, which runs
+// exactly once on a pool thread. fileSize is the size seen by the directory
+// walk and only decides whether and how the file is split; the digest always
+// equals a sequential hash of the file. Once cancelled (if given) is set, tasks
+// that have not started yet read nothing and onDone reports hashed as false.
+void scheduleFileHash(WorkStealingPool& pool, const std::filesystem::path& filePath, uint64_t fileSize,
+    HashAlgorithm algorithm, ReadStrategy strategy, FileHashCallback onDone, const std::atomic<bool>* cancelled = nullptr);
@@ -0,0 +1,400 @@
+#include "pch.h"
+#include "file_reader.h"
+#include "metrics.h"
+#include <algorithm>
+#include <new>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct ReadStrategyInfo {
+    ReadStrategy strategy;
+    const char* name;
+};
+
+constexpr ReadStrategyInfo kStrategies[] = {
+    { ReadStrategy::Auto, "auto" },
+    { ReadStrategy::Mapped, "mmap" },
+    { ReadStrategy::Buffered, "pread" },
+    { ReadStrategy::Direct, "direct" },
+    { ReadStrategy::Uring, "uring" },
+};
+
+// Block size for pread / O_DIRECT reads, and the alignment unbuffered I/O
+// needs for buffers, offsets and lengths
+constexpr size_t readBlockSize = 1 << 20;
+constexpr size_t directAlignment = 4096;
+
+// Files are mapped a window at a time to bound address space use
+constexpr uint64_t mapWindowSize = 64ull << 20;
+
+// One aligned read buffer per thread, reused across files
+class AlignedBuffer {
+public:
+    AlignedBuffer()
+        : data(static_cast<uint8_t*>(::operator new(readBlockSize, std::align_val_t(directAlignment)))) {
+    }
+
+    ~AlignedBuffer() {
+        ::operator delete(data, std::align_val_t(directAlignment));
+    }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    uint8_t* const data;
+};
+
+uint8_t* threadReadBuffer() {
+    thread_local AlignedBuffer buffer;
+    return buffer.data;
+}
+
+#ifdef _WIN32
+
+class FileHandle {
+public:
+    ~FileHandle() { close(); }
+
+    bool open(const std::filesystem::path& filePath, bool direct) {
+        close();
+        DWORD flags = direct ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN;
+        handle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, flags, nullptr);
+        return handle != INVALID_HANDLE_VALUE;
+    }
+
+    void close() {
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+            handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    bool size(uint64_t& fileSize) const {
+        LARGE_INTEGER value;
+        if (!GetFileSizeEx(handle, &value)) {
+            return false;
+        }
+        fileSize = static_cast<uint64_t>(value.QuadPart);
+        return true;
+    }
+
+    // Positional read; 0 bytes at end of file, -1 on error
+    int64_t readAt(uint8_t* buffer, size_t length, uint64_t offset) const {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD got = 0;
+        if (!ReadFile(handle, buffer, static_cast<DWORD>(length), &got, &overlapped)) {
+            return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+        }
+        return static_cast<int64_t>(got);
+    }
+
+    // The Windows cache manager has no per-range hints beyond the open flags
+    void adviseSequential(uint64_t, uint64_t) const {}
+    void adviseDone(uint64_t, uint64_t) const {}
+
+    HANDLE native() const { return handle; }
+
+private:
+    HANDLE handle = INVALID_HANDLE_VALUE;
+};
+
+uint64_t mapGranularity() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+class FileMapping {
+public:
+    explicit FileMapping(const FileHandle& file)
+        : mapping(CreateFileMappingW(file.native(), nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+    }
+
+    ~FileMapping() {
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+    }
+
+    bool valid() const { return mapping != nullptr; }
+
+    const uint8_t* map(uint64_t offset, size_t length) const {
+        return static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ,
+            static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), length));
+    }
+
+    void unmap(const uint8_t* view, size_t) const {
+        UnmapViewOfFile(view);
+    }
+
+private:
+    HANDLE mapping;
+};
+
+#else
+
+class FileHandle {
+public:
+    ~FileHandle() { close(); }
+
+    bool open(const std::filesystem::path& filePath, bool direct) {
+        close();
+        int flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+        if (direct) {
+            flags |= O_DIRECT;
+        }
+#endif
+        fd = ::open(filePath.c_str(), flags);
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+        if (fd >= 0 && direct) {
+            fcntl(fd, F_NOCACHE, 1);
+        }
+#endif
+        return fd >= 0;
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool size(uint64_t& fileSize) const {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            return false;
+        }
+        fileSize = static_cast<uint64_t>(info.st_size);
+        return true;
+    }
+
+    // Positional read; 0 bytes at end of file, -1 on error
+    int64_t readAt(uint8_t* buffer, size_t length, uint64_t offset) const {
+        while (true) {
+            ssize_t got = pread(fd, buffer, length, static_cast<off_t>(offset));
+            if (got >= 0 || errno != EINTR) {
+                return got;
+            }
+        }
+    }
+
+    void adviseSequential(uint64_t offset, uint64_t length) const {
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    // Consumed range is not needed again; keep it from crowding the page cache
+    void adviseDone(uint64_t offset, uint64_t length) const {
+#ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#endif
+    }
+
+    int native() const { return fd; }
+
+private:
+    int fd = -1;
+};
+
+uint64_t mapGranularity() {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return pageSize > 0 ? static_cast<uint64_t>(pageSize) : 4096;
+}
+
+class FileMapping {
+public:
+    explicit FileMapping(const FileHandle& file)
+        : fd(file.native()) {
+    }
+
+    bool valid() const { return true; }
+
+    const uint8_t* map(uint64_t offset, size_t length) const {
+        void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+        if (view == MAP_FAILED) {
+            return nullptr;
+        }
+        madvise(view, length, MADV_SEQUENTIAL);
+        return static_cast<const uint8_t*>(view);
+    }
+
+    void unmap(const uint8_t* view, size_t length) const {
+        munmap(const_cast<uint8_t*>(view), length);
+    }
+
+private:
+    int fd;
+};
+
+#endif
+
+// Pages of a mapped file are read on first touch; a file truncated while it is
+// mapped faults instead of returning a short read, so mapping stops at the size
+// seen when the file was opened
+bool readMapped(const FileHandle& file, uint64_t offset, uint64_t end, const ReadSink& onData, uint64_t& bytesRead) {
+    if (offset >= end) {
+        return true;
+    }
+
+    FileMapping mapping(file);
+    if (!mapping.valid()) {
+        return false;
+    }
+
+    const uint64_t granularity = mapGranularity();
+    uint64_t position = offset;
+    while (position < end) {
+        uint64_t base = position - position % granularity;
+        size_t viewLength = static_cast<size_t>((std::min)(base + mapWindowSize, end) - base);
+        const uint8_t* view = mapping.map(base, viewLength);
+        if (view == nullptr) {
+            return false;
+        }
+
+        size_t skip = static_cast<size_t>(position - base);
+        onData(view + skip, viewLength - skip);
+        mapping.unmap(view, viewLength);
+
+        bytesRead += viewLength - skip;
+        position = base + viewLength;
+    }
+    return true;
+}
+
+// Reads whole aligned blocks, so the same loop serves O_DIRECT; bytes outside
+// [offset, end) are read but not delivered
+bool readBlocks(const FileHandle& file, uint64_t offset, uint64_t end, bool dropConsumed,
+    const ReadSink& onData, uint64_t& bytesRead) {
+    uint8_t* buffer = threadReadBuffer();
+    uint64_t position = offset - offset % directAlignment;
+
+    while (position < end) {
+        int64_t got = file.readAt(buffer, readBlockSize, position);
+        if (got < 0) {
+            return false;
+        }
+        if (got == 0) {
+            break;
+        }
+
+        uint64_t blockEnd = (std::min)(position + static_cast<uint64_t>(got), end);
+        if (blockEnd > offset) {
+            uint64_t start = (std::max)(position, offset);
+            onData(buffer + (start - position), static_cast<size_t>(blockEnd - start));
+            bytesRead += blockEnd - start;
+        }
+        if (dropConsumed) {
+            file.adviseDone(position, static_cast<uint64_t>(got));
+        }
+        position += static_cast<uint64_t>(got);
+    }
+    return true;
+}
+
+// Read [offset, end) of an opened file with the resolved strategy
+bool readOpenedRange(FileHandle& file, const std::filesystem::path& filePath, uint64_t offset, uint64_t end,
+    ReadStrategy strategy, uint64_t fileSize, const ReadSink& onData, uint64_t& bytesRead) {
+    switch (resolveReadStrategy(strategy, fileSize)) {
+    case ReadStrategy::Mapped:
+        return readMapped(file, offset, end, onData, bytesRead);
+    case ReadStrategy::Direct:
+        if (readBlocks(file, offset, end, false, onData, bytesRead)) {
+            return true;
+        }
+        // Opened but refused unbuffered reads before any data arrived; retry buffered
+        if (bytesRead != 0 || !file.open(filePath, false)) {
+            return false;
+        }
+        [[fallthrough]];
+    case ReadStrategy::Buffered:
+    default:
+        file.adviseSequential(offset, end - offset);
+        return readBlocks(file, offset, end, true, onData, bytesRead);
+    }
+}
+
+} // namespace
+
+const char* readStrategyName(ReadStrategy strategy) {
+    for (const auto& info : kStrategies) {
+        if (info.strategy == strategy) {
+            return info.name;
+        }
+    }
+    return kStrategies[0].name;
+}
+
+bool parseReadStrategy(std::string_view name, ReadStrategy& strategy) {
+    for (const auto& info : kStrategies) {
+        if (name == info.name) {
+            strategy = info.strategy;
+            return true;
+        }
+    }
+    return false;
+}
+
+ReadStrategy resolveReadStrategy(ReadStrategy strategy, uint64_t fileSize) {
+    // Files handed to the reader outside the io_uring pipeline are read as in auto mode
+    if (strategy != ReadStrategy::Auto && strategy != ReadStrategy::Uring) {
+        return strategy;
+    }
+    return fileSize >= mappedReadThreshold ? ReadStrategy::Mapped : ReadStrategy::Buffered;
+}
+
+bool readFileRange(const std::filesystem::path& filePath, uint64_t offset, uint64_t length,
+    ReadStrategy strategy, const ReadSink& onData, uint64_t& bytesRead) {
+    bytesRead = 0;
+
+    PhaseTimer openTimer(MetricPhase::Open);
+    FileHandle file;
+    bool direct = strategy == ReadStrategy::Direct;
+    if (!file.open(filePath, direct)) {
+        // Some file systems (tmpfs, network shares) reject unbuffered opens
+        if (!direct || !file.open(filePath, false)) {
+            return false;
+        }
+        strategy = ReadStrategy::Buffered;
+    }
+
+    uint64_t fileSize = 0;
+    if (!file.size(fileSize)) {
+        return false;
+    }
+    uint64_t end = offset + (std::min)(length, fileSize - (std::min)(offset, fileSize));
+    openTimer.stop();
+
+    RunMetrics* metrics = currentMetrics();
+    if (metrics == nullptr) {
+        return readOpenedRange(file, filePath, offset, end, strategy, fileSize, onData, bytesRead);
+    }
+
+    // Time inside onData is the consumer's (hashing); the rest is reading
+    uint64_t sinkNs = 0;
+    uint64_t startNs = metricClockNs();
+    bool read = readOpenedRange(file, filePath, offset, end, strategy, fileSize,
+        [&](const void* data, size_t size) {
+            uint64_t sinkStartNs = metricClockNs();
+            onData(data, size);
+            sinkNs += metricClockNs() - sinkStartNs;
+        }, bytesRead);
+    uint64_t totalNs = metricClockNs() - startNs;
+    metrics->addTime(MetricPhase::Read, totalNs - (std::min)(sinkNs, totalNs));
+    metrics->addTime(MetricPhase::Hash, sinkNs);
+    metrics->addBytesRead(bytesRead);
+    return read;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "cs_handler_api.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+
+// How file contents are read for hashing
+enum class ReadStrategy {
+    Auto,       // Buffered for small files, Mapped for large ones
+    Mapped,     // mmap + MADV_SEQUENTIAL (MapViewOfFile on Windows)
+    Buffered,   // Large aligned pread blocks with sequential read-ahead hints
+    Direct,     // O_DIRECT (FILE_FLAG_NO_BUFFERING): bypasses the page cache
+    Uring       // io_uring pipeline for small files (Linux); otherwise as Auto
+};
+
+// Run option name ("auto", "mmap", "pread", "direct", "uring")
+CS_HANDLER_API const char* readStrategyName(ReadStrategy strategy);
+CS_HANDLER_API bool parseReadStrategy(std::string_view name, ReadStrategy& strategy);
+
+// Files at least this large are memory mapped in auto mode
+constexpr uint64_t mappedReadThreshold = 1ull << 20;
+
+// Strategy used for a file of the given size
+ReadStrategy resolveReadStrategy(ReadStrategy strategy, uint64_t fileSize);
+
+using ReadSink = std::function<void(const void* data, size_t length)>;
+
+// Deliver bytes [offset, offset + length) of a file to onData in order, stopping
+// early at the end of the file; bytesRead receives the number of bytes delivered.
+// Returns false if the file cannot be opened, mapped or read.
+//
+// The Buffered strategy also drops the pages it has consumed from the page
+// cache (POSIX_FADV_DONTNEED). Direct falls back to Buffered on file systems
+// that do not support unbuffered I/O.
+bool readFileRange(const std::filesystem::path& filePath, uint64_t offset, uint64_t length,
+    ReadStrategy strategy, const ReadSink& onData, uint64_t& bytesRead);
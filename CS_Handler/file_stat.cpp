@@ -0,0 +1,51 @@
+#include "pch.h"
+#include "file_stat.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+bool readFileStat(const std::filesystem::path& filePath, FileStat& stat) {
+    stat = FileStat{};
+
+#ifdef _WIN32
+    // FILE_FLAG_BACKUP_SEMANTICS also allows querying files without read access
+    HANDLE handle = CreateFileW(filePath.c_str(), FILE_READ_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info;
+    bool ok = GetFileInformationByHandle(handle, &info) != 0;
+    CloseHandle(handle);
+    if (!ok) {
+        return false;
+    }
+
+    stat.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    uint64_t writeTime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+    stat.mtimeNs = static_cast<int64_t>(writeTime * 100);   // FILETIME counts 100ns intervals
+    stat.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    stat.device = info.dwVolumeSerialNumber;
+    stat.linkCount = info.nNumberOfLinks;
+#else
+    struct stat info;
+    if (::stat(filePath.c_str(), &info) != 0) {
+        return false;
+    }
+
+    stat.size = static_cast<uint64_t>(info.st_size);
+#ifdef __APPLE__
+    stat.mtimeNs = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    stat.mtimeNs = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    stat.inode = static_cast<uint64_t>(info.st_ino);
+    stat.device = static_cast<uint64_t>(info.st_dev);
+    stat.linkCount = static_cast<uint32_t>(info.st_nlink);
+#endif
+
+    stat.valid = true;
+    return true;
+}
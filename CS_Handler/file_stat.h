@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+// Identity and change stamp of a file, stored with v3 manifest entries. A file
+// whose tuple is unchanged since the last run is assumed to have the same
+// contents.
+struct FileStat {
+    bool valid = false;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;    // Last write time in nanoseconds (Unix epoch; 1601 epoch on Windows)
+    uint64_t inode = 0;     // Inode number (file index on Windows)
+    uint64_t device = 0;    // Device (volume serial number on Windows); not stored in manifests
+    uint32_t linkCount = 0; // Hard links to the file; not stored in manifests
+
+    // Compares the stored tuple only, so a live stat equals its manifest entry
+    bool operator==(const FileStat& other) const {
+        return valid == other.valid && size == other.size && mtimeNs == other.mtimeNs && inode == other.inode;
+    }
+};
+
+// Device and inode of a file: equal for every hard link to it
+struct FileIdentity {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+
+    bool operator==(const FileIdentity& other) const = default;
+};
+
+struct FileIdentityHash {
+    size_t operator()(const FileIdentity& identity) const {
+        return std::hash<uint64_t>()(identity.inode ^ (identity.device * 0x9E3779B97F4A7C15ull));
+    }
+};
+
+inline FileIdentity fileIdentity(const FileStat& stat) {
+    return { stat.device, stat.inode };
+}
+
+// Returns false (and leaves stat invalid) if the file cannot be queried
+bool readFileStat(const std::filesystem::path& filePath, FileStat& stat);
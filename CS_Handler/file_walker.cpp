@@ -0,0 +1,85 @@
+#include "pch.h"
+#include "file_walker.h"
+#include "metrics.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct WalkChild {
+    std::string key;
+    std::filesystem::directory_entry entry;
+    bool isDirectory;
+};
+
+struct WalkFrame {
+    std::vector<WalkChild> children;
+    size_t next = 0;
+};
+
+std::vector<WalkChild> listDirectory(const std::filesystem::path& directory, const WalkErrorHandler& onError) {
+    PhaseTimer walkTimer(MetricPhase::Walk);
+    std::vector<WalkChild> children;
+    std::error_code ec;
+    std::filesystem::directory_iterator it(directory, std::filesystem::directory_options::skip_permission_denied, ec);
+
+    for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        const std::filesystem::directory_entry& entry = *it;
+        std::error_code typeEc;
+        bool isDirectory = entry.is_directory(typeEc) && !entry.is_symlink(typeEc);
+        bool isFile = !isDirectory && entry.is_regular_file(typeEc);
+        if (!isDirectory && !isFile) {
+            continue;
+        }
+
+        try {
+            std::string key = entry.path().filename().string();
+            if (isDirectory) {
+                key += static_cast<char>(std::filesystem::path::preferred_separator);
+            }
+            children.push_back({ std::move(key), entry, isDirectory });
+        }
+        catch (const std::exception&) {
+            // Name cannot be represented in the narrow manifest encoding
+            onError(entry.path(), std::make_error_code(std::errc::illegal_byte_sequence));
+        }
+    }
+
+    if (ec) {
+        onError(directory, ec);
+    }
+
+    std::sort(children.begin(), children.end(), [](const WalkChild& a, const WalkChild& b) {
+        return a.key < b.key;
+    });
+    return children;
+}
+
+} // namespace
+
+void walkSortedFiles(const std::filesystem::path& root, const FileVisitor& onFile, const WalkErrorHandler& onError,
+    const DirectoryFilter& enterDirectory) {
+    std::vector<WalkFrame> stack;
+    stack.push_back({ listDirectory(root, onError) });
+
+    while (!stack.empty()) {
+        WalkFrame& frame = stack.back();
+        if (frame.next == frame.children.size()) {
+            stack.pop_back();
+            continue;
+        }
+
+        const WalkChild& child = frame.children[frame.next++];
+        if (child.isDirectory) {
+            if (enterDirectory && !enterDirectory(child.entry.path())) {
+                continue;
+            }
+            // May reallocate the stack, so frame/child are not used afterwards
+            stack.push_back({ listDirectory(child.entry.path(), onError) });
+        }
+        else {
+            onFile(child.entry);
+        }
+    }
+}
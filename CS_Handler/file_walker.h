@@ -0,0 +1,26 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <system_error>
+
+using FileVisitor = std::function<void(const std::filesystem::directory_entry& entry)>;
+using WalkErrorHandler = std::function<void(const std::filesystem::path& path, const std::error_code& error)>;
+// Returns false to prune a directory: it is neither listed nor descended into
+using DirectoryFilter = std::function<bool(const std::filesystem::path& directory)>;
+
+// A directory the walk could not list, kept for reporting after the walk
+struct WalkFailure {
+    std::filesystem::path path;
+    std::string message;
+};
+
+// Depth-first walk that visits regular files in sorted path order. Siblings are
+// ordered byte-wise by name, with directories compared as "name<separator>",
+// so the visit order equals a plain string sort of the full paths.
+// Symlinked directories are not followed; unreadable directories are reported
+// through onError and skipped. enterDirectory, if set, is asked before each
+// directory below the root is listed.
+void walkSortedFiles(const std::filesystem::path& root, const FileVisitor& onFile, const WalkErrorHandler& onError,
+    const DirectoryFilter& enterDirectory = nullptr);
@@ -0,0 +1,287 @@
+#include "pch.h"
+#include "hash.h"
+#include "blake3.h"
+#include "crc.h"
+#include "crc_kernels.h"
+#include <algorithm>
+#include <bit>
+
+#define XXH_INLINE_ALL
+#include "third_party/xxhash.h"
+
+namespace {
+
+struct HashAlgorithmInfo {
+    HashAlgorithm algorithm;
+    const char* name;
+    size_t size;
+};
+
+constexpr HashAlgorithmInfo kAlgorithms[] = {
+    { HashAlgorithm::Crc32, "crc32", 4 },
+    { HashAlgorithm::Crc32c, "crc32c", 4 },
+    { HashAlgorithm::Crc64, "crc64", 8 },
+    { HashAlgorithm::Xxh3_64, "xxh3-64", 8 },
+    { HashAlgorithm::Xxh3_128, "xxh3-128", 16 },
+    { HashAlgorithm::Blake3, "blake3", blake3OutLength },
+};
+
+const HashAlgorithmInfo& algorithmInfo(HashAlgorithm algorithm) {
+    for (const auto& info : kAlgorithms) {
+        if (info.algorithm == algorithm) {
+            return info;
+        }
+    }
+    return kAlgorithms[0];
+}
+
+class Crc32Hasher : public Hasher {
+public:
+    void update(const void* data, size_t length) override { state = crc32Update(state, data, length); }
+    HashValue finalize() override { return hashFromUint(Crc32::finalize(state), 4); }
+
+private:
+    uint32_t state = Crc32::init();
+};
+
+class Crc32cHasher : public Hasher {
+public:
+    void update(const void* data, size_t length) override { state = crc32cUpdate(state, data, length); }
+    HashValue finalize() override { return hashFromUint(Crc32c::finalize(state), 4); }
+
+private:
+    uint32_t state = Crc32c::init();
+};
+
+class Crc64Hasher : public Hasher {
+public:
+    void update(const void* data, size_t length) override { state = Crc64::update(state, data, length); }
+    HashValue finalize() override { return hashFromUint(Crc64::finalize(state), 8); }
+
+private:
+    uint64_t state = Crc64::init();
+};
+
+class Xxh3_64Hasher : public Hasher {
+public:
+    Xxh3_64Hasher() { XXH3_64bits_reset(&state); }
+    void update(const void* data, size_t length) override { XXH3_64bits_update(&state, data, length); }
+    HashValue finalize() override { return hashFromUint(XXH3_64bits_digest(&state), 8); }
+
+private:
+    XXH3_state_t state;
+};
+
+class Xxh3_128Hasher : public Hasher {
+public:
+    Xxh3_128Hasher() { XXH3_128bits_reset(&state); }
+    void update(const void* data, size_t length) override { XXH3_128bits_update(&state, data, length); }
+
+    HashValue finalize() override {
+        XXH128_canonical_t canonical;
+        XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(&state));
+        HashValue hash;
+        hash.size = sizeof(canonical.digest);
+        std::copy(canonical.digest, canonical.digest + sizeof(canonical.digest), hash.bytes.begin());
+        return hash;
+    }
+
+private:
+    XXH3_state_t state;
+};
+
+class Blake3StreamHasher : public Hasher {
+public:
+    void update(const void* data, size_t length) override { hasher.update(data, length); }
+
+    HashValue finalize() override {
+        HashValue hash;
+        hash.size = blake3OutLength;
+        hasher.finalize(hash.bytes.data());
+        return hash;
+    }
+
+private:
+    Blake3Hasher hasher;
+};
+
+// Pieces must be whole power-of-two subtrees of the BLAKE3 chunk tree
+static_assert(hashPieceSize % blake3ChunkLength == 0 && std::has_single_bit(hashPieceSize / blake3ChunkLength),
+    "hashPieceSize must be a power-of-two number of BLAKE3 chunks");
+
+// Produces the subtree chaining value of one piece instead of a root hash
+class Blake3PieceHasher : public Hasher {
+public:
+    explicit Blake3PieceHasher(uint64_t offset)
+        : hasher(offset / blake3ChunkLength) {
+    }
+
+    void update(const void* data, size_t length) override { hasher.update(data, length); }
+
+    HashValue finalize() override {
+        HashValue hash;
+        hash.size = blake3OutLength;
+        hasher.finalizeSubtree(hash.bytes.data());
+        return hash;
+    }
+
+private:
+    Blake3Hasher hasher;
+};
+
+template <typename Engine>
+HashValue combineCrcPieces(const std::vector<HashValue>& pieces, uint64_t lastPieceLength, size_t size) {
+    auto crc = static_cast<typename Engine::value_type>(hashToUint(pieces[0]));
+    for (size_t i = 1; i < pieces.size(); i++) {
+        uint64_t length = i + 1 == pieces.size() ? lastPieceLength : hashPieceSize;
+        crc = Engine::combine(crc, static_cast<typename Engine::value_type>(hashToUint(pieces[i])), length);
+    }
+    return hashFromUint(crc, size);
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+std::unique_ptr<Hasher> createHasher(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::Crc32c:
+        return std::make_unique<Crc32cHasher>();
+    case HashAlgorithm::Crc64:
+        return std::make_unique<Crc64Hasher>();
+    case HashAlgorithm::Xxh3_64:
+        return std::make_unique<Xxh3_64Hasher>();
+    case HashAlgorithm::Xxh3_128:
+        return std::make_unique<Xxh3_128Hasher>();
+    case HashAlgorithm::Blake3:
+        return std::make_unique<Blake3StreamHasher>();
+    case HashAlgorithm::Crc32:
+    default:
+        return std::make_unique<Crc32Hasher>();
+    }
+}
+
+bool supportsPieceHashing(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::Crc32:
+    case HashAlgorithm::Crc32c:
+    case HashAlgorithm::Crc64:
+    case HashAlgorithm::Blake3:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::unique_ptr<Hasher> createPieceHasher(HashAlgorithm algorithm, uint64_t offset) {
+    // A CRC piece is just the finished CRC of its bytes
+    if (algorithm == HashAlgorithm::Blake3) {
+        return std::make_unique<Blake3PieceHasher>(offset);
+    }
+    return createHasher(algorithm);
+}
+
+HashValue combineHashPieces(HashAlgorithm algorithm, const std::vector<HashValue>& pieces, uint64_t lastPieceLength) {
+    switch (algorithm) {
+    case HashAlgorithm::Crc32c:
+        return combineCrcPieces<Crc32c>(pieces, lastPieceLength, 4);
+    case HashAlgorithm::Crc64:
+        return combineCrcPieces<Crc64>(pieces, lastPieceLength, 8);
+    case HashAlgorithm::Blake3: {
+        std::vector<uint8_t> cvs(pieces.size() * blake3OutLength);
+        for (size_t i = 0; i < pieces.size(); i++) {
+            std::copy(pieces[i].bytes.begin(), pieces[i].bytes.begin() + blake3OutLength, cvs.begin() + i * blake3OutLength);
+        }
+        HashValue hash;
+        hash.size = blake3OutLength;
+        blake3RootFromSubtrees(reinterpret_cast<const uint8_t (*)[blake3OutLength]>(cvs.data()), pieces.size(), hash.bytes.data());
+        return hash;
+    }
+    case HashAlgorithm::Crc32:
+    default:
+        return combineCrcPieces<Crc32>(pieces, lastPieceLength, 4);
+    }
+}
+
+bool supportsHashExtension(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::Crc32:
+    case HashAlgorithm::Crc32c:
+    case HashAlgorithm::Crc64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+HashValue extendHash(HashAlgorithm algorithm, const HashValue& prefix, const HashValue& suffix, uint64_t suffixLength) {
+    // Two CRC pieces combine the same way however long the first one is
+    return combineHashPieces(algorithm, { prefix, suffix }, suffixLength);
+}
+
+const char* hashAlgorithmName(HashAlgorithm algorithm) {
+    return algorithmInfo(algorithm).name;
+}
+
+bool parseHashAlgorithm(std::string_view name, HashAlgorithm& algorithm) {
+    for (const auto& info : kAlgorithms) {
+        if (name == info.name) {
+            algorithm = info.algorithm;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t hashSize(HashAlgorithm algorithm) {
+    return algorithmInfo(algorithm).size;
+}
+
+std::string hashToHex(const HashValue& hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(hash.size * 2, '0');
+    for (size_t i = 0; i < hash.size; i++) {
+        hex[i * 2] = digits[hash.bytes[i] >> 4];
+        hex[i * 2 + 1] = digits[hash.bytes[i] & 0x0F];
+    }
+    return hex;
+}
+
+bool hashFromHex(std::string_view text, size_t size, HashValue& hash) {
+    if (size > hash.bytes.size() || text.size() != size * 2) {
+        return false;
+    }
+    hash = HashValue{};
+    hash.size = static_cast<uint8_t>(size);
+    for (size_t i = 0; i < size; i++) {
+        int high = hexDigit(text[i * 2]);
+        int low = hexDigit(text[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        hash.bytes[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+HashValue hashFromUint(uint64_t value, size_t size) {
+    HashValue hash;
+    hash.size = static_cast<uint8_t>(size);
+    for (size_t i = 0; i < size; i++) {
+        hash.bytes[size - 1 - i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+    return hash;
+}
+
+uint64_t hashToUint(const HashValue& hash) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < hash.size && i < sizeof(value); i++) {
+        value = (value << 8) | hash.bytes[i];
+    }
+    return value;
+}
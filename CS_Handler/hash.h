@@ -0,0 +1,77 @@
+#pragma once
+
+#include "cs_handler_api.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Hash algorithms that can be recorded in a checksum manifest
+enum class HashAlgorithm {
+    Crc32,      // Default, compatible with manifests written before the v2 header
+    Crc32c,
+    Crc64,
+    Xxh3_64,
+    Xxh3_128,
+    Blake3
+};
+
+// A finished digest in canonical (big-endian) byte order, up to 256 bits
+struct HashValue {
+    uint8_t size = 0;
+    std::array<uint8_t, 32> bytes{};
+
+    bool operator==(const HashValue& other) const = default;
+};
+
+// Streaming hash state for one algorithm
+class Hasher {
+public:
+    virtual ~Hasher() = default;
+    virtual void update(const void* data, size_t length) = 0;
+    virtual HashValue finalize() = 0;
+};
+
+std::unique_ptr<Hasher> createHasher(HashAlgorithm algorithm);
+
+// Manifest name ("crc32", "crc32c", "crc64", "xxh3-64", "xxh3-128", "blake3")
+CS_HANDLER_API const char* hashAlgorithmName(HashAlgorithm algorithm);
+CS_HANDLER_API bool parseHashAlgorithm(std::string_view name, HashAlgorithm& algorithm);
+
+// Digest size in bytes
+size_t hashSize(HashAlgorithm algorithm);
+
+// Lowercase hex encoding of the digest bytes
+std::string hashToHex(const HashValue& hash);
+bool hashFromHex(std::string_view text, size_t size, HashValue& hash);
+
+// Build a HashValue from an integer digest (CRCs, XXH3-64)
+HashValue hashFromUint(uint64_t value, size_t size);
+uint64_t hashToUint(const HashValue& hash);
+
+// Large inputs can be hashed as independent pieces of hashPieceSize bytes (the
+// last piece may be shorter) and combined into the same digest a sequential
+// hasher produces. CRCs combine in GF(2), BLAKE3 merges subtree chaining
+// values. XXH3 has no combine step and is always hashed sequentially.
+constexpr uint64_t hashPieceSize = 8ull << 20;
+
+bool supportsPieceHashing(HashAlgorithm algorithm);
+
+// Hasher for the piece starting at byte offset (a multiple of hashPieceSize).
+// Its finalize() result is only meaningful to combineHashPieces.
+std::unique_ptr<Hasher> createPieceHasher(HashAlgorithm algorithm, uint64_t offset);
+
+// Digest of the whole input from its piece results in order (two or more).
+// For BLAKE3 the last piece must be at most hashPieceSize bytes long.
+HashValue combineHashPieces(HashAlgorithm algorithm, const std::vector<HashValue>& pieces, uint64_t lastPieceLength);
+
+// CRC digests are their own resumable state: the digest of a longer input is
+// the previous digest combined with the CRC of the added bytes. XXH3 and
+// BLAKE3 digests cannot be extended.
+bool supportsHashExtension(HashAlgorithm algorithm);
+
+// Digest of prefix bytes followed by suffixLength more bytes, from the digests of both
+HashValue extendHash(HashAlgorithm algorithm, const HashValue& prefix, const HashValue& suffix, uint64_t suffixLength);
@@ -0,0 +1,418 @@
+#include "pch.h"
+#include "manifest.h"
+#include "blake3.h"
+#include "mapped_file.h"
+#include "merkle.h"
+#include "sharded_manifest.h"
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+
+namespace {
+
+constexpr std::string_view kHeaderPrefix = "# checksum_handler manifest v";
+
+std::string_view trimLineEnd(std::string_view text) {
+    while (!text.empty() && (text.back() == '\r' || text.back() == ' ')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+template <typename T>
+bool parseNumber(std::string_view text, T& value) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && ptr == text.data() + text.size();
+}
+
+} // namespace
+
+std::string formatManifestHeader(const ManifestHeader& header) {
+    std::string line(kHeaderPrefix);
+    line += std::to_string(header.version);
+    line += " algorithm=";
+    line += hashAlgorithmName(header.algorithm);
+    if (header.hasStat) {
+        line += " stat=1";
+    }
+    if (header.sorted) {
+        line += " sorted=1";
+    }
+    if (header.hasTree) {
+        line += " tree=1";
+    }
+    if (header.relative) {
+        line += " relative=1";
+    }
+    if (header.frontCoded) {
+        line += " front=1";
+    }
+    if (header.appendCheck) {
+        line += " append=1";
+    }
+    return line;
+}
+
+bool parseManifestHeader(std::string_view line, ManifestHeader& header, std::string& error) {
+    line = trimLineEnd(line);
+    if (line.substr(0, kHeaderPrefix.size()) != kHeaderPrefix) {
+        return false;
+    }
+    line.remove_prefix(kHeaderPrefix.size());
+
+    // Version number, then space separated key=value pairs
+    size_t end = line.find(' ');
+    std::string_view versionText = line.substr(0, end);
+    int version = 0;
+    auto [ptr, ec] = std::from_chars(versionText.data(), versionText.data() + versionText.size(), version);
+    if (ec != std::errc() || ptr != versionText.data() + versionText.size()) {
+        error = "invalid manifest version";
+        return true;
+    }
+    header.version = version;
+
+    while (end != std::string_view::npos) {
+        line.remove_prefix(end + 1);
+        end = line.find(' ');
+        std::string_view field = line.substr(0, end);
+        size_t equals = field.find('=');
+        if (equals == std::string_view::npos) {
+            continue;
+        }
+
+        std::string_view key = field.substr(0, equals);
+        std::string_view value = field.substr(equals + 1);
+        if (key == "algorithm" && !parseHashAlgorithm(value, header.algorithm)) {
+            error = "unknown hash algorithm '" + std::string(value) + "'";
+        }
+        else if (key == "stat") {
+            header.hasStat = value == "1";
+        }
+        else if (key == "sorted") {
+            header.sorted = value == "1";
+        }
+        else if (key == "tree") {
+            header.hasTree = value == "1";
+        }
+        else if (key == "relative") {
+            header.relative = value == "1";
+        }
+        else if (key == "front") {
+            header.frontCoded = value == "1";
+        }
+        else if (key == "append") {
+            header.appendCheck = value == "1";
+        }
+    }
+    return true;
+}
+
+bool parseManifestHash(std::string_view text, const ManifestHeader& header, HashValue& hash) {
+    text = trimLineEnd(text);
+
+    // v1 manifests store the CRC-32 as a signed decimal int
+    if (header.version < 2) {
+        int32_t value = 0;
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != std::errc() || ptr != text.data() + text.size()) {
+            return false;
+        }
+        hash = hashFromUint(static_cast<uint32_t>(value), 4);
+        return true;
+    }
+
+    return hashFromHex(text, hashSize(header.algorithm), hash);
+}
+
+std::string formatManifestHash(const HashValue& hash) {
+    return hashToHex(hash);
+}
+
+bool splitManifestEntry(std::string_view line, const ManifestHeader& header, ManifestFields& fields) {
+    line = trimLineEnd(line);
+
+    // Columns after the path never contain spaces, so split from the right
+    size_t checkColumns = header.appendCheck ? 1 : 0;
+    size_t trailingColumns = (header.hasStat ? 3 : 0) + checkColumns;
+    size_t end = line.size();
+    size_t statEnd = line.size();
+    size_t hashStart = 0;
+    for (size_t column = 0; column <= trailingColumns; column++) {
+        if (end == 0) {
+            return false;
+        }
+        size_t space = line.rfind(' ', end - 1);
+        if (space == std::string_view::npos) {
+            return false;
+        }
+        hashStart = space + 1;
+        if (column < trailingColumns) {
+            end = space;
+            if (column + 1 == checkColumns) {
+                statEnd = space;
+            }
+        }
+    }
+
+    fields.path = line.substr(0, hashStart - 1);
+    fields.hash = line.substr(hashStart, end - hashStart);
+    fields.stat = header.hasStat ? line.substr(end + 1, statEnd - end - 1) : std::string_view();
+    fields.check = header.appendCheck ? line.substr(statEnd + 1) : std::string_view();
+    return true;
+}
+
+bool splitFrontCodedPath(std::string_view field, size_t& sharedLength, std::string_view& suffix) {
+    size_t space = field.find(' ');
+    if (space == std::string_view::npos || !parseNumber(field.substr(0, space), sharedLength)) {
+        return false;
+    }
+    suffix = field.substr(space + 1);
+    return true;
+}
+
+std::string formatFrontCodedPath(std::string_view path, std::string_view previousPath) {
+    size_t shared = 0;
+    size_t limit = (std::min)(path.size(), previousPath.size());
+    while (shared < limit && path[shared] == previousPath[shared]) {
+        shared++;
+    }
+    std::string field = std::to_string(shared);
+    field += ' ';
+    field += path.substr(shared);
+    return field;
+}
+
+bool parseManifestStat(std::string_view text, FileStat& stat) {
+    stat = FileStat{};
+    if (text == "- - -") {
+        return true;
+    }
+
+    size_t first = text.find(' ');
+    size_t second = first == std::string_view::npos ? first : text.find(' ', first + 1);
+    if (second == std::string_view::npos) {
+        return false;
+    }
+    stat.valid = parseNumber(text.substr(0, first), stat.size) &&
+        parseNumber(text.substr(first + 1, second - first - 1), stat.mtimeNs) &&
+        parseNumber(text.substr(second + 1), stat.inode);
+    return stat.valid;
+}
+
+std::string formatManifestStat(const FileStat& stat) {
+    if (!stat.valid) {
+        return "- - -";
+    }
+    return std::to_string(stat.size) + " " + std::to_string(stat.mtimeNs) + " " + std::to_string(stat.inode);
+}
+
+bool parseManifestAppendCheck(std::string_view text, AppendCheck& check) {
+    check = AppendCheck{};
+    if (text == "-") {
+        return true;
+    }
+
+    HashValue value;
+    if (!hashFromHex(text, sizeof(check.value), value)) {
+        return false;
+    }
+    check.valid = true;
+    check.value = hashToUint(value);
+    return true;
+}
+
+std::string formatManifestAppendCheck(const AppendCheck& check) {
+    if (!check.valid) {
+        return "-";
+    }
+    return hashToHex(hashFromUint(check.value, sizeof(check.value)));
+}
+
+void appendManifestEntry(std::string& out, std::string_view pathColumn, const HashValue& hash, const FileStat& stat,
+    const AppendCheck* check) {
+    if (!pathColumn.empty() && pathColumn.front() == '#') {
+        out += '#';
+    }
+    out += pathColumn;
+    out += ' ';
+    out += formatManifestHash(hash);
+    out += ' ';
+    out += formatManifestStat(stat);
+    if (check != nullptr) {
+        out += ' ';
+        out += formatManifestAppendCheck(*check);
+    }
+    out += '\n';
+}
+
+bool isManifestDirectoryLine(std::string_view line) {
+    return line.substr(0, manifestDirectoryPrefix.size()) == manifestDirectoryPrefix;
+}
+
+ManifestLineKind classifyManifestLine(std::string_view& line, const ManifestHeader& header) {
+    if (!header.hasTree || line.empty() || line.front() != '#') {
+        return ManifestLineKind::Entry;
+    }
+    if (line.size() > 1 && line[1] == '#') {
+        line.remove_prefix(1);
+        return ManifestLineKind::Entry;
+    }
+    return isManifestDirectoryLine(line) ? ManifestLineKind::Directory : ManifestLineKind::Invalid;
+}
+
+bool parseManifestDirectory(std::string_view line, std::string_view& directory, HashValue& digest) {
+    line = trimLineEnd(line);
+    if (!isManifestDirectoryLine(line)) {
+        return false;
+    }
+    line.remove_prefix(manifestDirectoryPrefix.size());
+
+    // The root of a relative manifest is the empty path
+    size_t space = line.find(' ');
+    if (!hashFromHex(line.substr(0, space), blake3OutLength, digest)) {
+        return false;
+    }
+    directory = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+    return true;
+}
+
+std::string formatManifestDirectory(std::string_view directory, const HashValue& digest) {
+    std::string line(manifestDirectoryPrefix);
+    line += hashToHex(digest);
+    if (!directory.empty()) {
+        line += ' ';
+        line += directory;
+    }
+    return line;
+}
+
+bool isChecksumOutputFile(const std::filesystem::path& fileName) {
+    return fileName == "checksum.txt" || fileName == "checksum.txt.tmp" ||
+        fileName == shardIndexFileName || fileName == std::string(shardIndexFileName) + ".tmp";
+}
+
+bool isChecksumOutputDirectory(const std::filesystem::path& directoryName) {
+    return directoryName == shardDirectoryName;
+}
+
+bool readManifestRoot(const std::filesystem::path& manifestPath, std::string& directory, HashValue& digest) {
+    MappedFile file;
+    if (!file.open(manifestPath)) {
+        return false;
+    }
+    std::string_view text(reinterpret_cast<const char*>(file.data()), file.size());
+
+    ManifestHeader header;
+    std::string error;
+    if (!parseManifestHeader(text.substr(0, text.find('\n')), header, error) || !error.empty() || !header.hasTree) {
+        return false;
+    }
+
+    // The root is written last, after every other directory has closed
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+        text.remove_suffix(1);
+    }
+    size_t lineStart = text.find_last_of('\n');
+    std::string_view rootDirectory;
+    if (!parseManifestDirectory(text.substr(lineStart == std::string_view::npos ? 0 : lineStart + 1), rootDirectory, digest)) {
+        return false;
+    }
+    directory.assign(rootDirectory);
+    return true;
+}
+
+std::string absoluteManifestPrefix(const std::filesystem::path& manifestPath) {
+    std::string directory;
+    HashValue digest;
+    if (!readManifestRoot(manifestPath, directory, digest)) {
+        std::error_code ec;
+        directory = std::filesystem::absolute(manifestPath, ec).parent_path().string();
+    }
+    return directoryPrefix(directory);
+}
+
+bool ManifestReader::open(const std::filesystem::path& manifestPath) {
+    file.open(manifestPath);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    manifestHeader = ManifestHeader{};
+    frontPath.clear();
+    skipped = 0;
+    pendingLine = false;
+    if (!std::getline(file, line)) {
+        return true;
+    }
+    std::string error;
+    if (parseManifestHeader(line, manifestHeader, error)) {
+        return error.empty() && manifestHeader.version <= manifestVersion;
+    }
+
+    // Files from the oldest versions start with an entry
+    pendingLine = true;
+    return true;
+}
+
+bool ManifestReader::next(std::string_view& path, HashValue& hash, FileStat& stat, AppendCheck& check) {
+    while (pendingLine || std::getline(file, line)) {
+        pendingLine = false;
+        std::string_view text = line;
+        ManifestLineKind kind = classifyManifestLine(text, manifestHeader);
+        if (kind == ManifestLineKind::Directory) {
+            std::string_view directory;
+            HashValue digest;
+            skipped += !parseManifestDirectory(text, directory, digest);
+            continue;
+        }
+        if (kind == ManifestLineKind::Invalid) {
+            skipped++;
+            continue;
+        }
+
+        ManifestFields fields;
+        hash = HashValue{};
+        stat = FileStat{};
+        check = AppendCheck{};
+        if (!splitManifestEntry(text, manifestHeader, fields) || !parseManifestHash(fields.hash, manifestHeader, hash) ||
+            (manifestHeader.hasStat && !parseManifestStat(fields.stat, stat)) ||
+            (manifestHeader.appendCheck && !parseManifestAppendCheck(fields.check, check))) {
+            skipped += !line.empty() && line != "\r";
+            continue;
+        }
+
+        if (manifestHeader.frontCoded) {
+            size_t shared = 0;
+            std::string_view suffix;
+            if (!splitFrontCodedPath(fields.path, shared, suffix) || shared > frontPath.size()) {
+                skipped++;
+                continue;
+            }
+            frontPath.resize(shared);
+            frontPath += suffix;
+            path = frontPath;
+        }
+        else {
+            path = fields.path;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool readManifestEntries(const std::filesystem::path& manifestPath, ManifestHeader& header, const ManifestEntryVisitor& onEntry) {
+    ManifestReader reader;
+    if (!reader.open(manifestPath)) {
+        return false;
+    }
+
+    header = reader.header();
+    std::string_view path;
+    HashValue hash;
+    FileStat stat;
+    AppendCheck check;
+    while (reader.next(path, hash, stat, check)) {
+        onEntry(path, hash, stat, check);
+    }
+    return reader.skippedLines() == 0;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "append_check.h"
+#include "file_stat.h"
+#include "hash.h"
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Newest manifest format version this build reads and writes
+constexpr int manifestVersion = 6;
+
+// Create writes the oldest version that holds its options, so older readers
+// still accept manifests that do not use the newer columns
+constexpr int plainManifestVersion = 4;
+constexpr int frontCodedManifestVersion = 5;
+
+// First line of a v2+ checksum.txt:
+//   # checksum_handler manifest v4 algorithm=xxh3-64 stat=1 sorted=1 tree=1 relative=1
+// followed by "<path> <hex digest>" lines. With stat=1 (v3) each line also
+// carries "<size> <mtime ns> <inode>", or "- - -" when the file could not be
+// queried. sorted=1 records that entry lines are in strictly ascending
+// byte-wise path order. With tree=1 (v4) every directory is followed by a
+// "#d <hex digest> <directory path>" line holding its Merkle digest; the root
+// directory's line is the last line of the file. relative=1 marks paths
+// stored relative to the manifest's folder (the root is then ""). front=1 (v5)
+// front-codes the path column as "<bytes shared with the previous entry's
+// path> <rest of the path>". append=1 (v6) adds a last column holding the
+// entry's AppendCheck as 16 hex digits, or "-" when it is unknown. Files
+// without a header are v1: CRC-32 values written as signed decimal integers.
+struct ManifestHeader {
+    int version = 1;
+    HashAlgorithm algorithm = HashAlgorithm::Crc32;
+    bool hasStat = false;
+    bool sorted = false;
+    bool hasTree = false;
+    bool relative = false;
+    bool frontCoded = false;
+    bool appendCheck = false;
+};
+
+// One parsed manifest entry
+struct ManifestEntry {
+    std::string path;
+    HashValue hash;
+    FileStat stat;
+};
+
+// Columns of one entry line
+struct ManifestFields {
+    std::string_view path;
+    std::string_view hash;
+    std::string_view stat;  // Empty unless the header has stat columns
+    std::string_view check; // Empty unless the header has append checks
+};
+
+std::string formatManifestHeader(const ManifestHeader& header);
+
+// Returns true when line is a manifest header. Unknown keys are ignored;
+// an unknown algorithm name leaves error set.
+bool parseManifestHeader(std::string_view line, ManifestHeader& header, std::string& error);
+
+// Parse / format the checksum column of an entry line for the given header
+bool parseManifestHash(std::string_view text, const ManifestHeader& header, HashValue& hash);
+std::string formatManifestHash(const HashValue& hash);
+
+// Split an entry line into columns; false when it has too few of them
+bool splitManifestEntry(std::string_view line, const ManifestHeader& header, ManifestFields& fields);
+
+// Path column of a front=1 manifest
+bool splitFrontCodedPath(std::string_view field, size_t& sharedLength, std::string_view& suffix);
+std::string formatFrontCodedPath(std::string_view path, std::string_view previousPath);
+
+bool parseManifestStat(std::string_view text, FileStat& stat);
+std::string formatManifestStat(const FileStat& stat);
+
+bool parseManifestAppendCheck(std::string_view text, AppendCheck& check);
+std::string formatManifestAppendCheck(const AppendCheck& check);
+
+// Append a stat=1 entry line, newline included; pathColumn is the path as
+// stored (front-coded in v5 manifests). check is the last column of append=1
+// manifests and nullptr for any other. A path column starting with '#' is
+// written with the '#' doubled, so it cannot be taken for a directory line.
+void appendManifestEntry(std::string& out, std::string_view pathColumn, const HashValue& hash, const FileStat& stat,
+    const AppendCheck* check = nullptr);
+
+// Directory digest lines of tree=1 manifests
+constexpr std::string_view manifestDirectoryPrefix = "#d ";
+bool isManifestDirectoryLine(std::string_view line);
+
+// What a non-empty line after the header of a manifest holds. In tree=1
+// manifests every line starting with '#' is a directory line or an escaped
+// entry, whose doubled '#' is removed from line; any other is invalid.
+enum class ManifestLineKind {
+    Entry,
+    Directory,
+    Invalid
+};
+ManifestLineKind classifyManifestLine(std::string_view& line, const ManifestHeader& header);
+bool parseManifestDirectory(std::string_view line, std::string_view& directory, HashValue& digest);
+std::string formatManifestDirectory(std::string_view directory, const HashValue& digest);
+
+// Names create writes into the tree it hashes: checksum.txt, checksum.idx and
+// their temporary files, and checksum.shards directories. Create, watch, verify
+// and duplicates skip them at any depth.
+bool isChecksumOutputFile(const std::filesystem::path& fileName);
+bool isChecksumOutputDirectory(const std::filesystem::path& directoryName);
+
+// Read only the header and the last line of a tree=1 manifest: the root
+// directory path and its digest. Returns false for any other manifest.
+bool readManifestRoot(const std::filesystem::path& manifestPath, std::string& directory, HashValue& digest);
+
+// Prefix to strip from the paths of a manifest without relative=1 so they match
+// those of a relative one: the root directory of a tree=1 manifest, otherwise
+// the folder the manifest is in. Ends with a separator.
+std::string absoluteManifestPrefix(const std::filesystem::path& manifestPath);
+
+using ManifestEntryVisitor = std::function<void(std::string_view path, const HashValue& hash, const FileStat& stat,
+    const AppendCheck& check)>;
+
+// Read the header and every entry of a manifest. Returns false if the file
+// cannot be opened, its header is invalid or newer than this build, or a line
+// is neither an entry nor a directory line (entries before it are visited).
+bool readManifestEntries(const std::filesystem::path& manifestPath, ManifestHeader& header, const ManifestEntryVisitor& onEntry);
+
+// Pulls the entries of a text manifest one at a time, for callers that read
+// several manifests in step. Lines that cannot be parsed, including malformed
+// directory lines, are skipped and counted.
+class ManifestReader {
+public:
+    // False if the file cannot be opened or its header is invalid or newer than this build
+    bool open(const std::filesystem::path& manifestPath);
+
+    // Next entry; path stays valid until the following call. False at the end.
+    bool next(std::string_view& path, HashValue& hash, FileStat& stat, AppendCheck& check);
+
+    const ManifestHeader& header() const { return manifestHeader; }
+    size_t skippedLines() const { return skipped; }
+
+private:
+    std::ifstream file;
+    ManifestHeader manifestHeader;
+    std::string line;
+    std::string frontPath;      // Path of the previous entry, for front-coded manifests
+    bool pendingLine = false;   // First line was an entry of a headerless manifest
+    size_t skipped = 0;
+};
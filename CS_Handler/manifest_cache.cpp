@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "manifest_cache.h"
+#include "file_stat.h"
+#include <algorithm>
+#include <list>
+#include <mutex>
+
+namespace {
+
+struct CachedManifest {
+    std::string key;
+    FileStat stat;
+    std::shared_ptr<const ParsedManifest> manifest;
+};
+
+// Most recently used first
+std::mutex cacheMutex;
+std::list<CachedManifest> cachedManifests;
+
+std::string cacheKey(const std::filesystem::path& manifestPath) {
+    std::error_code ec;
+    std::filesystem::path absolutePath = std::filesystem::absolute(manifestPath, ec);
+    return (ec ? manifestPath : absolutePath).lexically_normal().string();
+}
+
+} // namespace
+
+bool resolveManifestPath(const std::filesystem::path& path, std::filesystem::path& manifestPath, std::string& error) {
+    if (!std::filesystem::exists(path)) {
+        error = "Path does not exist: " + path.string();
+        return false;
+    }
+    if (!std::filesystem::is_directory(path)) {
+        manifestPath = path;
+        return true;
+    }
+
+    manifestPath = path / "checksum.txt";
+    if (!std::filesystem::exists(manifestPath)) {
+        manifestPath = path / "checksum.bin";
+    }
+    if (!std::filesystem::exists(manifestPath)) {
+        manifestPath = path / "checksum.idx";
+    }
+    if (!std::filesystem::exists(manifestPath)) {
+        error = "checksum.txt, checksum.bin or checksum.idx not found in folder: " + path.string();
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const ParsedManifest> loadCachedManifest(const std::filesystem::path& manifestPath, unsigned int threadCount,
+    std::string& error) {
+    std::string key = cacheKey(manifestPath);
+    FileStat stat;
+    readFileStat(manifestPath, stat);
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = std::find_if(cachedManifests.begin(), cachedManifests.end(), [&](const CachedManifest& entry) {
+            return entry.key == key;
+        });
+        if (it != cachedManifests.end()) {
+            if (it->stat == stat) {
+                cachedManifests.splice(cachedManifests.begin(), cachedManifests, it);
+                return it->manifest;
+            }
+            cachedManifests.erase(it);
+        }
+    }
+
+    // Parse outside the lock so other manifests can be served meanwhile
+    auto manifest = std::make_shared<ParsedManifest>();
+    if (!manifest->load(manifestPath, threadCount, error)) {
+        return nullptr;
+    }
+
+    // A file without stat data cannot be checked for changes, so it is not kept
+    if (stat.valid) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cachedManifests.remove_if([&](const CachedManifest& entry) { return entry.key == key; });
+        cachedManifests.push_front({ key, stat, manifest });
+        if (cachedManifests.size() > manifestCacheCapacity) {
+            cachedManifests.pop_back();
+        }
+    }
+    return manifest;
+}
+
+void evictCachedManifest(const std::filesystem::path& manifestPath) {
+    std::string key = cacheKey(manifestPath);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cachedManifests.remove_if([&](const CachedManifest& entry) { return entry.key == key; });
+}
+
+void clearCachedManifests() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cachedManifests.clear();
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "manifest_parser.h"
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+// Parsed manifests kept for reuse by later comparisons
+constexpr size_t manifestCacheCapacity = 8;
+
+// Manifest file for a path: the path itself, or the checksum.txt (else
+// checksum.bin, else the sharded checksum.idx) of a folder. Returns false with
+// error set when there is none.
+bool resolveManifestPath(const std::filesystem::path& path, std::filesystem::path& manifestPath, std::string& error);
+
+// Load a manifest through the process-wide cache. An entry is reused while the
+// file's size, mtime and inode are unchanged; the least recently used entry is
+// dropped once manifestCacheCapacity is exceeded. threadCount is passed to
+// ParsedManifest::load on a miss. Thread-safe; two threads missing on the same
+// file may both parse it.
+std::shared_ptr<const ParsedManifest> loadCachedManifest(const std::filesystem::path& manifestPath, unsigned int threadCount,
+    std::string& error);
+
+// Drop the cached copy of a manifest that is about to be replaced
+void evictCachedManifest(const std::filesystem::path& manifestPath);
+
+void clearCachedManifests();
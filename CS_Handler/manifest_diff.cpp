@@ -0,0 +1,243 @@
+#include "pch.h"
+#include "manifest_diff.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// Child of directory under which path lies: a file name, or a subdirectory
+// name with its trailing separator. Children compare in the same order as the
+// full paths below them.
+std::string_view childKey(std::string_view path, size_t directoryLength) {
+    size_t separator = path.find_first_of("/\\", directoryLength);
+    size_t end = separator == std::string_view::npos ? path.size() : separator + 1;
+    return path.substr(directoryLength, end - directoryLength);
+}
+
+bool isDirectoryKey(std::string_view key) {
+    return !key.empty() && (key.back() == '/' || key.back() == '\\');
+}
+
+class TreeDiff {
+public:
+    TreeDiff(const std::vector<ManifestDiffEntry>& currEntries, const DirectoryDigestMap& currDirectories,
+        const std::vector<ManifestDiffEntry>& newEntries, const DirectoryDigestMap& newDirectories,
+        const ManifestChangeSink& onChange)
+        : currEntries(currEntries), currDirectories(currDirectories),
+        newEntries(newEntries), newDirectories(newDirectories), onChange(onChange) {
+    }
+
+    // Compare the entries [currBegin, currEnd) and [newBegin, newEnd), all below directory
+    void descend(std::string_view directory, size_t currBegin, size_t currEnd, size_t newBegin, size_t newEnd) {
+        auto currDigest = currDirectories.find(directory);
+        auto newDigest = newDirectories.find(directory);
+        if (currDigest != currDirectories.end() && newDigest != newDirectories.end() && currDigest->second == newDigest->second) {
+            skipped += currEnd - currBegin;
+            return;
+        }
+
+        size_t currIndex = currBegin;
+        size_t newIndex = newBegin;
+        while (!stopped && (currIndex < currEnd || newIndex < newEnd)) {
+            std::string_view currKey = currIndex < currEnd ? childKey(currEntries[currIndex].path, directory.size()) : std::string_view();
+            std::string_view newKey = newIndex < newEnd ? childKey(newEntries[newIndex].path, directory.size()) : std::string_view();
+            int order = currIndex == currEnd ? 1 : newIndex == newEnd ? -1 : currKey.compare(newKey);
+
+            if (order < 0) {
+                size_t end = childEnd(currEntries, currIndex, currEnd, directory.size() + currKey.size(), currKey);
+                report(currEntries, currIndex, end, ChangeKind::Deleted);
+                currIndex = end;
+            }
+            else if (order > 0) {
+                size_t end = childEnd(newEntries, newIndex, newEnd, directory.size() + newKey.size(), newKey);
+                report(newEntries, newIndex, end, ChangeKind::Added);
+                newIndex = end;
+            }
+            else if (isDirectoryKey(currKey)) {
+                size_t prefixLength = directory.size() + currKey.size();
+                size_t currChildEnd = childEnd(currEntries, currIndex, currEnd, prefixLength, currKey);
+                size_t newChildEnd = childEnd(newEntries, newIndex, newEnd, prefixLength, newKey);
+                descend(currEntries[currIndex].path.substr(0, prefixLength), currIndex, currChildEnd, newIndex, newChildEnd);
+                currIndex = currChildEnd;
+                newIndex = newChildEnd;
+            }
+            else {
+                if (currEntries[currIndex].hash != newEntries[newIndex].hash) {
+                    stopped = !onChange({ newEntries[newIndex].path, ChangeKind::Changed });
+                }
+                currIndex++;
+                newIndex++;
+            }
+        }
+    }
+
+    size_t skippedEntries() const { return skipped; }
+
+private:
+    // End of the entries starting at begin that belong to the same child
+    static size_t childEnd(const std::vector<ManifestDiffEntry>& entries, size_t begin, size_t end, size_t prefixLength, std::string_view key) {
+        if (!isDirectoryKey(key)) {
+            return begin + 1;
+        }
+        std::string_view prefix = entries[begin].path.substr(0, prefixLength);
+        auto it = std::partition_point(entries.begin() + begin, entries.begin() + end, [&](const ManifestDiffEntry& entry) {
+            return entry.path.substr(0, prefixLength) == prefix;
+        });
+        return static_cast<size_t>(it - entries.begin());
+    }
+
+    void report(const std::vector<ManifestDiffEntry>& entries, size_t begin, size_t end, ChangeKind kind) {
+        for (size_t i = begin; i < end && !stopped; i++) {
+            stopped = !onChange({ entries[i].path, kind });
+        }
+    }
+
+    const std::vector<ManifestDiffEntry>& currEntries;
+    const DirectoryDigestMap& currDirectories;
+    const std::vector<ManifestDiffEntry>& newEntries;
+    const DirectoryDigestMap& newDirectories;
+    const ManifestChangeSink& onChange;
+    size_t skipped = 0;
+    bool stopped = false;
+};
+
+} // namespace
+
+const char* changeKindName(ChangeKind kind) {
+    switch (kind) {
+    case ChangeKind::Added:
+        return "ADDED";
+    case ChangeKind::Deleted:
+        return "DELETED";
+    case ChangeKind::Appended:
+        return "APPENDED";
+    default:
+        return "CHANGED";
+    }
+}
+
+bool isSortedManifest(const std::vector<ManifestDiffEntry>& entries) {
+    for (size_t i = 1; i < entries.size(); i++) {
+        if (!(entries[i - 1].path < entries[i].path)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void mergeSortedManifests(const std::vector<ManifestDiffEntry>& currEntries, const std::vector<ManifestDiffEntry>& newEntries,
+    std::vector<ManifestChange>& changes) {
+    mergeSortedManifests(currEntries, newEntries, [&](const ManifestChange& change) {
+        changes.push_back(change);
+        return true;
+    });
+}
+
+bool mergeSortedManifests(const std::vector<ManifestDiffEntry>& currEntries, const std::vector<ManifestDiffEntry>& newEntries,
+    const ManifestChangeSink& onChange) {
+    size_t currIndex = 0;
+    size_t newIndex = 0;
+    while (currIndex < currEntries.size() || newIndex < newEntries.size()) {
+        if (newIndex == newEntries.size()) {
+            if (!onChange({ currEntries[currIndex++].path, ChangeKind::Deleted })) {
+                return false;
+            }
+            continue;
+        }
+        if (currIndex == currEntries.size()) {
+            if (!onChange({ newEntries[newIndex++].path, ChangeKind::Added })) {
+                return false;
+            }
+            continue;
+        }
+
+        const ManifestDiffEntry& currEntry = currEntries[currIndex];
+        const ManifestDiffEntry& newEntry = newEntries[newIndex];
+        int order = currEntry.path.compare(newEntry.path);
+        bool more = true;
+        if (order < 0) {
+            more = onChange({ currEntry.path, ChangeKind::Deleted });
+            currIndex++;
+        }
+        else if (order > 0) {
+            more = onChange({ newEntry.path, ChangeKind::Added });
+            newIndex++;
+        }
+        else {
+            if (currEntry.hash != newEntry.hash) {
+                more = onChange({ newEntry.path, ChangeKind::Changed });
+            }
+            currIndex++;
+            newIndex++;
+        }
+        if (!more) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void hashJoinManifests(const std::vector<ManifestDiffEntry>& currEntries, const std::vector<ManifestDiffEntry>& newEntries,
+    std::vector<ManifestChange>& changes) {
+    // Path -> index of its last occurrence
+    auto indexByPath = [](const std::vector<ManifestDiffEntry>& entries) {
+        std::unordered_map<std::string_view, size_t> index;
+        index.reserve(entries.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            index.insert_or_assign(entries[i].path, i);
+        }
+        return index;
+    };
+    auto currIndex = indexByPath(currEntries);
+    auto newIndex = indexByPath(newEntries);
+
+    size_t firstChange = changes.size();
+    for (const auto& [filePath, index] : newIndex) {
+        auto it = currIndex.find(filePath);
+        if (it == currIndex.end()) {
+            changes.push_back({ filePath, ChangeKind::Added });
+        }
+        else if (currEntries[it->second].hash != newEntries[index].hash) {
+            changes.push_back({ filePath, ChangeKind::Changed });
+        }
+    }
+    for (const auto& [filePath, index] : currIndex) {
+        if (newIndex.find(filePath) == newIndex.end()) {
+            changes.push_back({ filePath, ChangeKind::Deleted });
+        }
+    }
+
+    std::sort(changes.begin() + firstChange, changes.end(), [](const ManifestChange& a, const ManifestChange& b) {
+        return a.path < b.path;
+    });
+}
+
+size_t diffManifestTrees(const std::vector<ManifestDiffEntry>& currEntries, const DirectoryDigestMap& currDirectories,
+    const std::vector<ManifestDiffEntry>& newEntries, const DirectoryDigestMap& newDirectories,
+    std::string_view rootDirectory, std::vector<ManifestChange>& changes) {
+    return diffManifestTrees(currEntries, currDirectories, newEntries, newDirectories, rootDirectory, [&](const ManifestChange& change) {
+        changes.push_back(change);
+        return true;
+    });
+}
+
+size_t diffManifestTrees(const std::vector<ManifestDiffEntry>& currEntries, const DirectoryDigestMap& currDirectories,
+    const std::vector<ManifestDiffEntry>& newEntries, const DirectoryDigestMap& newDirectories,
+    std::string_view rootDirectory, const ManifestChangeSink& onChange) {
+    TreeDiff diff(currEntries, currDirectories, newEntries, newDirectories, onChange);
+
+    // Every entry of a sorted list lies below the root when the first and last do;
+    // lists with entries outside it (never written by create) are merged as usual
+    auto belowRoot = [&](const std::vector<ManifestDiffEntry>& entries) {
+        return entries.empty() || (entries.front().path.substr(0, rootDirectory.size()) == rootDirectory &&
+            entries.back().path.substr(0, rootDirectory.size()) == rootDirectory);
+    };
+    if (belowRoot(currEntries) && belowRoot(newEntries)) {
+        diff.descend(rootDirectory, 0, currEntries.size(), 0, newEntries.size());
+        return diff.skippedEntries();
+    }
+
+    mergeSortedManifests(currEntries, newEntries, onChange);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "hash.h"
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One manifest entry as compared by validate; path points into the loaded manifest
+struct ManifestDiffEntry {
+    std::string_view path;
+    HashValue hash;
+};
+
+// Values match the exported ChecksumChangeType codes
+enum class ChangeKind {
+    Added = 1,
+    Deleted = 2,
+    Changed = 3,
+    Appended = 4    // Changed, but only by bytes added at the end
+};
+
+// "ADDED", "DELETED", "CHANGED" or "APPENDED", as reported in FileChangeInfo::changeType
+const char* changeKindName(ChangeKind kind);
+
+// One difference between two manifests; path points into the loaded manifests
+struct ManifestChange {
+    std::string_view path;
+    ChangeKind kind;
+};
+
+// Receives each change as the diff finds it; returning false stops the diff
+using ManifestChangeSink = std::function<bool(const ManifestChange& change)>;
+
+// True when paths are in strictly ascending byte-wise order (sorted, no duplicates)
+bool isSortedManifest(const std::vector<ManifestDiffEntry>& entries);
+
+// Single linear merge over two strictly sorted entry lists. Changes are
+// appended (or handed to onChange) in path order; false when onChange stopped it.
+void mergeSortedManifests(const std::vector<ManifestDiffEntry>& currEntries, const std::vector<ManifestDiffEntry>& newEntries,
+    std::vector<ManifestChange>& changes);
+bool mergeSortedManifests(const std::vector<ManifestDiffEntry>& currEntries, const std::vector<ManifestDiffEntry>& newEntries,
+    const ManifestChangeSink& onChange);
+
+// Fallback for unsorted (legacy) lists: a flat hash table over the current
+// entries, probed with the new ones. For duplicate paths the last entry wins.
+// Changes are appended in path order, as from the merge.
+void hashJoinManifests(const std::vector<ManifestDiffEntry>& currEntries, const std::vector<ManifestDiffEntry>& newEntries,
+    std::vector<ManifestChange>& changes);
+
+// Directory path (with trailing separator) -> Merkle digest
+using DirectoryDigestMap = std::unordered_map<std::string_view, HashValue>;
+
+// Diff two strictly sorted entry lists that share a root directory, descending
+// only into directories whose digests differ (or are missing on either side).
+// Matching subtrees are skipped with a binary search over the entry range.
+// Changes are appended (or handed to onChange) in path order; returns the
+// number of current entries skipped as part of matching subtrees.
+size_t diffManifestTrees(const std::vector<ManifestDiffEntry>& currEntries, const DirectoryDigestMap& currDirectories,
+    const std::vector<ManifestDiffEntry>& newEntries, const DirectoryDigestMap& newDirectories,
+    std::string_view rootDirectory, std::vector<ManifestChange>& changes);
+size_t diffManifestTrees(const std::vector<ManifestDiffEntry>& currEntries, const DirectoryDigestMap& currDirectories,
+    const std::vector<ManifestDiffEntry>& newEntries, const DirectoryDigestMap& newDirectories,
+    std::string_view rootDirectory, const ManifestChangeSink& onChange);
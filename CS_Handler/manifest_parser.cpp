@@ -0,0 +1,260 @@
+#include "pch.h"
+#include "manifest_parser.h"
+#include "binary_manifest.h"
+#include "metrics.h"
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+struct ChunkResult {
+    std::vector<ManifestDiffEntry> entries;
+    std::vector<uint64_t> sizes;            // Only with stat columns
+    std::vector<std::pair<std::string_view, HashValue>> directories;
+    std::vector<ManifestLineError> errors;  // Line numbers relative to the chunk
+    size_t lineCount = 0;
+
+    // Front-coded manifests: entry paths hold only the suffix until decoded
+    std::vector<size_t> sharedLengths;
+    std::vector<size_t> entryLines;
+};
+
+// Parse whole lines; text starts at a line start and ends after a newline or at end of file
+void parseChunk(std::string_view text, const ManifestHeader& header, ChunkResult& result) {
+    // Rough entry size, so most chunks never grow their vector
+    result.entries.reserve(text.size() / 48 + 1);
+
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        result.lineCount++;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        std::string_view text = line;
+        ManifestLineKind kind = classifyManifestLine(text, header);
+        if (kind == ManifestLineKind::Invalid) {
+            result.errors.push_back({ result.lineCount, false, line });
+            continue;
+        }
+        if (kind == ManifestLineKind::Directory) {
+            std::string_view directory;
+            HashValue digest;
+            if (parseManifestDirectory(line, directory, digest)) {
+                result.directories.emplace_back(directory, digest);
+            }
+            else {
+                result.errors.push_back({ result.lineCount, false, line });
+            }
+            continue;
+        }
+
+        ManifestFields fields;
+        if (!splitManifestEntry(text, header, fields)) {
+            result.errors.push_back({ result.lineCount, false, line });
+            continue;
+        }
+
+        HashValue hash;
+        if (!parseManifestHash(fields.hash, header, hash)) {
+            result.errors.push_back({ result.lineCount, true, fields.path });
+            continue;
+        }
+
+        if (header.frontCoded) {
+            size_t shared = 0;
+            if (!splitFrontCodedPath(fields.path, shared, fields.path)) {
+                result.errors.push_back({ result.lineCount, false, line });
+                continue;
+            }
+            result.sharedLengths.push_back(shared);
+            result.entryLines.push_back(result.lineCount);
+        }
+        result.entries.push_back({ fields.path, hash });
+        if (header.hasStat) {
+            FileStat stat;
+            result.sizes.push_back(parseManifestStat(fields.stat, stat) && stat.valid ? stat.size : unknownEntrySize);
+        }
+    }
+}
+
+} // namespace
+
+bool ParsedManifest::load(const std::filesystem::path& manifestPath, unsigned int threadCount, std::string& error) {
+    PhaseTimer parseTimer(MetricPhase::Parse);
+    manifestHeader = ManifestHeader{};
+    entryList.clear();
+    sizeList.clear();
+    lineErrors.clear();
+    directoryDigests.clear();
+    root = {};
+    hasRoot = false;
+    entriesSorted = false;
+    pathStorage.clear();
+    binary = isBinaryManifest(manifestPath);
+
+    if (binary) {
+        BinaryManifest manifest;
+        if (!manifest.open(manifestPath, error)) {
+            return false;
+        }
+        manifestHeader = manifest.header();
+
+        // One buffer for every joined path, sized up front so views stay valid
+        size_t totalLength = 0;
+        for (size_t i = 0; i < manifest.size(); i++) {
+            const BinaryManifestRecord& record = manifest.record(i);
+            totalLength += record.directoryLength + record.nameLength;
+        }
+        pathStorage.reserve(totalLength);
+        entryList.reserve(manifest.size());
+        for (size_t i = 0; i < manifest.size(); i++) {
+            const BinaryManifestRecord& record = manifest.record(i);
+            size_t start = pathStorage.size();
+            pathStorage += manifest.directory(record);
+            pathStorage += manifest.name(record);
+            entryList.push_back({ std::string_view(pathStorage).substr(start), manifest.hash(record) });
+            if (manifestHeader.hasStat) {
+                FileStat stat = manifest.stat(record);
+                sizeList.push_back(stat.valid ? stat.size : unknownEntrySize);
+            }
+        }
+        entriesSorted = isSortedManifest(entryList);
+        return true;
+    }
+
+    if (!file.open(manifestPath)) {
+        error = "unable to map file";
+        return false;
+    }
+    std::string_view text(reinterpret_cast<const char*>(file.data()), file.size());
+
+    // The first line may be a manifest header naming the algorithm
+    size_t firstLineNumber = 1;
+    size_t headerEnd = text.find('\n');
+    std::string headerError;
+    if (parseManifestHeader(text.substr(0, headerEnd), manifestHeader, headerError)) {
+        if (!headerError.empty()) {
+            error = "invalid header: " + headerError;
+            return false;
+        }
+        if (manifestHeader.version > manifestVersion) {
+            error = "manifest v" + std::to_string(manifestHeader.version) + ", this build reads up to v" +
+                std::to_string(manifestVersion);
+            return false;
+        }
+        text.remove_prefix(headerEnd == std::string_view::npos ? text.size() : headerEnd + 1);
+        firstLineNumber = 2;
+    }
+
+    // Newline-aligned chunks of at least manifestParseChunkSize bytes
+    if (threadCount == 0) {
+        threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+    }
+    size_t chunkCount = (std::min)(static_cast<size_t>(threadCount), text.size() / manifestParseChunkSize + 1);
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    for (size_t i = 1; i <= chunkCount; i++) {
+        size_t end = text.size();
+        if (i < chunkCount) {
+            size_t newline = text.find('\n', (std::max)(start, text.size() * i / chunkCount));
+            end = newline == std::string_view::npos ? text.size() : newline + 1;
+        }
+        if (end > start) {
+            chunks.push_back(text.substr(start, end - start));
+            start = end;
+        }
+    }
+
+    std::vector<ChunkResult> results(chunks.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunks.size(); i++) {
+        workers.emplace_back(parseChunk, chunks[i], std::cref(manifestHeader), std::ref(results[i]));
+    }
+    if (!chunks.empty()) {
+        parseChunk(chunks[0], manifestHeader, results[0]);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Concatenate in chunk order and make line numbers absolute
+    size_t entryCount = 0;
+    for (const auto& result : results) {
+        entryCount += result.entries.size();
+    }
+    entryList.reserve(entryCount);
+    sizeList.reserve(manifestHeader.hasStat ? entryCount : 0);
+    size_t lineBase = firstLineNumber - 1;
+    std::vector<size_t> sharedLengths;
+    std::vector<size_t> entryLines;
+    for (auto& result : results) {
+        entryList.insert(entryList.end(), result.entries.begin(), result.entries.end());
+        sizeList.insert(sizeList.end(), result.sizes.begin(), result.sizes.end());
+        sharedLengths.insert(sharedLengths.end(), result.sharedLengths.begin(), result.sharedLengths.end());
+        for (size_t line : result.entryLines) {
+            entryLines.push_back(line + lineBase);
+        }
+        for (auto lineError : result.errors) {
+            lineError.line += lineBase;
+            lineErrors.push_back(lineError);
+        }
+        for (const auto& [directory, digest] : result.directories) {
+            directoryDigests.insert_or_assign(directory, digest);
+            root = directory;
+            hasRoot = true;
+        }
+        lineBase += result.lineCount;
+    }
+
+    if (manifestHeader.frontCoded) {
+        decodeFrontCoding(sharedLengths, entryLines);
+    }
+    entriesSorted = isSortedManifest(entryList);
+    return true;
+}
+
+void ParsedManifest::decodeFrontCoding(const std::vector<size_t>& sharedLengths, const std::vector<size_t>& entryLines) {
+    // Every path depends on the one before it, so this pass is sequential.
+    // Sizes are checked first, so the buffer is allocated once and views stay valid.
+    std::vector<bool> valid(entryList.size());
+    size_t totalLength = 0;
+    size_t previousLength = 0;
+    for (size_t i = 0; i < entryList.size(); i++) {
+        valid[i] = sharedLengths[i] <= previousLength;
+        if (valid[i]) {
+            previousLength = sharedLengths[i] + entryList[i].path.size();
+            totalLength += previousLength;
+        }
+    }
+    pathStorage.reserve(totalLength);
+
+    size_t kept = 0;
+    std::string_view previousPath;
+    for (size_t i = 0; i < entryList.size(); i++) {
+        if (!valid[i]) {
+            lineErrors.push_back({ entryLines[i], false, entryList[i].path });
+            continue;
+        }
+        size_t start = pathStorage.size();
+        pathStorage += previousPath.substr(0, sharedLengths[i]);
+        pathStorage += entryList[i].path;
+        previousPath = std::string_view(pathStorage).substr(start);
+        if (!sizeList.empty()) {
+            sizeList[kept] = sizeList[i];
+        }
+        entryList[kept++] = { previousPath, entryList[i].hash };
+    }
+    entryList.resize(kept);
+    sizeList.resize(sizeList.empty() ? 0 : kept);
+
+    std::sort(lineErrors.begin(), lineErrors.end(), [](const ManifestLineError& a, const ManifestLineError& b) {
+        return a.line < b.line;
+    });
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "manifest.h"
+#include "manifest_diff.h"
+#include "mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Text lines smaller than this are not split across threads
+constexpr size_t manifestParseChunkSize = 1 << 20;
+
+// Entry size of a stat=1 manifest whose file could not be queried
+constexpr uint64_t unknownEntrySize = UINT64_MAX;
+
+// A line that could not be used. text is the whole line for malformed lines
+// and the path for lines whose digest does not parse.
+struct ManifestLineError {
+    size_t line;                // 1-based; the header is line 1
+    bool badHash;
+    std::string_view text;
+};
+
+// A text or binary manifest loaded for comparison.
+//
+// Text manifests are memory mapped and cut into newline-aligned chunks that are
+// parsed on separate threads with from_chars / hex decoding; entry paths are
+// views into the mapping and no line is copied. Binary manifests are mapped
+// and their records copied into the same flat entry list. Entries keep file
+// order, so they stay sorted when the file is.
+class ParsedManifest {
+public:
+    // threadCount 0 uses one thread per hardware thread. Returns false (with
+    // error set) if the file cannot be mapped or its header is invalid or too
+    // new; malformed entry lines are collected in errors() instead.
+    bool load(const std::filesystem::path& manifestPath, unsigned int threadCount, std::string& error);
+
+    const ManifestHeader& header() const { return manifestHeader; }
+    const std::vector<ManifestDiffEntry>& entries() const { return entryList; }
+    const std::vector<ManifestLineError>& errors() const { return lineErrors; }
+
+    // File sizes of a manifest with stat columns, parallel to entries(); empty
+    // for any other. Sizes of files that could not be queried are unknownEntrySize.
+    const std::vector<uint64_t>& entrySizes() const { return sizeList; }
+    bool hasRootDirectory() const { return hasRoot; }
+
+    // Checked once while loading, not taken from the header
+    bool isSorted() const { return entriesSorted; }
+
+    // Directory digests of a tree=1 manifest; the root is the last one in the file
+    // ("" for relative manifests)
+    const DirectoryDigestMap& directories() const { return directoryDigests; }
+    std::string_view rootDirectory() const { return root; }
+    bool isBinary() const { return binary; }
+
+private:
+    // Rebuild front-coded paths into pathStorage; entry paths hold suffixes until then
+    void decodeFrontCoding(const std::vector<size_t>& sharedLengths, const std::vector<size_t>& entryLines);
+
+    MappedFile file;
+    std::string pathStorage;    // Joined paths of a binary manifest, decoded paths of a front-coded one
+    ManifestHeader manifestHeader;
+    std::vector<ManifestDiffEntry> entryList;
+    std::vector<uint64_t> sizeList;
+    std::vector<ManifestLineError> lineErrors;
+    DirectoryDigestMap directoryDigests;
+    std::string_view root;
+    bool hasRoot = false;
+    bool entriesSorted = false;
+    bool binary = false;
+};
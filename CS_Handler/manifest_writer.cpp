@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "manifest_writer.h"
+#include "metrics.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+ManifestWriter::~ManifestWriter() {
+    abandon();
+}
+
+bool ManifestWriter::open(const std::filesystem::path& manifestPath, std::string& error) {
+    targetPath = manifestPath;
+    tempPath = manifestPath;
+    tempPath += ".tmp";
+
+#ifdef _WIN32
+    file = _wfopen(tempPath.c_str(), L"wb");
+#else
+    file = std::fopen(tempPath.c_str(), "wb");
+#endif
+    if (file == nullptr) {
+        error = "unable to create " + tempPath.string();
+        return false;
+    }
+
+    buffer.reserve(manifestWriteBufferSize);
+    metrics = currentMetrics();
+    writerThread = std::thread(&ManifestWriter::writeLoop, this);
+    return true;
+}
+
+void ManifestWriter::write(std::string_view text) {
+    buffer += text;
+    if (buffer.size() >= manifestWriteBufferSize) {
+        pending.push(std::move(buffer));
+        buffer = std::string();
+        buffer.reserve(manifestWriteBufferSize);
+    }
+}
+
+bool ManifestWriter::failed() const {
+    return writeFailed.load(std::memory_order_relaxed);
+}
+
+void ManifestWriter::writeLoop() {
+    MetricsScope scope(metrics);
+    std::string block;
+    while (pending.pop(block)) {
+        PhaseTimer writeTimer(MetricPhase::Write);
+        if (!writeFailed.load(std::memory_order_relaxed) && std::fwrite(block.data(), 1, block.size(), file) != block.size()) {
+            writeFailed.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool ManifestWriter::finishWriting() {
+    if (!writerThread.joinable()) {
+        return false;
+    }
+    if (!buffer.empty()) {
+        pending.push(std::move(buffer));
+        buffer = std::string();
+    }
+    pending.close();
+    writerThread.join();
+    return !writeFailed.load(std::memory_order_relaxed);
+}
+
+bool ManifestWriter::commit(std::string& error) {
+    bool written = finishWriting();
+    PhaseTimer syncTimer(MetricPhase::Write);
+    written = written && std::fflush(file) == 0;
+
+    // The data has to be durable before the rename makes it visible
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    written = std::fclose(file) == 0 && written;
+    file = nullptr;
+    syncTimer.stop();
+
+    if (!written) {
+        error = "write failed for " + tempPath.string();
+        std::error_code ec;
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, targetPath, ec);
+    if (ec) {
+        error = "unable to replace " + targetPath.string() + ": " + ec.message();
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+void ManifestWriter::abandon() {
+    if (file == nullptr) {
+        return;
+    }
+    finishWriting();
+    std::fclose(file);
+    file = nullptr;
+    std::error_code ec;
+    std::filesystem::remove(tempPath, ec);
+}
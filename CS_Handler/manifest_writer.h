@@ -0,0 +1,59 @@
+#pragma once
+
+#include "pipeline.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+
+class RunMetrics;
+
+// Bytes collected before a buffer is handed to the writing thread
+constexpr size_t manifestWriteBufferSize = 1 << 20;
+
+// Writes a manifest through a temporary file that replaces the target only
+// when every byte has reached the disk, so readers never see a partial file.
+//
+// Text is appended to an in-memory buffer; full buffers go to a background
+// thread that writes them, so formatting and disk writes overlap. Not
+// thread-safe: a single producer appends.
+class ManifestWriter {
+public:
+    ManifestWriter() = default;
+    ~ManifestWriter();
+
+    ManifestWriter(const ManifestWriter&) = delete;
+    ManifestWriter& operator=(const ManifestWriter&) = delete;
+
+    // Create "<manifest>.tmp" next to manifestPath and start the writing thread
+    bool open(const std::filesystem::path& manifestPath, std::string& error);
+
+    void write(std::string_view text);
+
+    // True once a background write has failed; later text is discarded
+    bool failed() const;
+
+    // Flush, sync and rename the temporary file over the manifest
+    bool commit(std::string& error);
+
+    // Stop and delete the temporary file
+    void abandon();
+
+    const std::filesystem::path& temporaryPath() const { return tempPath; }
+
+private:
+    void writeLoop();
+    bool finishWriting();
+
+    std::filesystem::path targetPath;
+    std::filesystem::path tempPath;
+    std::FILE* file = nullptr;
+    std::string buffer;
+    BoundedQueue<std::string> pending{ 4 };
+    std::thread writerThread;
+    std::atomic<bool> writeFailed{ false };
+    RunMetrics* metrics = nullptr;      // Of the thread that opened the writer
+};
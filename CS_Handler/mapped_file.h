@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read-only mapping of a whole file. An empty file maps successfully with
+// data() == nullptr and size() == 0.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::filesystem::path& filePath);
+    void close();
+
+    const uint8_t* data() const { return view; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* view = nullptr;
+    size_t length = 0;
+};
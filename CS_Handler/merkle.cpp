@@ -0,0 +1,102 @@
+#include "pch.h"
+#include "merkle.h"
+#include <filesystem>
+
+namespace {
+
+bool isSeparator(char c) {
+    return c == '/' || c == '\\';
+}
+
+HashValue finishDigest(const Blake3Hasher& hasher) {
+    HashValue digest;
+    digest.size = blake3OutLength;
+    hasher.finalize(digest.bytes.data());
+    return digest;
+}
+
+} // namespace
+
+std::string directoryPrefix(const std::string& path) {
+    std::string prefix = path;
+    if (prefix.empty() || !isSeparator(prefix.back())) {
+        prefix += static_cast<char>(std::filesystem::path::preferred_separator);
+    }
+    return prefix;
+}
+
+DirectoryDigestBuilder::DirectoryDigestBuilder(std::string rootDirectory, DirectoryDigestVisitor onDirectory)
+    : onDirectory(std::move(onDirectory)) {
+    openDirectories.push_back({ std::move(rootDirectory), Blake3Hasher() });
+}
+
+void DirectoryDigestBuilder::addFile(std::string_view path, const HashValue& hash) {
+    addEntry('f', path, hash);
+}
+
+void DirectoryDigestBuilder::addDirectory(std::string_view path, const HashValue& digest) {
+    if (!path.empty() && isSeparator(path.back())) {
+        path.remove_suffix(1);
+    }
+    addEntry('d', path, digest);
+}
+
+void DirectoryDigestBuilder::addEntry(char kind, std::string_view path, const HashValue& hash) {
+    const std::string& root = openDirectories.front().path;
+    if (path.size() <= root.size() || path.substr(0, root.size()) != root) {
+        return;
+    }
+    std::string_view parent = path.substr(0, path.find_last_of("/\\") + 1);
+
+    // Entries arrive sorted, so a directory is complete once a path leaves it
+    while (openDirectories.size() > 1 && parent.substr(0, openDirectories.back().path.size()) != openDirectories.back().path) {
+        closeDirectory();
+    }
+
+    // Open the directories between the innermost open one and the parent
+    size_t position = openDirectories.back().path.size();
+    while (position < parent.size()) {
+        size_t separator = parent.find_first_of("/\\", position);
+        openDirectories.push_back({ std::string(parent.substr(0, separator + 1)), Blake3Hasher() });
+        position = separator + 1;
+    }
+
+    addChild(kind, path.substr(parent.size()), hash);
+}
+
+HashValue DirectoryDigestBuilder::finish() {
+    while (openDirectories.size() > 1) {
+        closeDirectory();
+    }
+    HashValue rootDigest = finishDigest(openDirectories.front().hasher);
+    onDirectory(openDirectories.front().path, rootDigest);
+    return rootDigest;
+}
+
+void DirectoryDigestBuilder::addChild(char kind, std::string_view name, const HashValue& digest) {
+    uint8_t encoded[5] = {
+        static_cast<uint8_t>(kind),
+        static_cast<uint8_t>(name.size()),
+        static_cast<uint8_t>(name.size() >> 8),
+        static_cast<uint8_t>(name.size() >> 16),
+        static_cast<uint8_t>(name.size() >> 24),
+    };
+    Blake3Hasher& hasher = openDirectories.back().hasher;
+    hasher.update(encoded, sizeof(encoded));
+    hasher.update(name.data(), name.size());
+    hasher.update(&digest.size, 1);
+    hasher.update(digest.bytes.data(), digest.size);
+}
+
+void DirectoryDigestBuilder::closeDirectory() {
+    OpenDirectory directory = std::move(openDirectories.back());
+    openDirectories.pop_back();
+
+    HashValue digest = finishDigest(directory.hasher);
+    onDirectory(directory.path, digest);
+
+    // Name within the parent, without the trailing separator
+    std::string_view name(directory.path);
+    name = name.substr(openDirectories.back().path.size(), name.size() - openDirectories.back().path.size() - 1);
+    addChild('d', name, digest);
+}
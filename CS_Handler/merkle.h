@@ -0,0 +1,52 @@
+#pragma once
+
+#include "hash.h"
+#include "blake3.h"
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Merkle digests of directories.
+//
+// A directory's digest is the BLAKE3 hash of its children in path order, each
+// encoded as kind ('f' or 'd'), name length (u32 little-endian), name, digest
+// length (u8) and digest. Names exclude the parent path and a subdirectory's
+// trailing separator; file digests are the manifest's own. Two directories
+// with equal digests therefore hold the same files with the same contents.
+using DirectoryDigestVisitor = std::function<void(std::string_view directory, const HashValue& digest)>;
+
+// Directory path with exactly one trailing separator, as directory digest lines store it
+std::string directoryPrefix(const std::string& path);
+
+// Computes directory digests from file entries in sorted path order, with one
+// open directory per level. onDirectory receives each directory (path with a
+// trailing separator) as soon as its last entry has been added; the root
+// comes last.
+class DirectoryDigestBuilder {
+public:
+    DirectoryDigestBuilder(std::string rootDirectory, DirectoryDigestVisitor onDirectory);
+
+    // Entries outside the root are ignored
+    void addFile(std::string_view path, const HashValue& hash);
+
+    // A subdirectory whose digest is already known (path with a trailing
+    // separator), ordered among the files as its contents would be
+    void addDirectory(std::string_view path, const HashValue& digest);
+
+    // Close every open directory and return the root digest
+    HashValue finish();
+
+private:
+    struct OpenDirectory {
+        std::string path;
+        Blake3Hasher hasher;
+    };
+
+    void addEntry(char kind, std::string_view path, const HashValue& digest);
+    void addChild(char kind, std::string_view name, const HashValue& digest);
+    void closeDirectory();
+
+    std::vector<OpenDirectory> openDirectories;
+    DirectoryDigestVisitor onDirectory;
+};
@@ -0,0 +1,53 @@
+#include "pch.h"
+#include "metrics.h"
+#include "checksum.h"
+
+namespace {
+
+thread_local RunMetrics* activeMetrics = nullptr;
+
+double toSeconds(uint64_t ns) {
+    return static_cast<double>(ns) / 1e9;
+}
+
+} // namespace
+
+void RunMetrics::addWorkerBusy(uint64_t ns) {
+    std::lock_guard<std::mutex> lock(workerMutex);
+    workerBusyNs.push_back(ns);
+}
+
+void RunMetrics::collect(RunStats& stats) const {
+    stats.wallSeconds = toSeconds(metricClockNs() - startNs);
+    stats.bytesRead = bytesRead.load(std::memory_order_relaxed);
+
+    auto phaseSeconds = [this](MetricPhase phase) {
+        return toSeconds(phaseNs[static_cast<size_t>(phase)].load(std::memory_order_relaxed));
+    };
+    stats.walkSeconds = phaseSeconds(MetricPhase::Walk);
+    stats.openSeconds = phaseSeconds(MetricPhase::Open);
+    stats.readSeconds = phaseSeconds(MetricPhase::Read);
+    stats.hashSeconds = phaseSeconds(MetricPhase::Hash);
+    stats.writeSeconds = phaseSeconds(MetricPhase::Write);
+    stats.parseSeconds = phaseSeconds(MetricPhase::Parse);
+    stats.diffSeconds = phaseSeconds(MetricPhase::Diff);
+
+    std::lock_guard<std::mutex> lock(workerMutex);
+    stats.threadBusySeconds.clear();
+    for (uint64_t ns : workerBusyNs) {
+        stats.threadBusySeconds.push_back(toSeconds(ns));
+    }
+}
+
+RunMetrics* currentMetrics() {
+    return activeMetrics;
+}
+
+MetricsScope::MetricsScope(RunMetrics* metrics)
+    : previous(activeMetrics) {
+    activeMetrics = metrics;
+}
+
+MetricsScope::~MetricsScope() {
+    activeMetrics = previous;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct RunStats;
+
+// Phases timed during a run
+enum class MetricPhase {
+    Walk,       // Listing directories and reading file stats
+    Open,       // Opening files for hashing
+    Read,       // Reading (or, when mapped, mapping) file contents
+    Hash,       // Feeding contents to the hasher; page faults of mapped files land here
+    Write,      // Writing and syncing the manifest
+    Parse,      // Loading manifests
+    Diff        // Comparing loaded manifests
+};
+
+constexpr size_t metricPhaseCount = 7;
+
+// Monotonic clock reading for phase timing
+inline uint64_t metricClockNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Timings of one create or compare, added to from every thread of the run.
+// Phase times are summed over threads, so with several hashing threads the
+// hash and read times can exceed the wall time.
+class RunMetrics {
+public:
+    RunMetrics() : startNs(metricClockNs()) {}
+
+    RunMetrics(const RunMetrics&) = delete;
+    RunMetrics& operator=(const RunMetrics&) = delete;
+
+    void addTime(MetricPhase phase, uint64_t ns) {
+        phaseNs[static_cast<size_t>(phase)].fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    void addBytesRead(uint64_t bytes) {
+        bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // Called once by each pool worker as it exits
+    void addWorkerBusy(uint64_t ns);
+
+    // Fill the timing fields of stats: wall time since construction, phase
+    // seconds, bytes read and per-worker busy time. Counters are left alone.
+    void collect(RunStats& stats) const;
+
+private:
+    const uint64_t startNs;
+    std::array<std::atomic<uint64_t>, metricPhaseCount> phaseNs{};
+    std::atomic<uint64_t> bytesRead{ 0 };
+    mutable std::mutex workerMutex;
+    std::vector<uint64_t> workerBusyNs;
+};
+
+// Metrics the calling thread records into; nullptr when none are collected,
+// which makes every timer below a no-op
+RunMetrics* currentMetrics();
+
+// Bind metrics to the calling thread for the scope's lifetime. Threads started
+// for a run (pool workers, the manifest writer) inherit their creator's.
+class MetricsScope {
+public:
+    explicit MetricsScope(RunMetrics* metrics);
+    ~MetricsScope();
+
+    MetricsScope(const MetricsScope&) = delete;
+    MetricsScope& operator=(const MetricsScope&) = delete;
+
+private:
+    RunMetrics* previous;
+};
+
+// Charge the time until stop() or destruction to a phase of the current metrics
+class PhaseTimer {
+public:
+    explicit PhaseTimer(MetricPhase phase)
+        : metrics(currentMetrics()), phase(phase), startNs(metrics != nullptr ? metricClockNs() : 0) {
+    }
+
+    ~PhaseTimer() { stop(); }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    void stop() {
+        if (metrics != nullptr) {
+            metrics->addTime(phase, metricClockNs() - startNs);
+            metrics = nullptr;
+        }
+    }
+
+private:
+    RunMetrics* metrics;
+    MetricPhase phase;
+    uint64_t startNs;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <utility>
+
+// Blocking multi-producer / multi-consumer queue with a fixed capacity
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity(capacity == 0 ? 1 : capacity) {
+    }
+
+    // Blocks while the queue is full. Returns false once the queue is closed.
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty. Returns false when closed and drained.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    // No more pushes; consumers drain what is left
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+// Collects results that finish out of order and hands them to a single
+// consumer in sequence order. The producer of sequence numbers is held back
+// so that at most `window` items are in flight between it and the consumer.
+template <typename T>
+class ReorderBuffer {
+public:
+    explicit ReorderBuffer(size_t window)
+        : window(window == 0 ? 1 : window) {
+    }
+
+    // Producer side: wait until sequence may be issued
+    void acquire(uint64_t sequence) {
+        std::unique_lock<std::mutex> lock(mutex);
+        slotFree.wait(lock, [&] { return cancelled || sequence < nextSequence + window; });
+    }
+
+    // Worker side: publish the result for a sequence number
+    void put(uint64_t sequence, T value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.emplace(sequence, std::move(value));
+        if (sequence == nextSequence) {
+            ready.notify_one();
+        }
+    }
+
+    // Producer side: no sequence numbers at or beyond total will be issued
+    void finish(uint64_t total) {
+        std::lock_guard<std::mutex> lock(mutex);
+        totalSequences = total;
+        finished = true;
+        ready.notify_one();
+    }
+
+    // Consumer side: wait for the next result in order. Returns false after
+    // every issued sequence has been consumed.
+    bool next(T& value) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] {
+            return (!pending.empty() && pending.begin()->first == nextSequence) ||
+                (finished && nextSequence >= totalSequences);
+        });
+        if (pending.empty() || pending.begin()->first != nextSequence) {
+            return false;
+        }
+        value = std::move(pending.begin()->second);
+        pending.erase(pending.begin());
+        nextSequence++;
+        slotFree.notify_all();
+        return true;
+    }
+
+    // Release a producer blocked in acquire (used on error paths)
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+        slotFree.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable slotFree;
+    std::map<uint64_t, T> pending;
+    uint64_t nextSequence = 0;
+    uint64_t totalSequences = 0;
+    size_t window;
+    bool finished = false;
+    bool cancelled = false;
+};
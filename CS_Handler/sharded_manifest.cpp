@@ -0,0 +1,200 @@
+#include "pch.h"
+#include "sharded_manifest.h"
+#include "blake3.h"
+#include "manifest.h"
+#include "manifest_writer.h"
+#include "merkle.h"
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+
+namespace {
+
+constexpr std::string_view kIndexPrefix = "# checksum_handler index v";
+
+std::string_view trimLineEnd(std::string_view text) {
+    while (!text.empty() && (text.back() == '\r' || text.back() == ' ')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Next space separated field of line, removed from it
+std::string_view takeField(std::string_view& line) {
+    size_t space = line.find(' ');
+    std::string_view field = line.substr(0, space);
+    line.remove_prefix(space == std::string_view::npos ? line.size() : space + 1);
+    return field;
+}
+
+bool parseIndexHeader(std::string_view line, ShardIndex& index, std::string& error) {
+    line = trimLineEnd(line);
+    if (line.substr(0, kIndexPrefix.size()) != kIndexPrefix) {
+        error = "not a checksum index";
+        return false;
+    }
+    line.remove_prefix(kIndexPrefix.size());
+
+    std::string_view versionText = takeField(line);
+    int version = 0;
+    auto [ptr, ec] = std::from_chars(versionText.data(), versionText.data() + versionText.size(), version);
+    if (ec != std::errc() || ptr != versionText.data() + versionText.size() || version > shardIndexVersion) {
+        error = "unsupported checksum index version '" + std::string(versionText) + "'";
+        return false;
+    }
+
+    while (!line.empty()) {
+        std::string_view field = takeField(line);
+        size_t equals = field.find('=');
+        if (equals != std::string_view::npos && field.substr(0, equals) == "algorithm" &&
+            !parseHashAlgorithm(field.substr(equals + 1), index.algorithm)) {
+            error = "unknown hash algorithm '" + std::string(field.substr(equals + 1)) + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseShardLine(std::string_view line, ShardInfo& shard) {
+    line = trimLineEnd(line);
+    std::string_view digestText = takeField(line);
+    std::string_view countText = takeField(line);
+    std::string_view fileText = takeField(line);
+    if (!hashFromHex(digestText, blake3OutLength, shard.digest) || fileText.empty() || line.empty()) {
+        return false;
+    }
+    auto [ptr, ec] = std::from_chars(countText.data(), countText.data() + countText.size(), shard.entryCount);
+    if (ec != std::errc() || ptr != countText.data() + countText.size()) {
+        return false;
+    }
+    shard.fileName.assign(fileText);
+    shard.subtree.assign(line);
+    return true;
+}
+
+} // namespace
+
+std::string shardFileName(std::string_view subtree) {
+    std::unique_ptr<Hasher> hasher = createHasher(HashAlgorithm::Xxh3_64);
+    hasher->update(subtree.data(), subtree.size());
+    return hashToHex(hasher->finalize()) + ".txt";
+}
+
+std::string shardPathPrefix(std::string_view subtree) {
+    if (subtree == rootShardName) {
+        return std::string();
+    }
+    return std::string(subtree) + static_cast<char>(std::filesystem::path::preferred_separator);
+}
+
+bool isShardIndex(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::string prefix(kIndexPrefix.size(), '\0');
+    return file.read(prefix.data(), static_cast<std::streamsize>(prefix.size())) && prefix == kIndexPrefix;
+}
+
+bool readShardIndex(const std::filesystem::path& indexPath, ShardIndex& index, std::string& error) {
+    std::ifstream file(indexPath);
+    if (!file.is_open()) {
+        error = "unable to open " + indexPath.string();
+        return false;
+    }
+
+    index = ShardIndex{};
+    std::string line;
+    if (!std::getline(file, line) || !parseIndexHeader(line, index, error)) {
+        if (error.empty()) {
+            error = "empty checksum index";
+        }
+        return false;
+    }
+
+    bool hasRoot = false;
+    size_t lineNumber = 1;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        if (trimLineEnd(line).empty()) {
+            continue;
+        }
+        if (isManifestDirectoryLine(line)) {
+            std::string_view directory;
+            hasRoot = parseManifestDirectory(line, directory, index.rootDigest);
+            if (!hasRoot) {
+                error = "invalid root digest line " + std::to_string(lineNumber);
+                return false;
+            }
+            continue;
+        }
+
+        ShardInfo shard;
+        if (!parseShardLine(line, shard)) {
+            error = "invalid shard line " + std::to_string(lineNumber);
+            return false;
+        }
+        index.shards.push_back(std::move(shard));
+    }
+    if (!hasRoot) {
+        error = "checksum index has no root digest";
+        return false;
+    }
+    return true;
+}
+
+bool writeShardIndex(const std::filesystem::path& indexPath, ShardIndex& index, std::string& error) {
+    std::sort(index.shards.begin(), index.shards.end(),
+        [](const ShardInfo& a, const ShardInfo& b) { return a.subtree < b.subtree; });
+
+    ManifestWriter indexFile;
+    if (!indexFile.open(indexPath, error)) {
+        return false;
+    }
+    indexFile.write(std::string(kIndexPrefix) + std::to_string(shardIndexVersion) + " algorithm=" +
+        hashAlgorithmName(index.algorithm) + " shards=" + std::to_string(index.shards.size()) + "\n");
+    for (const ShardInfo& shard : index.shards) {
+        indexFile.write(hashToHex(shard.digest) + " " + std::to_string(shard.entryCount) + " " + shard.fileName + " " +
+            shard.subtree + "\n");
+    }
+    indexFile.write(formatManifestDirectory("", index.rootDigest) + "\n");
+    return indexFile.commit(error);
+}
+
+bool computeShardedRootDigest(const std::filesystem::path& shardDirectory, ShardIndex& index, std::string& error) {
+    // Children of the root in the order a full walk would reach them: files by
+    // name, directories by name plus separator
+    struct RootChild {
+        std::string key;
+        HashValue digest;
+        bool directory;
+    };
+    std::vector<RootChild> children;
+
+    for (const ShardInfo& shard : index.shards) {
+        if (shard.subtree != rootShardName) {
+            children.push_back({ shardPathPrefix(shard.subtree), shard.digest, true });
+            continue;
+        }
+
+        ManifestHeader header;
+        bool read = readManifestEntries(shardDirectory / shard.fileName, header,
+            [&](std::string_view path, const HashValue& hash, const FileStat&, const AppendCheck&) {
+                children.push_back({ std::string(path), hash, false });
+            });
+        if (!read) {
+            error = "unable to read shard " + (shardDirectory / shard.fileName).string();
+            return false;
+        }
+    }
+    std::sort(children.begin(), children.end(), [](const RootChild& a, const RootChild& b) { return a.key < b.key; });
+
+    DirectoryDigestBuilder builder("", [](std::string_view, const HashValue&) {});
+    for (const RootChild& child : children) {
+        if (child.directory) {
+            builder.addDirectory(child.key, child.digest);
+        }
+        else {
+            builder.addFile(child.key, child.digest);
+        }
+    }
+    index.rootDigest = builder.finish();
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "hash.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Sharded checksum files.
+//
+// A sharded create writes one manifest per top-level directory of the tree,
+// plus one for the files directly in it, into checksum.shards/, and an index,
+// checksum.idx, that lists them:
+//   # checksum_handler index v1 algorithm=xxh3-64 shards=3
+//   <hex digest> <entry count> <shard file> <subtree>
+//   #d <hex root digest>
+// Each shard is an ordinary relative manifest of its subtree and its digest is
+// that manifest's root digest; the files at the top of the tree form the shard
+// named ".". Shard lines are sorted by subtree. The last line is the Merkle
+// digest of the whole tree, equal to the root digest an unsharded manifest of
+// the same files records.
+constexpr std::string_view shardIndexFileName = "checksum.idx";
+constexpr std::string_view shardDirectoryName = "checksum.shards";
+constexpr std::string_view rootShardName = ".";
+constexpr int shardIndexVersion = 1;
+
+struct ShardInfo {
+    std::string subtree;        // Top-level directory name, or rootShardName
+    std::string fileName;       // Manifest within shardDirectoryName
+    uint64_t entryCount = 0;
+    HashValue digest;           // Root digest of the shard's manifest
+};
+
+struct ShardIndex {
+    HashAlgorithm algorithm = HashAlgorithm::Crc32;
+    std::vector<ShardInfo> shards;
+    HashValue rootDigest;
+};
+
+// Stable file name of a subtree's shard, so shards keep their names as others come and go
+std::string shardFileName(std::string_view subtree);
+
+// Path prefix of the subtree's entries within the whole tree ("" for the root shard)
+std::string shardPathPrefix(std::string_view subtree);
+
+// True when the file starts with an index header
+bool isShardIndex(const std::filesystem::path& path);
+
+bool readShardIndex(const std::filesystem::path& indexPath, ShardIndex& index, std::string& error);
+
+// Sorts the shards by subtree and writes the index through a temporary file
+bool writeShardIndex(const std::filesystem::path& indexPath, ShardIndex& index, std::string& error);
+
+// Set index.rootDigest from the shard digests and the entries of the root shard
+bool computeShardedRootDigest(const std::filesystem::path& shardDirectory, ShardIndex& index, std::string& error);
@@ -0,0 +1,521 @@
+#include "pch.h"
+#include "snapshot_store.h"
+#include "blake3.h"
+#include "manifest.h"
+#include "manifest_writer.h"
+#include "metrics.h"
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+#include <fstream>
+
+namespace {
+
+constexpr std::string_view kSnapshotPrefix = "# checksum_handler snapshot v";
+constexpr std::string_view kSnapshotExtension = ".snap";
+
+std::string_view trimLineEnd(std::string_view text) {
+    while (!text.empty() && (text.back() == '\r' || text.back() == '\n')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+template <typename Number>
+bool parseNumber(std::string_view text, Number& value) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && ptr == text.data() + text.size() && !text.empty();
+}
+
+// Next space separated field of line, removed from it
+std::string_view takeField(std::string_view& line) {
+    size_t space = line.find(' ');
+    std::string_view field = line.substr(0, space);
+    line.remove_prefix(space == std::string_view::npos ? line.size() : space + 1);
+    return field;
+}
+
+std::string utcTimestamp() {
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    return text;
+}
+
+// A chunk ends after an entry whose path hashes to the boundary value
+bool isChunkBoundary(std::string_view path) {
+    std::unique_ptr<Hasher> hasher = createHasher(HashAlgorithm::Xxh3_64);
+    hasher->update(path.data(), path.size());
+    return (hashToUint(hasher->finalize()) & snapshotChunkBoundaryMask) == snapshotChunkBoundaryMask;
+}
+
+bool parseSnapshotHeader(std::string_view line, Snapshot& snapshot, std::string& error) {
+    line = trimLineEnd(line);
+    if (line.substr(0, kSnapshotPrefix.size()) != kSnapshotPrefix) {
+        error = "not a snapshot";
+        return false;
+    }
+    line.remove_prefix(kSnapshotPrefix.size());
+
+    int version = 0;
+    std::string_view versionText = takeField(line);
+    if (!parseNumber(versionText, version) || version > snapshotVersion) {
+        error = "unsupported snapshot version '" + std::string(versionText) + "'";
+        return false;
+    }
+
+    while (!line.empty()) {
+        // The label is last and runs to the end of the line
+        if (line.substr(0, 6) == "label=") {
+            snapshot.label.assign(line.substr(6));
+            break;
+        }
+        std::string_view field = takeField(line);
+        size_t equals = field.find('=');
+        std::string_view key = field.substr(0, equals);
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : field.substr(equals + 1);
+        bool valid = true;
+        if (key == "id") {
+            valid = parseNumber(value, snapshot.id);
+        }
+        else if (key == "algorithm") {
+            valid = parseHashAlgorithm(value, snapshot.algorithm);
+        }
+        else if (key == "entries") {
+            valid = parseNumber(value, snapshot.entryCount);
+        }
+        else if (key == "created") {
+            snapshot.created.assign(value);
+        }
+        if (!valid) {
+            error = "invalid snapshot header field '" + std::string(field) + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseChunkLine(std::string_view line, SnapshotChunk& chunk) {
+    line = trimLineEnd(line);
+    std::string_view idText = takeField(line);
+    std::string_view countText = takeField(line);
+    if (idText.size() != 2 * blake3OutLength || !parseNumber(countText, chunk.entryCount) || chunk.entryCount == 0) {
+        return false;
+    }
+    chunk.id.assign(idText);
+    chunk.firstPath.assign(line);
+    return true;
+}
+
+// Chunk holding path within a snapshot's chunk list, or none when the path
+// sorts before the first chunk
+const SnapshotChunk* chunkHolding(const Snapshot& snapshot, std::string_view path) {
+    auto it = std::upper_bound(snapshot.chunks.begin(), snapshot.chunks.end(), path,
+        [](std::string_view value, const SnapshotChunk& chunk) { return value < chunk.firstPath; });
+    return it == snapshot.chunks.begin() ? nullptr : &*(it - 1);
+}
+
+// Walks a snapshot's entries in order, reading a chunk only when an entry of
+// it is needed
+class ChunkCursor {
+public:
+    explicit ChunkCursor(const Snapshot& snapshot)
+        : snapshot(snapshot) {
+    }
+
+    bool atEnd() const { return chunk == snapshot.chunks.size(); }
+    bool atChunkStart() const { return position == 0; }
+    const SnapshotChunk& currentChunk() const { return snapshot.chunks[chunk]; }
+    const SnapshotEntry& current() const { return entries[position]; }
+    bool isLoaded() const { return loaded; }
+
+    void load(std::vector<SnapshotEntry>&& chunkEntries) {
+        entries = std::move(chunkEntries);
+        loaded = true;
+    }
+
+    void skipChunk() {
+        chunk++;
+        position = 0;
+        loaded = false;
+    }
+
+    void advance() {
+        if (++position == entries.size()) {
+            skipChunk();
+        }
+    }
+
+private:
+    const Snapshot& snapshot;
+    size_t chunk = 0;
+    size_t position = 0;
+    std::vector<SnapshotEntry> entries;
+    bool loaded = false;
+};
+
+} // namespace
+
+SnapshotStore::SnapshotStore(const std::filesystem::path& directory)
+    : root(directory) {
+}
+
+std::filesystem::path SnapshotStore::chunkPath(const std::string& id) const {
+    return root / "chunks" / id.substr(0, 2) / id.substr(2);
+}
+
+std::filesystem::path SnapshotStore::snapshotPath(unsigned int id) const {
+    std::string name = std::to_string(id);
+    name.insert(0, name.size() < 6 ? 6 - name.size() : 0, '0');
+    return root / "snapshots" / (name + std::string(kSnapshotExtension));
+}
+
+bool SnapshotStore::writeChunk(const std::string& contents, std::string& id, std::string& error) {
+    std::unique_ptr<Hasher> hasher = createHasher(HashAlgorithm::Blake3);
+    hasher->update(contents.data(), contents.size());
+    id = hashToHex(hasher->finalize());
+
+    // Content addressed: a chunk that exists already holds these bytes
+    std::filesystem::path path = chunkPath(id);
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec)) {
+        return true;
+    }
+
+    PhaseTimer writeTimer(MetricPhase::Write);
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(contents.data(), static_cast<std::streamsize>(contents.size())) || !file.flush()) {
+            error = "unable to write " + tempPath.string();
+            file.close();
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        error = "unable to write " + path.string() + ": " + ec.message();
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    writtenChunks++;
+    writtenBytes += contents.size();
+    return true;
+}
+
+bool SnapshotStore::readChunk(const std::string& id, HashAlgorithm algorithm, std::vector<SnapshotEntry>& entries, std::string& error) {
+    PhaseTimer parseTimer(MetricPhase::Parse);
+    std::ifstream file(chunkPath(id), std::ios::binary);
+    if (!file.is_open()) {
+        error = "missing chunk " + id;
+        return false;
+    }
+
+    entries.clear();
+    std::string line;
+    std::string previousPath;
+    size_t digestSize = hashSize(algorithm);
+    while (std::getline(file, line)) {
+        std::string_view rest = trimLineEnd(line);
+        std::string_view digestText = takeField(rest);
+        size_t shared = 0;
+        std::string_view suffix;
+        SnapshotEntry entry;
+        if (!hashFromHex(digestText, digestSize, entry.hash) || !splitFrontCodedPath(rest, shared, suffix) ||
+            shared > previousPath.size()) {
+            error = "corrupt chunk " + id;
+            return false;
+        }
+        entry.path.assign(previousPath, 0, shared);
+        entry.path += suffix;
+        previousPath = entry.path;
+        entries.push_back(std::move(entry));
+    }
+    if (entries.empty()) {
+        error = "empty chunk " + id;
+        return false;
+    }
+    readChunks++;
+    readEntries += entries.size();
+    return true;
+}
+
+bool SnapshotStore::readSnapshot(const std::filesystem::path& path, bool withChunks, Snapshot& snapshot, std::string& error) const {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        error = "unable to open " + path.string();
+        return false;
+    }
+
+    snapshot = Snapshot{};
+    std::string line;
+    if (!std::getline(file, line) || !parseSnapshotHeader(line, snapshot, error)) {
+        error = path.filename().string() + ": " + (error.empty() ? "empty snapshot" : error);
+        return false;
+    }
+    if (!withChunks) {
+        return true;
+    }
+
+    size_t lineNumber = 1;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        SnapshotChunk chunk;
+        if (!parseChunkLine(line, chunk)) {
+            error = path.filename().string() + ": invalid chunk line " + std::to_string(lineNumber);
+            return false;
+        }
+        snapshot.chunks.push_back(std::move(chunk));
+    }
+    return true;
+}
+
+bool SnapshotStore::add(std::vector<SnapshotEntry>& entries, HashAlgorithm algorithm, const std::string& label,
+    Snapshot& snapshot, std::string& error) {
+    if (label.find_first_of("\r\n") != std::string::npos) {
+        error = "a snapshot label must be a single line";
+        return false;
+    }
+    std::vector<Snapshot> existing;
+    if (!list(existing, error)) {
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(root / "snapshots", ec);
+    if (ec) {
+        error = "unable to create " + (root / "snapshots").string() + ": " + ec.message();
+        return false;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const SnapshotEntry& a, const SnapshotEntry& b) { return a.path < b.path; });
+    snapshot = Snapshot{};
+    snapshot.id = existing.empty() ? 1 : existing.back().id + 1;
+    snapshot.algorithm = algorithm;
+    snapshot.entryCount = entries.size();
+    snapshot.created = utcTimestamp();
+    snapshot.label = label;
+    writtenChunks = 0;
+    writtenBytes = 0;
+
+    // Each chunk is front-coded from an empty path so it reads on its own
+    std::string contents;
+    std::string previousPath;
+    SnapshotChunk chunk;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const SnapshotEntry& entry = entries[i];
+        if (chunk.entryCount == 0) {
+            chunk.firstPath = entry.path;
+            previousPath.clear();
+        }
+        contents += hashToHex(entry.hash);
+        contents += ' ';
+        contents += formatFrontCodedPath(entry.path, previousPath);
+        contents += '\n';
+        previousPath = entry.path;
+        chunk.entryCount++;
+
+        if (i + 1 == entries.size() || chunk.entryCount == snapshotChunkMaxEntries || isChunkBoundary(entry.path)) {
+            if (!writeChunk(contents, chunk.id, error)) {
+                return false;
+            }
+            snapshot.chunks.push_back(std::move(chunk));
+            chunk = SnapshotChunk{};
+            contents.clear();
+        }
+    }
+
+    // The snapshot appears only once every chunk it names is on disk
+    ManifestWriter snapshotFile;
+    if (!snapshotFile.open(snapshotPath(snapshot.id), error)) {
+        return false;
+    }
+    snapshotFile.write(std::string(kSnapshotPrefix) + std::to_string(snapshotVersion) + " id=" + std::to_string(snapshot.id) +
+        " algorithm=" + hashAlgorithmName(algorithm) + " entries=" + std::to_string(snapshot.entryCount) +
+        " chunks=" + std::to_string(snapshot.chunks.size()) + " created=" + snapshot.created +
+        (label.empty() ? std::string() : " label=" + label) + "\n");
+    for (const SnapshotChunk& stored : snapshot.chunks) {
+        snapshotFile.write(stored.id + " " + std::to_string(stored.entryCount) + " " + stored.firstPath + "\n");
+    }
+    return snapshotFile.commit(error);
+}
+
+bool SnapshotStore::list(std::vector<Snapshot>& snapshots, std::string& error) const {
+    snapshots.clear();
+    std::error_code ec;
+    if (!std::filesystem::is_directory(root / "snapshots", ec)) {
+        return true;
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(root / "snapshots", ec)) {
+        if (entry.path().extension() != kSnapshotExtension) {
+            continue;
+        }
+        Snapshot snapshot;
+        if (!readSnapshot(entry.path(), false, snapshot, error)) {
+            return false;
+        }
+        snapshots.push_back(std::move(snapshot));
+    }
+    if (ec) {
+        error = "unable to list " + (root / "snapshots").string() + ": " + ec.message();
+        return false;
+    }
+    std::sort(snapshots.begin(), snapshots.end(), [](const Snapshot& a, const Snapshot& b) { return a.id < b.id; });
+    return true;
+}
+
+bool SnapshotStore::find(std::string_view name, Snapshot& snapshot, std::string& error) const {
+    unsigned int id = 0;
+    if (!parseNumber(name, id)) {
+        std::vector<Snapshot> snapshots;
+        if (!list(snapshots, error)) {
+            return false;
+        }
+        auto it = std::find_if(snapshots.rbegin(), snapshots.rend(), [&](const Snapshot& candidate) { return candidate.label == name; });
+        if (it == snapshots.rend()) {
+            error = "no snapshot with id or label '" + std::string(name) + "'";
+            return false;
+        }
+        id = it->id;
+    }
+
+    std::error_code ec;
+    if (!std::filesystem::exists(snapshotPath(id), ec)) {
+        error = "no snapshot with id " + std::to_string(id);
+        return false;
+    }
+    return readSnapshot(snapshotPath(id), true, snapshot, error);
+}
+
+bool SnapshotStore::diff(const Snapshot& from, const Snapshot& to, std::vector<SnapshotChange>& changes, std::string& error) {
+    if (from.algorithm != to.algorithm) {
+        error = std::string("Snapshots use different algorithms (") + hashAlgorithmName(from.algorithm) + ", " +
+            hashAlgorithmName(to.algorithm) + ")";
+        return false;
+    }
+
+    // Chunk boundaries depend only on paths, so wherever the two snapshots hold the
+    // same files their cursors meet at the start of the same chunk and skip it whole
+    PhaseTimer diffTimer(MetricPhase::Diff);
+    changes.clear();
+    ChunkCursor fromCursor(from);
+    ChunkCursor toCursor(to);
+    auto ensureLoaded = [&](ChunkCursor& cursor, HashAlgorithm algorithm) {
+        if (cursor.atEnd() || cursor.isLoaded()) {
+            return true;
+        }
+        std::vector<SnapshotEntry> entries;
+        if (!readChunk(cursor.currentChunk().id, algorithm, entries, error)) {
+            return false;
+        }
+        cursor.load(std::move(entries));
+        return true;
+    };
+
+    while (!fromCursor.atEnd() || !toCursor.atEnd()) {
+        if (!fromCursor.atEnd() && !toCursor.atEnd() && fromCursor.atChunkStart() && toCursor.atChunkStart() &&
+            fromCursor.currentChunk().id == toCursor.currentChunk().id) {
+            skippedChunks++;
+            fromCursor.skipChunk();
+            toCursor.skipChunk();
+            continue;
+        }
+        if (!ensureLoaded(fromCursor, from.algorithm) || !ensureLoaded(toCursor, to.algorithm)) {
+            return false;
+        }
+
+        if (toCursor.atEnd() || (!fromCursor.atEnd() && fromCursor.current().path < toCursor.current().path)) {
+            changes.push_back({ fromCursor.current().path, ChangeKind::Deleted });
+            fromCursor.advance();
+        }
+        else if (fromCursor.atEnd() || toCursor.current().path < fromCursor.current().path) {
+            changes.push_back({ toCursor.current().path, ChangeKind::Added });
+            toCursor.advance();
+        }
+        else {
+            if (!(fromCursor.current().hash == toCursor.current().hash)) {
+                changes.push_back({ toCursor.current().path, ChangeKind::Changed });
+            }
+            fromCursor.advance();
+            toCursor.advance();
+        }
+    }
+    return true;
+}
+
+bool SnapshotStore::fileHistory(std::string_view path, std::vector<FileHistoryEvent>& events, std::string& error) {
+    std::vector<Snapshot> snapshots;
+    if (!list(snapshots, error)) {
+        return false;
+    }
+
+    events.clear();
+    std::string previousChunk;     // Chunk that held the path in the previous snapshot; "" = none
+    bool present = false;
+    HashValue previousHash;
+    HashAlgorithm previousAlgorithm = HashAlgorithm::Crc32;
+    std::vector<SnapshotEntry> entries;
+    for (const Snapshot& header : snapshots) {
+        Snapshot snapshot;
+        if (!readSnapshot(snapshotPath(header.id), true, snapshot, error)) {
+            return false;
+        }
+
+        // An unchanged chunk holds the same entry, so only differing chunks are read
+        const SnapshotChunk* chunk = chunkHolding(snapshot, path);
+        std::string chunkId = chunk != nullptr ? chunk->id : std::string();
+        if (chunkId == previousChunk && snapshot.algorithm == previousAlgorithm) {
+            skippedChunks += chunk != nullptr ? 1 : 0;
+            continue;
+        }
+        previousChunk = chunkId;
+
+        bool found = false;
+        HashValue hash;
+        if (chunk != nullptr) {
+            if (!readChunk(chunk->id, snapshot.algorithm, entries, error)) {
+                return false;
+            }
+            auto it = std::lower_bound(entries.begin(), entries.end(), path,
+                [](const SnapshotEntry& entry, std::string_view value) { return entry.path < value; });
+            found = it != entries.end() && it->path == path;
+            if (found) {
+                hash = it->hash;
+            }
+        }
+
+        // A digest from another algorithm cannot be compared; it only starts a new baseline
+        bool sameAlgorithm = snapshot.algorithm == previousAlgorithm;
+        previousAlgorithm = snapshot.algorithm;
+        FileHistoryEvent event;
+        event.snapshotId = snapshot.id;
+        event.created = snapshot.created;
+        event.label = snapshot.label;
+        event.hash = hash;
+        bool changed = true;
+        if (found && !present) {
+            event.kind = ChangeKind::Added;
+        }
+        else if (!found && present) {
+            event.kind = ChangeKind::Deleted;
+        }
+        else {
+            event.kind = ChangeKind::Changed;
+            changed = found && sameAlgorithm && !(hash == previousHash);
+        }
+        present = found;
+        previousHash = hash;
+        if (changed) {
+            events.push_back(std::move(event));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "hash.h"
+#include "manifest_diff.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// History of checksum files in a content-addressed store.
+//
+// The entries of a snapshot (path and digest, in path order) are cut into
+// chunks at content-defined boundaries: a chunk ends after an entry whose path
+// hashes to a boundary value, or once it holds snapshotChunkMaxEntries entries.
+// Boundaries depend only on paths, so an unchanged run of files gives the same
+// chunks in every snapshot. Each chunk is stored once, under chunks/, named by
+// the BLAKE3 digest of its contents, one front-coded entry per line:
+//   <hex digest> <bytes shared with the previous path> <rest of the path>
+// A snapshot file under snapshots/ lists its chunks in order:
+//   # checksum_handler snapshot v1 id=3 algorithm=xxh3-64 entries=20000 chunks=311 created=2026-01-31T02:00:00Z label=nightly
+//   <chunk id> <entry count> <first path>
+// so a new snapshot costs its chunk list plus the chunks that changed.
+constexpr int snapshotVersion = 1;
+constexpr uint64_t snapshotChunkBoundaryMask = 63;     // About 64 entries per chunk
+constexpr size_t snapshotChunkMaxEntries = 1024;
+
+struct SnapshotChunk {
+    std::string id;             // Hex BLAKE3 digest of the chunk's contents
+    uint64_t entryCount = 0;
+    std::string firstPath;
+};
+
+struct Snapshot {
+    unsigned int id = 0;        // 1 for the first snapshot of a store
+    HashAlgorithm algorithm = HashAlgorithm::Crc32;
+    uint64_t entryCount = 0;
+    std::string created;        // UTC, ISO 8601
+    std::string label;
+    std::vector<SnapshotChunk> chunks;
+};
+
+struct SnapshotEntry {
+    std::string path;
+    HashValue hash;
+};
+
+// One path that differs between two snapshots
+struct SnapshotChange {
+    std::string path;
+    ChangeKind kind;
+};
+
+// A snapshot in which a file was added, changed or deleted
+struct FileHistoryEvent {
+    unsigned int snapshotId = 0;
+    std::string created;
+    std::string label;
+    ChangeKind kind = ChangeKind::Changed;
+    HashValue hash;             // Digest in that snapshot; empty when deleted
+};
+
+class SnapshotStore {
+public:
+    explicit SnapshotStore(const std::filesystem::path& directory);
+
+    // Record entries (sorted by path here) as the next snapshot. Only chunks not
+    // already in the store are written; the snapshot file is written last.
+    bool add(std::vector<SnapshotEntry>& entries, HashAlgorithm algorithm, const std::string& label,
+        Snapshot& snapshot, std::string& error);
+
+    // Every snapshot, oldest first, without its chunk list
+    bool list(std::vector<Snapshot>& snapshots, std::string& error) const;
+
+    // A snapshot by id, or the latest one with that label
+    bool find(std::string_view name, Snapshot& snapshot, std::string& error) const;
+
+    // Changes from one snapshot to another in path order. Runs of chunks the two
+    // share are skipped without being read.
+    bool diff(const Snapshot& from, const Snapshot& to, std::vector<SnapshotChange>& changes, std::string& error);
+
+    // Snapshots in which path was added, changed or deleted, oldest first. Only
+    // chunks that differ from the previous snapshot's chunk holding the path are read.
+    bool fileHistory(std::string_view path, std::vector<FileHistoryEvent>& events, std::string& error);
+
+    size_t chunksWritten() const { return writtenChunks; }  // New chunks of the last add
+    uint64_t bytesWritten() const { return writtenBytes; }
+    size_t chunksRead() const { return readChunks; }
+    size_t chunksSkipped() const { return skippedChunks; }   // Shared chunks a diff did not read
+    uint64_t entriesRead() const { return readEntries; }
+
+private:
+    std::filesystem::path chunkPath(const std::string& id) const;
+    std::filesystem::path snapshotPath(unsigned int id) const;
+    bool writeChunk(const std::string& contents, std::string& id, std::string& error);
+    bool readChunk(const std::string& id, HashAlgorithm algorithm, std::vector<SnapshotEntry>& entries, std::string& error);
+    bool readSnapshot(const std::filesystem::path& path, bool withChunks, Snapshot& snapshot, std::string& error) const;
+
+    std::filesystem::path root;
+    size_t writtenChunks = 0;
+    uint64_t writtenBytes = 0;
+    size_t readChunks = 0;
+    size_t skippedChunks = 0;
+    uint64_t readEntries = 0;
+};
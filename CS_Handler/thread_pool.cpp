@@ -0,0 +1,127 @@
+#include "pch.h"
+#include "thread_pool.h"
+#include "metrics.h"
+
+namespace {
+
+// Pool and worker index of the calling thread, if it is a pool worker
+thread_local WorkStealingPool* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(unsigned int threadCount)
+    : metrics(currentMetrics()) {
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+
+    for (unsigned int i = 0; i < threadCount; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (unsigned int i = 0; i < threadCount; i++) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    shutdown();
+}
+
+void WorkStealingPool::submit(Task task) {
+    WorkerQueue& queue = currentPool == this ? *queues[currentWorker] : injected;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Taking sleepMutex orders the increment against a worker checking the
+    // count before it waits, so the wakeup cannot be lost
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queuedTasks++;
+    }
+    wake.notify_one();
+}
+
+void WorkStealingPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+bool WorkStealingPool::takeTask(size_t index, Task& task) {
+    // Own queue, newest first
+    {
+        WorkerQueue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another worker
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        WorkerQueue& victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(injected.mutex);
+    if (!injected.tasks.empty()) {
+        task = std::move(injected.tasks.front());
+        injected.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentWorker = index;
+    MetricsScope scope(metrics);
+    uint64_t busyNs = 0;
+
+    while (true) {
+        Task task;
+        if (takeTask(index, task)) {
+            queuedTasks--;
+            uint64_t startNs = metrics != nullptr ? metricClockNs() : 0;
+            try {
+                task();
+            }
+            catch (...) {
+                // A failing task must not take the worker down with it
+            }
+            if (metrics != nullptr) {
+                busyNs += metricClockNs() - startNs;
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queuedTasks > 0; });
+        if (stopping && queuedTasks == 0) {
+            break;
+        }
+    }
+
+    if (metrics != nullptr) {
+        metrics->addWorkerBusy(busyNs);
+    }
+}
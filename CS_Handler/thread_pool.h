@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class RunMetrics;
+
+// Fixed-size thread pool with one task deque per worker. A worker runs its own
+// newest task first (LIFO keeps a split file's pieces hot) and, when idle,
+// steals the oldest task from another worker before taking new work from the
+// shared injection queue. Tasks submitted from a worker thread go to that
+// worker's deque; tasks from any other thread go to the injection queue.
+//
+// Workers record into the metrics of the thread that created the pool, each
+// adding its time spent running tasks when it exits.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned int threadCount);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(Task task);
+
+    // Runs every queued task, then stops and joins the workers
+    void shutdown();
+
+    unsigned int threadCount() const { return static_cast<unsigned int>(workers.size()); }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool takeTask(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    WorkerQueue injected;
+    std::vector<std::thread> workers;
+    RunMetrics* metrics;
+
+    // Tasks queued but not yet taken; lets idle workers sleep
+    std::atomic<size_t> queuedTasks{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
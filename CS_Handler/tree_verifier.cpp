@@ -0,0 +1,252 @@
+#include "pch.h"
+#include "tree_verifier.h"
+#include "file_hasher.h"
+#include "file_walker.h"
+#include "manifest.h"
+#include "manifest_parser.h"
+#include "merkle.h"
+#include "metrics.h"
+#include "sharded_manifest.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// Files handed to the pool per hashing thread before waiting for results
+constexpr size_t verifyWindowPerThread = 64;
+
+// Outcome of hashing one candidate
+enum class HashOutcome : uint8_t {
+    Pending,
+    Match,
+    Mismatch,
+    Unreadable
+};
+
+} // namespace
+
+TreeVerifier::TreeVerifier(const std::filesystem::path& directory, const ExcludeMatcher& excludeMatcher,
+    const VerifyOptions& options)
+    : root(directory), excludeMatcher(excludeMatcher), options(options) {
+}
+
+bool TreeVerifier::loadManifest(const std::filesystem::path& manifestPath, std::string& error) {
+    PhaseTimer parseTimer(MetricPhase::Parse);
+    manifestFile = manifestPath;
+
+    // Absolute paths of older manifests are rebased onto the directory
+    const std::string rootPrefix = directoryPrefix(root.string());
+    auto readEntries = [&](const std::filesystem::path& entriesPath, const std::string& pathPrefix) {
+        ManifestHeader header;
+        bool read = readManifestEntries(entriesPath, header,
+            [&](std::string_view filePath, const HashValue& hash, const FileStat& stat, const AppendCheck&) {
+                if (!header.relative && filePath.substr(0, rootPrefix.size()) == rootPrefix) {
+                    filePath.remove_prefix(rootPrefix.size());
+                }
+                FileStat entryStat = stat;
+                entryStat.valid = entryStat.valid && header.hasStat;
+                entries.push_back({ pathPrefix + std::string(filePath), hash, entryStat });
+            });
+        if (!read) {
+            error = "unable to read " + entriesPath.string();
+            return false;
+        }
+        manifestAlgorithm = header.algorithm;
+        return true;
+    };
+
+    // A sharded checksum file is read shard by shard, each under its subtree
+    if (isShardIndex(manifestPath)) {
+        ShardIndex index;
+        if (!readShardIndex(manifestPath, index, error)) {
+            return false;
+        }
+        manifestAlgorithm = index.algorithm;
+        for (const ShardInfo& shard : index.shards) {
+            if (!readEntries(manifestPath.parent_path() / shardDirectoryName / shard.fileName, shardPathPrefix(shard.subtree))) {
+                return false;
+            }
+        }
+    }
+    else if (!readEntries(manifestPath, std::string())) {
+        return false;
+    }
+
+    sortEntries();
+    return true;
+}
+
+bool TreeVerifier::loadManifest(const ParsedManifest& manifest, const std::filesystem::path& manifestPath, std::string& error) {
+    PhaseTimer parseTimer(MetricPhase::Parse);
+    manifestFile = manifestPath;
+    if (!manifest.errors().empty()) {
+        error = std::to_string(manifest.errors().size()) + " malformed lines in " + manifestPath.string();
+        return false;
+    }
+
+    const std::string rootPrefix = directoryPrefix(root.string());
+    const bool relative = manifest.header().relative;
+    const std::vector<uint64_t>& sizes = manifest.entrySizes();
+    manifestAlgorithm = manifest.header().algorithm;
+    entries.reserve(manifest.entries().size());
+    for (size_t i = 0; i < manifest.entries().size(); i++) {
+        const ManifestDiffEntry& entry = manifest.entries()[i];
+        std::string_view filePath = entry.path;
+        if (!relative && filePath.substr(0, rootPrefix.size()) == rootPrefix) {
+            filePath.remove_prefix(rootPrefix.size());
+        }
+
+        // Only the size is kept, which is all the pre-check compares
+        FileStat entryStat;
+        if (i < sizes.size() && sizes[i] != unknownEntrySize) {
+            entryStat.valid = true;
+            entryStat.size = sizes[i];
+        }
+        entries.push_back({ std::string(filePath), entry.hash, entryStat });
+    }
+    sortEntries();
+    return true;
+}
+
+void TreeVerifier::sortEntries() {
+    // Created manifests are sorted; legacy ones are sorted here for the merge
+    auto byPath = [](const ExpectedFile& a, const ExpectedFile& b) { return a.path < b.path; };
+    if (!std::is_sorted(entries.begin(), entries.end(), byPath)) {
+        std::stable_sort(entries.begin(), entries.end(), byPath);
+    }
+}
+
+void TreeVerifier::precheck(std::vector<ManifestChange>& changes) {
+    const size_t relativeStart = directoryPrefix(root.string()).size();
+    std::error_code ec;
+    std::filesystem::path manifestCanonical = std::filesystem::weakly_canonical(manifestFile, ec);
+
+    // Only a stat per file; the walk skips what create skips
+    walkSortedFiles(root,
+        [&](const std::filesystem::directory_entry& entry) {
+            const std::filesystem::path& filePath = entry.path();
+            if (isChecksumOutputFile(filePath.filename())) {
+                return;
+            }
+            std::string pathText = filePath.string();
+            if (!excludeMatcher.empty() && excludeMatcher.excludes(pathText, relativeStart, false)) {
+                return;
+            }
+            std::error_code canonicalError;
+            if (std::filesystem::weakly_canonical(filePath, canonicalError) == manifestCanonical && !canonicalError) {
+                return;
+            }
+
+            LiveFile file;
+            file.path = pathText.substr((std::min)(relativeStart, pathText.size()));
+            {
+                PhaseTimer statTimer(MetricPhase::Walk);
+                readFileStat(filePath, file.stat);
+            }
+            enumeratedBytes += file.stat.valid ? file.stat.size : 0;
+            files.push_back(std::move(file));
+        },
+        [&](const std::filesystem::path& failedPath, const std::error_code& error) {
+            walkFailures.push_back({ failedPath, error.message() });
+        },
+        [&](const std::filesystem::path& directory) {
+            if (isChecksumOutputDirectory(directory.filename())) {
+                return false;
+            }
+            return excludeMatcher.empty() || !excludeMatcher.excludes(directory.string(), relativeStart, true);
+        });
+
+    // The walk yields byte-wise path order, as the manifest is in; merge the two
+    PhaseTimer diffTimer(MetricPhase::Diff);
+    auto byPath = [](const LiveFile& a, const LiveFile& b) { return a.path < b.path; };
+    if (!std::is_sorted(files.begin(), files.end(), byPath)) {
+        std::sort(files.begin(), files.end(), byPath);
+    }
+
+    size_t e = 0;
+    size_t f = 0;
+    while (e < entries.size() || f < files.size()) {
+        int order = e == entries.size() ? 1 : f == files.size() ? -1 : entries[e].path.compare(files[f].path);
+        if (order < 0) {
+            changes.push_back({ entries[e++].path, ChangeKind::Deleted });
+        }
+        else if (order > 0) {
+            changes.push_back({ files[f++].path, ChangeKind::Added });
+        }
+        else {
+            // A size change settles it without reading the file
+            const FileStat& entryStat = entries[e].stat;
+            const FileStat& fileStat = files[f].stat;
+            if (entryStat.valid && fileStat.valid && entryStat.size != fileStat.size) {
+                changes.push_back({ files[f].path, ChangeKind::Changed });
+            }
+            else {
+                candidates.push_back({ e, f });
+            }
+            e++;
+            f++;
+        }
+    }
+}
+
+bool TreeVerifier::hashCandidates(std::vector<ManifestChange>& changes) {
+    unsigned int threadCount = options.threadCount > 0 ? options.threadCount : (std::max)(1u, std::thread::hardware_concurrency());
+    size_t window = static_cast<size_t>(threadCount) * verifyWindowPerThread;
+
+    std::vector<HashOutcome> outcomes(candidates.size(), HashOutcome::Pending);
+    std::mutex mutex;
+    std::condition_variable slotFree;
+    size_t inFlight = 0;
+    std::atomic<bool> stopped{ false };
+
+    {
+        WorkStealingPool pool(threadCount);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                slotFree.wait(lock, [&] { return inFlight < window || stopped.load(); });
+                if (stopped.load()) {
+                    break;
+                }
+                inFlight++;
+            }
+
+            const Candidate& candidate = candidates[i];
+            const LiveFile& file = files[candidate.file];
+            HashValue expected = entries[candidate.entry].hash;
+            uint64_t fileSize = file.stat.valid ? file.stat.size : 0;
+            // Once stopped, files still queued are dropped unread and stay Pending
+            scheduleFileHash(pool, root / std::filesystem::path(file.path), fileSize, manifestAlgorithm, options.readStrategy,
+                [&, i, expected](bool hashed, const HashValue& hash) {
+                    HashOutcome outcome = !hashed ? (stopped.load() ? HashOutcome::Pending : HashOutcome::Unreadable) :
+                        hash == expected ? HashOutcome::Match : HashOutcome::Mismatch;
+                    if (outcome != HashOutcome::Match && options.failFast) {
+                        stopped.store(true);
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    outcomes[i] = outcome;
+                    inFlight--;
+                    slotFree.notify_one();
+                },
+                &stopped);
+        }
+        pool.shutdown();
+    }
+
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (outcomes[i] == HashOutcome::Pending) {
+            continue;
+        }
+        hashedFiles++;
+        if (outcomes[i] == HashOutcome::Unreadable) {
+            readErrors++;
+        }
+        if (outcomes[i] != HashOutcome::Match) {
+            changes.push_back({ files[candidates[i].file].path, ChangeKind::Changed });
+        }
+    }
+    return !stopped.load() || hashedFiles == candidates.size();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "checksum.h"
+#include "exclude_matcher.h"
+#include "file_stat.h"
+#include "file_walker.h"
+#include "hash.h"
+#include "manifest_diff.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class ParsedManifest;
+
+// Checks the files under a directory against a checksum file without writing
+// a new one.
+//
+// The manifest's entries are read once. A stat walk of the directory is then
+// merged with them, which settles added and deleted files and files whose
+// size differs without reading any contents. Only files present on both sides
+// with the same size are hashed, on a work-stealing pool fed a bounded window
+// of files at a time; with failFast, the first difference stops further files
+// from being handed out.
+class TreeVerifier {
+public:
+    TreeVerifier(const std::filesystem::path& directory, const ExcludeMatcher& excludeMatcher, const VerifyOptions& options);
+
+    TreeVerifier(const TreeVerifier&) = delete;
+    TreeVerifier& operator=(const TreeVerifier&) = delete;
+
+    // Read the manifest's entries; false (with error set) if it cannot be read
+    bool loadManifest(const std::filesystem::path& manifestPath, std::string& error);
+
+    // Take the entries of a manifest already loaded from manifestPath, with the
+    // file sizes it recorded
+    bool loadManifest(const ParsedManifest& manifest, const std::filesystem::path& manifestPath, std::string& error);
+
+    // Walk the directory and merge it with the manifest: added, deleted and
+    // resized files are appended to changes
+    void precheck(std::vector<ManifestChange>& changes);
+
+    // Hash the files that passed the pre-check and append those whose digest
+    // differs (or that cannot be read). Returns false when failFast stopped it
+    // before every file was hashed.
+    bool hashCandidates(std::vector<ManifestChange>& changes);
+
+    HashAlgorithm algorithm() const { return manifestAlgorithm; }
+    size_t entryCount() const { return entries.size(); }
+    size_t fileCount() const { return files.size(); }
+    size_t candidateCount() const { return candidates.size(); }
+    uint64_t bytesEnumerated() const { return enumeratedBytes; }
+    size_t hashedCount() const { return hashedFiles; }
+    size_t readErrorCount() const { return readErrors; }
+    size_t walkErrorCount() const { return walkFailures.size(); }
+    const std::vector<WalkFailure>& walkErrorList() const { return walkFailures; }
+
+private:
+    struct ExpectedFile {
+        std::string path;
+        HashValue hash;
+        FileStat stat;
+    };
+
+    struct LiveFile {
+        std::string path;       // Relative to the directory
+        FileStat stat;
+    };
+
+    // A path on both sides with matching (or unknown) size
+    struct Candidate {
+        size_t entry;
+        size_t file;
+    };
+
+    void sortEntries();
+
+    std::filesystem::path root;
+    const ExcludeMatcher& excludeMatcher;
+    const VerifyOptions& options;
+    std::filesystem::path manifestFile;
+    HashAlgorithm manifestAlgorithm = HashAlgorithm::Crc32;
+    std::vector<ExpectedFile> entries;
+    std::vector<LiveFile> files;
+    std::vector<Candidate> candidates;
+    uint64_t enumeratedBytes = 0;
+    size_t hashedFiles = 0;
+    size_t readErrors = 0;
+    std::vector<WalkFailure> walkFailures;
+};
@@ -0,0 +1,579 @@
+#include "pch.h"
+#include "tree_watcher.h"
+#include "file_hasher.h"
+#include "file_walker.h"
+#include "manifest_cache.h"
+#include "manifest_writer.h"
+#include "merkle.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using WatchClock = std::chrono::steady_clock;
+
+// Upper bound on one wait, so stop and report requests are seen promptly
+constexpr auto watchTickInterval = std::chrono::milliseconds(500);
+
+// A burst that never goes quiet is still applied after this many settle periods
+constexpr int maxBurstSettlePeriods = 10;
+
+#ifdef __linux__
+constexpr uint32_t watchEventMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+#endif
+
+double millisecondsSince(WatchClock::time_point start) {
+    return std::chrono::duration<double, std::milli>(WatchClock::now() - start).count();
+}
+
+} // namespace
+
+TreeWatcher::TreeWatcher(const std::string& path, const ExcludeMatcher& excludeMatcher, const ChecksumOptions& options,
+    const WatchOptions& watchOptions, std::ostream& out, RunStats& stats)
+    : rootPrefix(directoryPrefix(path)), relativeStart(rootPrefix.size()),
+    checksumPath(std::filesystem::path(path) / "checksum.txt"), excludeMatcher(excludeMatcher),
+    options(options), watchOptions(watchOptions), out(out), stats(stats),
+    pool(options.threadCount > 0 ? options.threadCount : (std::max)(1u, std::thread::hardware_concurrency())) {
+}
+
+TreeWatcher::~TreeWatcher() {
+#ifdef __linux__
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+    }
+#endif
+}
+
+bool TreeWatcher::start(const std::filesystem::path& manifestPath, std::string& error) {
+    bool read = readManifestEntries(manifestPath, header,
+        [&](std::string_view filePath, const HashValue& hash, const FileStat& stat, const AppendCheck& check) {
+            files.insert_or_assign(std::string(filePath), WatchedFile{ hash, stat, check });
+        });
+    if (!read) {
+        error = "unable to read " + manifestPath.string();
+        return false;
+    }
+    if (!header.relative || !header.hasStat) {
+        error = "the checksum file was written by an older version; recreate it";
+        return false;
+    }
+
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd >= 0) {
+        pollingFallback = false;
+    }
+    else {
+        out << "\033[1;33mWarning: inotify is not available, polling every " << watchOptions.pollSeconds
+            << " seconds\033[0m" << std::endl;
+    }
+#else
+    out << "File system events are not supported on this platform, polling every " << watchOptions.pollSeconds
+        << " seconds" << std::endl;
+#endif
+
+    // Watches are added during the walk, before each directory is listed, so
+    // nothing changed after the manifest was written goes unnoticed
+    resync();
+    return true;
+}
+
+bool TreeWatcher::isIgnored(const std::string& relativePath, bool isDirectory) const {
+    if (relativePath.empty()) {
+        return false;
+    }
+
+    // Skipped as create skips them; the manifest and its temporary file change on every persist
+    std::string_view name = relativePath;
+    if (isDirectory) {
+        name.remove_suffix(1);
+    }
+    std::filesystem::path fileName = std::filesystem::path(name).filename();
+    if (isDirectory ? isChecksumOutputDirectory(fileName) : isChecksumOutputFile(fileName)) {
+        return true;
+    }
+    if (excludeMatcher.empty()) {
+        return false;
+    }
+
+    // Directories are matched without their trailing separator, as during create
+    std::string pathText = rootPrefix + relativePath;
+    if (isDirectory) {
+        pathText.pop_back();
+    }
+    return excludeMatcher.excludes(pathText, relativeStart, isDirectory);
+}
+
+bool TreeWatcher::hasPendingEvents() const {
+    return !dirtyFiles.empty() || !scanDirectories.empty() || !removedDirectories.empty();
+}
+
+void TreeWatcher::addWatch(const std::string& relativeDirectory) {
+#ifdef __linux__
+    if (inotifyFd < 0) {
+        return;
+    }
+    int descriptor = inotify_add_watch(inotifyFd, (rootPrefix + relativeDirectory).c_str(), watchEventMask);
+    if (descriptor >= 0) {
+        watchDirectories[descriptor] = relativeDirectory;
+        return;
+    }
+    if (!pollingFallback) {
+        out << "\033[1;33mWarning: Unable to watch " << rootPrefix + relativeDirectory << " (" << std::strerror(errno)
+            << "), polling every " << watchOptions.pollSeconds << " seconds\033[0m" << std::endl;
+        pollingFallback = true;
+    }
+#endif
+}
+
+void TreeWatcher::forgetWatches(const std::string& relativeDirectory) {
+    // The kernel drops watches of deleted directories itself; moved ones are re-added at their new path
+    for (auto it = watchDirectories.begin(); it != watchDirectories.end();) {
+        if (it->second.compare(0, relativeDirectory.size(), relativeDirectory) == 0) {
+            it = watchDirectories.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void TreeWatcher::readEvents() {
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+
+        for (char* position = buffer; position < buffer + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(position);
+            position += sizeof(struct inotify_event) + event->len;
+
+            // Events were dropped; only a full walk can tell what changed
+            if (event->mask & IN_Q_OVERFLOW) {
+                resyncPending = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watchDirectories.erase(event->wd);
+                continue;
+            }
+
+            // Events about a watched directory itself are also reported by its parent
+            auto it = watchDirectories.find(event->wd);
+            if (it == watchDirectories.end() || event->len == 0) {
+                continue;
+            }
+
+            std::string relativePath = it->second + event->name;
+            if (event->mask & IN_ISDIR) {
+                std::string relativeDirectory = directoryPrefix(rootPrefix + relativePath).substr(relativeStart);
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    removedDirectories.insert(relativeDirectory);
+                    scanDirectories.erase(relativeDirectory);
+                }
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    scanDirectories.insert(relativeDirectory);
+                }
+            }
+            else {
+                dirtyFiles.insert(relativePath);
+            }
+        }
+    }
+#endif
+}
+
+void TreeWatcher::scanDirectory(const std::string& relativeDirectory) {
+    if (isIgnored(relativeDirectory, true)) {
+        return;
+    }
+
+    addWatch(relativeDirectory);
+    walkSortedFiles(rootPrefix + relativeDirectory,
+        [&](const std::filesystem::directory_entry& entry) {
+            std::string relativePath = entry.path().string().substr(relativeStart);
+            if (!isIgnored(relativePath, false)) {
+                dirtyFiles.insert(relativePath);
+            }
+        },
+        [&](const std::filesystem::path& failedPath, const std::error_code& error) {
+            out << "\n\033[1;33mWarning: Unable to read directory " << failedPath << ": " << error.message() << "\033[0m" << std::endl;
+            stats.walkErrors++;
+        },
+        [&](const std::filesystem::path& directory) {
+            std::string relativePath = directoryPrefix(directory.string()).substr(relativeStart);
+            if (isIgnored(relativePath, true)) {
+                return false;
+            }
+            addWatch(relativePath);
+            return true;
+        });
+}
+
+void TreeWatcher::processBatch() {
+    WatchClock::time_point started = WatchClock::now();
+    batch = BatchCounts{};
+
+    // Removed directories first, so one replaced within the same burst is rescanned
+    for (const auto& directory : removedDirectories) {
+        auto it = files.lower_bound(directory);
+        while (it != files.end() && it->first.compare(0, directory.size(), directory) == 0) {
+            std::string relativePath = it->first;
+            ++it;
+            applyFile(relativePath, nullptr);
+        }
+        forgetWatches(directory);
+    }
+    for (const auto& directory : scanDirectories) {
+        scanDirectory(directory);
+    }
+
+    // Events are authoritative: a dirty file is rehashed even if its stat tuple
+    // looks unchanged, since a rewrite can land within the same timestamp tick
+    std::vector<PendingHash> pending;
+    for (const auto& relativePath : dirtyFiles) {
+        if (isIgnored(relativePath, false)) {
+            continue;
+        }
+        std::filesystem::path filePath = rootPrefix + relativePath;
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(filePath, ec)) {
+            applyFile(relativePath, nullptr);
+            continue;
+        }
+        PendingHash item;
+        item.relativePath = relativePath;
+        readFileStat(filePath, item.stat);
+        pending.push_back(std::move(item));
+    }
+
+    dirtyFiles.clear();
+    scanDirectories.clear();
+    removedDirectories.clear();
+    hashFiles(pending);
+    printBatch("Updated", millisecondsSince(started));
+}
+
+void TreeWatcher::resync() {
+    WatchClock::time_point started = WatchClock::now();
+    resyncPending = false;
+    batch = BatchCounts{};
+
+    // The walk sees everything the pending events describe
+    dirtyFiles.clear();
+    scanDirectories.clear();
+    removedDirectories.clear();
+
+    std::vector<PendingHash> pending;
+    std::vector<std::string> seen;
+    std::vector<std::string> unreadable;
+    addWatch("");
+    walkSortedFiles(rootPrefix,
+        [&](const std::filesystem::directory_entry& entry) {
+            std::string relativePath = entry.path().string().substr(relativeStart);
+            if (isIgnored(relativePath, false)) {
+                return;
+            }
+            PendingHash item;
+            item.relativePath = relativePath;
+            readFileStat(entry.path(), item.stat);
+            auto it = files.find(relativePath);
+            if (it == files.end() || !(it->second.stat == item.stat)) {
+                pending.push_back(std::move(item));
+            }
+            seen.push_back(std::move(relativePath));
+        },
+        [&](const std::filesystem::path& failedPath, const std::error_code& error) {
+            out << "\n\033[1;33mWarning: Unable to read directory " << failedPath << ": " << error.message() << "\033[0m" << std::endl;
+            stats.walkErrors++;
+            unreadable.push_back(directoryPrefix(failedPath.string()).substr((std::min)(relativeStart, failedPath.string().size())));
+        },
+        [&](const std::filesystem::path& directory) {
+            std::string relativePath = directoryPrefix(directory.string()).substr(relativeStart);
+            if (isIgnored(relativePath, true)) {
+                return false;
+            }
+            addWatch(relativePath);
+            return true;
+        });
+
+    // Both lists are in path order; entries the walk did not see are gone, unless
+    // their directory could not be read
+    std::vector<std::string> removed;
+    size_t seenIndex = 0;
+    for (const auto& [relativePath, file] : files) {
+        while (seenIndex < seen.size() && seen[seenIndex] < relativePath) {
+            seenIndex++;
+        }
+        if (seenIndex < seen.size() && seen[seenIndex] == relativePath) {
+            continue;
+        }
+        bool inUnreadable = std::any_of(unreadable.begin(), unreadable.end(), [&](const std::string& directory) {
+            return relativePath.compare(0, directory.size(), directory) == 0;
+        });
+        if (!inUnreadable) {
+            removed.push_back(relativePath);
+        }
+    }
+    for (const auto& relativePath : removed) {
+        applyFile(relativePath, nullptr);
+    }
+
+    hashFiles(pending);
+    printBatch("Resynchronized", millisecondsSince(started));
+}
+
+void TreeWatcher::hashFiles(std::vector<PendingHash>& pending) {
+    if (pending.empty()) {
+        return;
+    }
+
+    std::mutex doneMutex;
+    std::condition_variable done;
+    size_t remaining = pending.size();
+    for (auto& item : pending) {
+        uint64_t fileSize = item.stat.valid ? item.stat.size : 0;
+        scheduleFileHash(pool, rootPrefix + item.relativePath, fileSize, options.algorithm, options.readStrategy,
+            [&, result = &item](bool hashed, const HashValue& hash) {
+                result->hashed = hashed;
+                result->hash = hash;
+                if (hashed && header.appendCheck) {
+                    result->check = readAppendCheck(rootPrefix + result->relativePath, result->stat, options.readStrategy);
+                }
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (--remaining == 0) {
+                    done.notify_one();
+                }
+            });
+    }
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [&] { return remaining == 0; });
+    }
+
+    for (const auto& item : pending) {
+        if (item.hashed) {
+            stats.filesHashed++;
+            WatchedFile updated{ item.hash, item.stat, item.check };
+            applyFile(item.relativePath, &updated);
+        }
+        else if (!std::filesystem::exists(rootPrefix + item.relativePath)) {
+            applyFile(item.relativePath, nullptr);
+        }
+        else {
+            out << "\n\033[1;33mWarning: Unable to open file for checksum: " << rootPrefix + item.relativePath << "\033[0m" << std::endl;
+            stats.readErrors++;
+        }
+    }
+}
+
+void TreeWatcher::applyFile(const std::string& relativePath, const WatchedFile* updated) {
+    auto it = files.find(relativePath);
+    bool existed = it != files.end();
+    if (!existed && updated == nullptr) {
+        return;
+    }
+
+    // Same contents; only the stat tuple needs saving
+    if (existed && updated != nullptr && it->second.hash == updated->hash) {
+        if (!(it->second.stat == updated->stat) || it->second.check != updated->check) {
+            it->second.stat = updated->stat;
+            it->second.check = updated->check;
+            unsavedChanges++;
+        }
+        return;
+    }
+
+    // The first change to a path records its state at start
+    auto driftIt = drift.find(relativePath);
+    if (driftIt == drift.end()) {
+        driftIt = drift.emplace(relativePath, DriftEntry{ existed, existed ? it->second.hash : HashValue{} }).first;
+    }
+
+    if (updated == nullptr) {
+        files.erase(it);
+        batch.deleted++;
+    }
+    else if (existed) {
+        it->second = *updated;
+        batch.changed++;
+    }
+    else {
+        files.emplace(relativePath, *updated);
+        batch.added++;
+    }
+    stats.changesFound++;
+    unsavedChanges++;
+
+    // A path back in its original state is no longer drift
+    const DriftEntry& original = driftIt->second;
+    bool exists = updated != nullptr;
+    if (original.existed == exists && (!exists || original.hash == updated->hash)) {
+        drift.erase(driftIt);
+    }
+}
+
+void TreeWatcher::printBatch(const char* label, double milliseconds) const {
+    if (batch.added + batch.changed + batch.deleted == 0) {
+        return;
+    }
+    out << label << " " << batch.added << " added, " << batch.changed << " changed, " << batch.deleted
+        << " deleted in " << static_cast<long long>(milliseconds) << " ms; " << drift.size()
+        << " file" << (drift.size() == 1 ? "" : "s") << " drifted since watch started" << std::endl;
+}
+
+void TreeWatcher::reportDrift() const {
+    if (drift.empty()) {
+        out << "\n\033[1;32mNo Drift - Files Match the Checksum File Loaded at Start\033[0m" << std::endl;
+        return;
+    }
+
+    out << "\n\033[1;33mDrift Since Watch Started:\033[0m" << std::endl;
+    out << "-------------------------" << std::endl;
+    int addedCount = 0, deletedCount = 0, changedCount = 0;
+    for (const auto& [relativePath, original] : drift) {
+        if (!original.existed) {
+            out << "\033[1;32m[ADDED]\033[0m " << relativePath << std::endl;
+            addedCount++;
+        }
+        else if (files.find(relativePath) == files.end()) {
+            out << "\033[1;31m[DELETED]\033[0m " << relativePath << std::endl;
+            deletedCount++;
+        }
+        else {
+            out << "\033[1;33m[CHANGED]\033[0m " << relativePath << std::endl;
+            changedCount++;
+        }
+    }
+    out << "-------------------------" << std::endl;
+    out << "Summary: " << addedCount << " added, " << deletedCount << " deleted, " << changedCount << " changed" << std::endl;
+}
+
+bool TreeWatcher::persist() {
+    ManifestWriter writer;
+    std::string error;
+    if (!writer.open(checksumPath, error)) {
+        out << "\n\033[1;31mError: Unable to update checksum file: " << error << "\033[0m" << std::endl;
+        stats.writeErrors++;
+        return false;
+    }
+
+    // Same layout as create: entries in path order, each directory's digest after its last entry
+    writer.write(formatManifestHeader(header));
+    writer.write("\n");
+    DirectoryDigestBuilder directoryDigests("", [&](std::string_view directory, const HashValue& digest) {
+        writer.write(formatManifestDirectory(directory, digest));
+        writer.write("\n");
+    });
+    std::string line;
+    std::string_view previousPath;
+    for (const auto& [relativePath, file] : files) {
+        directoryDigests.addFile(relativePath, file.hash);
+        line.clear();
+        appendManifestEntry(line, header.frontCoded ? formatFrontCodedPath(relativePath, previousPath) : relativePath,
+            file.hash, file.stat, header.appendCheck ? &file.check : nullptr);
+        writer.write(line);
+        previousPath = relativePath;
+    }
+    HashValue rootDigest = directoryDigests.finish();
+
+    evictCachedManifest(checksumPath);
+    if (!writer.commit(error)) {
+        out << "\n\033[1;31mError: Unable to update checksum file: " << error << "\033[0m" << std::endl;
+        stats.writeErrors++;
+        return false;
+    }
+    unsavedChanges = 0;
+    out << "Checksum file saved: " << files.size() << " entries, root digest " << formatManifestHash(rootDigest) << std::endl;
+    return true;
+}
+
+void TreeWatcher::run(const std::atomic<bool>& stopRequested, std::atomic<bool>& reportRequested) {
+    const auto settleTime = std::chrono::milliseconds(watchOptions.settleMs);
+    const auto persistInterval = std::chrono::seconds(watchOptions.persistSeconds);
+    const auto pollInterval = std::chrono::seconds(watchOptions.pollSeconds);
+
+    WatchClock::time_point lastPersist = WatchClock::now();
+    WatchClock::time_point lastResync = WatchClock::now();
+    WatchClock::time_point burstStart;
+    WatchClock::time_point lastEvent;
+    bool inBurst = false;
+
+    out << "\n\033[1;36mWatching " << rootPrefix << " (" << files.size() << " files)\033[0m" << std::endl;
+    while (!stopRequested.load()) {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(watchTickInterval);
+        if (inBurst) {
+            auto untilSettled = std::chrono::duration_cast<std::chrono::milliseconds>(lastEvent + settleTime - WatchClock::now());
+            wait = (std::max)(std::chrono::milliseconds(0), (std::min)(wait, untilSettled));
+        }
+
+#ifdef __linux__
+        if (inotifyFd >= 0) {
+            struct pollfd descriptor{ inotifyFd, POLLIN, 0 };
+            if (poll(&descriptor, 1, static_cast<int>(wait.count())) > 0) {
+                readEvents();
+                if (hasPendingEvents()) {
+                    lastEvent = WatchClock::now();
+                    if (!inBurst) {
+                        burstStart = lastEvent;
+                        inBurst = true;
+                    }
+                }
+            }
+        }
+        else {
+            std::this_thread::sleep_for(wait);
+        }
+#else
+        std::this_thread::sleep_for(wait);
+#endif
+
+        WatchClock::time_point now = WatchClock::now();
+        if (inBurst && (now - lastEvent >= settleTime || now - burstStart >= settleTime * maxBurstSettlePeriods)) {
+            processBatch();
+            inBurst = false;
+        }
+        if (pollingFallback && now - lastResync >= pollInterval) {
+            resyncPending = true;
+        }
+        if (resyncPending) {
+            if (!pollingFallback) {
+                out << "\033[1;33mWarning: File system events were dropped, resynchronizing\033[0m" << std::endl;
+            }
+            resync();
+            inBurst = false;
+            lastResync = WatchClock::now();
+        }
+        if (reportRequested.exchange(false)) {
+            reportDrift();
+        }
+        if (unsavedChanges > 0 && now - lastPersist >= persistInterval) {
+            persist();
+            lastPersist = now;
+        }
+    }
+
+    // Apply whatever is still queued before the final save
+    if (hasPendingEvents()) {
+        processBatch();
+    }
+    if (unsavedChanges > 0) {
+        persist();
+    }
+    reportDrift();
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "checksum.h"
+#include "exclude_matcher.h"
+#include "file_stat.h"
+#include "hash.h"
+#include "manifest.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Keeps the entries of a checksummed tree current from file system events.
+//
+// The watcher starts from the manifest create has just written. On Linux every
+// directory gets an inotify watch, and events only mark paths dirty. Once a
+// burst has been quiet for settleMs, or has lasted ten times that long, the
+// dirty files are rehashed on the pool, new directories are scanned and
+// removed ones dropped. A queue overflow (or running without inotify) falls
+// back to a resync: a stat walk that rehashes only files whose size, mtime or
+// inode changed. checksum.txt is rewritten every persistSeconds while it is out
+// of date, and on exit.
+//
+// Drift is kept against the entries loaded at start: the first change to a
+// path records its original state, so a drift report costs O(changes).
+class TreeWatcher {
+public:
+    // Messages go to out; files hashed, changes applied and errors are added to stats
+    TreeWatcher(const std::string& path, const ExcludeMatcher& excludeMatcher, const ChecksumOptions& options,
+        const WatchOptions& watchOptions, std::ostream& out, RunStats& stats);
+    ~TreeWatcher();
+
+    TreeWatcher(const TreeWatcher&) = delete;
+    TreeWatcher& operator=(const TreeWatcher&) = delete;
+
+    // Load the baseline from a relative manifest, subscribe to events and
+    // catch up with changes made since the manifest was written
+    bool start(const std::filesystem::path& manifestPath, std::string& error);
+
+    // Process events until stopRequested is set. reportRequested prints the
+    // drift and is cleared.
+    void run(const std::atomic<bool>& stopRequested, std::atomic<bool>& reportRequested);
+
+private:
+    struct WatchedFile {
+        HashValue hash;
+        FileStat stat;
+        AppendCheck check;  // Kept up to date for append=1 manifests
+    };
+
+    // State of a path when the watch started
+    struct DriftEntry {
+        bool existed;
+        HashValue hash;
+    };
+
+    struct PendingHash {
+        std::string relativePath;
+        FileStat stat;
+        HashValue hash;
+        AppendCheck check;
+        bool hashed = false;
+    };
+
+    struct BatchCounts {
+        size_t added = 0;
+        size_t changed = 0;
+        size_t deleted = 0;
+    };
+
+    bool isIgnored(const std::string& relativePath, bool isDirectory) const;
+    bool hasPendingEvents() const;
+
+    void addWatch(const std::string& relativeDirectory);
+    void forgetWatches(const std::string& relativeDirectory);
+    void readEvents();
+
+    void scanDirectory(const std::string& relativeDirectory);
+    void processBatch();
+    void resync();
+    void hashFiles(std::vector<PendingHash>& pending);
+
+    // updated == nullptr removes the entry
+    void applyFile(const std::string& relativePath, const WatchedFile* updated);
+
+    void printBatch(const char* label, double milliseconds) const;
+    void reportDrift() const;
+    bool persist();
+
+    std::string rootPrefix;
+    size_t relativeStart;
+    std::filesystem::path checksumPath;
+    const ExcludeMatcher& excludeMatcher;
+    ChecksumOptions options;
+    WatchOptions watchOptions;
+    std::ostream& out;
+    RunStats& stats;
+    ManifestHeader header;
+    WorkStealingPool pool;
+
+    std::map<std::string, WatchedFile> files;       // Relative path -> current entry, in manifest order
+    std::map<std::string, DriftEntry> drift;
+
+    // Coalesced events, applied together once a burst settles
+    std::set<std::string> dirtyFiles;
+    std::set<std::string> scanDirectories;
+    std::set<std::string> removedDirectories;
+    bool resyncPending = false;
+
+    BatchCounts batch;
+    size_t unsavedChanges = 0;
+
+    // Directories that could not be watched are only seen by periodic resyncs
+    bool pollingFallback = true;
+
+    int inotifyFd = -1;
+    std::unordered_map<int, std::string> watchDirectories;   // Watch descriptor -> relative directory
+};
@@ -0,0 +1,511 @@
+#include "pch.h"
+#include "uring_reader.h"
+#include "metrics.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int uringSetup(unsigned int entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uringEnter(int ringFd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int uringRegister(int ringFd, unsigned int opcode, void* arg, unsigned int count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ringFd, opcode, arg, count));
+}
+
+// Ring indices are shared with the kernel
+unsigned int loadAcquire(unsigned int* value) {
+    return std::atomic_ref<unsigned int>(*value).load(std::memory_order_acquire);
+}
+
+void storeRelease(unsigned int* value, unsigned int newValue) {
+    std::atomic_ref<unsigned int>(*value).store(newValue, std::memory_order_release);
+}
+
+// The raw submission / completion rings of one io_uring instance
+class Ring {
+public:
+    ~Ring() {
+        if (sqes != nullptr) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqPointer != nullptr && cqPointer != sqPointer) {
+            munmap(cqPointer, cqSize);
+        }
+        if (sqPointer != nullptr) {
+            munmap(sqPointer, sqSize);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool init(unsigned int entries) {
+        io_uring_params params{};
+        fd = uringSetup(entries, &params);
+        if (fd < 0) {
+            return false;
+        }
+
+        sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            sqSize = cqSize = (std::max)(sqSize, cqSize);
+        }
+
+        sqPointer = mapRegion(sqSize, IORING_OFF_SQ_RING);
+        if (sqPointer == nullptr) {
+            return false;
+        }
+        cqPointer = singleMap ? sqPointer : mapRegion(cqSize, IORING_OFF_CQ_RING);
+        if (cqPointer == nullptr) {
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mapRegion(sqesSize, IORING_OFF_SQES));
+        if (sqes == nullptr) {
+            return false;
+        }
+
+        uint8_t* sq = static_cast<uint8_t*>(sqPointer);
+        sqTail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+
+        uint8_t* cq = static_cast<uint8_t*>(cqPointer);
+        cqHead = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Every opcode the pipeline issues must be supported by the running kernel
+    bool supports(const std::vector<uint8_t>& opcodes) {
+        std::vector<uint8_t> storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (uringRegister(fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+            return false;
+        }
+        for (uint8_t opcode : opcodes) {
+            if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool registerBuffers(const std::vector<iovec>& buffers) {
+        return uringRegister(fd, IORING_REGISTER_BUFFERS, const_cast<iovec*>(buffers.data()),
+            static_cast<unsigned int>(buffers.size())) == 0;
+    }
+
+    unsigned int capacity() const { return sqEntries; }
+
+    // Caller guarantees a free slot (at most capacity() operations in flight)
+    io_uring_sqe* nextSqe() {
+        unsigned int index = sqLocalTail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        sqLocalTail++;
+        unsubmitted++;
+        return sqe;
+    }
+
+    // Publish queued entries and wait for at least one completion
+    bool submitAndWait() {
+        storeRelease(sqTail, sqLocalTail);
+        while (true) {
+            int submitted = uringEnter(fd, unsubmitted, 1, IORING_ENTER_GETEVENTS);
+            if (submitted >= 0) {
+                unsubmitted -= (std::min)(unsubmitted, static_cast<unsigned int>(submitted));
+                return true;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                return false;
+            }
+        }
+    }
+
+    template <typename Handler>
+    void reap(Handler&& handler) {
+        unsigned int head = *cqHead;
+        unsigned int tail = loadAcquire(cqTail);
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            handler(cqe.user_data, cqe.res);
+            head++;
+        }
+        storeRelease(cqHead, head);
+    }
+
+private:
+    void* mapRegion(size_t size, off_t offset) {
+        void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return region == MAP_FAILED ? nullptr : region;
+    }
+
+    int fd = -1;
+    void* sqPointer = nullptr;
+    void* cqPointer = nullptr;
+    size_t sqSize = 0;
+    size_t cqSize = 0;
+    size_t sqesSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned int* sqTail = nullptr;
+    unsigned int* sqArray = nullptr;
+    unsigned int sqMask = 0;
+    unsigned int sqEntries = 0;
+    unsigned int sqLocalTail = 0;
+    unsigned int unsubmitted = 0;
+    unsigned int* cqHead = nullptr;
+    unsigned int* cqTail = nullptr;
+    unsigned int cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+// user_data of the eventfd read that wakes the I/O thread
+constexpr uint64_t wakeTag = 0;
+
+class LinuxUringReader final : public UringFileReader {
+public:
+    explicit LinuxUringReader(WorkStealingPool& pool)
+        : pool(pool) {
+    }
+
+    ~LinuxUringReader() override {
+        finish();
+        if (wakeFd >= 0) {
+            close(wakeFd);
+        }
+        if (buffers != nullptr) {
+            ::operator delete(buffers, std::align_val_t(4096));
+        }
+    }
+
+    bool init(unsigned int queueDepth, unsigned int bufferCount) {
+        if (!ring.init(queueDepth) ||
+            !ring.supports({ IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED })) {
+            return false;
+        }
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            return false;
+        }
+
+        // One operation per in-flight file plus the wakeup read
+        unsigned int maxFiles = ring.capacity() - 1;
+        if (bufferCount == 0 || bufferCount > maxFiles) {
+            bufferCount = maxFiles;
+        }
+
+        buffers = static_cast<uint8_t*>(::operator new(size_t(bufferCount) * uringBufferSize, std::align_val_t(4096)));
+        std::vector<iovec> regions(bufferCount);
+        for (unsigned int i = 0; i < bufferCount; i++) {
+            regions[i] = { buffers + size_t(i) * uringBufferSize, uringBufferSize };
+            freeBuffers.push_back(i);
+        }
+
+        // Registration pins the pool; without it (e.g. RLIMIT_MEMLOCK) plain reads are used
+        fixedBuffers = ring.registerBuffers(regions);
+
+        ioThread = std::thread(&LinuxUringReader::run, this);
+        return true;
+    }
+
+    void submit(const std::filesystem::path& filePath, uint64_t fileSize, HashAlgorithm algorithm, FileHashCallback onDone) override {
+        auto file = std::make_unique<UringFile>();
+        file->path = filePath.string();
+        file->expectedSize = fileSize;
+        file->hasher = createHasher(algorithm);
+        file->onDone = std::move(onDone);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!broken) {
+                waiting.push_back(std::move(file));
+            }
+        }
+        if (file) {
+            file->onDone(false, HashValue{});
+            return;
+        }
+        wake();
+    }
+
+    void finish() override {
+        if (!ioThread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake();
+        ioThread.join();
+    }
+
+private:
+    enum class FileState { Opening, Reading, Hashing };
+
+    struct UringFile {
+        std::string path;
+        uint64_t expectedSize = 0;
+        std::unique_ptr<Hasher> hasher;
+        FileHashCallback onDone;
+        FileState state = FileState::Opening;
+        int fd = -1;
+        uint64_t offset = 0;
+        unsigned int buffer = 0;
+    };
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    void armWake() {
+        io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wakeFd;
+        sqe->addr = reinterpret_cast<uint64_t>(&wakeCounter);
+        sqe->len = sizeof(wakeCounter);
+        sqe->user_data = wakeTag;
+    }
+
+    void queueOpen(UringFile* file) {
+        file->state = FileState::Opening;
+        io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(file->path.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = reinterpret_cast<uint64_t>(file);
+    }
+
+    void queueRead(UringFile* file) {
+        file->state = FileState::Reading;
+        io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = file->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffers + size_t(file->buffer) * uringBufferSize);
+        sqe->len = static_cast<uint32_t>(uringBufferSize);
+        sqe->off = file->offset;
+        sqe->buf_index = static_cast<uint16_t>(fixedBuffers ? file->buffer : 0);
+        sqe->user_data = reinterpret_cast<uint64_t>(file);
+    }
+
+    // Close, release the buffer and report; runs on the I/O thread or a pool thread
+    void complete(UringFile* file, bool hashed, const HashValue& hash) {
+        if (file->fd >= 0) {
+            close(file->fd);
+        }
+        FileHashCallback onDone = std::move(file->onDone);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeBuffers.push_back(file->buffer);
+            active.erase(file);
+        }
+        wake();
+        onDone(hashed, hash);
+    }
+
+    // Hash one completed read on the pool, then request the next read or finish
+    void hashBlock(UringFile* file, size_t length) {
+        {
+            PhaseTimer hashTimer(MetricPhase::Hash);
+            file->hasher->update(buffers + size_t(file->buffer) * uringBufferSize, length);
+        }
+        if (RunMetrics* metrics = currentMetrics()) {
+            metrics->addBytesRead(length);
+        }
+        file->offset += length;
+
+        // A short read that reaches the size seen by the walk is the end of the
+        // file; otherwise keep reading until a read returns nothing
+        if (length < uringBufferSize && file->offset == file->expectedSize) {
+            complete(file, true, file->hasher->finalize());
+            return;
+        }
+
+        bool failed = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (broken) {
+                failed = true;
+            }
+            else {
+                readable.push_back(file);
+            }
+        }
+        if (failed) {
+            complete(file, false, HashValue{});
+            return;
+        }
+        wake();
+    }
+
+    void onCompletion(uint64_t userData, int result) {
+        if (userData == wakeTag) {
+            wakeArmed = false;
+            return;
+        }
+
+        UringFile* file = reinterpret_cast<UringFile*>(userData);
+        if (result < 0) {
+            complete(file, false, HashValue{});
+            return;
+        }
+
+        if (file->state == FileState::Opening) {
+            file->fd = result;
+            queueRead(file);
+            return;
+        }
+
+        if (result == 0) {
+            complete(file, true, file->hasher->finalize());
+            return;
+        }
+        file->state = FileState::Hashing;
+        pool.submit([this, file, length = static_cast<size_t>(result)] {
+            hashBlock(file, length);
+        });
+    }
+
+    void run() {
+        while (true) {
+            if (!wakeArmed) {
+                armWake();
+                wakeArmed = true;
+            }
+
+            bool done = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (UringFile* file : readable) {
+                    queueRead(file);
+                }
+                readable.clear();
+
+                while (!waiting.empty() && !freeBuffers.empty()) {
+                    UringFile* file = waiting.front().get();
+                    file->buffer = freeBuffers.back();
+                    freeBuffers.pop_back();
+                    active.emplace(file, std::move(waiting.front()));
+                    waiting.pop_front();
+                    queueOpen(file);
+                }
+                done = stopping && waiting.empty() && active.empty();
+            }
+            if (done) {
+                break;
+            }
+
+            if (!ring.submitAndWait()) {
+                failAll();
+                return;
+            }
+            ring.reap([this](uint64_t userData, int result) { onCompletion(userData, result); });
+        }
+
+        // Let the outstanding wakeup read complete before the ring goes away
+        wake();
+        while (wakeArmed && ring.submitAndWait()) {
+            ring.reap([this](uint64_t userData, int) {
+                if (userData == wakeTag) {
+                    wakeArmed = false;
+                }
+            });
+        }
+    }
+
+    // The ring itself failed: operations in flight will never complete, so
+    // fail those files now; files being hashed fail when their task ends
+    void failAll() {
+        std::vector<UringFile*> files;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            broken = true;
+            for (auto& entry : active) {
+                if (entry.first->state != FileState::Hashing) {
+                    files.push_back(entry.first);
+                }
+            }
+            for (UringFile* file : readable) {
+                files.push_back(file);
+            }
+            readable.clear();
+            for (auto& file : waiting) {
+                files.push_back(file.get());
+                active.emplace(file.get(), std::move(file));
+            }
+            waiting.clear();
+        }
+        for (UringFile* file : files) {
+            complete(file, false, HashValue{});
+        }
+    }
+
+    WorkStealingPool& pool;
+    Ring ring;
+    int wakeFd = -1;
+    uint64_t wakeCounter = 0;
+    bool wakeArmed = false;
+    uint8_t* buffers = nullptr;
+    bool fixedBuffers = false;
+    std::thread ioThread;
+
+    std::mutex mutex;
+    std::deque<std::unique_ptr<UringFile>> waiting;
+    std::map<UringFile*, std::unique_ptr<UringFile>> active;
+    std::vector<UringFile*> readable;
+    std::vector<unsigned int> freeBuffers;
+    bool stopping = false;
+    bool broken = false;
+};
+
+} // namespace
+
+std::unique_ptr<UringFileReader> UringFileReader::create(WorkStealingPool& pool, unsigned int queueDepth, unsigned int bufferCount) {
+    auto reader = std::make_unique<LinuxUringReader>(pool);
+    if (!reader->init(queueDepth == 0 ? defaultUringQueueDepth : queueDepth, bufferCount)) {
+        return nullptr;
+    }
+    return reader;
+}
+
+#else
+
+std::unique_ptr<UringFileReader> UringFileReader::create(WorkStealingPool&, unsigned int, unsigned int) {
+    return nullptr;
+}
+
+#endif
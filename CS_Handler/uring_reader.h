@@ -0,0 +1,38 @@
+#pragma once
+
+#include "file_hasher.h"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+// Files smaller than this go through the io_uring pipeline; larger files are
+// read (and split) by the threaded reader
+constexpr uint64_t uringMaxFileSize = mappedReadThreshold;
+
+// Read size of one pooled buffer
+constexpr size_t uringBufferSize = 128 * 1024;
+
+constexpr unsigned int defaultUringQueueDepth = 128;
+
+// Asynchronous open/read pipeline for many small files on one io_uring (Linux).
+//
+// A single I/O thread keeps up to bufferCount files in flight: it issues the
+// open, then one read at a time into the file's buffer from a fixed pool that
+// is registered with the kernel. Every completed read is hashed on the pool;
+// the hashing task hands the file back for its next read, so per-file reads
+// stay in order while the ring keeps many files outstanding.
+class UringFileReader {
+public:
+    // Returns nullptr when io_uring (or a needed opcode) is unavailable, so the
+    // caller can fall back to the threaded reader. queueDepth 0 uses the
+    // default; bufferCount 0 uses one buffer per queue slot.
+    static std::unique_ptr<UringFileReader> create(WorkStealingPool& pool, unsigned int queueDepth, unsigned int bufferCount);
+
+    virtual ~UringFileReader() = default;
+
+    // Queue a file; onDone runs once on a pool thread
+    virtual void submit(const std::filesystem::path& filePath, uint64_t fileSize, HashAlgorithm algorithm, FileHashCallback onDone) = 0;
+
+    // Wait for every submitted file and stop the I/O thread
+    virtual void finish() = 0;
+};
@@ -1,4 +1,4 @@
-#include ".\CS_Handler\checksum.h"
+#include "CS_Handler/checksum.h"
 #include <iostream>
 #include <string>
 #include <filesystem>
@@ -9,8 +9,12 @@
 #include <limits>
 #include <iomanip>
 #include <algorithm>
+#include <stdexcept>
+#include <csignal>
 
+#ifdef _MSC_VER
 #pragma comment(lib, "CS_Handler.lib")
+#endif
 
 // Cross Compatibility for Clearing Console
 void clearConsole() {
@@ -21,19 +25,135 @@ void clearConsole() {
 #endif
 }
 
+// Ctrl+C / SIGTERM end a watch (saving the checksum file); SIGUSR1 prints its drift
+void handleWatchSignal(int signalNumber) {
+#ifdef SIGUSR1
+    if (signalNumber == SIGUSR1) {
+        requestWatchReport();
+        return;
+    }
+#endif
+    stopWatching();
+}
+
+// Write run stats as JSON to a file, or to stdout for "-"
+bool writeStatsJson(const std::string& statsPath, const RunStats& stats) {
+    std::string json = formatRunStatsJson(stats);
+    if (statsPath == "-") {
+        std::cout << json << std::flush;
+        return true;
+    }
+
+    std::ofstream statsFile(statsPath, std::ios::trunc);
+    statsFile << json;
+    if (!statsFile) {
+        std::cerr << "\033[1;31mError: Unable to write stats file: " << statsPath << "\033[0m" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Options shared by validate and changes: [--append-aware] [--tree <dir>] [--memory <MB>] [--temp-dir <dir>] [--quiet] [--stats-json <file>]
+bool parseValidateOptions(int argc, char* argv[], ValidateOptions& options, std::string& statsPath) {
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--append-aware") {
+            options.appendAware = true;
+        }
+        else if (arg == "--tree" && i + 1 < argc) {
+            options.treeDirectory = argv[++i];
+        }
+        else if (arg == "--memory" && i + 1 < argc) {
+            try {
+                options.memoryBudget = static_cast<uint64_t>(std::stoull(argv[++i])) << 20;
+            }
+            catch (const std::exception&) {
+                std::cout << "\033[1;31mError: Invalid memory budget: " << argv[i] << "\033[0m" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--temp-dir" && i + 1 < argc) {
+            options.tempDirectory = argv[++i];
+        }
+        else if (arg == "--quiet") {
+            options.quiet = true;
+        }
+        else if (arg == "--stats-json" && i + 1 < argc) {
+            statsPath = argv[++i];
+        }
+        else {
+            std::cout << "\033[1;31mError: Unknown option: " << arg << "\033[0m" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
 // Display command-line usage information
 void displayUsage(const std::string& programName) {
     std::cout << "\033[1;34mChecksum Handler - Command Line Usage:\033[0m" << std::endl;
-    std::cout << "  " << programName << " create <folder_path> [exclude_pattern1] [exclude_pattern2] ..." << std::endl;
+    std::cout << "  " << programName << " create <folder_path> [exclude_pattern1] [exclude_pattern2] ... [--algorithm <name>] [--threads <n>] [--reader <mode>] [--queue-depth <n>] [--io-buffers <n>] [--incremental] [--paranoid <percent>] [--exclude-from <file>] [--front-coding] [--append-aware] [--duplicates <file>] [--sharded] [--update <path>] [--history <store>] [--quiet] [--stats-json <file>]" << std::endl;
     std::cout << "      Creates a checksum file in the specified folder." << std::endl;
     std::cout << "      Optional: Specify patterns to exclude files containing these patterns." << std::endl;
+    std::cout << "      Patterns with *, ? or [ are gitignore-style globs; matching directories are skipped entirely." << std::endl;
+    std::cout << "      --algorithm: crc32 (default), crc32c, crc64, xxh3-64, xxh3-128 or blake3." << std::endl;
+    std::cout << "      --threads: number of hashing threads (default: one per CPU thread)." << std::endl;
+    std::cout << "      --reader: auto (default), mmap, pread, direct (bypasses the page cache) or uring (Linux io_uring)." << std::endl;
+    std::cout << "      --queue-depth, --io-buffers: io_uring ring entries and pooled read buffers (uring reader)." << std::endl;
+    std::cout << "      --incremental: only rehash files whose size, mtime or inode changed since the last checksum file." << std::endl;
+    std::cout << "      --paranoid: with --incremental, also rehash this percentage of unchanged files and report mismatches." << std::endl;
+    std::cout << "      --exclude-from: read gitignore-style patterns (with !pattern to re-include) from a file." << std::endl;
+    std::cout << "      --front-coding: store each path as the length shared with the previous path plus the rest." << std::endl;
+    std::cout << "      --append-aware: as --incremental, and for files that only grew hash just the appended bytes to extend their CRC." << std::endl;
+    std::cout << "      --duplicates: also write a report of the files with equal digests, without reading anything again." << std::endl;
+    std::cout << "      Hard links to one file are hashed once." << std::endl;
+    std::cout << "      --sharded: write checksum.idx plus one manifest per top-level directory, built in parallel." << std::endl;
+    std::cout << "      --update: rebuild only the shard holding this path, keeping the others (repeatable; implies --sharded)." << std::endl;
+    std::cout << "      --history: also record the new checksum file as a snapshot in this history store." << std::endl;
+    std::cout << "      --quiet: print nothing; the exit code reports the result." << std::endl;
+    std::cout << "      --stats-json: write counters, per-phase times, MB/s and thread utilization as JSON (\"-\" for stdout)." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  " << programName << " watch <folder_path> [create options] [--settle <ms>] [--persist <seconds>] [--poll <seconds>]" << std::endl;
+    std::cout << "      Creates the checksum file, then keeps it current from file system events (inotify on Linux)." << std::endl;
+    std::cout << "      --settle: quiet time that ends a burst of events (default 200 ms)." << std::endl;
+    std::cout << "      --persist: how often the updated checksum file is saved (default 30 seconds)." << std::endl;
+    std::cout << "      --poll: resync interval when events are unavailable (default 10 seconds)." << std::endl;
+    std::cout << "      Ctrl+C saves and exits; on POSIX, SIGUSR1 prints the files changed since the watch started." << std::endl;
     std::cout << std::endl;
-    std::cout << "  " << programName << " validate <current_path> <new_path>" << std::endl;
-    std::cout << "      Validates checksums between two paths and reports changes." << std::endl;
+    std::cout << "  " << programName << " validate <current_path> <new_path> [--append-aware] [--tree <dir>] [--memory <MB>] [--temp-dir <dir>] [--quiet] [--stats-json <file>]" << std::endl;
+    std::cout << "      Validates checksums between two paths and reports changes. verify is an alias." << std::endl;
+    std::cout << "      --append-aware: report files that only grew as appended, reading just their new bytes." << std::endl;
+    std::cout << "      --tree: folder the new checksum file describes, when it is stored elsewhere (default: its own folder)." << std::endl;
+    std::cout << "      --memory: memory budget in MB; larger checksum files are sorted through temporary files (--temp-dir)." << std::endl;
     std::cout << std::endl;
-    std::cout << "  " << programName << " changes <current_path> <new_path>" << std::endl;
+    std::cout << "  " << programName << " check <folder_path> <checksum_path> [exclude_pattern1] ... [--fail-fast] [--threads <n>] [--reader <mode>] [--exclude-from <file>] [--quiet] [--stats-json <file>]" << std::endl;
+    std::cout << "      Checks the files in a folder against a checksum file without writing a new one." << std::endl;
+    std::cout << "      Added, deleted and resized files are found from file sizes alone; only the rest are hashed." << std::endl;
+    std::cout << "      --fail-fast: stop at the first difference." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  " << programName << " duplicates <folder_path> [exclude_pattern1] ... [--report <file>] [--algorithm <name>] [--threads <n>] [--reader <mode>] [--exclude-from <file>] [--quiet] [--stats-json <file>]" << std::endl;
+    std::cout << "      Finds files with identical contents. Only files sharing a size are read, and only" << std::endl;
+    std::cout << "      those whose first 4 KB also match are read in full; hard links count as one file." << std::endl;
+    std::cout << "      --report: write the groups to a file instead of the console." << std::endl;
+    std::cout << "      --algorithm: digest that confirms a duplicate (default xxh3-128)." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  " << programName << " changes <current_path> <new_path> [--append-aware] [--tree <dir>] [--memory <MB>] [--temp-dir <dir>] [--quiet] [--stats-json <file>]" << std::endl;
     std::cout << "      Shows detailed changes between two checksum files." << std::endl;
     std::cout << std::endl;
+    std::cout << "  " << programName << " history add <store> <checksum_path> [--label <name>] [--quiet] [--stats-json <file>]" << std::endl;
+    std::cout << "  " << programName << " history list <store>" << std::endl;
+    std::cout << "  " << programName << " history diff <store> <snapshot_a> <snapshot_b> [--summary] [--quiet] [--stats-json <file>]" << std::endl;
+    std::cout << "  " << programName << " history log <store> <file_path> [--quiet] [--stats-json <file>]" << std::endl;
+    std::cout << "      Keeps checksum files as snapshots in a store that saves only the chunks of entries that changed." << std::endl;
+    std::cout << "      Snapshots are named by id (1, 2, ...) or by label. diff reads only the chunks the two snapshots do not share;" << std::endl;
+    std::cout << "      log lists the snapshots in which a file (path relative to the tree) was added, changed or deleted." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  " << programName << " convert <input_file> <output_file>" << std::endl;
+    std::cout << "      Converts a checksum file between the text (checksum.txt) and binary (checksum.bin) formats." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  " << programName << " info" << std::endl;
+    std::cout << "      Shows the checksum kernels selected for this CPU." << std::endl;
+    std::cout << std::endl;
     std::cout << "  " << programName << " help" << std::endl;
     std::cout << "      Displays this help information." << std::endl;
     std::cout << std::endl;
@@ -56,28 +176,165 @@ int main(int argc, char* argv[])
             return 0;
         }
 
-        // Create command
-        else if (command == "create" && argc >= 3) {
+        // Create command; watch takes the same options
+        else if ((command == "create" || command == "watch") && argc >= 3) {
             std::string path = argv[2];
 
-            // Handle exclude patterns from args 3+ if present
+            // Handle options and exclude patterns from args 3+ if present
             std::vector<std::string> excludePatterns;
+            ChecksumOptions options;
+            WatchOptions watchOptions;
+            std::string statsPath;
             for (int i = 3; i < argc; i++) {
-                excludePatterns.push_back(argv[i]);
+                std::string arg = argv[i];
+                if (command == "watch" && (arg == "--settle" || arg == "--persist" || arg == "--poll") && i + 1 < argc) {
+                    try {
+                        unsigned int value = static_cast<unsigned int>(std::stoul(argv[++i]));
+                        (arg == "--settle" ? watchOptions.settleMs : arg == "--persist" ? watchOptions.persistSeconds : watchOptions.pollSeconds) = value;
+                    }
+                    catch (const std::exception&) {
+                        std::cout << "\033[1;31mError: Invalid value for " << arg << ": " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--algorithm" && i + 1 < argc) {
+                    if (!parseHashAlgorithm(argv[++i], options.algorithm)) {
+                        std::cout << "\033[1;31mError: Unknown hash algorithm: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--threads" && i + 1 < argc) {
+                    try {
+                        options.threadCount = static_cast<unsigned int>(std::stoul(argv[++i]));
+                    }
+                    catch (const std::exception&) {
+                        std::cout << "\033[1;31mError: Invalid thread count: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--reader" && i + 1 < argc) {
+                    if (!parseReadStrategy(argv[++i], options.readStrategy)) {
+                        std::cout << "\033[1;31mError: Unknown read strategy: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if ((arg == "--queue-depth" || arg == "--io-buffers") && i + 1 < argc) {
+                    try {
+                        unsigned int value = static_cast<unsigned int>(std::stoul(argv[++i]));
+                        (arg == "--queue-depth" ? options.ioQueueDepth : options.ioBufferCount) = value;
+                    }
+                    catch (const std::exception&) {
+                        std::cout << "\033[1;31mError: Invalid value for " << arg << ": " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--exclude-from" && i + 1 < argc) {
+                    options.excludeFile = argv[++i];
+                }
+                else if (arg == "--front-coding") {
+                    options.frontCoding = true;
+                }
+                else if (arg == "--append-aware") {
+                    options.appendAware = true;
+                }
+                else if (arg == "--incremental") {
+                    options.incremental = true;
+                }
+                else if (arg == "--quiet") {
+                    options.quiet = true;
+                }
+                else if (arg == "--stats-json" && i + 1 < argc) {
+                    statsPath = argv[++i];
+                }
+                else if (arg == "--duplicates" && i + 1 < argc) {
+                    options.duplicateReport = argv[++i];
+                }
+                else if (arg == "--sharded") {
+                    options.sharded = true;
+                }
+                else if (arg == "--update" && i + 1 < argc) {
+                    options.shardUpdates.push_back(argv[++i]);
+                }
+                else if (arg == "--history" && i + 1 < argc) {
+                    options.historyStore = argv[++i];
+                }
+                else if (arg == "--paranoid" && i + 1 < argc) {
+                    try {
+                        double percent = std::stod(argv[++i]);
+                        if (percent < 0.0 || percent > 100.0) {
+                            throw std::out_of_range("percent");
+                        }
+                        options.paranoidSample = percent / 100.0;
+                    }
+                    catch (const std::exception&) {
+                        std::cout << "\033[1;31mError: Invalid sample percentage: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else {
+                    excludePatterns.push_back(arg);
+                }
             }
 
             // Show command info
-            std::cout << "\033[1;34mCommand: Create checksum file\033[0m" << std::endl;
-            std::cout << "Path: " << path << std::endl;
-            if (!excludePatterns.empty()) {
-                std::cout << "Exclude patterns: ";
-                for (const auto& pattern : excludePatterns) {
-                    std::cout << pattern << " ";
+            if (!options.quiet) {
+                std::cout << "\033[1;34mCommand: " << (command == "watch" ? "Watch folder" : "Create checksum file") << "\033[0m" << std::endl;
+                std::cout << "Path: " << path << std::endl;
+                std::cout << "Algorithm: " << hashAlgorithmName(options.algorithm) << std::endl;
+                if (options.threadCount > 0) {
+                    std::cout << "Threads: " << options.threadCount << std::endl;
+                }
+                std::cout << "Reader: " << readStrategyName(options.readStrategy) << std::endl;
+                if (options.incremental) {
+                    std::cout << "Incremental: yes";
+                    if (options.paranoidSample > 0.0) {
+                        std::cout << " (rehashing " << options.paranoidSample * 100.0 << "% of unchanged files)";
+                    }
+                    std::cout << std::endl;
+                }
+                if (options.appendAware) {
+                    std::cout << "Append-aware: yes" << std::endl;
+                }
+                if (options.sharded || !options.shardUpdates.empty()) {
+                    std::cout << "Sharded: yes";
+                    if (!options.shardUpdates.empty()) {
+                        std::cout << " (updating " << options.shardUpdates.size() << " paths)";
+                    }
+                    std::cout << std::endl;
+                }
+                if (!options.excludeFile.empty()) {
+                    std::cout << "Exclude file: " << options.excludeFile << std::endl;
                 }
-                std::cout << std::endl;
+                if (!excludePatterns.empty()) {
+                    std::cout << "Exclude patterns: ";
+                    for (const auto& pattern : excludePatterns) {
+                        std::cout << pattern << " ";
+                    }
+                    std::cout << std::endl;
+                }
+
+            }
+
+            RunStats stats;
+            if (!statsPath.empty()) {
+                options.stats = &stats;
             }
 
-            int result = createChecksumFile(path, excludePatterns);
+            int result = 0;
+            if (command == "watch") {
+                std::signal(SIGINT, handleWatchSignal);
+                std::signal(SIGTERM, handleWatchSignal);
+#ifdef SIGUSR1
+                std::signal(SIGUSR1, handleWatchSignal);
+#endif
+                result = watchChecksumFile(path, excludePatterns, options, watchOptions);
+            }
+            else {
+                result = createChecksumFile(path, excludePatterns, options);
+            }
+            if (!statsPath.empty() && !writeStatsJson(statsPath, stats)) {
+                return 1;
+            }
             return (result == 200) ? 0 : 1;  // Return 0 for success, 1 for error
         }
 
@@ -85,34 +342,265 @@ int main(int argc, char* argv[])
         else if ((command == "validate" || command == "verify") && argc >= 4) {
             std::string currPath = argv[2];
             std::string newPath = argv[3];
+            ValidateOptions options;
+            std::string statsPath;
+            if (!parseValidateOptions(argc, argv, options, statsPath)) {
+                return 1;
+            }
+            RunStats stats;
+            if (!statsPath.empty()) {
+                options.stats = &stats;
+            }
 
             // Show command info
-            std::cout << "\033[1;34mCommand: Validate checksums\033[0m" << std::endl;
-            std::cout << "Current Path: " << currPath << std::endl;
-            std::cout << "New Path: " << newPath << std::endl;
+            if (!options.quiet) {
+                std::cout << "\033[1;34mCommand: Validate checksums\033[0m" << std::endl;
+                std::cout << "Current Path: " << currPath << std::endl;
+                std::cout << "New Path: " << newPath << std::endl;
+            }
 
             // Use simple validation that returns true if no changes
-            bool result = validateChecksumFile(currPath, newPath);
+            bool result = validateChecksumFile(currPath, newPath, options);
+            if (!statsPath.empty() && !writeStatsJson(statsPath, stats)) {
+                return 1;
+            }
             return result ? 0 : 1;  // Return 0 if no changes (validation passed), 1 if changes or error
         }
 
+        // Check command - verify a folder against a checksum file directly
+        else if (command == "check" && argc >= 4) {
+            std::string path = argv[2];
+            std::string checksumPath = argv[3];
+            std::vector<std::string> excludePatterns;
+            VerifyOptions options;
+            std::string statsPath;
+            for (int i = 4; i < argc; i++) {
+                std::string arg = argv[i];
+                if (arg == "--fail-fast") {
+                    options.failFast = true;
+                }
+                else if (arg == "--threads" && i + 1 < argc) {
+                    try {
+                        options.threadCount = static_cast<unsigned int>(std::stoul(argv[++i]));
+                    }
+                    catch (const std::exception&) {
+                        std::cout << "\033[1;31mError: Invalid thread count: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--reader" && i + 1 < argc) {
+                    if (!parseReadStrategy(argv[++i], options.readStrategy)) {
+                        std::cout << "\033[1;31mError: Unknown read strategy: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--exclude-from" && i + 1 < argc) {
+                    options.excludeFile = argv[++i];
+                }
+                else if (arg == "--quiet") {
+                    options.quiet = true;
+                }
+                else if (arg == "--stats-json" && i + 1 < argc) {
+                    statsPath = argv[++i];
+                }
+                else {
+                    excludePatterns.push_back(arg);
+                }
+            }
+            RunStats stats;
+            if (!statsPath.empty()) {
+                options.stats = &stats;
+            }
+
+            // Show command info
+            if (!options.quiet) {
+                std::cout << "\033[1;34mCommand: Check folder\033[0m" << std::endl;
+                std::cout << "Path: " << path << std::endl;
+                std::cout << "Checksum Path: " << checksumPath << std::endl;
+                if (options.failFast) {
+                    std::cout << "Fail-fast: yes" << std::endl;
+                }
+            }
+
+            std::vector<FileChangeInfo> changes;
+            int result = verifyChecksumFile(path, checksumPath, excludePatterns, options, changes);
+            if (!statsPath.empty() && !writeStatsJson(statsPath, stats)) {
+                return 1;
+            }
+            return result == 0 ? 0 : 1;  // Return 0 if the folder matches, 1 if it differs or on error
+        }
+
+        // Duplicates command - groups of files with identical contents
+        else if (command == "duplicates" && argc >= 3) {
+            std::string path = argv[2];
+            std::vector<std::string> excludePatterns;
+            DuplicateOptions options;
+            std::string statsPath;
+            for (int i = 3; i < argc; i++) {
+                std::string arg = argv[i];
+                if (arg == "--report" && i + 1 < argc) {
+                    options.reportPath = argv[++i];
+                }
+                else if (arg == "--algorithm" && i + 1 < argc) {
+                    if (!parseHashAlgorithm(argv[++i], options.algorithm)) {
+                        std::cout << "\033[1;31mError: Unknown hash algorithm: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--threads" && i + 1 < argc) {
+                    try {
+                        options.threadCount = static_cast<unsigned int>(std::stoul(argv[++i]));
+                    }
+                    catch (const std::exception&) {
+                        std::cout << "\033[1;31mError: Invalid thread count: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--reader" && i + 1 < argc) {
+                    if (!parseReadStrategy(argv[++i], options.readStrategy)) {
+                        std::cout << "\033[1;31mError: Unknown read strategy: " << argv[i] << "\033[0m" << std::endl;
+                        return 1;
+                    }
+                }
+                else if (arg == "--exclude-from" && i + 1 < argc) {
+                    options.excludeFile = argv[++i];
+                }
+                else if (arg == "--quiet") {
+                    options.quiet = true;
+                }
+                else if (arg == "--stats-json" && i + 1 < argc) {
+                    statsPath = argv[++i];
+                }
+                else {
+                    excludePatterns.push_back(arg);
+                }
+            }
+            RunStats stats;
+            if (!statsPath.empty()) {
+                options.stats = &stats;
+            }
+
+            // Show command info
+            if (!options.quiet) {
+                std::cout << "\033[1;34mCommand: Find duplicate files\033[0m" << std::endl;
+                std::cout << "Path: " << path << std::endl;
+                std::cout << "Algorithm: " << hashAlgorithmName(options.algorithm) << std::endl;
+            }
+
+            int result = findDuplicateFiles(path, excludePatterns, options);
+            if (!statsPath.empty() && !writeStatsJson(statsPath, stats)) {
+                return 1;
+            }
+            return result < 0 ? 1 : 0;  // Return 0 whether or not duplicates were found, 1 on error
+        }
+
+        // History command - snapshots of checksum files in a deduplicated store
+        else if (command == "history" && argc >= 4) {
+            std::string action = argv[2];
+            std::string storePath = argv[3];
+            std::vector<std::string> arguments;
+            HistoryOptions options;
+            std::string statsPath;
+            for (int i = 4; i < argc; i++) {
+                std::string arg = argv[i];
+                if (arg == "--label" && i + 1 < argc) {
+                    options.label = argv[++i];
+                }
+                else if (arg == "--summary") {
+                    options.listChanges = false;
+                }
+                else if (arg == "--quiet") {
+                    options.quiet = true;
+                }
+                else if (arg == "--stats-json" && i + 1 < argc) {
+                    statsPath = argv[++i];
+                }
+                else {
+                    arguments.push_back(arg);
+                }
+            }
+            RunStats stats;
+            if (!statsPath.empty()) {
+                options.stats = &stats;
+            }
+
+            int result = -1;
+            if (action == "add" && arguments.size() == 1) {
+                result = addSnapshot(storePath, arguments[0], options);
+            }
+            else if (action == "list" && arguments.empty()) {
+                result = listSnapshots(storePath, options);
+            }
+            else if (action == "diff" && arguments.size() == 2) {
+                std::vector<FileChangeInfo> changes;
+                result = diffSnapshots(storePath, arguments[0], arguments[1], options, changes);
+            }
+            else if (action == "log" && arguments.size() == 1) {
+                result = showFileHistory(storePath, arguments[0], options) < 0 ? -1 : 0;
+            }
+            else {
+                std::cout << "\033[1;31mError: Invalid history command\033[0m" << std::endl;
+                displayUsage(argv[0]);
+                return 1;
+            }
+            if (!statsPath.empty() && !writeStatsJson(statsPath, stats)) {
+                return 1;
+            }
+            return result == 0 ? 0 : 1;
+        }
+
         // Changes command - new feature using getChecksumFileChanges
         else if (command == "changes" && argc >= 4) {
             std::string currPath = argv[2];
             std::string newPath = argv[3];
+            ValidateOptions options;
+            std::string statsPath;
+            if (!parseValidateOptions(argc, argv, options, statsPath)) {
+                return 1;
+            }
+            RunStats stats;
+            if (!statsPath.empty()) {
+                options.stats = &stats;
+            }
 
             // Show command info
-            std::cout << "\033[1;34mCommand: Show detailed changes\033[0m" << std::endl;
-            std::cout << "Current Path: " << currPath << std::endl;
-            std::cout << "New Path: " << newPath << std::endl;
+            if (!options.quiet) {
+                std::cout << "\033[1;34mCommand: Show detailed changes\033[0m" << std::endl;
+                std::cout << "Current Path: " << currPath << std::endl;
+                std::cout << "New Path: " << newPath << std::endl;
+            }
 
-            // Use getChecksumFileChanges with true to print results
-            std::vector<FileChangeInfo> changes = getChecksumFileChanges(currPath, newPath, true);
+            // Print results while collecting them
+            std::vector<FileChangeInfo> changes = getChecksumFileChanges(currPath, newPath, options);
+            if (!statsPath.empty() && !writeStatsJson(statsPath, stats)) {
+                return 1;
+            }
 
             // Return change count for scripting
             return changes.empty() ? 0 : static_cast<int>(std::min(changes.size(), static_cast<size_t>(255)));
         }
 
+        // Convert command - text manifest to binary or back
+        else if (command == "convert" && argc >= 4) {
+            std::string inputPath = argv[2];
+            std::string outputPath = argv[3];
+
+            // Show command info
+            std::cout << "\033[1;34mCommand: Convert checksum file\033[0m" << std::endl;
+            std::cout << "Input: " << inputPath << std::endl;
+            std::cout << "Output: " << outputPath << std::endl;
+
+            return convertChecksumFile(inputPath, outputPath) ? 0 : 1;
+        }
+
+        // Info command - report which CRC kernels this machine uses
+        else if (command == "info") {
+            std::cout << "\033[1;34mCommand: Kernel info\033[0m" << std::endl;
+            std::cout << "CRC-32 kernel: " << getCrc32KernelName() << std::endl;
+            std::cout << "CRC-32C kernel: " << getCrc32cKernelName() << std::endl;
+            return 0;
+        }
+
         // Invalid command or insufficient arguments
         else {
             std::cout << "\033[1;31mError: Invalid command or insufficient arguments.\033[0m" << std::endl;
@@ -184,7 +672,18 @@ int main(int argc, char* argv[])
                 }
             }
 
-            createChecksumFile(str, excludePatterns);
+            // Optional: Ask for the hash algorithm
+            std::cout << "Enter hash algorithm (crc32, crc32c, crc64, xxh3-64, xxh3-128, blake3) or press Enter for crc32: ";
+            std::string algorithmInput;
+            std::getline(std::cin, algorithmInput);
+
+            ChecksumOptions options;
+            if (!algorithmInput.empty() && !parseHashAlgorithm(algorithmInput, options.algorithm)) {
+                std::cout << "\033[1;31mUnknown hash algorithm: " << algorithmInput << "\033[0m" << std::endl;
+                break;
+            }
+
+            createChecksumFile(str, excludePatterns, options);
             break;
         }
 